@@ -8,20 +8,35 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "core/dependencygraph.h"
 #include "core/interpreter.h"
 #include "core/lineparser.h"
+#include "core/outputsink.h"
+#include "core/profiler.h"
+#include "core/server.h"
+#include "core/threadpool.h"
 
 namespace
 {
 
-bool executeFile(const std::string &filename, Interpreter &interpreter);
+bool executeFile(const std::string &filename, Interpreter &interpreter, std::ostream &out = std::cout,
+                 std::ostream &err = std::cerr);
+bool isSnapshotFile(const std::string &filename);
 
 /**
  * @brief Global settings for REPL behavior
@@ -30,10 +45,60 @@ struct REPLSettings {
     bool showIndentation = true;
     bool showLineNumbers = false;
     bool colorOutput = false;
+    bool dumpTree = false;
 };
 
 REPLSettings g_replSettings;
 
+// Token Ctrl+C cancels while something runs; without one it ends the program
+std::atomic<CancelToken *> g_interruptTarget{nullptr};
+
+extern "C" void handleInterrupt(int signal)
+{
+    CancelToken *target = g_interruptTarget.load();
+    if (target) {
+        target->cancel();
+    } else {
+        std::signal(signal, SIG_DFL);
+        std::raise(signal);
+    }
+}
+
+// Server that Ctrl+C and SIGTERM stop while --serve runs
+std::atomic<Server *> g_server{nullptr};
+
+extern "C" void handleServerStop(int)
+{
+    Server *server = g_server.load();
+    if (server) {
+        server->stop();
+    }
+}
+
+/**
+ * @brief Makes Ctrl+C stop the interpreter's executions while in scope
+ */
+class InterruptScope
+{
+public:
+    explicit InterruptScope(Interpreter &interpreter) : m_token(interpreter.getCancelToken())
+    {
+        g_interruptTarget.store(&m_token);
+    }
+    ~InterruptScope()
+    {
+        g_interruptTarget.store(nullptr);
+        // A Ctrl+C that came after the execution finished must not stop the next one
+        m_token.reset();
+    }
+
+    InterruptScope(const InterruptScope &) = delete;
+    InterruptScope &operator=(const InterruptScope &) = delete;
+
+private:
+    CancelToken &m_token;
+};
+
 /**
  * @brief Print the welcome message and basic usage instructions
  */
@@ -60,7 +125,7 @@ void printWelcome()
      */
     // In cmd_main.cpp, update the printHelp function:
     // In cmd_main.cpp, update printHelp():
-void printHelp()
+void printHelp(const Interpreter &interpreter)
 {
     std::cout << "\nGlossAI Commands:\n";
     std::cout << "  help          - Show this help message\n";
@@ -68,10 +133,18 @@ void printHelp()
     std::cout << "  clear         - Clear all variables and functions\n";
     std::cout << "  vars          - Show all defined variables\n";
     std::cout << "  funcs         - Show all available built-in functions\n";
+    std::cout << "  memo          - Show result cache statistics of pure functions\n";
+    std::cout << "  profile on|off - Start or stop profiling (currently " << (interpreter.isProfiling() ? "ON" : "OFF") << ")\n";
+    std::cout << "  profile       - Show the hottest lines and nodes profiled so far\n";
+    std::cout << "  profile reset - Forget the profile\n";
+    std::cout << "  profile save <file> - Write the profile as folded stacks for flame graphs\n";
+    std::cout << "  reactive on|off - Recompute formulas when the variables they read change (currently " << (interpreter.isReactive() ? "ON" : "OFF") << ")\n";
+    std::cout << "  reactive      - Show how many formulas are tracked and stale\n";
     std::cout << "  version       - Show version information\n";
-    std::cout << "  load <file>   - Load and execute a .glo file\n";
+    std::cout << "  load <file>   - Load and execute a .glo file, or load a .gloc snapshot\n";
     std::cout << "  indent        - Toggle auto-indentation (currently " << (g_replSettings.showIndentation ? "ON" : "OFF") << ")\n";
     std::cout << "  lines         - Toggle line numbers (currently " << (g_replSettings.showLineNumbers ? "ON" : "OFF") << ")\n";
+    std::cout << "  ast           - Toggle printing of the optimized syntax tree (currently " << (g_replSettings.dumpTree ? "ON" : "OFF") << ")\n";
     std::cout << "\nPrompts:\n";
     std::cout << "  >             - Ready for new statement\n";
     std::cout << "  ...           - Continuation line (multi-line statement)\n";
@@ -84,11 +157,15 @@ void printHelp()
     std::cout << "  log, ln       - Logarithmic functions\n";
     std::cout << "  sqrt, cbrt    - Square and cube roots\n";
     std::cout << "  root(n,x)     - nth root of x\n";
+    std::cout << "  [1, 2, 3]     - Array (a[i] indexes from 0, operators apply element-wise)\n";
     std::cout << "  pi, e         - Mathematical constants\n";
     std::cout << "  x = value     - Variable assignment\n";
     std::cout << "  print expr    - Print expressions\n";
     std::cout << "  if (cond) expr else expr - Conditional expression\n";
     std::cout << "  while (cond) statement   - While loop\n";
+    std::cout << "  for (init; cond; step) statement - For loop\n";
+    std::cout << "  parallel (s) for (i = a; i < b; i++) { s += ... } - For loop on all cores, summing into s\n";
+    std::cout << "  function f(a, b) { ... return a } - Function definition\n";
     std::cout << "\nMulti-line Example:\n";
     std::cout << "  > while (i < 3) {\n";
     std::cout << "  ...     print \"i =\", i\n";
@@ -140,6 +217,23 @@ void printHelp()
         return result;
     }
 
+    /**
+     * @brief Write a profile as folded stacks
+     * @param profiler The collected profile
+     * @param filename Destination file
+     * @return True if the file was written
+     */
+    bool writeFoldedStacks(const Profiler &profiler, const std::string &filename)
+    {
+        std::ofstream file(filename);
+        profiler.writeFoldedStacks(file);
+        if (!file) {
+            std::cerr << "Error: Could not write file '" << filename << "'" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
     /**
      * @brief Check if the input is a special command
      * @param input The user input
@@ -153,7 +247,7 @@ void printHelp()
 
         if (cmd == "help")
         {
-            printHelp();
+            printHelp(interpreter);
             return true;
         }
 
@@ -174,9 +268,15 @@ void printHelp()
         if (cmd.substr(0, 4) == "load") {
             if (cmd.length() > 5) {
                 std::string filename = trim(cmd.substr(5));
-                executeFile(filename, interpreter);
+                if (!isSnapshotFile(filename)) {
+                    executeFile(filename, interpreter);
+                } else if (interpreter.loadSnapshot(filename)) {
+                    std::cout << "Loaded snapshot: " << filename << "\n";
+                } else {
+                    std::cout << "Error: " << interpreter.getLastError() << "\n";
+                }
             } else {
-                std::cout << "Usage: load <filename.glo>\n";
+                std::cout << "Usage: load <filename.glo|filename.gloc>\n";
             }
             return true;
         }
@@ -199,6 +299,71 @@ void printHelp()
             return true;
         }
 
+        if (cmd == "memo")
+        {
+            auto statistics = interpreter.getMemoStatistics();
+            if (statistics.empty())
+            {
+                std::cout << "No memoized functions.\n";
+            }
+            for (const auto &memo : statistics)
+            {
+                size_t calls = memo.hits + memo.misses;
+                std::cout << "  " << memo.function << ": " << memo.hits << " hits, " << memo.misses << " misses ("
+                          << std::fixed << std::setprecision(1) << (calls ? 100.0 * memo.hits / calls : 0.0)
+                          << std::defaultfloat << "% hit rate), " << memo.size << "/" << memo.capacity
+                          << " results, " << memo.evictions << " evictions\n";
+            }
+            return true;
+        }
+
+        if (cmd == "profile" || cmd.substr(0, 8) == "profile ")
+        {
+            std::string argument = cmd.size() > 8 ? trim(cmd.substr(8)) : std::string();
+            if (argument == "on" || argument == "off") {
+                interpreter.setProfiling(argument == "on");
+                std::cout << "Profiling " << (argument == "on" ? "enabled" : "disabled") << std::endl;
+            } else if (argument == "reset") {
+                interpreter.resetProfile();
+                std::cout << "Profile cleared.\n";
+            } else if (argument.substr(0, 5) == "save ") {
+                // The file name keeps its case
+                std::string original = trim(input);
+                std::string filename = trim(original.substr(original.size() - argument.size() + 5));
+                if (!interpreter.getProfiler()) {
+                    std::cout << "Nothing profiled yet; type 'profile on' first.\n";
+                } else if (writeFoldedStacks(*interpreter.getProfiler(), filename)) {
+                    std::cout << "Folded stacks written to " << filename << "\n";
+                }
+            } else if (argument.empty()) {
+                if (interpreter.getProfiler()) {
+                    interpreter.getProfiler()->writeReport(std::cout);
+                } else {
+                    std::cout << "Nothing profiled yet; type 'profile on' first.\n";
+                }
+            } else {
+                std::cout << "Usage: profile [on|off|reset|save <file>]\n";
+            }
+            return true;
+        }
+
+        if (cmd == "reactive" || cmd.substr(0, 9) == "reactive ")
+        {
+            std::string argument = cmd.size() > 9 ? trim(cmd.substr(9)) : std::string();
+            if (argument == "on" || argument == "off") {
+                interpreter.setReactive(argument == "on");
+                std::cout << "Reactive mode " << (argument == "on" ? "enabled" : "disabled") << std::endl;
+            } else if (argument.empty()) {
+                const DependencyGraph &graph = interpreter.getDependencies();
+                std::cout << "Reactive mode " << (interpreter.isReactive() ? "ON" : "OFF") << ": " << graph.size()
+                          << " formulas, " << graph.staleCount() << " stale, " << graph.recomputations()
+                          << " recomputed\n";
+            } else {
+                std::cout << "Usage: reactive [on|off]\n";
+            }
+            return true;
+        }
+
         if (cmd == "funcs")
         {
             auto functions = interpreter.getBuiltinFunctions();
@@ -226,6 +391,13 @@ void printHelp()
             std::cout << "  min(x,y)  - Minimum of x and y\n";
             std::cout << "  max(x,y)  - Maximum of x and y\n";
 
+            std::cout << "\nArrays:\n";
+            std::cout << "  [x, y, ...]  - Array literal; a[i] is element i (from 0)\n";
+            std::cout << "  len(a)       - Number of elements\n";
+            std::cout << "  range(n), range(a,b[,step]) - Numbers from a (0) up to b (n)\n";
+            std::cout << "  sum(a), mean(a), min(a), max(a) - Reductions\n";
+            std::cout << "  dot(a,b), norm(a) - Dot product and Euclidean length\n";
+
             std::cout << "\nConstants:\n";
             std::cout << "  pi, e, tau, phi, sqrt2, sqrt3, ln2, ln10\n\n";
 
@@ -251,10 +423,33 @@ void printHelp()
             std::cout << "Line numbers " << (g_replSettings.showLineNumbers ? "enabled" : "disabled") << std::endl;
             return true;
         }
+        
+        // Handle syntax tree dump toggle
+        if (cmd == "ast") {
+            g_replSettings.dumpTree = !g_replSettings.dumpTree;
+            std::cout << "Syntax tree dump " << (g_replSettings.dumpTree ? "enabled" : "disabled") << std::endl;
+            return true;
+        }
 
         return false;
     }
 
+    /**
+     * @brief Print the optimized syntax tree of some code when dumping is enabled
+     * @param code The code about to be executed
+     * @param interpreter The interpreter instance
+     * @param out Stream the tree is written to
+     */
+    void dumpTree(const std::string &code, Interpreter &interpreter, std::ostream &out = std::cout)
+    {
+        if (g_replSettings.dumpTree) {
+            std::string tree = interpreter.dumpTree(code);
+            if (!tree.empty()) {
+                out << "  AST: " << tree << "\n";
+            }
+        }
+    }
+
     /**
      * @brief Process a single line of input
      * @param input The user input
@@ -271,6 +466,9 @@ void printHelp()
             return true;
         }
 
+        // Ctrl+C stops the statement or the loaded file, not the REPL
+        InterruptScope interrupt(interpreter);
+
         // Handle special commands
         if (handleCommand(trimmedInput, interpreter))
         {
@@ -281,6 +479,7 @@ void printHelp()
         // Execute the mathematical expression
         try
         {
+            dumpTree(trimmedInput, interpreter);
             std::string result = interpreter.execute(trimmedInput);
             if (!result.empty())
             {
@@ -358,7 +557,9 @@ void printHelp()
      */
     void executeExpression(const std::string &expression, Interpreter &interpreter)
     {
+        InterruptScope interrupt(interpreter);
         try {
+            dumpTree(expression, interpreter);
             std::string result = interpreter.execute(expression);
 
             // Don't show result for print statements OR block statements
@@ -388,16 +589,42 @@ void printHelp()
         std::cout << "  -h, --help     Show this help message\n";
         std::cout << "  -v, --version  Show version information\n";
         std::cout << "  -i, --interactive  Start interactive mode (default if no expression)\n";
+        std::cout << "  -O0, -O1, -O2  Optimization level (default -O0)\n";
+        std::cout << "                 -O1 folds constants and removes dead branches\n";
+        std::cout << "                 -O2 also reduces strength and hoists loop invariants\n";
+        std::cout << "  --fast-math    Use polynomial sin, cos, tan and log10, and exp, log and pow in batches (about 1e-11 relative error)\n";
+        std::cout << "  --dump-ast     Print the optimized syntax tree before executing\n";
+        std::cout << "  --stream FILE  Run FILE (- for stdin) statement by statement while reading it\n";
+        std::cout << "  -j, --jobs N   Run several .glo files on N threads (0 = one per core)\n";
+        std::cout << "  --compile FILE Run FILE and save its variables and functions as a snapshot\n";
+        std::cout << "  -o FILE        Snapshot written by --compile (default: FILE with .gloc)\n";
+        std::cout << "  --load FILE    Load a .gloc snapshot before running anything (repeatable)\n";
+        std::cout << "  --profile      Print the hottest lines and nodes to standard error after running\n";
+        std::cout << "  --profile-folded FILE  Profile and write folded stacks for flame graphs to FILE\n";
+        std::cout << "  --max-steps N  Stop each execution after N loop iterations and calls\n";
+        std::cout << "  --max-time MS  Stop each execution (a REPL statement, or a whole script) after MS milliseconds\n";
+        std::cout << "  --max-depth N  Limit nested function calls to N\n";
+        std::cout << "  --max-memory BYTES  Stop each execution whose variables, or any one string or array, grow beyond BYTES\n";
+        std::cout << "  --serve ADDRESS  Answer requests on a port, HOST:PORT or Unix socket path\n";
+        std::cout << "                 (-j sets the worker threads; Linux only)\n";
         std::cout << "\nExamples:\n";
         std::cout << "  " << programName << "                    # Start interactive mode\n";
         std::cout << "  " << programName << " \"2 + 3 * 4\"        # Evaluate expression\n";
         std::cout << "  " << programName
                   << " \"sin(pi/2)\"        # Evaluate trigonometric expression\n";
         std::cout << "  " << programName << " script.glo         # Execute GlossAI file\n";
+        std::cout << "  " << programName << " -j 8 *.glo         # Execute many files in parallel\n";
+        std::cout << "  " << programName << " -O2 --dump-ast \"2*pi*r\"  # Show the optimized tree\n";
+        std::cout << "  " << programName << " --compile lib.glo -o lib.gloc  # Precompile a library\n";
+        std::cout << "  " << programName << " --load lib.gloc script.glo    # Start from the library\n";
+        std::cout << "  " << programName << " --profile-folded out.folded script.glo  # Profile a script\n";
+        std::cout << "  " << programName << " --max-time 500 script.glo  # Give the whole script 500 ms\n";
+        std::cout << "  " << programName << " --serve 7878 -j 4  # Serve requests on localhost:7878\n";
         std::cout << "\nFile Format:\n";
-        std::cout << "  GlossAI files (.glo) contain one expression per line\n";
+        std::cout << "  GlossAI files (.glo) contain one statement per line; blocks may span lines\n";
         std::cout << "  Lines starting with # are comments and are ignored\n";
         std::cout << "  Empty lines are ignored\n";
+        std::cout << "  Snapshots (.gloc) hold the variables and functions a file defined\n";
         std::cout << "\nIn interactive mode, type 'help' for more commands.\n";
     }
 
@@ -405,75 +632,286 @@ void printHelp()
      * @brief Execute a GlossAI file
      * @param filename The path to the .glo file
      * @param interpreter The interpreter instance
+     * @param out Stream for the listing and results
+     * @param err Stream for error messages
      * @return True if successful, false on error
      */
-    bool executeFile(const std::string &filename, Interpreter &interpreter)
+    bool executeFile(const std::string &filename, Interpreter &interpreter, std::ostream &out, std::ostream &err)
     {
         // Check if file exists
         if (!std::filesystem::exists(filename)) {
-            std::cerr << "Error: File '" << filename << "' not found" << std::endl;
+            err << "Error: File '" << filename << "' not found" << std::endl;
             return false;
         }
 
-        // Open file
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open file '" << filename << "'" << std::endl;
-            return false;
-        }
+        out << "Executing file: " << filename << std::endl;
+        out << "===========================================" << std::endl;
 
-        std::cout << "Executing file: " << filename << std::endl;
-        std::cout << "===========================================" << std::endl;
+        // Printed lines are held back so that they follow the echo of their statement
+        std::string printed;
+        interpreter.setOutput(std::make_unique<CallbackSink>([&printed](const std::string &text) { printed += text; }));
 
-        std::string line;
-        int lineNumber = 1;
+        // The file is mapped and parsed once; statements may span lines
         bool hasError = false;
+        bool success = interpreter.executeProgram(filename, [&](const Interpreter::StatementResult &result) {
+            out << "Line " << result.line << ": " << result.source << "\n";
+            dumpTree(std::string(result.source), interpreter, out);
+            out << printed;
+            printed.clear();
 
-        // Read and execute line by line
-        while (std::getline(file, line)) {
-            std::string trimmedLine = trim(line);
+            // Show result if not empty
+            if (!result.value.empty() && result.value != "null") {
+                out << "  = " << result.value << "\n";
+            }
+            if (!result.error.empty()) {
+                out.flush(); // Keep errors in place when both streams share a terminal or file
+                err << "Error on line " << result.line << ": " << result.error << std::endl;
+                hasError = true;
+            }
+        });
+        interpreter.setOutput(out);
 
-            // Skip empty lines and comments
-            if (trimmedLine.empty() || trimmedLine[0] == '#') {
-                lineNumber++;
-                continue;
+        if (!success && !hasError) {
+            // Nothing ran: the file could not be mapped or lexed
+            err << "Error: " << interpreter.getLastError() << std::endl;
+            hasError = true;
+        }
+
+        out << "===========================================" << std::endl;
+        if (hasError) {
+            out << "File execution completed with errors" << std::endl;
+        } else {
+            out << "File execution completed successfully" << std::endl;
+        }
+
+        return !hasError;
+    }
+
+    /**
+     * @brief Load snapshots into an interpreter, stopping at the first failure
+     * @param snapshots Paths of the .gloc files
+     * @param interpreter The interpreter instance
+     * @param err Stream for error messages
+     * @return True if every snapshot was loaded
+     */
+    bool loadSnapshots(const std::vector<std::string> &snapshots, Interpreter &interpreter,
+                       std::ostream &err = std::cerr)
+    {
+        for (const std::string &snapshot : snapshots) {
+            if (!interpreter.loadSnapshot(snapshot)) {
+                err << "Error: " << interpreter.getLastError() << std::endl;
+                return false;
             }
+        }
+        return true;
+    }
 
-            // Show line being executed (optional)
-            std::cout << "Line " << lineNumber << ": " << trimmedLine << std::endl;
+    /**
+     * @brief Run a GlossAI file and save what it defined as a .gloc snapshot
+     * @param filename The path to the .glo file
+     * @param output The path of the snapshot to write
+     * @param interpreter The interpreter instance
+     * @return True if every statement succeeded and the snapshot was written
+     */
+    bool compileFile(const std::string &filename, const std::string &output, Interpreter &interpreter)
+    {
+        bool hasError = false;
+        bool success = interpreter.executeProgram(filename, [&](const Interpreter::StatementResult &result) {
+            if (!result.error.empty()) {
+                std::cerr << "Error on line " << result.line << ": " << result.error << std::endl;
+                hasError = true;
+            }
+        });
+        if (!success) {
+            if (!hasError) {
+                std::cerr << "Error: " << interpreter.getLastError() << std::endl;
+            }
+            return false; // A partial library would fail later, far from its cause
+        }
+
+        if (!interpreter.saveSnapshot(output)) {
+            std::cerr << "Error: " << interpreter.getLastError() << std::endl;
+            return false;
+        }
+        std::cout << "Compiled " << filename << " to " << output << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Output and outcome of one script run by runJobs()
+     */
+    struct ScriptRun {
+        std::ostringstream out;
+        std::ostringstream err;
+        bool success = false;
+        bool done = false;
+        double seconds = 0.0;
+    };
+
+    /**
+     * @brief Execute independent GlossAI files in parallel
+     *
+     * Each worker thread has its own interpreter, whose context is cleared
+     * and loaded from the snapshots before every file. Output is buffered per file and written in command
+     * line order as soon as a file and all files before it have finished,
+     * followed by a summary of failures and timing.
+     * @param files Paths of the .glo files
+     * @param jobs Number of worker threads (0 = one per core)
+     * @param optimizationLevel Optimization level for every interpreter
+     * @param fastMath Whether every interpreter uses the fast-math functions
+     * @param snapshots Snapshots loaded before every file
+     * @param limits Limits of every execution
+     * @return True if every file succeeded
+     */
+    bool runJobs(const std::vector<std::string> &files, size_t jobs, int optimizationLevel, bool fastMath,
+                 const std::vector<std::string> &snapshots, const ExecutionLimits &limits)
+    {
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point start = Clock::now();
 
-            try {
-                std::string result = interpreter.execute(trimmedLine);
+        size_t threads = jobs > 0 ? jobs : ThreadPool::defaultThreadCount();
+        std::vector<std::unique_ptr<Interpreter>> interpreters(threads);
+        std::vector<ScriptRun> runs(files.size());
+        std::mutex mutex;
+        std::condition_variable finished;
 
-                // Show result if not empty
-                if (!result.empty() && result != "null") {
-                    std::cout << "  = " << result << std::endl;
+        ThreadPool pool(threads);
+        for (size_t i = 0; i < files.size(); ++i) {
+            pool.submit([&, i] {
+                std::unique_ptr<Interpreter> &interpreter = interpreters[pool.workerIndex()];
+                if (!interpreter) {
+                    interpreter = std::make_unique<Interpreter>();
+                    interpreter->setOptimizationLevel(optimizationLevel);
+                    interpreter->setFastMath(fastMath);
+                    interpreter->setLimits(limits);
+                } else {
+                    interpreter->clearContext();
                 }
 
-                // Check for errors
-                std::string error = interpreter.getLastError();
-                if (!error.empty()) {
-                    std::cerr << "Error on line " << lineNumber << ": " << error << std::endl;
-                    hasError = true;
+                ScriptRun &run = runs[i];
+                interpreter->setOutput(run.out);
+                Clock::time_point begin = Clock::now();
+                try {
+                    run.success = loadSnapshots(snapshots, *interpreter, run.err) &&
+                                  executeFile(files[i], *interpreter, run.out, run.err);
+                } catch (const std::exception &e) {
+                    run.err << "Error: " << e.what() << std::endl;
                 }
-            } catch (const std::exception &e) {
-                std::cerr << "Error on line " << lineNumber << ": " << e.what() << std::endl;
-                hasError = true;
-            }
+                run.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
 
-            lineNumber++;
+                std::lock_guard<std::mutex> lock(mutex);
+                run.done = true;
+                finished.notify_all();
+            });
         }
 
-        file.close();
+        double scriptSeconds = 0.0;
+        std::vector<size_t> failures;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            ScriptRun &run = runs[i];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [&run] { return run.done; });
+            }
+            std::cout << run.out.str();
+            std::cerr << run.err.str();
+            run.out.str(std::string());
+            run.err.str(std::string());
+
+            scriptSeconds += run.seconds;
+            if (!run.success) {
+                failures.push_back(i);
+            }
+        }
+        pool.wait();
 
+        double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
         std::cout << "===========================================" << std::endl;
-        if (hasError) {
-            std::cout << "File execution completed with errors" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "Ran " << files.size() << " files on " << threads << " threads in " << wallSeconds
+                  << " s (" << scriptSeconds << " s of script time)" << std::endl;
+        if (failures.empty()) {
+            std::cout << "All files completed successfully" << std::endl;
         } else {
-            std::cout << "File execution completed successfully" << std::endl;
+            std::cout << failures.size() << " failed:" << std::endl;
+            for (size_t i : failures) {
+                std::cout << "  " << files[i] << " (" << runs[i].seconds << " s)" << std::endl;
+            }
         }
+        std::cout << std::defaultfloat;
+        return failures.empty();
+    }
 
-        return !hasError;
+    /**
+     * @brief Answer requests from clients until Ctrl+C or SIGTERM
+     * @param address Port, HOST:PORT or Unix socket path
+     * @param jobs Number of worker threads (0 = one per core)
+     * @param optimizationLevel Optimization level of every session
+     * @param fastMath Whether every session uses the fast-math functions
+     * @param snapshots Snapshots loaded into every session
+     * @param limits Limits of every request
+     * @return True if the server ran and stopped normally
+     */
+    bool runServer(const std::string &address, size_t jobs, int optimizationLevel, bool fastMath,
+                   const std::vector<std::string> &snapshots, const ExecutionLimits &limits)
+    {
+        Server::Options options;
+        options.workers = jobs;
+        options.optimizationLevel = optimizationLevel;
+        options.fastMath = fastMath;
+        options.limits = limits;
+        options.snapshots = snapshots;
+        try {
+            Server server(options);
+            server.listen(address);
+            std::cout << "Listening on " << server.address() << " (Ctrl+C to stop)" << std::endl;
+
+            g_server.store(&server);
+            std::signal(SIGINT, handleServerStop);
+            std::signal(SIGTERM, handleServerStop);
+            server.run();
+            g_server.store(nullptr);
+            std::signal(SIGINT, handleInterrupt);
+            std::signal(SIGTERM, SIG_DFL);
+
+            std::cout << "Stopped: " << server.statisticsJson() << std::endl;
+        } catch (const std::exception &e) {
+            g_server.store(nullptr);
+            std::cerr << "Error: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Execute a script statement by statement while it is read
+     *
+     * Unlike executeFile(), the script is never held in memory as a whole
+     * and nothing is echoed, which suits long generated scripts.
+     * @param filename Path of the script, or "-" for standard input
+     * @param interpreter The interpreter instance
+     * @return True if every statement succeeded
+     */
+    bool streamFile(const std::string &filename, Interpreter &interpreter)
+    {
+        std::ifstream file;
+        if (filename != "-") {
+            file.open(filename);
+            if (!file.is_open()) {
+                std::cerr << "Error: Could not open file '" << filename << "'" << std::endl;
+                return false;
+            }
+        }
+        std::istream &input = filename == "-" ? std::cin : file;
+
+        return interpreter.executeScript(input, [](const Interpreter::StatementResult &result) {
+            if (!result.value.empty() && result.value != "null") {
+                std::cout << "  = " << result.value << "\n";
+            }
+            if (!result.error.empty()) {
+                std::cerr << "Error on line " << result.line << ": " << result.error << "\n";
+            }
+        });
     }
 
     /**
@@ -492,6 +930,22 @@ void printHelp()
         return extension == ".glo";
     }
 
+    /**
+     * @brief Check if a file has .gloc extension
+     * @param filename The filename to check
+     * @return True if file has .gloc extension
+     */
+    bool isSnapshotFile(const std::string &filename)
+    {
+        if (filename.length() < 5)
+            return false;
+
+        std::string extension = filename.substr(filename.length() - 5);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        return extension == ".gloc";
+    }
+
 } // anonymous namespace
 
 /**
@@ -506,13 +960,165 @@ int main(int argc, char *argv[])
         // Create interpreter instance
         Interpreter interpreter;
 
+        // Extract option flags; everything else is an expression or file
+        std::vector<std::string> args;
+        bool stream = false;
+        bool parallel = false;
+        size_t jobs = 0;
+        std::string compile;
+        std::string compileOutput;
+        std::vector<std::string> snapshots;
+        bool profile = false;
+        std::string foldedStacks;
+        ExecutionLimits limits;
+        std::string serve;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+                interpreter.setOptimizationLevel(arg[2] - '0');
+            } else if (arg == "--fast-math") {
+                interpreter.setFastMath(true);
+            } else if (arg == "--dump-ast") {
+                g_replSettings.dumpTree = true;
+            } else if (arg == "--stream") {
+                stream = true;
+            } else if (arg == "-j" || arg == "--jobs") {
+                if (i + 1 >= argc) {
+                    std::cerr << "Error: " << arg << " expects a number of threads" << std::endl;
+                    return 1;
+                }
+                parallel = true;
+                jobs = std::stoul(argv[++i]);
+            } else if (arg == "--serve") {
+                if (i + 1 >= argc) {
+                    std::cerr << "Error: " << arg << " expects an address" << std::endl;
+                    return 1;
+                }
+                serve = argv[++i];
+            } else if (arg == "--profile") {
+                profile = true;
+            } else if (arg == "--profile-folded") {
+                if (i + 1 >= argc) {
+                    std::cerr << "Error: " << arg << " expects a file" << std::endl;
+                    return 1;
+                }
+                profile = true;
+                foldedStacks = argv[++i];
+            } else if (arg == "--max-steps" || arg == "--max-time" || arg == "--max-depth" || arg == "--max-memory") {
+                if (i + 1 >= argc) {
+                    std::cerr << "Error: " << arg << " expects a number" << std::endl;
+                    return 1;
+                }
+                unsigned long long value = std::stoull(argv[++i]);
+                if (arg == "--max-steps") {
+                    limits.maxSteps = value;
+                } else if (arg == "--max-time") {
+                    limits.maxTime = std::chrono::milliseconds(value);
+                } else if (arg == "--max-depth") {
+                    limits.maxCallDepth = value;
+                } else {
+                    limits.maxMemory = value;
+                }
+            } else if (arg == "--compile" || arg == "-o" || arg == "--load") {
+                if (i + 1 >= argc) {
+                    std::cerr << "Error: " << arg << " expects a file" << std::endl;
+                    return 1;
+                }
+                std::string file = argv[++i];
+                if (arg == "--compile") {
+                    compile = file;
+                } else if (arg == "-o") {
+                    compileOutput = file;
+                } else {
+                    snapshots.push_back(file);
+                }
+            } else {
+                args.push_back(arg);
+            }
+        }
+
+        interpreter.setLimits(limits);
+        std::signal(SIGINT, handleInterrupt);
+
+        if (profile && (parallel || !compile.empty())) {
+            std::cerr << "Error: --profile cannot be combined with --jobs or --compile" << std::endl;
+            return 1;
+        }
+
+        if (!compile.empty()) {
+            if (!args.empty() || parallel || stream) {
+                std::cerr << "Error: --compile expects a single .glo file and no other input" << std::endl;
+                return 1;
+            }
+            if (compileOutput.empty()) {
+                compileOutput = std::filesystem::path(compile).replace_extension(".gloc").string();
+            }
+            // Libraries may build on snapshots of other libraries
+            if (!loadSnapshots(snapshots, interpreter)) {
+                return 1;
+            }
+            return compileFile(compile, compileOutput, interpreter) ? 0 : 1;
+        }
+        if (!compileOutput.empty()) {
+            std::cerr << "Error: -o is only valid with --compile" << std::endl;
+            return 1;
+        }
+
+        if (!serve.empty()) {
+            if (!args.empty() || stream || profile) {
+                std::cerr << "Error: --serve takes no expression, file, --stream or --profile" << std::endl;
+                return 1;
+            }
+            // Sessions load the snapshots themselves; a bad one is reported once, here
+            if (!loadSnapshots(snapshots, interpreter)) {
+                return 1;
+            }
+            return runServer(serve, jobs, interpreter.getOptimizationLevel(), interpreter.isFastMath(), snapshots,
+                             limits) ? 0 : 1;
+        }
+
+        if (parallel) {
+            if (args.empty() || !std::all_of(args.begin(), args.end(), isGlossAIFile)) {
+                std::cerr << "Error: --jobs expects one or more .glo files" << std::endl;
+                return 1;
+            }
+            return runJobs(args, jobs, interpreter.getOptimizationLevel(), interpreter.isFastMath(), snapshots,
+                           limits) ? 0 : 1;
+        }
+
+        if (!loadSnapshots(snapshots, interpreter)) {
+            return 1;
+        }
+
+        // Only what runs from here on is profiled; the report follows the run
+        interpreter.setProfiling(profile);
+        auto finish = [&](int status) {
+            if (profile) {
+                std::cout.flush();
+                interpreter.getProfiler()->writeReport(std::cerr);
+                if (!foldedStacks.empty() && !writeFoldedStacks(*interpreter.getProfiler(), foldedStacks)) {
+                    return 1;
+                }
+            }
+            return status;
+        };
+
+        if (stream) {
+            if (args.size() != 1) {
+                std::cerr << "Error: --stream expects exactly one file (or -)" << std::endl;
+                return 1;
+            }
+            InterruptScope interrupt(interpreter);
+            return finish(streamFile(args[0], interpreter) ? 0 : 1);
+        }
+
         // Parse command-line arguments
-        if (argc == 1) {
+        if (args.empty()) {
             // No arguments - start interactive mode
             printWelcome();
             runREPL(interpreter);
-        } else if (argc == 2) {
-            std::string arg = argv[1];
+        } else if (args.size() == 1) {
+            const std::string &arg = args[0];
 
             if (arg == "-h" || arg == "--help") {
                 printUsage(argv[0]);
@@ -525,8 +1131,9 @@ int main(int argc, char *argv[])
                 runREPL(interpreter);
             } else if (isGlossAIFile(arg)) {
                 // Execute GlossAI file
+                InterruptScope interrupt(interpreter);
                 bool success = executeFile(arg, interpreter);
-                return success ? 0 : 1;
+                return finish(success ? 0 : 1);
             } else {
                 // Treat as expression to evaluate
                 executeExpression(arg, interpreter);
@@ -534,15 +1141,15 @@ int main(int argc, char *argv[])
         } else {
             // Multiple arguments - combine as single expression
             std::string expression;
-            for (int i = 1; i < argc; ++i) {
-                if (i > 1)
+            for (size_t i = 0; i < args.size(); ++i) {
+                if (i > 0)
                     expression += " ";
-                expression += argv[i];
+                expression += args[i];
             }
             executeExpression(expression, interpreter);
         }
 
-        return 0;
+        return finish(0);
     } catch (const std::exception &e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
         return 1;
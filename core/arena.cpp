@@ -0,0 +1,26 @@
+#include "arena.h"
+#include <algorithm>
+
+Arena::Arena(size_t blockSize)
+    : m_blockSize(blockSize), m_cursor(nullptr), m_end(nullptr), m_bytesReserved(0)
+{
+}
+
+Arena::~Arena()
+{
+    for (auto it = m_destructors.rbegin(); it != m_destructors.rend(); ++it) {
+        it->destroy(it->object);
+    }
+}
+
+void *Arena::allocateSlow(size_t size, size_t alignment)
+{
+    // Requests larger than a block get a block sized to fit them
+    size_t blockSize = std::max(m_blockSize, size + alignment);
+    m_blocks.emplace_back(new char[blockSize]); // Left uninitialized on purpose
+    m_bytesReserved += blockSize;
+
+    m_cursor = m_blocks.back().get();
+    m_end = m_cursor + blockSize;
+    return allocate(size, alignment);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "span.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Bump allocator that releases everything it handed out at once
+ *
+ * Objects are placed back to back in large blocks, so building a tree of many
+ * small nodes costs a pointer increment per node instead of a heap
+ * allocation. Only objects with non-trivial destructors are tracked; they are
+ * destroyed in reverse order of creation when the arena goes away.
+ */
+class Arena
+{
+public:
+    explicit Arena(size_t blockSize = 16 * 1024);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * @brief Get raw storage that lives as long as the arena
+     * @param size Number of bytes
+     * @param alignment Required alignment (a power of two)
+     */
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t offset = (alignment - reinterpret_cast<std::uintptr_t>(m_cursor) % alignment) % alignment;
+        if (m_cursor && size + offset <= static_cast<size_t>(m_end - m_cursor)) {
+            void *result = m_cursor + offset;
+            m_cursor += offset + size;
+            return result;
+        }
+        return allocateSlow(size, alignment);
+    }
+
+    /**
+     * @brief Construct an object in the arena
+     */
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            m_destructors.push_back({object, [](void *p) { static_cast<T *>(p)->~T(); }});
+        }
+        return object;
+    }
+
+    /**
+     * @brief Copy a sequence of trivially copyable elements into the arena
+     */
+    template <typename T>
+    Span<T> copy(const std::vector<T> &elements)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Arena arrays hold plain data only");
+        if (elements.empty()) {
+            return Span<T>();
+        }
+        T *data = static_cast<T *>(allocate(sizeof(T) * elements.size(), alignof(T)));
+        std::uninitialized_copy(elements.begin(), elements.end(), data);
+        return Span<T>(data, elements.size());
+    }
+
+    /**
+     * @brief Total bytes reserved from the system
+     */
+    size_t bytesReserved() const { return m_bytesReserved; }
+
+private:
+    struct Destructor {
+        void *object;
+        void (*destroy)(void *);
+    };
+
+    void *allocateSlow(size_t size, size_t alignment);
+
+    size_t m_blockSize;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char *m_cursor;
+    char *m_end;
+    size_t m_bytesReserved;
+    std::vector<Destructor> m_destructors;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Shared payload of an array Value: contiguous doubles
+ *
+ * Copying an array Value takes a reference, never the elements. Operations
+ * that produce an array write into an operand's payload when they hold the
+ * only reference to it (a temporary, or a variable's value nothing else
+ * shares) and allocate a new payload otherwise, so a shared payload is
+ * never modified.
+ */
+struct ArrayData {
+    std::atomic<std::uint32_t> refs;
+    std::vector<double> elements;
+
+    explicit ArrayData(std::vector<double> values) : refs(1), elements(std::move(values)) {}
+
+    /**
+     * @brief Take an additional reference
+     */
+    static void retain(ArrayData *data)
+    {
+        data->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Drop a reference, freeing the payload when it was the last one
+     */
+    static void release(ArrayData *data)
+    {
+        if (data->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete data;
+        }
+    }
+
+    /**
+     * @brief Check whether the caller holds the only reference, so it may write the elements
+     */
+    bool isUnique() const { return refs.load(std::memory_order_acquire) == 1; }
+};
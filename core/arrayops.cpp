@@ -0,0 +1,268 @@
+#include "arrayops.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define GLOSSAI_ARRAY_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace ArrayKernels
+{
+
+double sum(const double *values, size_t count)
+{
+    size_t i = 0;
+    double total;
+#ifdef GLOSSAI_ARRAY_SSE2
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd(), s2 = _mm_setzero_pd(), s3 = _mm_setzero_pd();
+    for (; i + 8 <= count; i += 8) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(values + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(values + i + 2));
+        s2 = _mm_add_pd(s2, _mm_loadu_pd(values + i + 4));
+        s3 = _mm_add_pd(s3, _mm_loadu_pd(values + i + 6));
+    }
+    s0 = _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3));
+    double lanes[2];
+    _mm_storeu_pd(lanes, s0);
+    total = lanes[0] + lanes[1];
+#else
+    double s[4] = {0.0, 0.0, 0.0, 0.0};
+    for (; i + 4 <= count; i += 4) {
+        s[0] += values[i];
+        s[1] += values[i + 1];
+        s[2] += values[i + 2];
+        s[3] += values[i + 3];
+    }
+    total = (s[0] + s[1]) + (s[2] + s[3]);
+#endif
+    for (; i < count; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+double dot(const double *left, const double *right, size_t count)
+{
+    size_t i = 0;
+    double total;
+#ifdef GLOSSAI_ARRAY_SSE2
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd(), s2 = _mm_setzero_pd(), s3 = _mm_setzero_pd();
+    for (; i + 8 <= count; i += 8) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(left + i + 2), _mm_loadu_pd(right + i + 2)));
+        s2 = _mm_add_pd(s2, _mm_mul_pd(_mm_loadu_pd(left + i + 4), _mm_loadu_pd(right + i + 4)));
+        s3 = _mm_add_pd(s3, _mm_mul_pd(_mm_loadu_pd(left + i + 6), _mm_loadu_pd(right + i + 6)));
+    }
+    s0 = _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3));
+    double lanes[2];
+    _mm_storeu_pd(lanes, s0);
+    total = lanes[0] + lanes[1];
+#else
+    double s[4] = {0.0, 0.0, 0.0, 0.0};
+    for (; i + 4 <= count; i += 4) {
+        s[0] += left[i] * right[i];
+        s[1] += left[i + 1] * right[i + 1];
+        s[2] += left[i + 2] * right[i + 2];
+        s[3] += left[i + 3] * right[i + 3];
+    }
+    total = (s[0] + s[1]) + (s[2] + s[3]);
+#endif
+    for (; i < count; ++i) {
+        total += left[i] * right[i];
+    }
+    return total;
+}
+
+namespace
+{
+
+/**
+ * @brief Shared body of minimum() and maximum()
+ * @tparam Smallest True for the minimum
+ */
+template <bool Smallest>
+double extremum(const double *values, size_t count)
+{
+    size_t i = 0;
+    double best = values[0];
+    bool sawNaN = false;
+#ifdef GLOSSAI_ARRAY_SSE2
+    if (count >= 4) {
+        __m128d b0 = _mm_loadu_pd(values), b1 = _mm_loadu_pd(values + 2);
+        __m128d nan = _mm_or_pd(_mm_cmpunord_pd(b0, b0), _mm_cmpunord_pd(b1, b1));
+        for (i = 4; i + 4 <= count; i += 4) {
+            __m128d x0 = _mm_loadu_pd(values + i);
+            __m128d x1 = _mm_loadu_pd(values + i + 2);
+            // min/max return their second operand when either is NaN; NaNs are tracked separately
+            b0 = Smallest ? _mm_min_pd(b0, x0) : _mm_max_pd(b0, x0);
+            b1 = Smallest ? _mm_min_pd(b1, x1) : _mm_max_pd(b1, x1);
+            nan = _mm_or_pd(nan, _mm_or_pd(_mm_cmpunord_pd(x0, x0), _mm_cmpunord_pd(x1, x1)));
+        }
+        b0 = Smallest ? _mm_min_pd(b0, b1) : _mm_max_pd(b0, b1);
+        double lanes[2];
+        _mm_storeu_pd(lanes, b0);
+        best = Smallest ? std::min(lanes[0], lanes[1]) : std::max(lanes[0], lanes[1]);
+        sawNaN = _mm_movemask_pd(nan) != 0;
+    }
+#endif
+    for (; i < count; ++i) {
+        double value = values[i];
+        sawNaN = sawNaN || std::isnan(value);
+        best = Smallest ? std::min(best, value) : std::max(best, value);
+    }
+    return sawNaN ? std::numeric_limits<double>::quiet_NaN() : best;
+}
+
+} // anonymous namespace
+
+double minimum(const double *values, size_t count)
+{
+    return extremum<true>(values, count);
+}
+
+double maximum(const double *values, size_t count)
+{
+    return extremum<false>(values, count);
+}
+
+} // namespace ArrayKernels
+
+namespace
+{
+
+double scalarOperand(const Value &value)
+{
+    if (value.getType() == Value::String) {
+        throw std::runtime_error("Cannot combine an array with a string");
+    }
+    return value.toNumber();
+}
+
+/**
+ * @brief Combine two operands, at least one of them an array, element by element
+ *
+ * Written as a template over the operation so each operator gets its own
+ * loop the compiler can vectorize.
+ */
+template <typename Operation>
+Value combine(Value &left, Value &right, Operation operation)
+{
+    if (left.isArray() && right.isArray()) {
+        const std::vector<double> &a = left.asArray();
+        const std::vector<double> &b = right.asArray();
+        if (a.size() != b.size()) {
+            throw std::runtime_error("Arrays of different lengths: " + std::to_string(a.size()) + " and " +
+                                     std::to_string(b.size()));
+        }
+        Value *reused = left.uniqueArray() ? &left : right.uniqueArray() ? &right : nullptr;
+        std::vector<double> fresh;
+        double *out;
+        if (reused) {
+            out = reused->uniqueArray()->data();
+        } else {
+            fresh.resize(a.size());
+            out = fresh.data();
+        }
+        const double *x = a.data();
+        const double *y = b.data();
+        for (size_t i = 0, count = a.size(); i < count; ++i) {
+            out[i] = operation(x[i], y[i]);
+        }
+        return reused ? std::move(*reused) : Value(std::move(fresh));
+    }
+
+    if (left.isArray()) {
+        const double scalar = scalarOperand(right);
+        std::vector<double> *elements = left.uniqueArray();
+        std::vector<double> fresh(elements ? 0 : left.asArray().size());
+        const double *x = left.asArray().data();
+        double *out = elements ? elements->data() : fresh.data();
+        for (size_t i = 0, count = left.asArray().size(); i < count; ++i) {
+            out[i] = operation(x[i], scalar);
+        }
+        return elements ? std::move(left) : Value(std::move(fresh));
+    }
+
+    const double scalar = scalarOperand(left);
+    std::vector<double> *elements = right.uniqueArray();
+    std::vector<double> fresh(elements ? 0 : right.asArray().size());
+    const double *y = right.asArray().data();
+    double *out = elements ? elements->data() : fresh.data();
+    for (size_t i = 0, count = right.asArray().size(); i < count; ++i) {
+        out[i] = operation(scalar, y[i]);
+    }
+    return elements ? std::move(right) : Value(std::move(fresh));
+}
+
+void checkDivisor(const Value &divisor, const char *message)
+{
+    bool zero = divisor.isArray() ? std::find(divisor.asArray().begin(), divisor.asArray().end(), 0.0) !=
+                                        divisor.asArray().end()
+                                  : scalarOperand(divisor) == 0.0;
+    if (zero) {
+        throw std::runtime_error(message);
+    }
+}
+
+} // anonymous namespace
+
+Value elementwise(BinaryOperator op, Value &&left, Value &&right)
+{
+    switch (op) {
+    case BinaryOperator::Add: return combine(left, right, [](double a, double b) { return a + b; });
+    case BinaryOperator::Subtract: return combine(left, right, [](double a, double b) { return a - b; });
+    case BinaryOperator::Multiply: return combine(left, right, [](double a, double b) { return a * b; });
+    case BinaryOperator::Divide:
+        checkDivisor(right, "Division by zero");
+        return combine(left, right, [](double a, double b) { return a / b; });
+    case BinaryOperator::Power: return combine(left, right, [](double a, double b) { return std::pow(a, b); });
+    case BinaryOperator::Mod:
+        checkDivisor(right, "Modulo by zero");
+        return combine(left, right, [](double a, double b) { return std::fmod(a, b); });
+    case BinaryOperator::Div:
+        checkDivisor(right, "Integer division by zero");
+        return combine(left, right, [](double a, double b) { return std::trunc(a / b); });
+    case BinaryOperator::Equal: return combine(left, right, [](double a, double b) { return a == b ? 1.0 : 0.0; });
+    case BinaryOperator::NotEqual:
+        return combine(left, right, [](double a, double b) { return a != b ? 1.0 : 0.0; });
+    case BinaryOperator::Less: return combine(left, right, [](double a, double b) { return a < b ? 1.0 : 0.0; });
+    case BinaryOperator::Greater: return combine(left, right, [](double a, double b) { return a > b ? 1.0 : 0.0; });
+    case BinaryOperator::LessEqual:
+        return combine(left, right, [](double a, double b) { return a <= b ? 1.0 : 0.0; });
+    case BinaryOperator::GreaterEqual:
+        return combine(left, right, [](double a, double b) { return a >= b ? 1.0 : 0.0; });
+    default:
+        throw std::runtime_error("Unsupported array operator");
+    }
+}
+
+Value negateElements(Value operand)
+{
+    return mapElements(std::move(operand), [](double a) { return -a; });
+}
+
+Value mapElements(Value operand, double (*function)(double))
+{
+    std::vector<double> *elements = operand.uniqueArray();
+    if (elements) {
+        for (double &element : *elements) {
+            element = function(element);
+        }
+        return operand;
+    }
+    const std::vector<double> &source = operand.asArray();
+    std::vector<double> result(source.size());
+    for (size_t i = 0; i < source.size(); ++i) {
+        result[i] = function(source[i]);
+    }
+    return Value(std::move(result));
+}
+
+Value combineElements(Value left, Value right, double (*function)(double, double))
+{
+    return combine(left, right, function);
+}
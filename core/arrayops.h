@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ast.h"
+#include <cstddef>
+
+/**
+ * @brief Reductions over contiguous doubles
+ *
+ * Each keeps several independent accumulators, in SSE2 registers where
+ * available, so the additions of consecutive elements do not wait on each
+ * other. Sums are therefore added in a different order than a loop over the
+ * elements would, and may differ from it in the last bits.
+ */
+namespace ArrayKernels
+{
+
+double sum(const double *values, size_t count);
+double dot(const double *left, const double *right, size_t count);
+
+/**
+ * @brief Smallest element; NaN if any element is NaN
+ * @param count At least 1
+ */
+double minimum(const double *values, size_t count);
+
+/**
+ * @brief Largest element; NaN if any element is NaN
+ * @param count At least 1
+ */
+double maximum(const double *values, size_t count);
+
+} // namespace ArrayKernels
+
+/**
+ * @brief Apply an arithmetic or comparison operator element by element
+ *
+ * Two arrays must have the same length. A number (or boolean) combined with
+ * an array is combined with every element; comparisons give arrays of 1 and
+ * 0. Zero divisors fail as they do for numbers. The result is written into
+ * an operand that holds the only reference to its elements; operands are
+ * only taken from once nothing can fail, so on an error both are unchanged.
+ * @param op Add to GreaterEqual (logical and assignment operators are not element-wise)
+ * @throws std::runtime_error on different lengths, a zero divisor or a string operand
+ */
+Value elementwise(BinaryOperator op, Value &&left, Value &&right);
+
+/**
+ * @brief Negate every element of an array
+ *
+ * Like mapElements() and combineElements(), the result reuses the elements
+ * of an operand nothing else references.
+ */
+Value negateElements(Value operand);
+
+/**
+ * @brief Apply a one-argument math function to every element of an array
+ */
+Value mapElements(Value operand, double (*function)(double));
+
+/**
+ * @brief Apply a two-argument math function to matching elements, broadcasting
+ *        a number operand like elementwise()
+ * @param left,right Arguments, at least one of them an array
+ * @throws std::runtime_error on different lengths or a string argument
+ */
+Value combineElements(Value left, Value right, double (*function)(double, double));
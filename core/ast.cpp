@@ -1,4 +1,6 @@
 #include "ast.h"
+#include "arrayops.h"
+#include <charconv>
 #include <unordered_map>
 #include <sstream>
 #include <algorithm>
@@ -8,48 +10,77 @@
 // Value implementation
 double Value::toNumber() const {
     switch (m_type) {
-    case Number: return m_number;
-    case Boolean: return m_boolean ? 1.0 : 0.0;
+    case Number: return m_payload.number;
+    case Boolean: return m_payload.boolean ? 1.0 : 0.0;
     case String: {
         try {
-            return std::stod(m_string);
+            return std::stod(m_payload.string->text);
         } catch (...) {
             return 0.0;
         }
     }
     case Null: return 0.0;
+    case Array: return std::nan(""); // Arrays combine element by element instead
     }
     return 0.0;
 }
 
 bool Value::toBool() const {
     switch (m_type) {
-    case Boolean: return m_boolean;
-    case Number: return m_number != 0.0;
-    case String: return !m_string.empty();
+    case Boolean: return m_payload.boolean;
+    case Number: return m_payload.number != 0.0;
+    case String: return !m_payload.string->text.empty();
+    case Array: return !m_payload.array->elements.empty();
     case Null: return false;
     }
     return false;
 }
 
 std::string Value::toString() const
+{
+    std::string text;
+    appendTo(text);
+    return text;
+}
+
+void Value::appendTo(std::string& out) const
 {
     switch (m_type) {
     case Number: {
-        double val = m_number;
-        // Check if it's a whole number
+        double val = m_payload.number;
+        // Longest fixed-notation double: 309 integer digits, sign, point and 6 decimals
+        char buffer[320];
+        std::to_chars_result result;
+        // Whole numbers print without a fraction, others with six decimals like printf's %f
         if (val == static_cast<double>(static_cast<long long>(val))) {
-            return std::to_string(static_cast<long long>(val));
+            result = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<long long>(val));
+        } else {
+            result = std::to_chars(buffer, buffer + sizeof(buffer), val, std::chars_format::fixed, 6);
         }
-        return std::to_string(val);
+        out.append(buffer, result.ptr);
+        break;
     }
     case String:
-        return m_string;
+        out += m_payload.string->text;
+        break;
     case Boolean:
-        return m_boolean ? "true" : "false";
+        out += m_payload.boolean ? "true" : "false";
+        break;
+    case Array: {
+        out += '[';
+        const std::vector<double> &elements = m_payload.array->elements;
+        for (size_t i = 0; i < elements.size(); ++i) {
+            if (i > 0) {
+                out += ", ";
+            }
+            Value(elements[i]).appendTo(out);
+        }
+        out += ']';
+        break;
+    }
     case Null:
     default:
-        return "";
+        break;
     }
 }
 
@@ -58,9 +89,10 @@ bool Value::operator==(const Value& other) const {
         return false;
     }
     switch (m_type) {
-    case Number: return m_number == other.m_number;
-    case Boolean: return m_boolean == other.m_boolean;
-    case String: return m_string == other.m_string;
+    case Number: return m_payload.number == other.m_payload.number;
+    case Boolean: return m_payload.boolean == other.m_payload.boolean;
+    case String: return m_payload.string == other.m_payload.string; // Interned: equal text, same payload
+    case Array: return m_payload.array->elements == other.m_payload.array->elements;
     case Null: return true;
     }
     return false;
@@ -68,16 +100,19 @@ bool Value::operator==(const Value& other) const {
 
 bool Value::operator<(const Value& other) const {
     if (m_type == Number && other.m_type == Number) {
-        return m_number < other.m_number;
+        return m_payload.number < other.m_payload.number;
     }
     if (m_type == String && other.m_type == String) {
-        return m_string < other.m_string;
+        return m_payload.string->text < other.m_payload.string->text;
     }
     return toNumber() < other.toNumber();
 }
 
 Value Value::operator+(const Value &other) const
 {
+    if (m_type == Array || other.m_type == Array) {
+        return elementwise(BinaryOperator::Add, Value(*this), Value(other));
+    }
     try {
         if (m_type == String || other.m_type == String) {
             return Value(toString() + other.toString());
@@ -89,14 +124,23 @@ Value Value::operator+(const Value &other) const
 }
 
 Value Value::operator-(const Value& other) const {
+    if (m_type == Array || other.m_type == Array) {
+        return elementwise(BinaryOperator::Subtract, Value(*this), Value(other));
+    }
     return Value(toNumber() - other.toNumber());
 }
 
 Value Value::operator*(const Value& other) const {
+    if (m_type == Array || other.m_type == Array) {
+        return elementwise(BinaryOperator::Multiply, Value(*this), Value(other));
+    }
     return Value(toNumber() * other.toNumber());
 }
 
 Value Value::operator/(const Value& other) const {
+    if (m_type == Array || other.m_type == Array) {
+        return elementwise(BinaryOperator::Divide, Value(*this), Value(other));
+    }
     double divisor = other.toNumber();
     if (divisor == 0.0) {
         throw std::runtime_error("Division by zero");
@@ -180,8 +224,20 @@ std::string WhileNode::toString() const
 
 std::string ForNode::toString() const
 {
-    return "for (" + m_init->toString() + "; " + m_condition->toString() + 
-           "; " + m_update->toString() + ") " + m_body->toString();
+    std::string prefix;
+    if (m_parallel) {
+        prefix = "parallel ";
+        if (!m_reductions.empty()) {
+            prefix += "(";
+            for (size_t i = 0; i < m_reductions.size(); ++i) {
+                prefix += (i > 0 ? ", " : "") + m_reductions[i];
+            }
+            prefix += ") ";
+        }
+    }
+    return prefix + "for (" + (m_init ? m_init->toString() : "") + "; " +
+           (m_condition ? m_condition->toString() : "") + "; " +
+           (m_update ? m_update->toString() : "") + ") " + m_body->toString();
 }
 
 std::string BlockNode::toString() const
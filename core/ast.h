@@ -3,31 +3,83 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include "array.h"
+#include "span.h"
+#include "stringtable.h"
 
 class ASTNode;
+struct BuiltinFunction;
 
 /**
  * @brief Represents a value in the interpreter
- * Pure C++ implementation using variant-like behavior
+ *
+ * A 16-byte tagged value: a type tag plus an 8-byte payload. Numbers and
+ * booleans are stored inline, so copying them is a plain move; strings
+ * reference an interned, reference-counted StringData, and arrays of
+ * numbers a reference-counted ArrayData.
  */
 class Value {
 public:
-    enum Type {
+    enum Type : std::uint8_t {
         Null,
         Boolean,
         Number,
-        String
+        String,
+        Array
     };
     
-    Value() : m_type(Null), m_number(0.0), m_boolean(false) {}
-    Value(double num) : m_type(Number), m_number(num), m_boolean(false) {}
-    Value(bool b) : m_type(Boolean), m_number(0.0), m_boolean(b) {}
-    Value(const std::string& str) : m_type(String), m_number(0.0), m_boolean(false), m_string(str) {}
+    Value() : m_type(Null) { m_payload.number = 0.0; }
+    Value(double num) : m_type(Number) { m_payload.number = num; }
+    Value(bool b) : m_type(Boolean) { m_payload.number = 0.0; m_payload.boolean = b; }
+    Value(const std::string& str) : m_type(String) { m_payload.string = StringTable::intern(str); }
+    Value(const char* str) : Value(std::string(str)) {}
+    explicit Value(std::vector<double> elements) : m_type(Array) { m_payload.array = new ArrayData(std::move(elements)); }
+    
+    Value(const Value& other) : m_type(other.m_type), m_payload(other.m_payload)
+    {
+        retainPayload();
+    }
+    Value(Value&& other) noexcept : m_type(other.m_type), m_payload(other.m_payload)
+    {
+        other.m_type = Null;
+    }
+    Value& operator=(const Value& other)
+    {
+        other.retainPayload();
+        releasePayload();
+        m_type = other.m_type;
+        m_payload = other.m_payload;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept
+    {
+        if (this != &other) {
+            releasePayload();
+            m_type = other.m_type;
+            m_payload = other.m_payload;
+            other.m_type = Null;
+        }
+        return *this;
+    }
+    ~Value()
+    {
+        releasePayload();
+    }
     
     Type getType() const { return m_type; }
+    bool isNumber() const { return m_type == Number; }
+    double asNumber() const { return m_payload.number; } // Only meaningful when isNumber()
+    const std::string& asString() const { return m_payload.string->text; } // Only meaningful for String
+    bool isArray() const { return m_type == Array; }
+    const std::vector<double>& asArray() const { return m_payload.array->elements; } // Only meaningful for Array
+    /// Elements that may be written in place: an array nothing else references, else nullptr
+    std::vector<double>* uniqueArray() { return m_type == Array && m_payload.array->isUnique() ? &m_payload.array->elements : nullptr; }
     double toNumber() const;
     bool toBool() const;
     std::string toString() const;
+    /// Append toString()'s text without building a temporary string
+    void appendTo(std::string& out) const;
     
     bool operator==(const Value& other) const;
     bool operator!=(const Value& other) const { return !(*this == other); }
@@ -42,21 +94,67 @@ public:
     Value operator/(const Value& other) const;
     
 private:
+    void retainPayload() const
+    {
+        if (m_type == String) StringTable::retain(m_payload.string);
+        else if (m_type == Array) ArrayData::retain(m_payload.array);
+    }
+    void releasePayload()
+    {
+        if (m_type == String) StringTable::release(m_payload.string);
+        else if (m_type == Array) ArrayData::release(m_payload.array);
+    }
+
     Type m_type;
-    double m_number;
-    bool m_boolean;
-    std::string m_string;
+    union Payload {
+        double number;
+        bool boolean;
+        StringData* string;
+        ArrayData* array;
+    } m_payload;
+};
+
+static_assert(sizeof(Value) == 16, "Value should stay a tag plus an 8-byte payload");
+
+/**
+ * @brief Concrete type of an AST node, one per ASTVisitor overload
+ */
+enum class NodeKind : std::uint8_t {
+    Literal, Identifier, BinaryOp, UnaryOp, FunctionCall,
+    If, While, For, Block, FunctionDef, Return, Print
 };
 
 /**
  * @brief Base class for all AST nodes
- * Pure C++ implementation
+ *
+ * Nodes are created by and owned by a Program (see program.h), which frees
+ * the whole tree at once; they are never deleted individually, hence the
+ * protected non-virtual destructor.
+ *
+ * Every node records its kind, so code that needs one particular node type
+ * tests a byte with nodeCast() instead of going through RTTI, and the
+ * source position of the token it was parsed from, for run-time errors.
  */
 class ASTNode
 {
 public:
-    virtual ~ASTNode() = default;
-    
+    NodeKind getKind() const { return m_kind; }
+
+    /**
+     * @brief Line of the node's token (1-based); 0 for nodes made by the optimizer or a snapshot
+     */
+    int getLine() const { return static_cast<int>(m_line); }
+    int getColumn() const { return m_column; }
+
+    /**
+     * @brief Record where the node was parsed from; columns past 65535 are clamped
+     */
+    void setPosition(int line, int column)
+    {
+        m_line = static_cast<std::uint32_t>(line > 0 ? line : 0);
+        m_column = static_cast<std::uint16_t>(column < 0 ? 0 : column > 0xFFFF ? 0xFFFF : column);
+    }
+
     /**
      * @brief Accept a visitor for the visitor pattern
      * @param visitor The visitor to accept
@@ -67,8 +165,22 @@ public:
      * @brief Get a string representation of the node (for debugging)
      */
     virtual std::string toString() const = 0;
+
+protected:
+    explicit ASTNode(NodeKind kind) : m_kind(kind) {}
+    ~ASTNode() = default;
+
+private:
+    std::uint32_t m_line = 0;
+    std::uint16_t m_column = 0;
+    NodeKind m_kind;
 };
 
+/**
+ * @brief Arena-allocated list of child nodes
+ */
+using NodeList = Span<ASTNode *const>;
+
 /**
  * @brief Visitor interface for AST traversal
  */
@@ -113,7 +225,9 @@ enum class UnaryOperator {
 class LiteralNode : public ASTNode
 {
 public:
-    explicit LiteralNode(const Value &value) : m_value(value) {}
+    static constexpr NodeKind Kind = NodeKind::Literal;
+
+    explicit LiteralNode(const Value &value) : ASTNode(Kind), m_value(value) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override { return m_value.toString(); }
@@ -126,19 +240,37 @@ private:
 
 /**
  * @brief Identifier node (variable names, function names)
+ *
+ * Once the resolver has run, variable references also carry the
+ * (scope depth, slot index) address of their Context slot.
  */
 class IdentifierNode : public ASTNode
 {
 public:
-    explicit IdentifierNode(const std::string &name) : m_name(name) {}
+    static constexpr NodeKind Kind = NodeKind::Identifier;
+
+    explicit IdentifierNode(const std::string &name) : ASTNode(Kind), m_name(name) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override { return m_name; }
     
-    std::string getName() const { return m_name; }
+    const std::string &getName() const { return m_name; }
+    
+    bool isResolved() const { return m_resolved; }
+    std::uint16_t getScopeDepth() const { return m_scopeDepth; }
+    std::uint32_t getSlotIndex() const { return m_slotIndex; }
+    void resolve(std::uint16_t depth, std::uint32_t index)
+    {
+        m_scopeDepth = depth;
+        m_slotIndex = index;
+        m_resolved = true;
+    }
 
 private:
     std::string m_name;
+    bool m_resolved = false;
+    std::uint16_t m_scopeDepth = 0;
+    std::uint32_t m_slotIndex = 0;
 };
 
 /**
@@ -147,20 +279,22 @@ private:
 class BinaryOpNode : public ASTNode
 {
 public:
-    BinaryOpNode(std::unique_ptr<ASTNode> left, BinaryOperator op, std::unique_ptr<ASTNode> right)
-        : m_left(std::move(left)), m_operator(op), m_right(std::move(right)) {}
+    static constexpr NodeKind Kind = NodeKind::BinaryOp;
+
+    BinaryOpNode(ASTNode *left, BinaryOperator op, ASTNode *right)
+        : ASTNode(Kind), m_left(left), m_operator(op), m_right(right) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    ASTNode* getLeft() const { return m_left.get(); }
-    ASTNode* getRight() const { return m_right.get(); }
+    ASTNode* getLeft() const { return m_left; }
+    ASTNode* getRight() const { return m_right; }
     BinaryOperator getOperator() const { return m_operator; }
 
 private:
-    std::unique_ptr<ASTNode> m_left;
+    ASTNode *m_left;
     BinaryOperator m_operator;
-    std::unique_ptr<ASTNode> m_right;
+    ASTNode *m_right;
 };
 
 /**
@@ -169,18 +303,20 @@ private:
 class UnaryOpNode : public ASTNode
 {
 public:
-    UnaryOpNode(UnaryOperator op, std::unique_ptr<ASTNode> operand)
-        : m_operator(op), m_operand(std::move(operand)) {}
+    static constexpr NodeKind Kind = NodeKind::UnaryOp;
+
+    UnaryOpNode(UnaryOperator op, ASTNode *operand)
+        : ASTNode(Kind), m_operator(op), m_operand(operand) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
     UnaryOperator getOperator() const { return m_operator; }
-    ASTNode* getOperand() const { return m_operand.get(); }
+    ASTNode* getOperand() const { return m_operand; }
 
 private:
     UnaryOperator m_operator;
-    std::unique_ptr<ASTNode> m_operand;
+    ASTNode *m_operand;
 };
 
 /**
@@ -189,18 +325,27 @@ private:
 class FunctionCallNode : public ASTNode
 {
 public:
-    FunctionCallNode(std::unique_ptr<ASTNode> function, std::vector<std::unique_ptr<ASTNode>> arguments)
-        : m_function(std::move(function)), m_arguments(std::move(arguments)) {}
+    static constexpr NodeKind Kind = NodeKind::FunctionCall;
+
+    FunctionCallNode(ASTNode *function, NodeList arguments)
+        : ASTNode(Kind), m_function(function), m_arguments(arguments) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    ASTNode* getFunction() const { return m_function.get(); }
-    const std::vector<std::unique_ptr<ASTNode>>& getArguments() const { return m_arguments; }
+    ASTNode* getFunction() const { return m_function; }
+    NodeList getArguments() const { return m_arguments; }
+
+    /**
+     * @brief Native function bound by the Resolver (nullptr if unknown or wrong arity)
+     */
+    const BuiltinFunction* getBuiltin() const { return m_builtin; }
+    void setBuiltin(const BuiltinFunction* builtin) { m_builtin = builtin; }
 
 private:
-    std::unique_ptr<ASTNode> m_function;
-    std::vector<std::unique_ptr<ASTNode>> m_arguments;
+    ASTNode *m_function;
+    NodeList m_arguments;
+    const BuiltinFunction* m_builtin = nullptr;
 };
 
 /**
@@ -209,12 +354,15 @@ private:
 class IfNode : public ASTNode
 {
 public:
-    IfNode(std::unique_ptr<ASTNode> condition,
-           std::unique_ptr<ASTNode> thenBranch,
-           std::unique_ptr<ASTNode> elseBranch = nullptr)
-        : m_condition(std::move(condition))
-        , m_thenBranch(std::move(thenBranch))
-        , m_elseBranch(std::move(elseBranch))
+    static constexpr NodeKind Kind = NodeKind::If;
+
+    IfNode(ASTNode *condition,
+           ASTNode *thenBranch,
+           ASTNode *elseBranch = nullptr)
+        : ASTNode(Kind)
+        , m_condition(condition)
+        , m_thenBranch(thenBranch)
+        , m_elseBranch(elseBranch)
     {}
 
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
@@ -222,14 +370,14 @@ public:
     std::string toString() const override;
     
 
-    ASTNode *getCondition() const { return m_condition.get(); }
-    ASTNode *getThenBranch() const { return m_thenBranch.get(); }
-    ASTNode *getElseBranch() const { return m_elseBranch.get(); }
+    ASTNode *getCondition() const { return m_condition; }
+    ASTNode *getThenBranch() const { return m_thenBranch; }
+    ASTNode *getElseBranch() const { return m_elseBranch; }
 
 private:
-    std::unique_ptr<ASTNode> m_condition;
-    std::unique_ptr<ASTNode> m_thenBranch;
-    std::unique_ptr<ASTNode> m_elseBranch;
+    ASTNode *m_condition;
+    ASTNode *m_thenBranch;
+    ASTNode *m_elseBranch;
 };
 
 /**
@@ -238,44 +386,66 @@ private:
 class WhileNode : public ASTNode
 {
 public:
-    WhileNode(std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> body)
-        : m_condition(std::move(condition)), m_body(std::move(body)) {}
+    static constexpr NodeKind Kind = NodeKind::While;
+
+    WhileNode(ASTNode *condition, ASTNode *body)
+        : ASTNode(Kind), m_condition(condition), m_body(body) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    ASTNode* getCondition() const { return m_condition.get(); }
-    ASTNode* getBody() const { return m_body.get(); }
+    ASTNode* getCondition() const { return m_condition; }
+    ASTNode* getBody() const { return m_body; }
 
 private:
-    std::unique_ptr<ASTNode> m_condition;
-    std::unique_ptr<ASTNode> m_body;
+    ASTNode *m_condition;
+    ASTNode *m_body;
 };
 
 /**
  * @brief For loop node
+ *
+ * Any of the three clauses may be omitted (nullptr); a missing condition loops
+ * until the body returns.
  */
 class ForNode : public ASTNode
 {
 public:
-    ForNode(std::unique_ptr<ASTNode> init, std::unique_ptr<ASTNode> condition, 
-            std::unique_ptr<ASTNode> update, std::unique_ptr<ASTNode> body)
-        : m_init(std::move(init)), m_condition(std::move(condition))
-        , m_update(std::move(update)), m_body(std::move(body)) {}
+    static constexpr NodeKind Kind = NodeKind::For;
+
+    ForNode(ASTNode *init, ASTNode *condition, 
+            ASTNode *update, ASTNode *body)
+        : ASTNode(Kind), m_init(init), m_condition(condition)
+        , m_update(update), m_body(body) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    ASTNode* getInit() const { return m_init.get(); }
-    ASTNode* getCondition() const { return m_condition.get(); }
-    ASTNode* getUpdate() const { return m_update.get(); }
-    ASTNode* getBody() const { return m_body.get(); }
+    ASTNode* getInit() const { return m_init; }
+    ASTNode* getCondition() const { return m_condition; }
+    ASTNode* getUpdate() const { return m_update; }
+    ASTNode* getBody() const { return m_body; }
+
+    /**
+     * @brief Mark the loop as a parallel for, whose iterations ParallelLoops splits across threads
+     * @param reductions Variables the iterations add to, combined when the loop ends
+     */
+    void setParallel(std::vector<std::string> reductions)
+    {
+        m_parallel = true;
+        m_reductions = std::move(reductions);
+    }
+
+    bool isParallel() const { return m_parallel; }
+    const std::vector<std::string> &getReductions() const { return m_reductions; }
 
 private:
-    std::unique_ptr<ASTNode> m_init;
-    std::unique_ptr<ASTNode> m_condition;
-    std::unique_ptr<ASTNode> m_update;
-    std::unique_ptr<ASTNode> m_body;
+    ASTNode *m_init;
+    ASTNode *m_condition;
+    ASTNode *m_update;
+    ASTNode *m_body;
+    bool m_parallel = false;
+    std::vector<std::string> m_reductions;
 };
 
 /**
@@ -284,16 +454,18 @@ private:
 class BlockNode : public ASTNode
 {
 public:
-    explicit BlockNode(std::vector<std::unique_ptr<ASTNode>> statements)
-        : m_statements(std::move(statements)) {}
+    static constexpr NodeKind Kind = NodeKind::Block;
+
+    explicit BlockNode(NodeList statements)
+        : ASTNode(Kind), m_statements(statements) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    const std::vector<std::unique_ptr<ASTNode>>& getStatements() const { return m_statements; }
+    NodeList getStatements() const { return m_statements; }
 
 private:
-    std::vector<std::unique_ptr<ASTNode>> m_statements;
+    NodeList m_statements;
 };
 
 /**
@@ -302,20 +474,35 @@ private:
 class FunctionDefNode : public ASTNode
 {
 public:
-    FunctionDefNode(const std::string &name, const std::vector<std::string> &parameters, std::unique_ptr<ASTNode> body)
-        : m_name(name), m_parameters(parameters), m_body(std::move(body)) {}
+    static constexpr NodeKind Kind = NodeKind::FunctionDef;
+
+    FunctionDefNode(const std::string &name, const std::vector<std::string> &parameters, ASTNode *body)
+        : ASTNode(Kind), m_name(name), m_parameters(parameters), m_body(body) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    std::string getName() const { return m_name; }
-    std::vector<std::string> getParameters() const { return m_parameters; }
-    ASTNode* getBody() const { return m_body.get(); }
+    const std::string &getName() const { return m_name; }
+    const std::vector<std::string> &getParameters() const { return m_parameters; }
+    ASTNode* getBody() const { return m_body; }
+
+    /**
+     * @brief Frame layout bound by the Resolver: parameters, then variables assigned in the body
+     */
+    const std::vector<std::string> &getLocals() const { return m_locals; }
+    bool isResolved() const { return m_resolved; }
+    void setLocals(std::vector<std::string> locals)
+    {
+        m_locals = std::move(locals);
+        m_resolved = true;
+    }
 
 private:
     std::string m_name;
     std::vector<std::string> m_parameters;
-    std::unique_ptr<ASTNode> m_body;
+    ASTNode *m_body;
+    std::vector<std::string> m_locals;
+    bool m_resolved = false;
 };
 
 /**
@@ -324,16 +511,18 @@ private:
 class ReturnNode : public ASTNode
 {
 public:
-    explicit ReturnNode(std::unique_ptr<ASTNode> value = nullptr)
-        : m_value(std::move(value)) {}
+    static constexpr NodeKind Kind = NodeKind::Return;
+
+    explicit ReturnNode(ASTNode *value = nullptr)
+        : ASTNode(Kind), m_value(value) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    ASTNode* getValue() const { return m_value.get(); }
+    ASTNode* getValue() const { return m_value; }
 
 private:
-    std::unique_ptr<ASTNode> m_value;
+    ASTNode *m_value;
 };
 
 
@@ -343,14 +532,32 @@ private:
 class PrintNode : public ASTNode
 {
 public:
-    explicit PrintNode(std::vector<std::unique_ptr<ASTNode>> expressions)
-        : m_expressions(std::move(expressions)) {}
+    static constexpr NodeKind Kind = NodeKind::Print;
+
+    explicit PrintNode(NodeList expressions)
+        : ASTNode(Kind), m_expressions(expressions) {}
     
     void accept(ASTVisitor *visitor) override { visitor->visit(this); }
     std::string toString() const override;
     
-    const std::vector<std::unique_ptr<ASTNode>>& getExpressions() const { return m_expressions; }
+    NodeList getExpressions() const { return m_expressions; }
 
 private:
-    std::vector<std::unique_ptr<ASTNode>> m_expressions;
-};
\ No newline at end of file
+    NodeList m_expressions;
+};
+
+/**
+ * @brief Downcast a node to one concrete node type
+ * @return The node, or nullptr if it is null or of another kind
+ */
+template <typename T>
+T *nodeCast(ASTNode *node)
+{
+    return node && node->getKind() == T::Kind ? static_cast<T *>(node) : nullptr;
+}
+
+template <typename T>
+const T *nodeCast(const ASTNode *node)
+{
+    return node && node->getKind() == T::Kind ? static_cast<const T *>(node) : nullptr;
+}
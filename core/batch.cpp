@@ -0,0 +1,478 @@
+#include "batch.h"
+#include "builtins.h"
+#include "context.h"
+#include "fastmath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+
+// Lane operations. Each kernel runs its operation over the whole chunk in one
+// loop and, if the operation can fail, flags offending lanes in a second loop
+// using the same conditions as the scalar implementation.
+
+template <typename F>
+void unaryKernel(const BatchLanes &lanes, size_t count)
+{
+    F f;
+    for (size_t i = 0; i < count; ++i) {
+        lanes.out[i] = f(lanes.a[i]);
+    }
+}
+
+template <typename F>
+void binaryKernel(const BatchLanes &lanes, size_t count)
+{
+    F f;
+    for (size_t i = 0; i < count; ++i) {
+        lanes.out[i] = f(lanes.a[i], lanes.b[i]);
+    }
+}
+
+template <typename F, typename Fails>
+void checkedUnaryKernel(const BatchLanes &lanes, size_t count)
+{
+    unaryKernel<F>(lanes, count);
+    Fails fails;
+    for (size_t i = 0; i < count; ++i) {
+        lanes.failed[i] |= fails(lanes.a[i]);
+    }
+}
+
+template <typename F, typename Fails>
+void checkedBinaryKernel(const BatchLanes &lanes, size_t count)
+{
+    binaryKernel<F>(lanes, count);
+    Fails fails;
+    for (size_t i = 0; i < count; ++i) {
+        lanes.failed[i] |= fails(lanes.a[i], lanes.b[i]);
+    }
+}
+
+// Fast-math kernels handle most arguments; lanes outside InRange are redone with the exact function
+template <typename F, typename InRange, typename Exact>
+void rangedUnaryKernel(const BatchLanes &lanes, size_t count)
+{
+    unaryKernel<F>(lanes, count);
+    InRange inRange;
+    Exact exact;
+    for (size_t i = 0; i < count; ++i) {
+        if (!inRange(lanes.a[i])) {
+            lanes.out[i] = exact(lanes.a[i]);
+        }
+    }
+}
+
+template <typename F, typename InRange, typename Exact>
+void rangedBinaryKernel(const BatchLanes &lanes, size_t count)
+{
+    binaryKernel<F>(lanes, count);
+    InRange inRange;
+    Exact exact;
+    for (size_t i = 0; i < count; ++i) {
+        if (!inRange(lanes.a[i], lanes.b[i])) {
+            lanes.out[i] = exact(lanes.a[i], lanes.b[i]);
+        }
+    }
+}
+
+void copyKernel(const BatchLanes &lanes, size_t count)
+{
+    std::memcpy(lanes.out, lanes.a, count * sizeof(double));
+}
+
+// Operators
+struct Add { double operator()(double a, double b) const { return a + b; } };
+struct Subtract { double operator()(double a, double b) const { return a - b; } };
+struct Multiply { double operator()(double a, double b) const { return a * b; } };
+struct Divide { double operator()(double a, double b) const { return a / b; } };
+struct Power { double operator()(double a, double b) const { return std::pow(a, b); } };
+struct Modulo { double operator()(double a, double b) const { return std::fmod(a, b); } };
+struct IntegerDivide { double operator()(double a, double b) const { return std::trunc(a / b); } };
+struct Equal { double operator()(double a, double b) const { return a == b ? 1.0 : 0.0; } };
+struct NotEqual { double operator()(double a, double b) const { return a != b ? 1.0 : 0.0; } };
+struct Less { double operator()(double a, double b) const { return a < b ? 1.0 : 0.0; } };
+struct Greater { double operator()(double a, double b) const { return a > b ? 1.0 : 0.0; } };
+struct LessEqual { double operator()(double a, double b) const { return a <= b ? 1.0 : 0.0; } };
+struct GreaterEqual { double operator()(double a, double b) const { return a >= b ? 1.0 : 0.0; } };
+struct Negate { double operator()(double a) const { return -a; } };
+struct Not { double operator()(double a) const { return a == 0.0 ? 1.0 : 0.0; } };
+
+// Standard functions
+struct Sin { double operator()(double a) const { return std::sin(a); } };
+struct Cos { double operator()(double a) const { return std::cos(a); } };
+struct Tan { double operator()(double a) const { return std::tan(a); } };
+struct Asin { double operator()(double a) const { return std::asin(a); } };
+struct Acos { double operator()(double a) const { return std::acos(a); } };
+struct Atan { double operator()(double a) const { return std::atan(a); } };
+struct Log { double operator()(double a) const { return std::log(a); } };
+struct Log10 { double operator()(double a) const { return std::log10(a); } };
+struct Log2 { double operator()(double a) const { return std::log2(a); } };
+struct Exp { double operator()(double a) const { return std::exp(a); } };
+struct Sqrt { double operator()(double a) const { return std::sqrt(a); } };
+struct Cbrt { double operator()(double a) const { return std::cbrt(a); } };
+struct Root { double operator()(double n, double x) const { return std::pow(x, 1.0 / n); } };
+struct Abs { double operator()(double a) const { return std::abs(a); } };
+struct Min { double operator()(double a, double b) const { return std::min(a, b); } };
+struct Max { double operator()(double a, double b) const { return std::max(a, b); } };
+struct Ceil { double operator()(double a) const { return std::ceil(a); } };
+struct Floor { double operator()(double a) const { return std::floor(a); } };
+struct Round { double operator()(double a) const { return std::round(a); } };
+
+// Fast-math functions
+struct FastSin { double operator()(double a) const { return FastMath::sinKernel(a); } };
+struct FastCos { double operator()(double a) const { return FastMath::cosKernel(a); } };
+struct FastTan { double operator()(double a) const { return FastMath::tanKernel(a); } };
+struct FastLog { double operator()(double a) const { return FastMath::log(a); } };
+struct FastLog10 { double operator()(double a) const { return FastMath::log10(a); } };
+struct FastLog2 { double operator()(double a) const { return FastMath::log2(a); } };
+struct FastExp { double operator()(double a) const { return FastMath::exp(a); } };
+struct FastPower { double operator()(double a, double b) const { return FastMath::powKernel(a, b); } };
+struct TrigInRange { bool operator()(double a) const { return FastMath::trigInRange(a); } };
+struct PowInRange { bool operator()(double a, double b) const { return FastMath::powInRange(a, b); } };
+
+// Failure conditions, mirroring the checks of the evaluator and builtins.cpp
+struct ZeroDivisor { bool operator()(double, double b) const { return b == 0.0; } };
+struct OutsideUnitRange { bool operator()(double a) const { return a < -1.0 || a > 1.0; } };
+struct NonPositive { bool operator()(double a) const { return a <= 0; } };
+struct Negative { bool operator()(double a) const { return a < 0; } };
+struct InvalidRoot {
+    bool operator()(double n, double x) const { return n == 0 || (x < 0 && std::fmod(n, 2) == 0); }
+};
+
+struct StandardKernel {
+    const char *name;
+    size_t arguments;
+    BatchKernelFunction kernel;
+};
+
+const StandardKernel kStandardKernels[] = {
+    {"sin", 1, unaryKernel<Sin>},
+    {"cos", 1, unaryKernel<Cos>},
+    {"tan", 1, unaryKernel<Tan>},
+    {"asin", 1, checkedUnaryKernel<Asin, OutsideUnitRange>},
+    {"acos", 1, checkedUnaryKernel<Acos, OutsideUnitRange>},
+    {"atan", 1, unaryKernel<Atan>},
+    {"log", 1, checkedUnaryKernel<Log, NonPositive>},
+    {"log10", 1, checkedUnaryKernel<Log10, NonPositive>},
+    {"log2", 1, checkedUnaryKernel<Log2, NonPositive>},
+    {"ln", 1, checkedUnaryKernel<Log, NonPositive>},
+    {"exp", 1, unaryKernel<Exp>},
+    {"sqrt", 1, checkedUnaryKernel<Sqrt, Negative>},
+    {"cbrt", 1, unaryKernel<Cbrt>},
+    {"root", 2, checkedBinaryKernel<Root, InvalidRoot>},
+    {"pow", 2, binaryKernel<Power>},
+    {"abs", 1, unaryKernel<Abs>},
+    {"min", 2, binaryKernel<Min>},
+    {"max", 2, binaryKernel<Max>},
+    {"ceil", 1, unaryKernel<Ceil>},
+    {"floor", 1, unaryKernel<Floor>},
+    {"round", 1, unaryKernel<Round>},
+};
+
+const StandardKernel kFastMathKernels[] = {
+    {"sin", 1, rangedUnaryKernel<FastSin, TrigInRange, Sin>},
+    {"cos", 1, rangedUnaryKernel<FastCos, TrigInRange, Cos>},
+    {"tan", 1, rangedUnaryKernel<FastTan, TrigInRange, Tan>},
+    {"log", 1, checkedUnaryKernel<FastLog, NonPositive>},
+    {"log10", 1, checkedUnaryKernel<FastLog10, NonPositive>},
+    {"log2", 1, checkedUnaryKernel<FastLog2, NonPositive>},
+    {"ln", 1, checkedUnaryKernel<FastLog, NonPositive>},
+    {"exp", 1, unaryKernel<FastExp>},
+    {"pow", 2, rangedBinaryKernel<FastPower, PowInRange, Power>},
+};
+
+/**
+ * @brief Find the column kernel of a standard or fast-math function (null if it has none)
+ */
+BatchKernelFunction standardKernel(const BuiltinFunction *function, size_t argumentCount)
+{
+    if (function->isApproximate()) {
+        for (const StandardKernel &entry : kFastMathKernels) {
+            if (std::strcmp(entry.name, function->name) == 0) {
+                return entry.arguments == argumentCount ? entry.kernel : nullptr;
+            }
+        }
+        return nullptr;
+    }
+    // Overridden standard names are embedder functions and run lane by lane
+    if (BuiltinRegistry::standard().find(function->name) != function) {
+        return nullptr;
+    }
+    for (const StandardKernel &entry : kStandardKernels) {
+        if (std::strcmp(entry.name, function->name) == 0) {
+            // min and max of a single argument are reductions, run lane by lane
+            return entry.arguments == argumentCount ? entry.kernel : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+} // anonymous namespace
+
+BatchKernel::Result BatchKernel::run(Span<double> out) const
+{
+    const size_t rows = out.size();
+    for (const BatchColumn &column : columns) {
+        if (column.values.size() < rows) {
+            throw std::runtime_error("Column '" + column.name + "' has " + std::to_string(column.values.size()) +
+                                     " rows, expected " + std::to_string(rows));
+        }
+    }
+
+    std::vector<double> registers(static_cast<size_t>(registerCount) * ChunkSize);
+    std::vector<double> broadcast(constants.size() * ChunkSize);
+    for (size_t i = 0; i < constants.size(); ++i) {
+        std::fill_n(broadcast.data() + i * ChunkSize, ChunkSize, constants[i]);
+    }
+    std::uint8_t failed[ChunkSize];
+    std::vector<Value> arguments;
+
+    Result outcome{0, 0};
+    for (size_t start = 0; start < rows; start += ChunkSize) {
+        const size_t count = std::min(ChunkSize, rows - start);
+        std::fill_n(failed, count, std::uint8_t(0));
+
+        auto lanes = [&](const Operand &operand) -> const double * {
+            switch (operand.kind) {
+            case Operand::Register: return registers.data() + operand.index * ChunkSize;
+            case Operand::Column: return columns[operand.index].values.data() + start;
+            case Operand::Constant: return broadcast.data() + operand.index * ChunkSize;
+            }
+            return nullptr;
+        };
+
+        for (const Operation &operation : operations) {
+            double *destination = registers.data() + operation.destination * ChunkSize;
+            const Operand *inputs = operands.data() + operation.firstOperand;
+
+            if (operation.kernel) {
+                BatchLanes args{destination, lanes(inputs[0]),
+                                operation.operandCount > 1 ? lanes(inputs[1]) : nullptr, failed};
+                operation.kernel(args, count);
+                continue;
+            }
+
+            // Embedder functions only have a scalar implementation
+            arguments.resize(operation.operandCount);
+            for (size_t lane = 0; lane < count; ++lane) {
+                for (std::uint32_t i = 0; i < operation.operandCount; ++i) {
+                    arguments[i] = Value(lanes(inputs[i])[lane]);
+                }
+                try {
+                    destination[lane] = operation.native->function(Span<const Value>(arguments)).toNumber();
+                } catch (const std::exception &) {
+                    destination[lane] = 0.0;
+                    failed[lane] = 1;
+                }
+            }
+        }
+
+        const double *values = lanes(result);
+        for (size_t i = 0; i < count; ++i) {
+            out[start + i] = failed[i] ? std::numeric_limits<double>::quiet_NaN() : values[i];
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (failed[i] && outcome.failedRows++ == 0) {
+                outcome.firstFailedRow = start + i;
+            }
+        }
+    }
+    return outcome;
+}
+
+void BatchKernel::bindRow(Context &context, size_t row) const
+{
+    for (const BatchColumn &column : columns) {
+        context.setVariable(column.name, Value(column.values[row]));
+    }
+    for (const auto &variable : captured) {
+        context.setVariable(variable.first, Value(variable.second));
+    }
+}
+
+BatchCompiler::BatchCompiler()
+    : m_kernel(nullptr), m_context(nullptr), m_builtins(nullptr), m_result{BatchKernel::Operand::Constant, 0}
+{
+}
+
+std::unique_ptr<BatchKernel> BatchCompiler::compile(ASTNode *root, const std::vector<BatchColumn> &columns,
+                                                    const Context &context, const BuiltinRegistry &builtins)
+{
+    auto kernel = std::make_unique<BatchKernel>();
+    kernel->columns = columns;
+    m_kernel = kernel.get();
+    m_context = &context;
+    m_builtins = &builtins;
+
+    BatchKernel::Operand result = lower(root);
+    if (result.kind == BatchKernel::Operand::Column) {
+        // Keep the result off the caller's input so run() never aliases it
+        emit(copyKernel, nullptr, {result});
+        result = m_result;
+    }
+    kernel->result = result;
+
+    m_kernel = nullptr;
+    return kernel;
+}
+
+BatchKernel::Operand BatchCompiler::lower(ASTNode *node)
+{
+    if (!node) {
+        throw std::runtime_error("Empty expression");
+    }
+    node->accept(this);
+    return m_result;
+}
+
+BatchKernel::Operand BatchCompiler::constant(double value)
+{
+    m_kernel->constants.push_back(value);
+    return BatchKernel::Operand{BatchKernel::Operand::Constant,
+                                static_cast<std::uint32_t>(m_kernel->constants.size() - 1)};
+}
+
+void BatchCompiler::emit(BatchKernelFunction kernel, const BuiltinFunction *native,
+                         const std::vector<BatchKernel::Operand> &operands)
+{
+    BatchKernel::Operation operation;
+    operation.kernel = kernel;
+    operation.native = native;
+    operation.destination = m_kernel->registerCount++;
+    operation.firstOperand = static_cast<std::uint32_t>(m_kernel->operands.size());
+    operation.operandCount = static_cast<std::uint32_t>(operands.size());
+    m_kernel->operands.insert(m_kernel->operands.end(), operands.begin(), operands.end());
+    m_kernel->operations.push_back(operation);
+    m_result = BatchKernel::Operand{BatchKernel::Operand::Register, operation.destination};
+}
+
+void BatchCompiler::unsupported(ASTNode *node) const
+{
+    throw std::runtime_error("Not supported in batch evaluation: " + node->toString());
+}
+
+void BatchCompiler::visit(LiteralNode *node)
+{
+    Value value = node->getValue();
+    if (value.getType() != Value::Number && value.getType() != Value::Boolean) {
+        unsupported(node);
+    }
+    m_result = constant(value.toNumber());
+}
+
+void BatchCompiler::visit(IdentifierNode *node)
+{
+    const std::string &name = node->getName();
+
+    // Same precedence as the evaluator: constants, then inputs, then variables
+    if (name == "pi") {
+        m_result = constant(M_PI);
+        return;
+    }
+    if (name == "e") {
+        m_result = constant(M_E);
+        return;
+    }
+
+    const auto &columns = m_kernel->columns;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name == name) {
+            m_result = BatchKernel::Operand{BatchKernel::Operand::Column, static_cast<std::uint32_t>(i)};
+            return;
+        }
+    }
+
+    if (!m_context->hasVariable(name)) {
+        throw std::runtime_error("Undefined variable: " + name);
+    }
+    Value value = m_context->getVariable(name);
+    if (value.getType() != Value::Number && value.getType() != Value::Boolean) {
+        throw std::runtime_error("Batch evaluation needs a numeric value for variable: " + name);
+    }
+    m_kernel->captured.emplace_back(name, value.toNumber());
+    m_result = constant(value.toNumber());
+}
+
+void BatchCompiler::visit(BinaryOpNode *node)
+{
+    BatchKernelFunction kernel = nullptr;
+    switch (node->getOperator()) {
+    case BinaryOperator::Add: kernel = binaryKernel<Add>; break;
+    case BinaryOperator::Subtract: kernel = binaryKernel<Subtract>; break;
+    case BinaryOperator::Multiply: kernel = binaryKernel<Multiply>; break;
+    case BinaryOperator::Divide: kernel = checkedBinaryKernel<Divide, ZeroDivisor>; break;
+    case BinaryOperator::Power: kernel = binaryKernel<Power>; break;
+    case BinaryOperator::Mod: kernel = checkedBinaryKernel<Modulo, ZeroDivisor>; break;
+    case BinaryOperator::Div: kernel = checkedBinaryKernel<IntegerDivide, ZeroDivisor>; break;
+    case BinaryOperator::Equal: kernel = binaryKernel<Equal>; break;
+    case BinaryOperator::NotEqual: kernel = binaryKernel<NotEqual>; break;
+    case BinaryOperator::Less: kernel = binaryKernel<Less>; break;
+    case BinaryOperator::Greater: kernel = binaryKernel<Greater>; break;
+    case BinaryOperator::LessEqual: kernel = binaryKernel<LessEqual>; break;
+    case BinaryOperator::GreaterEqual: kernel = binaryKernel<GreaterEqual>; break;
+    default:
+        // Assignments, and && / || whose right side may not be evaluated
+        unsupported(node);
+    }
+
+    BatchKernel::Operand left = lower(node->getLeft());
+    BatchKernel::Operand right = lower(node->getRight());
+    emit(kernel, nullptr, {left, right});
+}
+
+void BatchCompiler::visit(UnaryOpNode *node)
+{
+    BatchKernelFunction kernel = nullptr;
+    switch (node->getOperator()) {
+    case UnaryOperator::Negate: kernel = unaryKernel<Negate>; break;
+    case UnaryOperator::Not: kernel = unaryKernel<Not>; break;
+    default:
+        unsupported(node);
+    }
+
+    BatchKernel::Operand operand = lower(node->getOperand());
+    emit(kernel, nullptr, {operand});
+}
+
+void BatchCompiler::visit(FunctionCallNode *node)
+{
+    auto *funcNode = nodeCast<IdentifierNode>(node->getFunction());
+    if (!funcNode) {
+        throw std::runtime_error("Invalid function call");
+    }
+
+    const auto &arguments = node->getArguments();
+    const BuiltinFunction *builtin = m_builtins->find(funcNode->getName());
+    if (!builtin || !builtin->accepts(arguments.size())) {
+        throw std::runtime_error("Unknown function: " + funcNode->getName() + " with " +
+                                 std::to_string(arguments.size()) + " arguments");
+    }
+    // Lanes hold numbers, not arrays
+    if (builtin->makesArray()) {
+        unsupported(node);
+    }
+    // Bound like the Resolver would, so the evaluator can replay a row
+    node->setBuiltin(builtin);
+
+    std::vector<BatchKernel::Operand> operands;
+    operands.reserve(arguments.size());
+    for (ASTNode *argument : arguments) {
+        operands.push_back(lower(argument));
+    }
+
+    BatchKernelFunction kernel = standardKernel(builtin, arguments.size());
+    emit(kernel, kernel ? nullptr : builtin, operands);
+}
+
+void BatchCompiler::visit(IfNode *node) { unsupported(node); }
+void BatchCompiler::visit(WhileNode *node) { unsupported(node); }
+void BatchCompiler::visit(ForNode *node) { unsupported(node); }
+void BatchCompiler::visit(BlockNode *node) { unsupported(node); }
+void BatchCompiler::visit(FunctionDefNode *node) { unsupported(node); }
+void BatchCompiler::visit(ReturnNode *node) { unsupported(node); }
+void BatchCompiler::visit(PrintNode *node) { unsupported(node); }
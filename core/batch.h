@@ -0,0 +1,153 @@
+#pragma once
+
+#include "ast.h"
+#include "span.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BuiltinFunction;
+class BuiltinRegistry;
+class Context;
+
+/**
+ * @brief A named column of input values for batch evaluation
+ */
+struct BatchColumn {
+    std::string name;
+    Span<const double> values;
+};
+
+/**
+ * @brief Per-chunk arguments of a batch kernel
+ *
+ * Every operand is a plain array of ChunkSize doubles (a register, a slice
+ * of an input column, or a broadcast constant), so kernels are simple loops
+ * the compiler can vectorize.
+ */
+struct BatchLanes {
+    double *out;
+    const double *a;
+    const double *b;
+    std::uint8_t *failed; // Set to 1 for lanes that would raise an error
+};
+
+using BatchKernelFunction = void (*)(const BatchLanes &lanes, size_t count);
+
+/**
+ * @brief A numeric expression lowered to column kernels
+ *
+ * Produced by BatchCompiler. Rows are processed in chunks of ChunkSize; each
+ * operation runs over the whole chunk before the next one starts, so values
+ * are never boxed into Value. Lanes whose evaluation would fail are flagged
+ * and produce NaN, the other lanes are unaffected.
+ */
+class BatchKernel
+{
+public:
+    static constexpr size_t ChunkSize = 256;
+
+    /**
+     * @brief Where an operation reads its input from
+     */
+    struct Operand {
+        enum Kind : std::uint8_t { Register, Column, Constant };
+        Kind kind;
+        std::uint32_t index;
+    };
+
+    /**
+     * @brief One operation, writing a full chunk into a register
+     */
+    struct Operation {
+        BatchKernelFunction kernel;     // Null for natives without a column kernel
+        const BuiltinFunction *native;  // Called lane by lane when kernel is null
+        std::uint32_t destination;      // Register index
+        std::uint32_t firstOperand;     // Into operands
+        std::uint32_t operandCount;
+    };
+
+    /**
+     * @brief Outcome of a run
+     */
+    struct Result {
+        size_t failedRows;
+        size_t firstFailedRow; // Only meaningful when failedRows > 0
+    };
+
+    std::vector<Operation> operations;
+    std::vector<Operand> operands;
+    std::vector<BatchColumn> columns;
+    std::vector<double> constants;
+    std::vector<std::pair<std::string, double>> captured; // Context variables folded into constants
+    std::uint32_t registerCount = 0;
+    Operand result{Operand::Constant, 0};
+
+    /**
+     * @brief Evaluate the expression for every row
+     * @param out Receives one value per row; its size is the row count
+     * @return Number of failed rows and the first of them
+     */
+    Result run(Span<double> out) const;
+
+    /**
+     * @brief Define the inputs of one row as variables
+     *
+     * Lets the reference evaluator reproduce a row exactly, e.g. to report the
+     * error of a failed lane.
+     */
+    void bindRow(Context &context, size_t row) const;
+};
+
+/**
+ * @brief Lowers a numeric expression into a BatchKernel
+ *
+ * Identifiers refer to input columns, or else to variables of the context
+ * (read once, as constants). Operators and the standard math functions map
+ * to column kernels; other native functions are called lane by lane.
+ * Anything else (assignments, control flow, short-circuit logic, strings)
+ * is rejected with std::runtime_error.
+ */
+class BatchCompiler : public ASTVisitor
+{
+public:
+    BatchCompiler();
+
+    /**
+     * @brief Compile an expression
+     * @param root Root node of the (optimized) expression
+     * @param columns Input columns, looked up by name
+     * @param context Context providing the remaining variables
+     * @param builtins Functions calls are bound against
+     * @return The compiled kernel
+     */
+    std::unique_ptr<BatchKernel> compile(ASTNode *root, const std::vector<BatchColumn> &columns,
+                                         const Context &context, const BuiltinRegistry &builtins);
+
+    // ASTVisitor interface
+    void visit(LiteralNode *node) override;
+    void visit(IdentifierNode *node) override;
+    void visit(BinaryOpNode *node) override;
+    void visit(UnaryOpNode *node) override;
+    void visit(FunctionCallNode *node) override;
+    void visit(IfNode *node) override;
+    void visit(WhileNode *node) override;
+    void visit(ForNode *node) override;
+    void visit(BlockNode *node) override;
+    void visit(FunctionDefNode *node) override;
+    void visit(ReturnNode *node) override;
+    void visit(PrintNode *node) override;
+
+private:
+    BatchKernel::Operand lower(ASTNode *node);
+    BatchKernel::Operand constant(double value);
+    void emit(BatchKernelFunction kernel, const BuiltinFunction *native,
+              const std::vector<BatchKernel::Operand> &operands);
+    [[noreturn]] void unsupported(ASTNode *node) const;
+
+    BatchKernel *m_kernel;
+    const Context *m_context;
+    const BuiltinRegistry *m_builtins;
+    BatchKernel::Operand m_result;
+};
@@ -0,0 +1,105 @@
+#include "budget.h"
+#include "context.h"
+#include <algorithm>
+
+namespace
+{
+
+// Estimating memory walks every variable, so it is done on every 16th check only
+constexpr std::uint32_t MemoryCheckInterval = 16;
+
+const ExecutionLimits Unlimited;
+
+} // anonymous namespace
+
+ExecutionBudget::ExecutionBudget()
+    : m_limits(&Unlimited), m_cancel(nullptr), m_context(nullptr), m_steps(0), m_interval(CheckInterval),
+      m_countdown(CheckInterval), m_checks(0), m_exhausted(false), m_failure(ExecutionInterrupted::Stopped)
+{
+}
+
+void ExecutionBudget::begin(const ExecutionLimits &limits, const CancelToken *cancel, const Context *context)
+{
+    m_limits = &limits;
+    m_cancel = cancel;
+    m_context = context;
+    m_steps = 0;
+    m_checks = 0;
+    m_exhausted = false;
+    if (limits.maxTime.count() > 0) {
+        m_deadline = Clock::now() + limits.maxTime;
+    }
+    scheduleNextCheck();
+}
+
+void ExecutionBudget::beginPart(const ExecutionBudget &parent, const Context *context)
+{
+    m_limits = parent.m_limits;
+    m_cancel = parent.m_cancel;
+    m_context = context;
+    m_steps = parent.steps();
+    m_checks = 0;
+    m_exhausted = false;
+    m_deadline = parent.m_deadline;
+    scheduleNextCheck();
+}
+
+void ExecutionBudget::addSteps(std::uint64_t steps)
+{
+    m_steps = this->steps() + steps;
+    scheduleNextCheck();
+}
+
+void ExecutionBudget::scheduleNextCheck()
+{
+    // The check after the last allowed step is the one that fails
+    m_interval = CheckInterval;
+    if (m_limits->maxSteps > 0) {
+        m_interval = static_cast<std::uint32_t>(
+            std::min<std::uint64_t>(CheckInterval, m_limits->maxSteps + 1 - std::min(m_steps, m_limits->maxSteps)));
+    }
+    m_countdown = m_interval;
+}
+
+void ExecutionBudget::check()
+{
+    m_steps += m_interval;
+    // Every step checks until the next interval is scheduled, and for good after a failure
+    m_interval = 1;
+    m_countdown = 1;
+    if (m_cancel && m_cancel->isCancelled()) {
+        throw ExecutionInterrupted(ExecutionInterrupted::Stopped, "Execution stopped");
+    }
+    if (m_exhausted) {
+        throw ExecutionInterrupted(m_failure, m_failureMessage);
+    }
+    if (m_limits->maxSteps > 0 && m_steps > m_limits->maxSteps) {
+        fail(ExecutionInterrupted::StepLimit,
+             "Step limit exceeded (" + std::to_string(m_limits->maxSteps) + " steps)");
+    }
+    if (m_limits->maxTime.count() > 0 && Clock::now() >= m_deadline) {
+        fail(ExecutionInterrupted::TimeLimit,
+             "Time limit exceeded (" + std::to_string(m_limits->maxTime.count()) + " ms)");
+    }
+    if (m_limits->maxMemory > 0 && m_context && ++m_checks % MemoryCheckInterval == 0 &&
+        m_context->memoryUsage() > m_limits->maxMemory) {
+        memoryExceeded();
+    }
+    scheduleNextCheck();
+}
+
+void ExecutionBudget::memoryExceeded()
+{
+    fail(ExecutionInterrupted::MemoryLimit,
+         "Memory limit exceeded (" + std::to_string(m_limits->maxMemory) + " bytes)");
+}
+
+void ExecutionBudget::fail(ExecutionInterrupted::Reason reason, const std::string &message)
+{
+    m_exhausted = true;
+    m_failure = reason;
+    m_failureMessage = message;
+    m_interval = 1;
+    m_countdown = 1;
+    throw ExecutionInterrupted(reason, message);
+}
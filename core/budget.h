@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+class Context;
+
+/**
+ * @brief Resources one execution may use; zero means unlimited
+ */
+struct ExecutionLimits {
+    std::uint64_t maxSteps = 0;           // Loop iterations plus user function calls
+    std::chrono::milliseconds maxTime{0}; // Wall-clock time
+    size_t maxCallDepth = 0;              // Nested user function calls (never above Interpreter::setMaxCallDepth())
+    size_t maxMemory = 0;                 // Bytes held by variables (estimated), and by any single string or array
+
+    /// True if steps, time or memory are limited (those are metered while running)
+    bool isMetered() const { return maxSteps > 0 || maxTime.count() > 0 || maxMemory > 0; }
+};
+
+/**
+ * @brief Flag that asks a running execution to stop
+ *
+ * cancel() may be called from any thread, and from a signal handler: it is a
+ * single lock-free store.
+ */
+class CancelToken
+{
+public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    void reset() { m_cancelled.store(false, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    /// The flag itself, for native code that polls it
+    const std::atomic<bool> &flag() const { return m_cancelled; }
+
+private:
+    std::atomic<bool> m_cancelled{false};
+};
+
+/**
+ * @brief Error raised when an execution is stopped or runs out of a limit
+ *
+ * Thrown from loop back-edges and calls, so the engines unwind the frames of
+ * the calls in progress like on any other error.
+ */
+class ExecutionInterrupted : public std::runtime_error
+{
+public:
+    enum Reason { Stopped, StepLimit, TimeLimit, CallDepthLimit, MemoryLimit };
+
+    ExecutionInterrupted(Reason reason, const std::string &message) : std::runtime_error(message), m_reason(reason) {}
+
+    Reason reason() const { return m_reason; }
+
+private:
+    Reason m_reason;
+};
+
+/**
+ * @brief Meters one execution against its limits and cancel token
+ *
+ * The engines call step() at every loop back-edge and call. It only
+ * decrements a counter; every CheckInterval steps (or exactly at the step
+ * limit) the slow path checks the token, the clock and the memory estimate.
+ * Once a limit has run out, every further step fails the same way until the
+ * next begin().
+ */
+class ExecutionBudget
+{
+public:
+    /// Steps between checks of the token, the clock and memory
+    static constexpr std::uint32_t CheckInterval = 1024;
+
+    ExecutionBudget();
+
+    /**
+     * @brief Start metering: reset the step count and the clock
+     * @param limits Limits of this execution (kept by reference; must stay unchanged while running)
+     * @param cancel Token to poll (may be nullptr)
+     * @param context Context whose memory use is estimated for limits.maxMemory
+     */
+    void begin(const ExecutionLimits &limits, const CancelToken *cancel, const Context *context);
+
+    /**
+     * @brief Count one loop iteration or call
+     * @throws ExecutionInterrupted if the token was cancelled or a limit ran out
+     */
+    void step()
+    {
+        if (--m_countdown == 0) {
+            check();
+        }
+    }
+
+    /**
+     * @brief Check a string that was just built against the memory limit
+     * @throws ExecutionInterrupted if it alone exceeds the limit
+     */
+    void checkString(size_t length)
+    {
+        if (m_limits->maxMemory > 0 && length > m_limits->maxMemory) {
+            memoryExceeded();
+        }
+    }
+
+    /**
+     * @brief Check an array that was just built against the memory limit
+     * @param length Number of elements (8 bytes each)
+     * @throws ExecutionInterrupted if it alone exceeds the limit
+     */
+    void checkArray(size_t length)
+    {
+        if (m_limits->maxMemory > 0 && length > m_limits->maxMemory / sizeof(double)) {
+            memoryExceeded();
+        }
+    }
+
+    /**
+     * @brief Steps counted since begin()
+     */
+    std::uint64_t steps() const { return m_steps + (m_interval - m_countdown); }
+
+    /**
+     * @brief Check whether a limit ran out since begin()
+     */
+    bool isExhausted() const { return m_exhausted; }
+
+    /**
+     * @brief Start metering work that an execution handed to another thread
+     *
+     * Uses the limits, token and deadline of @p parent, which must not run
+     * meanwhile, and starts from the steps it has taken, so the part may take
+     * the steps the parent had left. Memory is estimated for @p context.
+     */
+    void beginPart(const ExecutionBudget &parent, const Context *context);
+
+    /**
+     * @brief Count steps taken by parts begun from this budget
+     *
+     * A step limit they exceeded together fails the next step().
+     */
+    void addSteps(std::uint64_t steps);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void check();
+    void scheduleNextCheck();
+    [[noreturn]] void memoryExceeded();
+    [[noreturn]] void fail(ExecutionInterrupted::Reason reason, const std::string &message);
+
+    const ExecutionLimits *m_limits;
+    const CancelToken *m_cancel;
+    const Context *m_context;
+    std::uint64_t m_steps;     // Steps of the intervals already checked
+    std::uint32_t m_interval;  // Length of the current interval
+    std::uint32_t m_countdown; // Steps left in it
+    std::uint32_t m_checks;
+    Clock::time_point m_deadline;
+    bool m_exhausted;
+    ExecutionInterrupted::Reason m_failure;
+    std::string m_failureMessage;
+};
@@ -0,0 +1,407 @@
+#include "builtins.h"
+#include "arrayops.h"
+#include "fastmath.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+
+// Scalar implementations; the builtins apply them to every element of an array argument
+double sinOf(double x) { return std::sin(x); }
+double cosOf(double x) { return std::cos(x); }
+double tanOf(double x) { return std::tan(x); }
+
+double asinOf(double val)
+{
+    if (val < -1.0 || val > 1.0) {
+        throw std::runtime_error("Arcsine of value outside [-1, 1]");
+    }
+    return std::asin(val);
+}
+
+double acosOf(double val)
+{
+    if (val < -1.0 || val > 1.0) {
+        throw std::runtime_error("Arccosine of value outside [-1, 1]");
+    }
+    return std::acos(val);
+}
+
+double atanOf(double x) { return std::atan(x); }
+
+// Logarithms of non-positive numbers fail in both precision modes
+double positive(double val, const char *function)
+{
+    if (val <= 0) {
+        throw std::runtime_error(std::string(function) + " of non-positive number");
+    }
+    return val;
+}
+
+double logOf(double val) { return std::log(positive(val, "Logarithm")); }
+double log10Of(double val) { return std::log10(positive(val, "Log10")); }
+double log2Of(double val) { return std::log2(positive(val, "Log2")); }
+double expOf(double x) { return std::exp(x); }
+
+double sqrtOf(double val)
+{
+    if (val < 0) {
+        throw std::runtime_error("Square root of negative number");
+    }
+    return std::sqrt(val);
+}
+
+// Cube root (alternative to root(3, x))
+double cbrtOf(double x) { return std::cbrt(x); }
+
+double rootOf(double n, double x)
+{
+    // n is the root degree (2 for square root, 3 for cube root, etc.)
+    if (n == 0) {
+        throw std::runtime_error("Root degree cannot be zero");
+    }
+    if (x < 0 && std::fmod(n, 2) == 0) {
+        throw std::runtime_error("Even root of negative number");
+    }
+
+    // nth root of x = x^(1/n)
+    return std::pow(x, 1.0 / n);
+}
+
+double powOf(double x, double y) { return std::pow(x, y); }
+
+// Fast-math versions
+double fastSinOf(double x) { return FastMath::sin(x); }
+double fastCosOf(double x) { return FastMath::cos(x); }
+double fastTanOf(double x) { return FastMath::tan(x); }
+double fastLog10Of(double val) { return FastMath::log10(positive(val, "Log10")); }
+
+double absOf(double x) { return std::abs(x); }
+double minOf(double x, double y) { return std::min(x, y); }
+double maxOf(double x, double y) { return std::max(x, y); }
+double ceilOf(double x) { return std::ceil(x); }
+double floorOf(double x) { return std::floor(x); }
+double roundOf(double x) { return std::round(x); }
+
+template <double (*Function)(double)>
+Value unary(Span<const Value> args)
+{
+    return args[0].isArray() ? mapElements(args[0], Function) : Value(Function(args[0].toNumber()));
+}
+
+template <double (*Function)(double, double)>
+Value binary(Span<const Value> args)
+{
+    if (args[0].isArray() || args[1].isArray()) {
+        return combineElements(args[0], args[1], Function);
+    }
+    return Value(Function(args[0].toNumber(), args[1].toNumber()));
+}
+
+// Arrays never get longer than this (2 GiB of elements), so a mistyped range fails instead of exhausting memory
+constexpr size_t kMaxArrayLength = size_t(1) << 28;
+
+const std::vector<double> &arrayArgument(const Value &value, const char *function)
+{
+    if (!value.isArray()) {
+        throw std::runtime_error(std::string(function) + " needs an array");
+    }
+    return value.asArray();
+}
+
+// Array functions
+Value builtinArray(Span<const Value> args)
+{
+    // Array arguments are spliced in, so [a, x] appends to a
+    size_t count = 0;
+    for (const Value &arg : args) {
+        count += arg.isArray() ? arg.asArray().size() : 1;
+    }
+    std::vector<double> elements;
+    elements.reserve(count);
+    for (const Value &arg : args) {
+        if (arg.isArray()) {
+            elements.insert(elements.end(), arg.asArray().begin(), arg.asArray().end());
+        } else if (arg.getType() == Value::Number || arg.getType() == Value::Boolean) {
+            elements.push_back(arg.toNumber());
+        } else {
+            throw std::runtime_error("Array elements must be numbers");
+        }
+    }
+    return Value(std::move(elements));
+}
+
+Value builtinAt(Span<const Value> args)
+{
+    const std::vector<double> &elements = arrayArgument(args[0], "Indexing");
+    double index = args[1].toNumber();
+    if (index != std::trunc(index)) {
+        throw std::runtime_error("Array index must be a whole number");
+    }
+    if (!(index >= 0 && index < static_cast<double>(elements.size()))) {
+        throw std::runtime_error("Array index out of range: " + args[1].toString() + " (length " +
+                                 std::to_string(elements.size()) + ")");
+    }
+    return Value(elements[static_cast<size_t>(index)]);
+}
+
+Value builtinLen(Span<const Value> args)
+{
+    return Value(static_cast<double>(arrayArgument(args[0], "len").size()));
+}
+
+Value builtinRange(Span<const Value> args)
+{
+    // range(n) counts 0 to n - 1; range(start, stop[, step]) stops before stop, like a for loop
+    double start = args.size() > 1 ? args[0].toNumber() : 0.0;
+    double stop = args.size() > 1 ? args[1].toNumber() : args[0].toNumber();
+    double step = args.size() > 2 ? args[2].toNumber() : 1.0;
+    if (step == 0.0 || std::isnan(step)) {
+        throw std::runtime_error("Range step cannot be zero");
+    }
+    double steps = std::ceil((stop - start) / step);
+    if (!(steps <= static_cast<double>(kMaxArrayLength))) {
+        throw std::runtime_error("Range too long");
+    }
+    std::vector<double> elements(steps > 0 ? static_cast<size_t>(steps) : 0);
+    for (size_t i = 0; i < elements.size(); ++i) {
+        elements[i] = start + static_cast<double>(i) * step;
+    }
+    return Value(std::move(elements));
+}
+
+// Reductions; a number argument is treated as an array of one element
+Value builtinSum(Span<const Value> args)
+{
+    if (!args[0].isArray()) {
+        return Value(args[0].toNumber());
+    }
+    const std::vector<double> &elements = args[0].asArray();
+    return Value(ArrayKernels::sum(elements.data(), elements.size()));
+}
+
+Value builtinMean(Span<const Value> args)
+{
+    if (!args[0].isArray()) {
+        return Value(args[0].toNumber());
+    }
+    const std::vector<double> &elements = args[0].asArray();
+    if (elements.empty()) {
+        throw std::runtime_error("Mean of an empty array");
+    }
+    return Value(ArrayKernels::sum(elements.data(), elements.size()) / static_cast<double>(elements.size()));
+}
+
+Value builtinDot(Span<const Value> args)
+{
+    const std::vector<double> &left = arrayArgument(args[0], "dot");
+    const std::vector<double> &right = arrayArgument(args[1], "dot");
+    if (left.size() != right.size()) {
+        throw std::runtime_error("Arrays of different lengths: " + std::to_string(left.size()) + " and " +
+                                 std::to_string(right.size()));
+    }
+    return Value(ArrayKernels::dot(left.data(), right.data(), left.size()));
+}
+
+Value builtinNorm(Span<const Value> args)
+{
+    if (!args[0].isArray()) {
+        return Value(std::abs(args[0].toNumber()));
+    }
+    const std::vector<double> &elements = args[0].asArray();
+    return Value(std::sqrt(ArrayKernels::dot(elements.data(), elements.data(), elements.size())));
+}
+
+// min and max reduce a single array and compare two values (element-wise for arrays)
+template <double (*Reduce)(const double *, size_t), double (*Function)(double, double)>
+Value extremum(Span<const Value> args)
+{
+    if (args.size() == 2) {
+        return binary<Function>(args);
+    }
+    if (!args[0].isArray()) {
+        return Value(args[0].toNumber());
+    }
+    const std::vector<double> &elements = args[0].asArray();
+    if (elements.empty()) {
+        throw std::runtime_error("Extremum of an empty array");
+    }
+    return Value(Reduce(elements.data(), elements.size()));
+}
+
+constexpr std::uint8_t Pure = BuiltinFunction::Pure;
+constexpr std::uint8_t NoThrow = BuiltinFunction::NoThrow;
+constexpr std::uint8_t MakesArray = BuiltinFunction::MakesArray;
+constexpr std::uint8_t Approximate = BuiltinFunction::Approximate;
+
+/**
+ * @brief The standard function table, in the order Interpreter advertises it
+ */
+constexpr BuiltinFunction kStandardFunctions[] = {
+    // Trigonometric functions
+    {"sin", 1, 1, unary<sinOf>, Pure | NoThrow},
+    {"cos", 1, 1, unary<cosOf>, Pure | NoThrow},
+    {"tan", 1, 1, unary<tanOf>, Pure | NoThrow},
+    {"asin", 1, 1, unary<asinOf>, Pure},
+    {"acos", 1, 1, unary<acosOf>, Pure},
+    {"atan", 1, 1, unary<atanOf>, Pure | NoThrow},
+
+    // Logarithmic functions
+    {"log", 1, 1, unary<logOf>, Pure},
+    {"log10", 1, 1, unary<log10Of>, Pure},
+    {"log2", 1, 1, unary<log2Of>, Pure},
+    {"ln", 1, 1, unary<logOf>, Pure},
+    {"exp", 1, 1, unary<expOf>, Pure | NoThrow},
+
+    // Root functions
+    {"sqrt", 1, 1, unary<sqrtOf>, Pure},
+    {"cbrt", 1, 1, unary<cbrtOf>, Pure | NoThrow},
+    {"root", 2, 2, binary<rootOf>, Pure},
+
+    // Power and exponential
+    {"pow", 2, 2, binary<powOf>, Pure | NoThrow},
+    {"abs", 1, 1, unary<absOf>, Pure | NoThrow},
+
+    // Utility functions
+    {"min", 1, 2, extremum<ArrayKernels::minimum, minOf>, Pure | NoThrow},
+    {"max", 1, 2, extremum<ArrayKernels::maximum, maxOf>, Pure | NoThrow},
+    {"ceil", 1, 1, unary<ceilOf>, Pure | NoThrow},
+    {"floor", 1, 1, unary<floorOf>, Pure | NoThrow},
+    {"round", 1, 1, unary<roundOf>, Pure | NoThrow},
+
+    // Arrays ([a, b, c] calls array, a[i] calls at)
+    {"array", 0, 255, builtinArray, Pure | MakesArray},
+    {"at", 2, 2, builtinAt, Pure},
+    {"len", 1, 1, builtinLen, Pure},
+    {"range", 1, 3, builtinRange, Pure | MakesArray},
+    {"sum", 1, 1, builtinSum, Pure | NoThrow},
+    {"mean", 1, 1, builtinMean, Pure},
+    {"dot", 2, 2, builtinDot, Pure},
+    {"norm", 1, 1, builtinNorm, Pure | NoThrow},
+};
+
+/**
+ * @brief Replacements for standard functions in fast-math mode, with the same arities and checks
+ *
+ * One value at a time, glibc's table-driven exp, log, log2 and pow beat the
+ * kernels (glossai_bench --filter math/), so those entries keep libm and
+ * only select the kernels of batches.
+ */
+constexpr BuiltinFunction kFastMathFunctions[] = {
+    {"sin", 1, 1, unary<fastSinOf>, Pure | NoThrow | Approximate},
+    {"cos", 1, 1, unary<fastCosOf>, Pure | NoThrow | Approximate},
+    {"tan", 1, 1, unary<fastTanOf>, Pure | NoThrow | Approximate},
+    {"log", 1, 1, unary<logOf>, Pure | Approximate},
+    {"log10", 1, 1, unary<fastLog10Of>, Pure | Approximate},
+    {"log2", 1, 1, unary<log2Of>, Pure | Approximate},
+    {"ln", 1, 1, unary<logOf>, Pure | Approximate},
+    {"exp", 1, 1, unary<expOf>, Pure | NoThrow | Approximate},
+    {"pow", 2, 2, binary<powOf>, Pure | NoThrow | Approximate},
+};
+
+using FunctionIndex = std::unordered_map<std::string, const BuiltinFunction *>;
+
+template <size_t N>
+FunctionIndex indexTable(const BuiltinFunction (&functions)[N])
+{
+    FunctionIndex table;
+    for (const BuiltinFunction &function : functions) {
+        table.emplace(function.name, &function);
+    }
+    return table;
+}
+
+const BuiltinFunction *findIn(const FunctionIndex &index, const std::string &name)
+{
+    auto it = index.find(name);
+    return it != index.end() ? it->second : nullptr;
+}
+
+const BuiltinFunction *findStandard(const std::string &name)
+{
+    static const FunctionIndex index = indexTable(kStandardFunctions);
+    return findIn(index, name);
+}
+
+const BuiltinFunction *findFastMath(const std::string &name)
+{
+    static const FunctionIndex index = indexTable(kFastMathFunctions);
+    return findIn(index, name);
+}
+
+} // anonymous namespace
+
+BuiltinRegistry::BuiltinRegistry() = default;
+
+BuiltinRegistry::BuiltinRegistry(const BuiltinRegistry &other) : m_fastMath(other.m_fastMath)
+{
+    // Entries are re-registered so that the index points into this registry
+    for (const BuiltinFunction &function : other.m_custom) {
+        registerFunction(function.name, function.minArgs, function.maxArgs, function.function, function.flags);
+    }
+}
+
+const BuiltinRegistry &BuiltinRegistry::standard()
+{
+    static const BuiltinRegistry registry;
+    return registry;
+}
+
+const BuiltinFunction *BuiltinRegistry::find(const std::string &name) const
+{
+    // Embedder functions take precedence so they can override the standard library
+    auto it = m_customIndex.find(name);
+    if (it != m_customIndex.end()) {
+        return it->second;
+    }
+    if (m_fastMath) {
+        if (const BuiltinFunction *function = findFastMath(name)) {
+            return function;
+        }
+    }
+    return findStandard(name);
+}
+
+const BuiltinFunction *BuiltinRegistry::registerFunction(const std::string &name, int minArgs, int maxArgs,
+                                                         NativeFunction function, std::uint8_t flags)
+{
+    if (name.empty() || !function) {
+        throw std::invalid_argument("A native function needs a name and an implementation");
+    }
+    if (minArgs < 0 || maxArgs < minArgs || maxArgs > 255) {
+        throw std::invalid_argument("Invalid arity range for native function: " + name);
+    }
+
+    auto it = m_customIndex.find(name);
+    if (it != m_customIndex.end()) {
+        // Update in place so calls that are already bound see the new definition
+        auto *entry = const_cast<BuiltinFunction *>(it->second);
+        entry->minArgs = static_cast<std::uint8_t>(minArgs);
+        entry->maxArgs = static_cast<std::uint8_t>(maxArgs);
+        entry->function = function;
+        entry->flags = flags;
+        return entry;
+    }
+
+    m_customNames.push_back(name);
+    m_custom.push_back(BuiltinFunction{m_customNames.back().c_str(), static_cast<std::uint8_t>(minArgs),
+                                       static_cast<std::uint8_t>(maxArgs), function, flags});
+    m_customIndex.emplace(name, &m_custom.back());
+    return &m_custom.back();
+}
+
+std::vector<std::string> BuiltinRegistry::names() const
+{
+    std::vector<std::string> result;
+    for (const BuiltinFunction &function : kStandardFunctions) {
+        result.push_back(function.name);
+    }
+    for (const std::string &name : m_customNames) {
+        if (!findStandard(name)) {
+            result.push_back(name);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ast.h"
+#include "span.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Signature of a native function callable from GlossAI code
+ *
+ * Arguments are passed as a view over already evaluated values (on the VM
+ * stack, or in a small fixed buffer in the evaluator), so calls never
+ * allocate. Errors are reported by throwing std::runtime_error.
+ */
+using NativeFunction = Value (*)(Span<const Value> args);
+
+/**
+ * @brief A named native function with its accepted arity range
+ */
+struct BuiltinFunction {
+    /**
+     * @brief Properties the optimizer may rely on
+     */
+    enum Flags : std::uint8_t {
+        Pure = 1 << 0,   // Result depends only on the arguments, no side effects
+        NoThrow = 1 << 1,    // Never fails, whatever the number arguments (arrays may still not match)
+        MakesArray = 1 << 2, // May return an array even when no argument is one
+        Approximate = 1 << 3 // Fast-math entry of a standard function: batches use the fastmath.h kernel,
+                             // single calls the kernel or libm, whichever is faster; registry entries only
+    };
+
+    const char *name;
+    std::uint8_t minArgs;
+    std::uint8_t maxArgs;
+    NativeFunction function;
+    std::uint8_t flags;
+
+    bool accepts(size_t argumentCount) const
+    {
+        return argumentCount >= minArgs && argumentCount <= maxArgs;
+    }
+
+    bool isPure() const { return flags & Pure; }
+    bool isNoThrow() const { return flags & NoThrow; }
+    bool makesArray() const { return flags & MakesArray; }
+    bool isApproximate() const { return flags & Approximate; }
+};
+
+/**
+ * @brief Table of native functions available to a program
+ *
+ * The standard math library is a static table shared by every registry.
+ * Embedders can register additional functions (or override standard ones);
+ * calls are bound to a BuiltinFunction once when the program is resolved,
+ * so the name lookup never happens on the call path. Entries are never
+ * moved, so bound pointers stay valid for the lifetime of the registry.
+ *
+ * In fast-math mode, sin, cos, tan, exp, log, ln, log2, log10 and pow are
+ * found in a second static table of polynomial approximations (see
+ * fastmath.h for their error bounds). They accept and reject the same
+ * arguments as the standard functions.
+ */
+class BuiltinRegistry
+{
+public:
+    BuiltinRegistry();
+
+    /**
+     * @brief Copy the registered functions and the precision mode; calls bound to other's entries are not affected
+     */
+    BuiltinRegistry(const BuiltinRegistry &other);
+    BuiltinRegistry &operator=(const BuiltinRegistry &) = delete;
+
+    /**
+     * @brief Get the shared registry holding only the standard functions
+     */
+    static const BuiltinRegistry &standard();
+
+    /**
+     * @brief Find a function by name
+     * @param name Function name
+     * @return The function, or nullptr if unknown
+     */
+    const BuiltinFunction *find(const std::string &name) const;
+
+    /**
+     * @brief Register (or replace) a native function
+     * @param name Function name
+     * @param minArgs Minimum number of arguments
+     * @param maxArgs Maximum number of arguments
+     * @param function Implementation
+     * @param flags Combination of BuiltinFunction::Flags
+     * @return The registered entry
+     */
+    const BuiltinFunction *registerFunction(const std::string &name, int minArgs, int maxArgs,
+                                            NativeFunction function, std::uint8_t flags = 0);
+
+    /**
+     * @brief Get the names of all available functions, standard ones first
+     */
+    std::vector<std::string> names() const;
+
+    /**
+     * @brief Select the fast-math approximations of the standard functions that have one
+     *
+     * Only affects later lookups: calls that are already bound keep their function.
+     * Registered functions still take precedence.
+     */
+    void setFastMath(bool enabled) { m_fastMath = enabled; }
+
+    bool isFastMath() const { return m_fastMath; }
+
+private:
+    bool m_fastMath = false;
+    std::deque<BuiltinFunction> m_custom;
+    std::deque<std::string> m_customNames;
+    std::unordered_map<std::string, const BuiltinFunction *> m_customIndex;
+};
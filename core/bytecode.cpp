@@ -0,0 +1,150 @@
+#include "bytecode.h"
+#include <algorithm>
+
+size_t Chunk::emit(OpCode op, std::uint32_t operand, std::uint16_t count)
+{
+    code.emplace_back(op, operand, count);
+    return code.size() - 1;
+}
+
+std::uint32_t Chunk::addConstant(const Value &value)
+{
+    constants.push_back(value);
+    return static_cast<std::uint32_t>(constants.size() - 1);
+}
+
+std::uint32_t Chunk::addNative(const BuiltinFunction *function)
+{
+    auto it = std::find(natives.begin(), natives.end(), function);
+    if (it != natives.end()) {
+        return static_cast<std::uint32_t>(it - natives.begin());
+    }
+    natives.push_back(function);
+    return static_cast<std::uint32_t>(natives.size() - 1);
+}
+
+std::uint32_t Chunk::addName(const std::string &name)
+{
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end()) {
+        return static_cast<std::uint32_t>(it - names.begin());
+    }
+    names.push_back(name);
+    return static_cast<std::uint32_t>(names.size() - 1);
+}
+
+void Chunk::markPosition(const ASTNode *node)
+{
+    if (node->getLine() > 0) {
+        positions.push_back(SourcePosition{static_cast<std::uint32_t>(code.size()), node->getLine(),
+                                           node->getColumn()});
+    }
+}
+
+SourcePosition Chunk::positionOf(size_t instruction) const
+{
+    auto before = [](const SourcePosition &position, size_t index) { return position.instruction < index; };
+    auto it = std::lower_bound(positions.begin(), positions.end(), instruction, before);
+    if (it != positions.end() && it->instruction == instruction) {
+        return *it;
+    }
+    return SourcePosition{static_cast<std::uint32_t>(instruction), 0, 0};
+}
+
+std::string Chunk::disassemble() const
+{
+    std::string result;
+    for (size_t i = 0; i < code.size(); ++i) {
+        const Instruction &inst = code[i];
+        result += std::to_string(i) + "\t" + opCodeName(inst.op);
+
+        switch (inst.op) {
+        case OpCode::PushConstant:
+        case OpCode::Fail:
+            result += " " + constants[inst.operand].toString();
+            break;
+        case OpCode::LoadVariable:
+        case OpCode::StoreVariable:
+        case OpCode::AddAssign:
+        case OpCode::SubtractAssign:
+        case OpCode::MultiplyAssign:
+        case OpCode::DivideAssign:
+        case OpCode::Increment:
+        case OpCode::Decrement:
+        case OpCode::PostIncrement:
+        case OpCode::PostDecrement:
+            result += " [" + std::to_string(inst.count) + ":" + std::to_string(inst.operand) + "]";
+            break;
+        case OpCode::CallBuiltin:
+            result += std::string(" ") + natives[inst.operand]->name + "/" + std::to_string(inst.count);
+            break;
+        case OpCode::CallFunction:
+            result += " " + names[inst.operand] + "/" + std::to_string(inst.count);
+            break;
+        case OpCode::DefineFunction:
+            result += " " + functions[inst.operand]->getName();
+            break;
+        case OpCode::ParallelFor:
+            result += " " + std::to_string(inst.operand);
+            break;
+        case OpCode::Jump:
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfTrue:
+        case OpCode::Print:
+            result += " " + std::to_string(inst.operand);
+            break;
+        default:
+            break;
+        }
+        result += "\n";
+    }
+    return result;
+}
+
+const char *opCodeName(OpCode op)
+{
+    switch (op) {
+    case OpCode::PushConstant: return "PUSH_CONST";
+    case OpCode::PushNull: return "PUSH_NULL";
+    case OpCode::PushTrue: return "PUSH_TRUE";
+    case OpCode::PushFalse: return "PUSH_FALSE";
+    case OpCode::Pop: return "POP";
+    case OpCode::LoadVariable: return "LOAD";
+    case OpCode::StoreVariable: return "STORE";
+    case OpCode::AddAssign: return "ADD_ASSIGN";
+    case OpCode::SubtractAssign: return "SUB_ASSIGN";
+    case OpCode::MultiplyAssign: return "MUL_ASSIGN";
+    case OpCode::DivideAssign: return "DIV_ASSIGN";
+    case OpCode::Increment: return "INC";
+    case OpCode::Decrement: return "DEC";
+    case OpCode::PostIncrement: return "POST_INC";
+    case OpCode::PostDecrement: return "POST_DEC";
+    case OpCode::Add: return "ADD";
+    case OpCode::Subtract: return "SUB";
+    case OpCode::Multiply: return "MUL";
+    case OpCode::Divide: return "DIV";
+    case OpCode::Power: return "POW";
+    case OpCode::Mod: return "MOD";
+    case OpCode::Div: return "IDIV";
+    case OpCode::Negate: return "NEG";
+    case OpCode::Equal: return "EQ";
+    case OpCode::NotEqual: return "NE";
+    case OpCode::Less: return "LT";
+    case OpCode::Greater: return "GT";
+    case OpCode::LessEqual: return "LE";
+    case OpCode::GreaterEqual: return "GE";
+    case OpCode::Not: return "NOT";
+    case OpCode::ToBool: return "TO_BOOL";
+    case OpCode::Jump: return "JUMP";
+    case OpCode::JumpIfFalse: return "JUMP_IF_FALSE";
+    case OpCode::JumpIfTrue: return "JUMP_IF_TRUE";
+    case OpCode::CallBuiltin: return "CALL_BUILTIN";
+    case OpCode::CallFunction: return "CALL";
+    case OpCode::DefineFunction: return "DEFINE";
+    case OpCode::ParallelFor: return "PARALLEL_FOR";
+    case OpCode::Print: return "PRINT";
+    case OpCode::Fail: return "FAIL";
+    case OpCode::Return: return "RETURN";
+    }
+    return "?";
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "ast.h"
+#include "builtins.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Operation codes understood by the GlossAI virtual machine
+ *
+ * The VM is stack based: operands are pushed on the value stack and each
+ * operation pops its inputs and pushes its result. Every compiled statement
+ * leaves exactly one value on the stack, mirroring what Evaluator::evaluate()
+ * would have returned for the same node.
+ */
+enum class OpCode : std::uint8_t {
+    // Stack manipulation
+    PushConstant,   // operand: constant index
+    PushNull,
+    PushTrue,
+    PushFalse,
+    Pop,
+
+    // Variables (operand: slot index, Instruction::count: scope depth)
+    LoadVariable,
+    StoreVariable,  // value stays on the stack
+    AddAssign,      // pops the right operand, pushes the new value
+    SubtractAssign,
+    MultiplyAssign,
+    DivideAssign,
+    Increment,      // pushes the new value
+    Decrement,
+    PostIncrement,  // pushes the old value
+    PostDecrement,
+
+    // Arithmetic
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Mod,
+    Div,
+    Negate,
+
+    // Comparison and logic
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    Not,
+    ToBool,
+
+    // Control flow
+    Jump,           // operand: absolute target
+    JumpIfFalse,    // operand: absolute target, pops the condition
+    JumpIfTrue,     // operand: absolute target, pops the condition
+
+    // Calls and statements
+    CallBuiltin,    // operand: native table index, argument count in Instruction::count
+    CallFunction,   // operand: name index of a user function, argument count in Instruction::count
+    DefineFunction, // operand: definition index, pushes null
+    ParallelFor,    // operand: loop index, pushes null
+    Print,          // operand: expression count
+    Fail,           // operand: constant index of the error message
+    Return
+};
+
+/**
+ * @brief A single VM instruction
+ */
+struct Instruction {
+    OpCode op;
+    std::uint16_t count;
+    std::uint32_t operand;
+
+    Instruction(OpCode o = OpCode::PushNull, std::uint32_t arg = 0, std::uint16_t n = 0)
+        : op(o), count(n), operand(arg) {}
+};
+
+static_assert(sizeof(Instruction) == 8, "Instruction should stay compact");
+
+/**
+ * @brief Where the node an instruction was compiled from was parsed
+ */
+struct SourcePosition {
+    std::uint32_t instruction;
+    int line;   // 1-based; 0 if unknown
+    int column;
+};
+
+/**
+ * @brief A compiled unit of bytecode
+ *
+ * Holds the linear instruction stream together with the constant and native
+ * function tables it references. Variables are addressed by Context slot, so a chunk
+ * is only valid for the context it was resolved against. Produced by
+ * Compiler and executed by VirtualMachine.
+ */
+class Chunk
+{
+public:
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<const BuiltinFunction *> natives;
+    std::vector<std::string> names;             // User functions called, looked up when the call runs
+    std::vector<FunctionDefNode *> functions;   // Definitions, owned by the compiled tree
+    std::vector<ForNode *> loops;               // Parallel loops, owned by the compiled tree
+    std::vector<SourcePosition> positions;      // Of the instructions that can fail, in code order
+    size_t maxStackDepth = 0;
+
+    /**
+     * @brief Append an instruction and return its index
+     */
+    size_t emit(OpCode op, std::uint32_t operand = 0, std::uint16_t count = 0);
+
+    /**
+     * @brief Add a constant to the pool and return its index
+     */
+    std::uint32_t addConstant(const Value &value);
+
+    /**
+     * @brief Add a native function to the call table (deduplicated) and return its index
+     */
+    std::uint32_t addNative(const BuiltinFunction *function);
+
+    /**
+     * @brief Add a user function name to the call table (deduplicated) and return its index
+     */
+    std::uint32_t addName(const std::string &name);
+
+    /**
+     * @brief Record the source position of a node for the next instruction emitted
+     *
+     * Only the instructions that report errors get one, so the table stays
+     * small and is only searched when something failed.
+     */
+    void markPosition(const ASTNode *node);
+
+    /**
+     * @brief Position recorded for an instruction (line 0 if there is none)
+     */
+    SourcePosition positionOf(size_t instruction) const;
+
+    /**
+     * @brief Produce a human readable listing of the chunk (for debugging)
+     */
+    std::string disassemble() const;
+};
+
+/**
+ * @brief Get the mnemonic of an opcode
+ */
+const char *opCodeName(OpCode op);
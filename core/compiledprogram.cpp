@@ -0,0 +1,329 @@
+#include "compiledprogram.h"
+#include "builtins.h"
+#include "compiler.h"
+#include "context.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "outputsink.h"
+#include "parser.h"
+#include "programcache.h"
+#include "resolver.h"
+#include "vm.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+
+/**
+ * @brief Rejects assignments and increments of global slots that hold constants
+ *
+ * Runs on the resolved tree, so variables a function body assigns, which
+ * are frame locals, may reuse a constant's name.
+ */
+class ConstantWriteChecker : public ASTVisitor
+{
+public:
+    explicit ConstantWriteChecker(const std::vector<bool> &constant) : m_constant(constant) {}
+
+    void check(ASTNode *node)
+    {
+        if (node) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *) override {}
+    void visit(BinaryOpNode *node) override
+    {
+        switch (node->getOperator()) {
+        case BinaryOperator::Assign:
+        case BinaryOperator::PlusAssign:
+        case BinaryOperator::MinusAssign:
+        case BinaryOperator::MultiplyAssign:
+        case BinaryOperator::DivideAssign:
+            checkTarget(node->getLeft());
+            break;
+        default:
+            break;
+        }
+        check(node->getLeft());
+        check(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override
+    {
+        if (node->getOperator() != UnaryOperator::Negate && node->getOperator() != UnaryOperator::Not) {
+            checkTarget(node->getOperand());
+        }
+        check(node->getOperand());
+    }
+    void visit(FunctionCallNode *node) override
+    {
+        for (ASTNode *arg : node->getArguments()) {
+            check(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        check(node->getCondition());
+        check(node->getThenBranch());
+        check(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        check(node->getCondition());
+        check(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        check(node->getInit());
+        check(node->getCondition());
+        check(node->getUpdate());
+        check(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            check(statement);
+        }
+    }
+    void visit(FunctionDefNode *node) override { check(node->getBody()); }
+    void visit(ReturnNode *node) override { check(node->getValue()); }
+    void visit(PrintNode *node) override
+    {
+        for (ASTNode *expr : node->getExpressions()) {
+            check(expr);
+        }
+    }
+
+private:
+    void checkTarget(ASTNode *target)
+    {
+        auto *identifier = nodeCast<IdentifierNode>(target);
+        if (identifier && identifier->isResolved() && identifier->getScopeDepth() == 0 &&
+            m_constant[identifier->getSlotIndex()]) {
+            throw std::runtime_error("Cannot assign to constant: " + identifier->getName());
+        }
+    }
+
+    const std::vector<bool> &m_constant; // Indexed by global slot
+};
+
+} // anonymous namespace
+
+CompiledProgram::CompiledProgram()
+    : m_prepared(std::make_unique<PreparedProgram>())
+{
+}
+
+CompiledProgram::~CompiledProgram() = default;
+
+std::shared_ptr<const CompiledProgram> CompiledProgram::compile(const std::string &source)
+{
+    return compile(source, Options());
+}
+
+std::shared_ptr<const CompiledProgram> CompiledProgram::compile(const std::string &source, const Options &options)
+{
+    std::shared_ptr<CompiledProgram> compiled(new CompiledProgram());
+    compiled->m_source = source;
+    compiled->m_builtins = options.builtins;
+    compiled->m_shared = options.globals;
+    const BuiltinRegistry *builtins = options.builtins ? options.builtins.get() : &BuiltinRegistry::standard();
+    PreparedProgram &prepared = *compiled->m_prepared;
+
+    // Same steps as Interpreter::prepare(), with a lexer and parser of our own
+    Lexer lexer;
+    Parser parser;
+    try {
+        // Tokens are views into the source, so lex the copy the program keeps
+        prepared.program = parser.parse(lexer.tokenize(compiled->m_source));
+        if (!prepared.program) {
+            prepared.error = parser.getLastError();
+            prepared.errorLine = parser.getErrorLine();
+            prepared.errorColumn = parser.getErrorColumn();
+            return compiled;
+        }
+    } catch (const std::exception &e) {
+        prepared.program.reset();
+        prepared.error = e.what();
+        prepared.errorLine = lexer.getCurrentLine();
+        prepared.errorColumn = lexer.getCurrentColumn();
+        return compiled;
+    }
+
+    try {
+        ASTNode *ast = prepared.program->root();
+        prepared.isStatement = isStatementRoot(ast);
+        ASTNode *root = Optimizer(*prepared.program, options.optimizationLevel, builtins).optimize(ast);
+
+        // Slots are laid out in a context of our own, which every ExecutionContext reproduces
+        Context layout;
+        Resolver().resolve(root, &layout, builtins);
+        prepared.resolved = true;
+        std::vector<bool> constant;
+        for (std::uint32_t index = 0; index < layout.globalSlotCount(); ++index) {
+            const std::string &name = layout.slotName(SlotRef{0, index});
+            const Value *value = options.globals ? options.globals->find(name) : nullptr;
+            compiled->m_globals.push_back(name);
+            constant.push_back(value != nullptr);
+            if (value) {
+                compiled->m_constants.emplace_back(index, *value);
+            }
+        }
+        ConstantWriteChecker(constant).check(root);
+
+        prepared.chunk = Compiler().compile(root);
+        prepared.root = root;
+    } catch (const std::exception &e) {
+        prepared.program.reset();
+        prepared.chunk.reset();
+        prepared.error = e.what();
+        compiled->m_globals.clear();
+        compiled->m_constants.clear();
+    }
+    return compiled;
+}
+
+bool CompiledProgram::ok() const
+{
+    return m_prepared->root != nullptr;
+}
+
+const std::string &CompiledProgram::error() const
+{
+    return m_prepared->error;
+}
+
+int CompiledProgram::errorLine() const
+{
+    return m_prepared->errorLine;
+}
+
+int CompiledProgram::errorColumn() const
+{
+    return m_prepared->errorColumn;
+}
+
+bool CompiledProgram::isStatement() const
+{
+    return m_prepared->isStatement;
+}
+
+ExecutionContext::ExecutionContext(std::shared_ptr<const CompiledProgram> program)
+    : m_program(std::move(program))
+    , m_vm(std::make_unique<VirtualMachine>())
+{
+    if (!m_program) {
+        throw std::invalid_argument("An execution context needs a program");
+    }
+    setOutput(std::cout);
+    m_vm->setBudget(&m_budget);
+    layOut();
+}
+
+ExecutionContext::~ExecutionContext() = default;
+
+void ExecutionContext::layOut()
+{
+    // A fresh context hands out global slots in resolution order, so this
+    // reproduces the program's layout
+    m_context = std::make_unique<Context>();
+    for (const std::string &name : m_program->m_globals) {
+        m_context->resolveVariable(name);
+    }
+    for (const auto &constant : m_program->m_constants) {
+        VariableSlot &slot = m_context->slot(SlotRef{0, constant.first});
+        slot.value = constant.second;
+        slot.defined = true;
+    }
+    setLimits(m_limits);
+}
+
+Interpreter::Result ExecutionContext::run()
+{
+    using Status = Interpreter::Status;
+
+    Interpreter::Result result;
+    const PreparedProgram &prepared = *m_program->m_prepared;
+    if (!prepared.root) {
+        result.status = Status::SyntaxError;
+        result.line = prepared.errorLine;
+        result.column = prepared.errorColumn;
+        result.error = prepared.error;
+        return result;
+    }
+
+    m_budget.begin(m_limits, &m_cancel, m_context.get());
+    try {
+        Value value;
+        if (!m_vm->execute(*prepared.chunk, m_context.get(), value)) {
+            const EvalError &error = m_vm->error();
+            result.status = Status::RuntimeError;
+            result.code = error.code;
+            result.line = error.line;
+            result.column = error.column;
+            result.error = error.message;
+        } else if (!prepared.isStatement) {
+            result.value = std::move(value);
+        }
+    } catch (const ExecutionInterrupted &e) {
+        result.status = e.reason() == ExecutionInterrupted::Stopped ? Status::Stopped : Status::LimitExceeded;
+        result.error = e.what();
+    } catch (const std::exception &e) {
+        result.status = Status::RuntimeError;
+        result.code = ErrorCode::Other;
+        result.error = e.what();
+    } catch (...) {
+        result.status = Status::RuntimeError;
+        result.code = ErrorCode::Other;
+        result.error = "Unknown error occurred during execution";
+    }
+    m_cancel.reset();
+    m_output->flush();
+    return result;
+}
+
+void ExecutionContext::setVariable(const std::string &name, const Value &value)
+{
+    if (m_program->m_shared && m_program->m_shared->find(name)) {
+        throw std::runtime_error("Cannot assign to constant: " + name);
+    }
+    m_context->setVariable(name, value);
+}
+
+Value ExecutionContext::getVariable(const std::string &name) const
+{
+    return m_context->getVariable(name);
+}
+
+void ExecutionContext::reset()
+{
+    layOut();
+}
+
+void ExecutionContext::setOutput(std::unique_ptr<OutputSink> output)
+{
+    if (m_output) {
+        m_output->flush();
+    }
+    m_output = std::move(output);
+    m_vm->setOutput(m_output.get());
+}
+
+void ExecutionContext::setOutput(std::ostream &output)
+{
+    setOutput(std::make_unique<StreamSink>(output));
+}
+
+void ExecutionContext::setLimits(const ExecutionLimits &limits)
+{
+    m_limits = limits;
+    size_t depth = Context::DefaultMaxCallDepth;
+    if (limits.maxCallDepth > 0) {
+        depth = std::min(depth, limits.maxCallDepth);
+    }
+    m_context->setMaxCallDepth(depth);
+}
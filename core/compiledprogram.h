@@ -0,0 +1,196 @@
+#pragma once
+
+#include "budget.h"
+#include "interpreter.h"
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class BuiltinRegistry;
+class Context;
+class OutputSink;
+class VirtualMachine;
+struct PreparedProgram;
+
+/**
+ * @brief Read-only named values shared by many execution contexts
+ *
+ * Filled once and then only read, so any number of threads may use it at
+ * the same time. Programs compiled against it treat its names as constants:
+ * code that assigns to one does not compile, and every ExecutionContext of
+ * the program starts with their values.
+ */
+class SharedGlobals
+{
+public:
+    SharedGlobals() = default;
+    explicit SharedGlobals(std::unordered_map<std::string, Value> values) : m_values(std::move(values)) {}
+
+    /**
+     * @brief Get the value of a constant
+     * @return The value, or nullptr if there is no constant of that name
+     */
+    const Value *find(const std::string &name) const
+    {
+        auto it = m_values.find(name);
+        return it == m_values.end() ? nullptr : &it->second;
+    }
+
+    size_t size() const { return m_values.size(); }
+
+private:
+    std::unordered_map<std::string, Value> m_values;
+};
+
+/**
+ * @brief Source text lexed, parsed, optimized, bound and compiled once
+ *
+ * Immutable once compile() returns, so one program can be shared by any
+ * number of threads, each running it in an ExecutionContext of its own.
+ * Variables are bound to slots of a layout owned by the program rather
+ * than of an interpreter's context, and calls to the native functions that
+ * existed when it was compiled. Programs run on the VM only; the JIT is
+ * not used.
+ */
+class CompiledProgram
+{
+public:
+    struct Options {
+        int optimizationLevel = 0;                       // As Interpreter::setOptimizationLevel()
+        std::shared_ptr<const BuiltinRegistry> builtins; // Native functions; the standard table if null
+        std::shared_ptr<const SharedGlobals> globals;    // Constants; none if null
+    };
+
+    /**
+     * @brief Compile source text
+     *
+     * Never throws for bad code: check ok() and error() instead.
+     * @param source Code to compile (one statement or expression, as for Interpreter::execute())
+     * @param options Optimization level, native functions and constants
+     * @return The program, which may hold an error
+     */
+    static std::shared_ptr<const CompiledProgram> compile(const std::string &source, const Options &options);
+    static std::shared_ptr<const CompiledProgram> compile(const std::string &source);
+
+    ~CompiledProgram();
+
+    CompiledProgram(const CompiledProgram &) = delete;
+    CompiledProgram &operator=(const CompiledProgram &) = delete;
+
+    /**
+     * @brief Check whether the program compiled and can be run
+     */
+    bool ok() const;
+
+    /**
+     * @brief Lex, parse or binding error; empty if ok()
+     */
+    const std::string &error() const;
+
+    /// Where a syntax error was found (1-based; 0 if unknown)
+    int errorLine() const;
+    int errorColumn() const;
+
+    /**
+     * @brief Check whether the program is a statement, which reports no result
+     */
+    bool isStatement() const;
+
+    const std::string &source() const { return m_source; }
+
+    /**
+     * @brief Names of the global variables the program uses, in slot order
+     */
+    const std::vector<std::string> &globals() const { return m_globals; }
+
+private:
+    friend class ExecutionContext;
+
+    CompiledProgram();
+
+    std::string m_source;
+    std::unique_ptr<PreparedProgram> m_prepared; // Resolved and compiled; never changed after compile()
+    std::shared_ptr<const BuiltinRegistry> m_builtins;
+    std::shared_ptr<const SharedGlobals> m_shared;
+    std::vector<std::string> m_globals;
+    std::vector<std::pair<std::uint32_t, Value>> m_constants; // Global slots that start with a shared value
+};
+
+/**
+ * @brief Variables of one thread running a shared CompiledProgram
+ *
+ * Holds its own context, VM, output sink and budget, so contexts of the same
+ * program run in parallel without locks. Variables keep their values from
+ * one run to the next, like an interpreter's; a context is not itself
+ * thread-safe and is meant to be reused by the thread that owns it.
+ */
+class ExecutionContext
+{
+public:
+    explicit ExecutionContext(std::shared_ptr<const CompiledProgram> program);
+    ~ExecutionContext();
+
+    ExecutionContext(const ExecutionContext &) = delete;
+    ExecutionContext &operator=(const ExecutionContext &) = delete;
+
+    /**
+     * @brief Run the program once
+     * @return The result, or why it failed (Status::SyntaxError if it did not compile)
+     */
+    Interpreter::Result run();
+
+    /**
+     * @brief Set a global variable, typically an input of the next run
+     * @throws std::runtime_error if the name is one of the program's constants
+     */
+    void setVariable(const std::string &name, const Value &value);
+
+    /**
+     * @brief Get a global variable (null if it is not defined)
+     */
+    Value getVariable(const std::string &name) const;
+
+    /**
+     * @brief Forget all variables and functions; constants keep their values
+     */
+    void reset();
+
+    /**
+     * @brief Send the output of print statements to a sink (std::cout by default)
+     */
+    void setOutput(std::unique_ptr<OutputSink> output);
+
+    /**
+     * @brief Send the output of print statements to a stream, in blocks
+     */
+    void setOutput(std::ostream &output);
+
+    /**
+     * @brief Limit every run, as Interpreter::setLimits()
+     */
+    void setLimits(const ExecutionLimits &limits);
+
+    const ExecutionLimits &getLimits() const { return m_limits; }
+
+    /**
+     * @brief Get the token that stops the current run from any thread
+     */
+    CancelToken &getCancelToken() { return m_cancel; }
+
+    const CompiledProgram &program() const { return *m_program; }
+
+private:
+    std::shared_ptr<const CompiledProgram> m_program;
+    std::unique_ptr<Context> m_context;
+    std::unique_ptr<VirtualMachine> m_vm;
+    std::unique_ptr<OutputSink> m_output;
+    ExecutionLimits m_limits;
+    CancelToken m_cancel;
+    ExecutionBudget m_budget;
+
+    void layOut();
+};
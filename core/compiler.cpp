@@ -0,0 +1,401 @@
+#include "compiler.h"
+#include <stdexcept>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef M_E
+#define M_E 2.71828182845904523536
+#endif
+
+namespace
+{
+
+/**
+ * @brief Net stack effect of an opcode whose effect does not depend on its operands
+ */
+int stackEffect(OpCode op)
+{
+    switch (op) {
+    case OpCode::PushConstant:
+    case OpCode::PushNull:
+    case OpCode::PushTrue:
+    case OpCode::PushFalse:
+    case OpCode::LoadVariable:
+    case OpCode::DefineFunction:
+    case OpCode::ParallelFor:
+    case OpCode::Increment:
+    case OpCode::Decrement:
+    case OpCode::PostIncrement:
+    case OpCode::PostDecrement:
+    case OpCode::Fail:
+        return 1;
+    case OpCode::Pop:
+    case OpCode::JumpIfFalse:
+    case OpCode::JumpIfTrue:
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Power:
+    case OpCode::Mod:
+    case OpCode::Div:
+    case OpCode::Equal:
+    case OpCode::NotEqual:
+    case OpCode::Less:
+    case OpCode::Greater:
+    case OpCode::LessEqual:
+    case OpCode::GreaterEqual:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+OpCode arithmeticOpCode(BinaryOperator op)
+{
+    switch (op) {
+    case BinaryOperator::Assign: return OpCode::StoreVariable;
+    case BinaryOperator::PlusAssign: return OpCode::AddAssign;
+    case BinaryOperator::MinusAssign: return OpCode::SubtractAssign;
+    case BinaryOperator::MultiplyAssign: return OpCode::MultiplyAssign;
+    case BinaryOperator::DivideAssign: return OpCode::DivideAssign;
+    case BinaryOperator::Add: return OpCode::Add;
+    case BinaryOperator::Subtract: return OpCode::Subtract;
+    case BinaryOperator::Multiply: return OpCode::Multiply;
+    case BinaryOperator::Divide: return OpCode::Divide;
+    case BinaryOperator::Power: return OpCode::Power;
+    case BinaryOperator::Mod: return OpCode::Mod;
+    case BinaryOperator::Div: return OpCode::Div;
+    case BinaryOperator::Equal: return OpCode::Equal;
+    case BinaryOperator::NotEqual: return OpCode::NotEqual;
+    case BinaryOperator::Less: return OpCode::Less;
+    case BinaryOperator::Greater: return OpCode::Greater;
+    case BinaryOperator::LessEqual: return OpCode::LessEqual;
+    case BinaryOperator::GreaterEqual: return OpCode::GreaterEqual;
+    default:
+        throw std::runtime_error("Unsupported binary operator");
+    }
+}
+
+} // anonymous namespace
+
+Compiler::Compiler()
+    : m_chunk(nullptr), m_stackDepth(0)
+{
+}
+
+Compiler::~Compiler() = default;
+
+std::unique_ptr<Chunk> Compiler::compile(ASTNode *root)
+{
+    if (!root) {
+        throw std::runtime_error("Cannot compile null AST node");
+    }
+
+    auto chunk = std::make_unique<Chunk>();
+    m_chunk = chunk.get();
+    m_stackDepth = 0;
+
+    root->accept(this);
+    emit(OpCode::Return);
+
+    m_chunk = nullptr;
+    return chunk;
+}
+
+void Compiler::emit(OpCode op, std::uint32_t operand, std::uint16_t count)
+{
+    m_chunk->emit(op, operand, count);
+    adjustStack(stackEffect(op));
+}
+
+void Compiler::emitAt(const ASTNode *node, OpCode op, std::uint32_t operand, std::uint16_t count)
+{
+    // Errors the instruction reports point at the node
+    m_chunk->markPosition(node);
+    emit(op, operand, count);
+}
+
+size_t Compiler::emitJump(OpCode op)
+{
+    size_t index = m_chunk->emit(op);
+    adjustStack(stackEffect(op));
+    return index;
+}
+
+void Compiler::patchJump(size_t index)
+{
+    m_chunk->code[index].operand = static_cast<std::uint32_t>(m_chunk->code.size());
+}
+
+void Compiler::emitVariable(OpCode op, IdentifierNode *node)
+{
+    if (!node->isResolved()) {
+        throw std::runtime_error("Unresolved identifier: " + node->getName());
+    }
+    if (op == OpCode::StoreVariable) {
+        emit(op, node->getSlotIndex(), node->getScopeDepth());
+    } else {
+        emitAt(node, op, node->getSlotIndex(), node->getScopeDepth());
+    }
+}
+
+void Compiler::emitFail(const ASTNode *node, const std::string &message)
+{
+    emitAt(node, OpCode::Fail, m_chunk->addConstant(Value(message)));
+}
+
+void Compiler::adjustStack(int delta)
+{
+    m_stackDepth += delta;
+    if (m_stackDepth > static_cast<int>(m_chunk->maxStackDepth)) {
+        m_chunk->maxStackDepth = static_cast<size_t>(m_stackDepth);
+    }
+}
+
+void Compiler::visit(LiteralNode *node)
+{
+    emit(OpCode::PushConstant, m_chunk->addConstant(node->getValue()));
+}
+
+void Compiler::visit(IdentifierNode *node)
+{
+    const std::string &name = node->getName();
+
+    // Mirror the evaluator's handling of built-in constants
+    if (name == "pi") {
+        emit(OpCode::PushConstant, m_chunk->addConstant(Value(M_PI)));
+        return;
+    }
+    if (name == "e") {
+        emit(OpCode::PushConstant, m_chunk->addConstant(Value(M_E)));
+        return;
+    }
+
+    emitVariable(OpCode::LoadVariable, node);
+}
+
+void Compiler::visit(BinaryOpNode *node)
+{
+    BinaryOperator op = node->getOperator();
+
+    if (op == BinaryOperator::Assign || op == BinaryOperator::PlusAssign ||
+        op == BinaryOperator::MinusAssign || op == BinaryOperator::MultiplyAssign ||
+        op == BinaryOperator::DivideAssign) {
+
+        auto *identNode = nodeCast<IdentifierNode>(node->getLeft());
+        if (!identNode) {
+            emitFail(node, "Invalid assignment target");
+            return;
+        }
+
+        node->getRight()->accept(this);
+        emitVariable(arithmeticOpCode(op), identNode);
+        return;
+    }
+
+    // Short-circuit logical operators always produce a boolean
+    if (op == BinaryOperator::And || op == BinaryOperator::Or) {
+        node->getLeft()->accept(this);
+        size_t shortCircuit = emitJump(op == BinaryOperator::And ? OpCode::JumpIfFalse
+                                                                 : OpCode::JumpIfTrue);
+        node->getRight()->accept(this);
+        emit(OpCode::ToBool);
+        size_t end = emitJump(OpCode::Jump);
+
+        patchJump(shortCircuit);
+        adjustStack(-1); // Only one of the two pushes below is ever executed
+        emit(op == BinaryOperator::And ? OpCode::PushFalse : OpCode::PushTrue);
+        patchJump(end);
+        return;
+    }
+
+    node->getLeft()->accept(this);
+    node->getRight()->accept(this);
+    if (op == BinaryOperator::Divide || op == BinaryOperator::Mod || op == BinaryOperator::Div) {
+        emitAt(node, arithmeticOpCode(op));
+    } else {
+        emit(arithmeticOpCode(op));
+    }
+}
+
+void Compiler::visit(UnaryOpNode *node)
+{
+    UnaryOperator op = node->getOperator();
+
+    if (op == UnaryOperator::Negate || op == UnaryOperator::Not) {
+        node->getOperand()->accept(this);
+        emit(op == UnaryOperator::Negate ? OpCode::Negate : OpCode::Not);
+        return;
+    }
+
+    auto *identNode = nodeCast<IdentifierNode>(node->getOperand());
+    if (!identNode) {
+        switch (op) {
+        case UnaryOperator::PreIncrement:
+            emitFail(node, "Pre-increment can only be applied to variables");
+            break;
+        case UnaryOperator::PostIncrement:
+            emitFail(node, "Post-increment can only be applied to variables");
+            break;
+        case UnaryOperator::PreDecrement:
+            emitFail(node, "Pre-decrement can only be applied to variables");
+            break;
+        default:
+            emitFail(node, "Post-decrement can only be applied to variables");
+            break;
+        }
+        return;
+    }
+
+    switch (op) {
+    case UnaryOperator::PreIncrement: emitVariable(OpCode::Increment, identNode); break;
+    case UnaryOperator::PostIncrement: emitVariable(OpCode::PostIncrement, identNode); break;
+    case UnaryOperator::PreDecrement: emitVariable(OpCode::Decrement, identNode); break;
+    case UnaryOperator::PostDecrement: emitVariable(OpCode::PostDecrement, identNode); break;
+    default:
+        throw std::runtime_error("Unsupported unary operator");
+    }
+}
+
+void Compiler::visit(FunctionCallNode *node)
+{
+    auto *funcNode = nodeCast<IdentifierNode>(node->getFunction());
+    if (!funcNode) {
+        emitFail(node, "Invalid function call");
+        return;
+    }
+
+    const auto &arguments = node->getArguments();
+    for (const auto &arg : arguments) {
+        arg->accept(this);
+    }
+
+    // Unbound calls go to a user function, looked up when they run like in the evaluator
+    const BuiltinFunction *builtin = node->getBuiltin();
+    if (!builtin) {
+        emitAt(node, OpCode::CallFunction, m_chunk->addName(funcNode->getName()),
+               static_cast<std::uint16_t>(arguments.size()));
+    } else {
+        emit(OpCode::CallBuiltin, m_chunk->addNative(builtin),
+             static_cast<std::uint16_t>(arguments.size()));
+    }
+    adjustStack(1 - static_cast<int>(arguments.size()));
+}
+
+void Compiler::visit(IfNode *node)
+{
+    node->getCondition()->accept(this);
+    size_t elseJump = emitJump(OpCode::JumpIfFalse);
+
+    node->getThenBranch()->accept(this);
+    size_t endJump = emitJump(OpCode::Jump);
+
+    patchJump(elseJump);
+    adjustStack(-1); // The then branch's result is not on the stack here
+    if (node->getElseBranch()) {
+        node->getElseBranch()->accept(this);
+    } else {
+        emit(OpCode::PushNull);
+    }
+    patchJump(endJump);
+}
+
+void Compiler::visit(WhileNode *node)
+{
+    // The loop's value is the last body result, or null if it never ran
+    emit(OpCode::PushNull);
+
+    size_t loopStart = m_chunk->code.size();
+    node->getCondition()->accept(this);
+    size_t exitJump = emitJump(OpCode::JumpIfFalse);
+
+    emit(OpCode::Pop);
+    node->getBody()->accept(this);
+    emit(OpCode::Jump, static_cast<std::uint32_t>(loopStart));
+
+    patchJump(exitJump);
+}
+
+void Compiler::visit(ForNode *node)
+{
+    // ParallelLoops binds and compiles the body itself when the loop runs
+    if (node->isParallel()) {
+        m_chunk->loops.push_back(node);
+        emitAt(node, OpCode::ParallelFor, static_cast<std::uint32_t>(m_chunk->loops.size() - 1));
+        return;
+    }
+
+    if (node->getInit()) {
+        node->getInit()->accept(this);
+        emit(OpCode::Pop);
+    }
+
+    // Same value as a while loop: the last body result, or null if it never ran
+    emit(OpCode::PushNull);
+
+    size_t loopStart = m_chunk->code.size();
+    size_t exitJump = 0;
+    if (node->getCondition()) {
+        node->getCondition()->accept(this);
+        exitJump = emitJump(OpCode::JumpIfFalse);
+    }
+
+    emit(OpCode::Pop);
+    node->getBody()->accept(this);
+    if (node->getUpdate()) {
+        node->getUpdate()->accept(this);
+        emit(OpCode::Pop);
+    }
+    emit(OpCode::Jump, static_cast<std::uint32_t>(loopStart));
+
+    if (node->getCondition()) {
+        patchJump(exitJump);
+    }
+}
+
+void Compiler::visit(BlockNode *node)
+{
+    const auto &statements = node->getStatements();
+    if (statements.empty()) {
+        emit(OpCode::PushNull);
+        return;
+    }
+
+    for (size_t i = 0; i < statements.size(); ++i) {
+        if (i > 0) {
+            emit(OpCode::Pop);
+        }
+        statements[i]->accept(this);
+    }
+}
+
+void Compiler::visit(FunctionDefNode *node)
+{
+    // The body is compiled separately, on the function's first call
+    m_chunk->functions.push_back(node);
+    emit(OpCode::DefineFunction, static_cast<std::uint32_t>(m_chunk->functions.size() - 1));
+}
+
+void Compiler::visit(ReturnNode *node)
+{
+    if (node->getValue()) {
+        node->getValue()->accept(this);
+    } else {
+        emit(OpCode::PushNull);
+    }
+    emit(OpCode::Return);
+}
+
+void Compiler::visit(PrintNode *node)
+{
+    const auto &expressions = node->getExpressions();
+    for (const auto &expr : expressions) {
+        expr->accept(this);
+    }
+
+    emit(OpCode::Print, static_cast<std::uint32_t>(expressions.size()));
+    adjustStack(1 - static_cast<int>(expressions.size()));
+}
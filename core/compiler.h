@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ast.h"
+#include "bytecode.h"
+#include <memory>
+
+/**
+ * @brief Lowers an AST into linear bytecode for the VirtualMachine
+ *
+ * The compiler walks the tree once; the resulting Chunk can then be executed
+ * any number of times without touching the AST again. Identifiers must have
+ * been bound to slots by the Resolver beforehand.
+ */
+class Compiler : public ASTVisitor
+{
+public:
+    Compiler();
+    ~Compiler();
+
+    /**
+     * @brief Compile an AST into a chunk of bytecode
+     * @param root Root node of the AST
+     * @return The compiled chunk
+     */
+    std::unique_ptr<Chunk> compile(ASTNode *root);
+
+    // ASTVisitor interface
+    void visit(LiteralNode *node) override;
+    void visit(IdentifierNode *node) override;
+    void visit(BinaryOpNode *node) override;
+    void visit(UnaryOpNode *node) override;
+    void visit(FunctionCallNode *node) override;
+    void visit(IfNode *node) override;
+    void visit(WhileNode *node) override;
+    void visit(ForNode *node) override;
+    void visit(BlockNode *node) override;
+    void visit(FunctionDefNode *node) override;
+    void visit(ReturnNode *node) override;
+    void visit(PrintNode *node) override;
+
+private:
+    void emit(OpCode op, std::uint32_t operand = 0, std::uint16_t count = 0);
+    void emitAt(const ASTNode *node, OpCode op, std::uint32_t operand = 0, std::uint16_t count = 0);
+    size_t emitJump(OpCode op);
+    void patchJump(size_t index);
+    void emitVariable(OpCode op, IdentifierNode *node);
+    void emitFail(const ASTNode *node, const std::string &message);
+    void adjustStack(int delta);
+
+    Chunk *m_chunk;
+    int m_stackDepth;
+};
@@ -1,8 +1,103 @@
 #include "context.h"
+#include "budget.h"
+#include "builtins.h"
+#include "memocache.h"
+#include "program.h"
+#include "resolver.h"
 #include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+
+// Frame slots reserved up front; enough for moderately deep recursion before the first growth
+constexpr size_t InitialFrameSlots = 1024;
+
+/**
+ * @brief Checks that a resolved function body only touches its own frame
+ *
+ * Calls to user functions cannot be judged from the tree alone; their
+ * names are collected for the caller to check.
+ */
+class EffectChecker : public ASTVisitor
+{
+public:
+    bool localOnly = true;
+    std::vector<std::string> callees;
+
+    void check(ASTNode *node)
+    {
+        if (node && localOnly) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *node) override
+    {
+        const std::string &name = node->getName();
+        if (name != "pi" && name != "e" &&
+            (!node->isResolved() || node->getScopeDepth() != SlotRef::FrameDepth)) {
+            localOnly = false;
+        }
+    }
+    void visit(BinaryOpNode *node) override
+    {
+        check(node->getLeft());
+        check(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override { check(node->getOperand()); }
+    void visit(FunctionCallNode *node) override
+    {
+        if (const BuiltinFunction *builtin = node->getBuiltin()) {
+            localOnly = localOnly && builtin->isPure();
+        } else if (auto *funcNode = nodeCast<IdentifierNode>(node->getFunction())) {
+            callees.push_back(funcNode->getName());
+        } else {
+            localOnly = false;
+        }
+        for (ASTNode *arg : node->getArguments()) {
+            check(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        check(node->getCondition());
+        check(node->getThenBranch());
+        check(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        check(node->getCondition());
+        check(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        check(node->getInit());
+        check(node->getCondition());
+        check(node->getUpdate());
+        check(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            check(statement);
+        }
+    }
+    void visit(FunctionDefNode *) override { localOnly = false; }
+    void visit(ReturnNode *node) override { check(node->getValue()); }
+    void visit(PrintNode *) override { localOnly = false; }
+};
+
+} // anonymous namespace
 
 Context::Context()
+    : m_frameBase(0)
+    , m_maxCallDepth(DefaultMaxCallDepth)
+    , m_memoCapacity(DefaultMemoCapacity)
+    , m_purityKnown(false)
 {
+    m_frameSlots.reserve(InitialFrameSlots);
     // Push initial global scope
     pushScope();
 }
@@ -12,15 +107,18 @@ Context::~Context() = default;
 void Context::setVariable(const std::string &name, const Value &value)
 {
     if (!m_variableScopes.empty()) {
-        m_variableScopes.back()[name] = value;
+        VariableScope &scope = m_variableScopes.back();
+        VariableSlot &slot = scope.slots[reserveSlot(scope, name)];
+        slot.value = value;
+        slot.defined = true;
     }
 }
 
 Value Context::getVariable(const std::string &name) const
 {
-    Value *var = findVariable(name);
+    const VariableSlot *var = findVariable(name);
     if (var) {
-        return *var;
+        return var->value;
     }
     return Value();
 }
@@ -32,22 +130,86 @@ bool Context::hasVariable(const std::string &name) const
 
 void Context::removeVariable(const std::string &name)
 {
-    // Remove from current scope only
+    // Remove from current scope only. The slot itself stays reserved so that
+    // compiled code addressing it keeps pointing at the right place.
     if (!m_variableScopes.empty()) {
-        m_variableScopes.back().erase(name);
+        VariableScope &scope = m_variableScopes.back();
+        auto it = scope.index.find(name);
+        if (it != scope.index.end()) {
+            scope.slots[it->second] = VariableSlot();
+        }
+    }
+}
+
+SlotRef Context::resolveVariable(const std::string &name)
+{
+    // Prefer the innermost defined variable, searching outwards to the global scope
+    for (size_t depth = m_variableScopes.size(); depth-- > 0;) {
+        const VariableScope &scope = m_variableScopes[depth];
+        auto it = scope.index.find(name);
+        if (it != scope.index.end() && scope.slots[it->second].defined) {
+            return SlotRef{static_cast<std::uint16_t>(depth), it->second};
+        }
     }
+
+    // Not defined yet: bind to (or reserve) a slot in the current scope
+    std::uint16_t depth = static_cast<std::uint16_t>(m_variableScopes.size() - 1);
+    return SlotRef{depth, reserveSlot(m_variableScopes.back(), name)};
+}
+
+std::uint32_t Context::reserveSlot(VariableScope &scope, const std::string &name)
+{
+    auto it = scope.index.find(name);
+    if (it != scope.index.end()) {
+        return it->second;
+    }
+
+    std::uint32_t index = static_cast<std::uint32_t>(scope.slots.size());
+    scope.index.emplace(name, index);
+    scope.slots.emplace_back();
+    scope.names.push_back(name);
+    return index;
 }
 
 void Context::setFunction(const std::string &name, const UserFunction &function)
 {
-    m_functions[name] = function;
+    auto stored = std::make_shared<UserFunction>(function);
+    stored->name = name;
+    stored->chunk.reset();
+    if (stored->body && !stored->program) {
+        Resolver().resolveFunction(*stored, this);
+    }
+    m_functions[name] = std::move(stored);
+    invalidateMemos();
+}
+
+void Context::defineFunction(FunctionDefNode *definition)
+{
+    if (!definition->isResolved()) {
+        Resolver().resolve(definition, this);
+    }
+
+    auto function = std::make_shared<UserFunction>();
+    function->name = definition->getName();
+    function->parameters = definition->getParameters();
+    function->locals = definition->getLocals();
+    function->program = std::make_shared<Program>();
+    function->body = function->program->copyTree(definition->getBody());
+    m_functions[function->name] = std::move(function);
+    invalidateMemos();
+}
+
+std::shared_ptr<UserFunction> Context::findFunction(const std::string &name) const
+{
+    auto it = m_functions.find(name);
+    return it != m_functions.end() ? it->second : nullptr;
 }
 
 UserFunction Context::getFunction(const std::string &name) const
 {
     auto it = m_functions.find(name);
     if (it != m_functions.end()) {
-        return it->second;
+        return *it->second;
     }
     return UserFunction(); // Return empty function if not found
 }
@@ -59,7 +221,83 @@ bool Context::hasFunction(const std::string &name) const
 
 void Context::removeFunction(const std::string &name)
 {
-    m_functions.erase(name);
+    if (m_functions.erase(name) > 0) {
+        invalidateMemos();
+    }
+}
+
+void Context::rebindFunctions(const BuiltinRegistry *builtins)
+{
+    for (auto &pair : m_functions) {
+        UserFunction &function = *pair.second;
+        if (function.body) {
+            Resolver().resolveFunction(function, this, builtins);
+        }
+        function.chunk.reset();
+    }
+    invalidateMemos();
+}
+
+MemoCache *Context::memoFor(UserFunction &function)
+{
+    if (m_memoCapacity == 0 || !isPure(function)) {
+        return nullptr;
+    }
+    if (!function.memo) {
+        function.memo = std::make_shared<MemoCache>(m_memoCapacity);
+    }
+    return function.memo.get();
+}
+
+void Context::setMemoCapacity(size_t capacity)
+{
+    m_memoCapacity = capacity;
+    for (auto &pair : m_functions) {
+        pair.second->memo.reset();
+    }
+}
+
+bool Context::isPure(UserFunction &function)
+{
+    switch (function.purity) {
+    case UserFunction::Purity::Pure:
+        return true;
+    case UserFunction::Purity::Impure:
+        return false;
+    case UserFunction::Purity::Analyzing:
+        // Mutual recursion: a cycle is only trusted when it closes on the function itself
+        return false;
+    case UserFunction::Purity::Unknown:
+        break;
+    }
+
+    m_purityKnown = true;
+    function.purity = UserFunction::Purity::Analyzing;
+    EffectChecker checker;
+    checker.check(function.body);
+    bool pure = function.body && checker.localOnly;
+    for (size_t i = 0; pure && i < checker.callees.size(); ++i) {
+        if (checker.callees[i] == function.name) {
+            continue;
+        }
+        std::shared_ptr<UserFunction> callee = findFunction(checker.callees[i]);
+        pure = callee && isPure(*callee);
+    }
+    function.purity = pure ? UserFunction::Purity::Pure : UserFunction::Purity::Impure;
+    return pure;
+}
+
+void Context::invalidateMemos()
+{
+    // Memos only exist for analyzed functions; skipping the walk keeps defining many functions linear
+    if (!m_purityKnown) {
+        return;
+    }
+    for (auto &pair : m_functions) {
+        pair.second->purity = UserFunction::Purity::Unknown;
+        pair.second->memo.reset();
+    }
+    m_purityKnown = false;
 }
 
 void Context::pushScope()
@@ -79,15 +317,69 @@ int Context::getScopeDepth() const
     return static_cast<int>(m_variableScopes.size());
 }
 
+void Context::pushFrame(const UserFunction &function)
+{
+    if (m_frames.size() >= m_maxCallDepth) {
+        throw ExecutionInterrupted(ExecutionInterrupted::CallDepthLimit,
+                                   "Maximum call depth exceeded (" + std::to_string(m_maxCallDepth) + ")");
+    }
+
+    size_t base = m_frames.empty() ? 0 : m_frameBase + m_frames.back().function->locals.size();
+    size_t end = base + function.locals.size();
+    if (end > m_frameSlots.size()) {
+        // Popped slots are left in place in their reset state, so this only runs on new depth records
+        m_frameSlots.resize(std::max(end, m_frameSlots.size() * 2));
+    }
+    m_frames.push_back(Frame{base, &function});
+    m_frameBase = base;
+}
+
+void Context::popFrame()
+{
+    const Frame &frame = m_frames.back();
+    for (size_t i = 0; i < frame.function->locals.size(); ++i) {
+        m_frameSlots[frame.base + i] = VariableSlot();
+    }
+    m_frames.pop_back();
+    m_frameBase = m_frames.empty() ? 0 : m_frames.back().base;
+}
+
+size_t Context::memoryUsage() const
+{
+    auto slotBytes = [](const VariableSlot *slot, const VariableSlot *end) {
+        size_t bytes = 0;
+        for (; slot != end; ++slot) {
+            bytes += sizeof(VariableSlot);
+            if (slot->value.getType() == Value::String) {
+                bytes += slot->value.asString().size();
+            } else if (slot->value.isArray()) {
+                bytes += slot->value.asArray().size() * sizeof(double);
+            }
+        }
+        return bytes;
+    };
+
+    size_t bytes = 0;
+    for (const VariableScope &scope : m_variableScopes) {
+        bytes += slotBytes(scope.slots.data(), scope.slots.data() + scope.slots.size());
+    }
+    if (!m_frames.empty()) {
+        const VariableSlot *frames = m_frameSlots.data();
+        bytes += slotBytes(frames, frames + m_frameBase + m_frames.back().function->locals.size());
+    }
+    return bytes;
+}
+
 std::vector<std::string> Context::getIdentifiers() const
 {
     std::vector<std::string> identifiers;
     
     // Add all variables from all scopes
     for (const auto &scope : m_variableScopes) {
-        for (const auto &pair : scope) {
-            if (std::find(identifiers.begin(), identifiers.end(), pair.first) == identifiers.end()) {
-                identifiers.push_back(pair.first);
+        for (size_t i = 0; i < scope.slots.size(); ++i) {
+            if (scope.slots[i].defined && !isTemporaryName(scope.names[i]) &&
+                std::find(identifiers.begin(), identifiers.end(), scope.names[i]) == identifiers.end()) {
+                identifiers.push_back(scope.names[i]);
             }
         }
     }
@@ -107,29 +399,58 @@ void Context::clear()
 {
     m_variableScopes.clear();
     m_functions.clear();
+    m_frameSlots.clear();
+    m_frames.clear();
+    m_frameBase = 0;
+    m_dependencies.clear();
     pushScope(); // Restore global scope
 }
 
+std::unique_ptr<Context> Context::copyGlobals() const
+{
+    auto copy = std::make_unique<Context>();
+    copy->m_variableScopes.front() = m_variableScopes.front();
+    for (const auto &pair : m_functions) {
+        auto function = std::make_shared<UserFunction>(*pair.second);
+        function->purity = UserFunction::Purity::Unknown;
+        function->memo.reset();
+        copy->m_functions.emplace(pair.first, std::move(function));
+    }
+    copy->m_maxCallDepth = m_maxCallDepth;
+    copy->m_memoCapacity = m_memoCapacity;
+    return copy;
+}
+
 std::unordered_map<std::string, Value> Context::getCurrentScopeVariables() const
 {
+    std::unordered_map<std::string, Value> variables;
     if (!m_variableScopes.empty()) {
-        return m_variableScopes.back();
+        const VariableScope &scope = m_variableScopes.back();
+        for (size_t i = 0; i < scope.slots.size(); ++i) {
+            if (scope.slots[i].defined && !isTemporaryName(scope.names[i])) {
+                variables.emplace(scope.names[i], scope.slots[i].value);
+            }
+        }
     }
-    return std::unordered_map<std::string, Value>();
+    return variables;
 }
 
 std::unordered_map<std::string, UserFunction> Context::getFunctions() const
 {
-    return m_functions;
+    std::unordered_map<std::string, UserFunction> functions;
+    for (const auto &pair : m_functions) {
+        functions.emplace(pair.first, *pair.second);
+    }
+    return functions;
 }
 
-Value* Context::findVariable(const std::string &name) const
+const VariableSlot* Context::findVariable(const std::string &name) const
 {
     // Search from most recent scope to global scope
     for (auto it = m_variableScopes.rbegin(); it != m_variableScopes.rend(); ++it) {
-        auto var_it = it->find(name);
-        if (var_it != it->end()) {
-            return const_cast<Value*>(&var_it->second);
+        auto var_it = it->index.find(name);
+        if (var_it != it->index.end() && it->slots[var_it->second].defined) {
+            return &it->slots[var_it->second];
         }
     }
     return nullptr;
@@ -139,6 +460,7 @@ Value* Context::findVariable(const std::string &name) const
 void Context::addPendingLine(const std::string &line)
 {
     m_pendingLines.push_back(line);
+    Lexer().lexLine(line, m_pendingState);
 }
 
 std::string Context::getPendingCode() const
@@ -154,6 +476,7 @@ std::string Context::getPendingCode() const
 void Context::clearPendingLines()
 {
     m_pendingLines.clear();
+    m_pendingState = LexState();
 }
 
 bool Context::hasPendingLines() const
@@ -163,24 +486,10 @@ bool Context::hasPendingLines() const
 
 int Context::getBraceLevel() const
 {
-    int level = 0;
-    for (const auto &line : m_pendingLines) {
-        for (char c : line) {
-            if (c == '{') level++;
-            else if (c == '}') level--;
-        }
-    }
-    return level;
+    return m_pendingState.braces;
 }
 
 int Context::getParenLevel() const
 {
-    int level = 0;
-    for (const auto &line : m_pendingLines) {
-        for (char c : line) {
-            if (c == '(') level++;
-            else if (c == ')') level--;
-        }
-    }
-    return level;
+    return m_pendingState.parens;
 }
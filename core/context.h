@@ -1,27 +1,84 @@
 #pragma once
 
 #include "ast.h"
+#include "dependencygraph.h"
+#include "lexer.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <cstdint>
 
 class ASTNode;
+class BuiltinRegistry;
+class Chunk;
+class MemoCache;
+class Program;
+
+/**
+ * @brief Compile-time address of a variable: scope depth (0 = global) and slot index
+ *
+ * Variables local to a user function use FrameDepth; their index is relative
+ * to the frame of the call being executed.
+ */
+struct SlotRef {
+    static constexpr std::uint16_t FrameDepth = 0xFFFF;
+
+    std::uint16_t depth;
+    std::uint32_t index;
+};
+
+/**
+ * @brief Storage for a single variable
+ *
+ * Slots are reserved when an identifier is first resolved and stay in place
+ * afterwards, so compiled code can keep addressing them by index. A reserved
+ * slot only counts as a variable once something has been assigned to it.
+ */
+struct VariableSlot {
+    Value value;
+    bool defined = false;
+};
+
+/**
+ * @brief Check whether a name belongs to a compiler temporary
+ *
+ * Temporaries introduced by the optimizer start with '$', which the lexer
+ * never accepts in an identifier, so they cannot clash with user variables.
+ * They live in ordinary slots but are never listed.
+ */
+inline bool isTemporaryName(const std::string &name)
+{
+    return !name.empty() && name[0] == '$';
+}
 
 /**
  * @brief Represents a user-defined function
+ *
+ * Each call gets a frame of locals.size() slots; the arguments occupy the
+ * first ones. Functions defined by GlossAI code own a copy of their body, so
+ * the program that defined them may be freed.
  */
 struct UserFunction {
+    enum class Purity : std::uint8_t { Unknown, Analyzing, Pure, Impure };
+
     std::string name;
     std::vector<std::string> parameters;
-    ASTNode *body; // Note: We don't own this pointer
+    ASTNode *body;                      // Owned by program, or by whoever called Context::setFunction()
+    std::vector<std::string> locals;    // Frame layout: parameters, then variables assigned in the body
+    std::shared_ptr<Program> program;   // Owns body for functions defined in GlossAI code
+    std::shared_ptr<Chunk> chunk;       // Body compiled for the VM on its first call
+    Purity purity = Purity::Unknown;    // Decided on the first call, reset when any function changes
+    std::shared_ptr<MemoCache> memo;    // Results of earlier calls, for pure functions
 };
 
 /**
  * @brief Execution context for the GlossAI interpreter
  * 
  * Manages variables, functions, and scoping for the interpreter.
- * Supports nested scopes for blocks and function calls.
+ * Supports nested scopes for blocks and function calls. Each scope keeps its
+ * variables in a contiguous slot array; the name to slot table is only used
+ * when resolving identifiers and when listing variables.
  * Pure C++ implementation using standard containers.
  */
 class Context
@@ -58,13 +115,76 @@ public:
      */
     void removeVariable(const std::string &name);
 
+    // Slot access (used by the resolver, the evaluator and the VM)
+    /**
+     * @brief Bind a name to a slot, reserving one in the current scope if needed
+     *
+     * Existing bindings are searched from the innermost scope outwards. The
+     * returned reference stays valid until its scope is popped or cleared.
+     * @param name Variable name
+     * @return Slot address for the variable
+     */
+    SlotRef resolveVariable(const std::string &name);
+
+    /**
+     * @brief Access a slot previously returned by resolveVariable()
+     */
+    VariableSlot &slot(SlotRef ref)
+    {
+        return ref.depth == SlotRef::FrameDepth ? m_frameSlots[m_frameBase + ref.index]
+                                                : m_variableScopes[ref.depth].slots[ref.index];
+    }
+    const VariableSlot &slot(SlotRef ref) const
+    {
+        return ref.depth == SlotRef::FrameDepth ? m_frameSlots[m_frameBase + ref.index]
+                                                : m_variableScopes[ref.depth].slots[ref.index];
+    }
+
+    /**
+     * @brief Number of slots reserved in the global scope
+     */
+    std::uint32_t globalSlotCount() const
+    {
+        return static_cast<std::uint32_t>(m_variableScopes.front().slots.size());
+    }
+
+    /**
+     * @brief Get the name bound to a slot (for error messages)
+     */
+    const std::string &slotName(SlotRef ref) const
+    {
+        return ref.depth == SlotRef::FrameDepth ? m_frames.back().function->locals[ref.index]
+                                                : m_variableScopes[ref.depth].names[ref.index];
+    }
+
     // Function management
     /**
      * @brief Define a function
+     *
+     * The body's identifiers are bound here: parameters and variables the
+     * body assigns to become frame locals, other names refer to globals.
      * @param name Function name
-     * @param function Function definition
+     * @param function Function definition; the body must outlive it
      */
     void setFunction(const std::string &name, const UserFunction &function);
+
+    /**
+     * @brief Define a function from a definition in GlossAI code
+     *
+     * The body is copied, so the definition's program need not outlive the function.
+     * @param definition Definition node (bound by the Resolver if it was not yet)
+     */
+    void defineFunction(FunctionDefNode *definition);
+
+    /**
+     * @brief Look a function up without copying it
+     *
+     * Callers keep the returned reference for the duration of a call, so the
+     * function survives being redefined by its own body.
+     * @param name Function name
+     * @return The function, or nullptr if none has that name
+     */
+    std::shared_ptr<UserFunction> findFunction(const std::string &name) const;
     
     /**
      * @brief Get a function definition
@@ -86,6 +206,42 @@ public:
      */
     void removeFunction(const std::string &name);
 
+    /**
+     * @brief Bind the native calls in every function body again
+     *
+     * For when lookups in the function table changed (fast-math mode).
+     * Compiled bodies and cached results are dropped; constants folded into
+     * the bodies when they were defined keep their values.
+     * @param builtins Functions the calls are bound to (the standard table if null)
+     */
+    void rebindFunctions(const BuiltinRegistry *builtins);
+
+    /**
+     * @brief Get the result cache of a function, if its calls may be memoized
+     *
+     * A function qualifies when its body provably depends only on its
+     * arguments: it reads and writes nothing but its locals, does not print
+     * or define functions, and calls only pure builtins, itself, and other
+     * functions that qualify. Defining or removing any function drops all
+     * caches, since callees may have changed.
+     * @param function Function about to be called
+     * @return The cache, or nullptr if the function is impure or memoization is off
+     */
+    MemoCache *memoFor(UserFunction &function);
+
+    /// Results kept per pure function by default
+    static constexpr size_t DefaultMemoCapacity = 4096;
+
+    /**
+     * @brief Set how many results are kept per pure function (0 disables memoization)
+     */
+    void setMemoCapacity(size_t capacity);
+
+    /**
+     * @brief Get the number of results kept per pure function
+     */
+    size_t getMemoCapacity() const { return m_memoCapacity; }
+
     // Scope management
     /**
      * @brief Push a new scope (for blocks, function calls)
@@ -103,6 +259,56 @@ public:
      */
     int getScopeDepth() const;
 
+    // Call frames
+    /// Nested user function calls allowed by default
+    static constexpr size_t DefaultMaxCallDepth = 1000;
+
+    /**
+     * @brief Start a call: make a frame of function.locals.size() undefined slots current
+     *
+     * Frames live in one contiguous array that only grows, so once it has
+     * reached the deepest recursion seen, calls no longer allocate.
+     * @throws std::runtime_error if the maximum call depth would be exceeded
+     */
+    void pushFrame(const UserFunction &function);
+
+    /**
+     * @brief End the current call and reset its slots
+     */
+    void popFrame();
+
+    /**
+     * @brief Number of calls in progress
+     */
+    size_t getCallDepth() const { return m_frames.size(); }
+
+    /**
+     * @brief Limit how deeply user functions may call each other
+     * @param depth Maximum number of nested calls
+     */
+    void setMaxCallDepth(size_t depth) { m_maxCallDepth = depth; }
+
+    /**
+     * @brief Get the maximum call depth
+     */
+    size_t getMaxCallDepth() const { return m_maxCallDepth; }
+
+    /**
+     * @brief Estimate the bytes held by variables
+     *
+     * Counts the slots of every scope and of the calls in progress, plus the
+     * text of the strings and the elements of the arrays stored in them
+     * (shared payloads once per slot).
+     * Walks every variable, so it is meant for occasional checks.
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * @brief Formulas of the global variables defined in reactive mode
+     */
+    DependencyGraph &dependencies() { return m_dependencies; }
+    const DependencyGraph &dependencies() const { return m_dependencies; }
+
     // Utility methods
     /**
      * @brief Get all available identifiers (variables and functions)
@@ -114,6 +320,16 @@ public:
      * @brief Clear all variables and functions
      */
     void clear();
+
+    /**
+     * @brief Make a context holding copies of the global variables and functions
+     *
+     * The copy has the same global slot layout, so code resolved against this
+     * context runs in it unchanged. Functions share their bodies and compiled
+     * code but get result caches of their own, so the copy may be used on
+     * another thread while this context is only read.
+     */
+    std::unique_ptr<Context> copyGlobals() const;
     
     /**
      * @brief Get all variables in the current scope
@@ -163,13 +379,40 @@ public:
      */
     int getParenLevel() const;
 
+    /**
+     * @brief Get the lexer state after the pending lines
+     *
+     * Kept up to date by addPendingLine(), which lexes only the line added.
+     */
+    const LexState &getPendingState() const { return m_pendingState; }
+
 private:
-    using VariableScope = std::unordered_map<std::string, Value>;
+    struct VariableScope {
+        std::unordered_map<std::string, std::uint32_t> index;
+        std::vector<VariableSlot> slots;
+        std::vector<std::string> names;
+    };
+    
+    struct Frame {
+        size_t base;                  // First slot in m_frameSlots
+        const UserFunction *function; // Kept alive by the caller
+    };
     
     std::vector<VariableScope> m_variableScopes;
-    std::unordered_map<std::string, UserFunction> m_functions;
+    std::unordered_map<std::string, std::shared_ptr<UserFunction>> m_functions;
+    std::vector<VariableSlot> m_frameSlots; // Locals of all calls in progress, innermost last
+    std::vector<Frame> m_frames;
+    size_t m_frameBase;                     // First slot of the innermost frame
+    size_t m_maxCallDepth;
+    size_t m_memoCapacity;
+    bool m_purityKnown;                     // Some function was analyzed since the last invalidateMemos()
+    DependencyGraph m_dependencies;
     std::vector<std::string> m_pendingLines;  // For multi-line parsing
+    LexState m_pendingState;                  // Where the next pending line starts
     
     // Helper methods
-    Value* findVariable(const std::string &name) const;
+    bool isPure(UserFunction &function);
+    void invalidateMemos();
+    const VariableSlot* findVariable(const std::string &name) const;
+    std::uint32_t reserveSlot(VariableScope &scope, const std::string &name);
 };
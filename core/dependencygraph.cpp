@@ -0,0 +1,305 @@
+#include "dependencygraph.h"
+#include "ast.h"
+#include "context.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace
+{
+
+void addName(std::vector<std::string> &names, const std::string &name)
+{
+    if (!isTemporaryName(name) && std::find(names.begin(), names.end(), name) == names.end()) {
+        names.push_back(name);
+    }
+}
+
+class AccessCollector : public ASTVisitor
+{
+public:
+    explicit AccessCollector(StatementAccess &access) : m_access(access) {}
+
+    void collect(ASTNode *node)
+    {
+        if (node) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *node) override { addName(m_access.reads, node->getName()); }
+    void visit(BinaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getLeft());
+        if (node->getOperator() == BinaryOperator::Assign && target) {
+            addName(m_access.writes, target->getName());
+        } else {
+            if (target && isCompoundAssignment(node->getOperator())) {
+                addName(m_access.writes, target->getName());
+            }
+            collect(node->getLeft());
+        }
+        collect(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getOperand());
+        if (target && node->getOperator() != UnaryOperator::Negate && node->getOperator() != UnaryOperator::Not) {
+            addName(m_access.writes, target->getName());
+        }
+        collect(node->getOperand());
+    }
+    void visit(FunctionCallNode *node) override
+    {
+        collect(node->getFunction());
+        for (ASTNode *arg : node->getArguments()) {
+            collect(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        collect(node->getCondition());
+        collect(node->getThenBranch());
+        collect(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        collect(node->getCondition());
+        collect(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        collect(node->getInit());
+        collect(node->getCondition());
+        collect(node->getUpdate());
+        collect(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            collect(statement);
+        }
+    }
+    void visit(FunctionDefNode *node) override { addName(m_access.writes, node->getName()); }
+    void visit(ReturnNode *node) override { collect(node->getValue()); }
+    void visit(PrintNode *node) override
+    {
+        for (ASTNode *expr : node->getExpressions()) {
+            collect(expr);
+        }
+    }
+
+private:
+    static bool isCompoundAssignment(BinaryOperator op)
+    {
+        return op == BinaryOperator::PlusAssign || op == BinaryOperator::MinusAssign ||
+               op == BinaryOperator::MultiplyAssign || op == BinaryOperator::DivideAssign;
+    }
+
+    StatementAccess &m_access;
+};
+
+} // anonymous namespace
+
+StatementAccess analyzeAccess(ASTNode *root)
+{
+    StatementAccess access;
+    AccessCollector(access).collect(root);
+
+    // "name = expression" is a formula when the expression reads something other than the name
+    auto *assignment = nodeCast<BinaryOpNode>(root);
+    if (assignment && assignment->getOperator() == BinaryOperator::Assign && access.writes.size() == 1) {
+        auto *target = nodeCast<IdentifierNode>(assignment->getLeft());
+        if (target && target->getName() == access.writes.front() && !access.reads.empty() &&
+            std::find(access.reads.begin(), access.reads.end(), target->getName()) == access.reads.end()) {
+            access.defines = target->getName();
+        }
+    }
+    return access;
+}
+
+void DependencyGraph::define(const std::string &name, std::string source, std::vector<std::string> reads)
+{
+    checkAcyclic(name, reads);
+    remove(name);
+
+    Definition &definition = m_definitions[name];
+    definition.source = std::move(source);
+    definition.reads = std::move(reads);
+    for (const std::string &read : definition.reads) {
+        m_dependents[read].push_back(name);
+    }
+    invalidate(name);
+}
+
+void DependencyGraph::checkAcyclic(const std::string &name, const std::vector<std::string> &reads) const
+{
+    std::unordered_set<std::string> visited; // Shared by the reads: a definition without a path has none for any
+    for (const std::string &read : reads) {
+        std::vector<std::string> path;
+        if (read == name || findPath(read, name, path, visited)) {
+            std::string cycle = name;
+            cycle += " -> " + read;
+            for (const std::string &step : path) {
+                cycle += " -> " + step;
+            }
+            throw std::runtime_error("Circular definition: " + cycle);
+        }
+    }
+}
+
+bool DependencyGraph::findPath(const std::string &from, const std::string &to, std::vector<std::string> &path,
+                               std::unordered_set<std::string> &visited) const
+{
+    // Each definition is searched once, so a define() is linear in the size of the graph
+    const Definition *definition = find(from);
+    if (!definition || !visited.insert(from).second) {
+        return false;
+    }
+    for (const std::string &read : definition->reads) {
+        path.push_back(read);
+        if (read == to || findPath(read, to, path, visited)) {
+            return true;
+        }
+        path.pop_back();
+    }
+    return false;
+}
+
+void DependencyGraph::remove(const std::string &name)
+{
+    auto found = m_definitions.find(name);
+    if (found == m_definitions.end()) {
+        return;
+    }
+    unlink(name, found->second);
+    if (found->second.stale) {
+        --m_staleCount;
+    }
+    m_definitions.erase(found);
+}
+
+void DependencyGraph::unlink(const std::string &name, const Definition &definition)
+{
+    for (const std::string &read : definition.reads) {
+        auto dependents = m_dependents.find(read);
+        if (dependents != m_dependents.end()) {
+            std::vector<std::string> &list = dependents->second;
+            list.erase(std::remove(list.begin(), list.end(), name), list.end());
+            if (list.empty()) {
+                m_dependents.erase(dependents);
+            }
+        }
+    }
+}
+
+void DependencyGraph::invalidate(const std::string &name)
+{
+    // A stale definition's dependents are stale already
+    std::vector<const std::string *> pending{&name};
+    while (!pending.empty()) {
+        const std::string &changed = *pending.back();
+        pending.pop_back();
+        auto dependents = m_dependents.find(changed);
+        if (dependents == m_dependents.end()) {
+            continue;
+        }
+        for (const std::string &dependent : dependents->second) {
+            Definition &definition = m_definitions.find(dependent)->second;
+            if (!definition.stale) {
+                definition.stale = true;
+                ++m_staleCount;
+                pending.push_back(&dependent);
+            }
+        }
+    }
+}
+
+std::vector<std::string> DependencyGraph::staleOrder(const std::vector<std::string> &names) const
+{
+    std::vector<std::string> order;
+    if (m_staleCount == 0) {
+        return order;
+    }
+    std::unordered_map<std::string, bool> visited;
+    for (const std::string &name : names) {
+        appendStale(name, visited, order);
+    }
+    return order;
+}
+
+std::vector<std::string> DependencyGraph::staleOrder() const
+{
+    std::vector<std::string> order;
+    std::unordered_map<std::string, bool> visited;
+    for (const auto &entry : m_definitions) {
+        if (entry.second.stale) {
+            appendStale(entry.first, visited, order);
+        }
+    }
+    return order;
+}
+
+void DependencyGraph::appendStale(const std::string &name, std::unordered_map<std::string, bool> &visited,
+                                  std::vector<std::string> &order) const
+{
+    // Whatever an up-to-date definition reads is up to date too
+    const Definition *definition = find(name);
+    if (!definition || !definition->stale || visited[name]) {
+        return;
+    }
+    visited[name] = true;
+    for (const std::string &read : definition->reads) {
+        appendStale(read, visited, order);
+    }
+    order.push_back(name);
+}
+
+void DependencyGraph::markFresh(const std::string &name)
+{
+    auto found = m_definitions.find(name);
+    if (found != m_definitions.end() && found->second.stale) {
+        found->second.stale = false;
+        --m_staleCount;
+        ++m_recomputations;
+    }
+}
+
+const DependencyGraph::Definition *DependencyGraph::find(const std::string &name) const
+{
+    auto found = m_definitions.find(name);
+    return found == m_definitions.end() ? nullptr : &found->second;
+}
+
+DependencyGraph::Definition *DependencyGraph::find(const std::string &name)
+{
+    auto found = m_definitions.find(name);
+    return found == m_definitions.end() ? nullptr : &found->second;
+}
+
+void DependencyGraph::dropPrograms()
+{
+    for (auto &entry : m_definitions) {
+        entry.second.program.reset();
+    }
+}
+
+bool DependencyGraph::isStale(const std::string &name) const
+{
+    const Definition *definition = find(name);
+    return definition && definition->stale;
+}
+
+std::vector<std::string> DependencyGraph::dependents(const std::string &name) const
+{
+    auto found = m_dependents.find(name);
+    return found == m_dependents.end() ? std::vector<std::string>() : found->second;
+}
+
+void DependencyGraph::clear()
+{
+    m_definitions.clear();
+    m_dependents.clear();
+    m_staleCount = 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class ASTNode;
+struct PreparedProgram;
+
+/**
+ * @brief Global names a top-level statement reads and writes
+ */
+struct StatementAccess {
+    std::vector<std::string> reads;  // Variables read and user functions called, without duplicates
+    std::vector<std::string> writes; // Variables assigned or incremented, and functions defined
+    std::string defines;             // Target of a statement "name = expression" whose expression reads
+                                     // other names; empty for any other statement
+};
+
+/**
+ * @brief Collect what a top-level statement reads and writes
+ *
+ * Compiler temporaries are left out, and so are the parameters and locals
+ * of function definitions: their bodies run only when called.
+ * @param root Statement, as parsed (and optionally optimized)
+ */
+StatementAccess analyzeAccess(ASTNode *root);
+
+/**
+ * @brief Which definitions read which names, for reactive recomputation
+ *
+ * A definition is a variable whose value comes from a formula ("y = 2*x + 1");
+ * it reads the names its formula reads. Changing a name marks every
+ * definition that depends on it, directly or through other definitions,
+ * stale without recomputing anything. staleOrder() then lists the stale
+ * definitions a read needs in an order that computes each one after what
+ * it reads. Cycles are rejected when a definition is added, so that order
+ * always exists.
+ *
+ * Only the calls a formula makes are recorded, not what the called
+ * functions read: redefining a function makes the definitions calling it
+ * stale, but changing a global one of them reads does not.
+ */
+class DependencyGraph
+{
+public:
+    struct Definition {
+        std::string source;             // Statement that recomputes the variable
+        std::vector<std::string> reads; // Without duplicates
+        bool stale = false;
+        std::shared_ptr<PreparedProgram> program; // Source prepared on the first recomputation
+    };
+
+    /**
+     * @brief Add or replace the definition of a variable; it starts up to date
+     * @param name Variable
+     * @param source Statement that assigns the formula to the variable
+     * @param reads Names the formula reads
+     * @throws std::runtime_error if the definition would depend on itself (graph unchanged)
+     */
+    void define(const std::string &name, std::string source, std::vector<std::string> reads);
+
+    /**
+     * @brief Check that a definition could be added
+     * @throws std::runtime_error naming the cycle it would close
+     */
+    void checkAcyclic(const std::string &name, const std::vector<std::string> &reads) const;
+
+    /**
+     * @brief Forget the definition of a variable that was given a plain value
+     *
+     * Definitions that read the variable keep depending on it.
+     */
+    void remove(const std::string &name);
+
+    /**
+     * @brief Mark every definition depending on a changed name stale
+     *
+     * Visits only definitions that were up to date, so repeated changes
+     * between two reads cost nothing.
+     */
+    void invalidate(const std::string &name);
+
+    /**
+     * @brief Stale definitions the given names need, dependencies first
+     * @param names Names about to be read; those that are stale definitions are included
+     */
+    std::vector<std::string> staleOrder(const std::vector<std::string> &names) const;
+
+    /**
+     * @brief Every stale definition, dependencies first
+     */
+    std::vector<std::string> staleOrder() const;
+
+    /**
+     * @brief Record that a stale definition was recomputed
+     */
+    void markFresh(const std::string &name);
+
+    /**
+     * @brief Get a definition (nullptr if the variable has none)
+     */
+    const Definition *find(const std::string &name) const;
+    Definition *find(const std::string &name);
+
+    /**
+     * @brief Drop the prepared sources, which bound calls and folded constants
+     *        under the function table and optimization level of their time
+     */
+    void dropPrograms();
+
+    bool isStale(const std::string &name) const;
+
+    /**
+     * @brief Definitions that read a name directly
+     */
+    std::vector<std::string> dependents(const std::string &name) const;
+
+    size_t size() const { return m_definitions.size(); }
+    size_t staleCount() const { return m_staleCount; }
+
+    /**
+     * @brief Number of definitions recomputed since the graph was created
+     */
+    std::uint64_t recomputations() const { return m_recomputations; }
+
+    void clear();
+
+private:
+    std::unordered_map<std::string, Definition> m_definitions;
+    std::unordered_map<std::string, std::vector<std::string>> m_dependents; // Name to the definitions reading it
+    size_t m_staleCount = 0;
+    std::uint64_t m_recomputations = 0;
+
+    void unlink(const std::string &name, const Definition &definition);
+    bool findPath(const std::string &from, const std::string &to, std::vector<std::string> &path,
+                  std::unordered_set<std::string> &visited) const;
+    void appendStale(const std::string &name, std::unordered_map<std::string, bool> &visited,
+                     std::vector<std::string> &order) const;
+};
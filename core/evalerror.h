@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Kinds of run-time error
+ */
+enum class ErrorCode : std::uint8_t {
+    None,
+    UndefinedVariable, // Read, compound assignment or increment of a variable never assigned
+    UnknownFunction,   // No builtin or user function of that name takes that many arguments
+    ArgumentCount,     // User function called with the wrong number of arguments
+    DivisionByZero,    // "/", "%" or "div" by zero
+    InvalidTarget,     // Assignment, increment or call of something that is not a name
+    Other              // Thrown by a builtin or an array operation
+};
+
+/**
+ * @brief A run-time error and where it happened
+ *
+ * The failures formulas run into routinely (reading a variable that is not
+ * set, dividing by zero, calling a function that is not defined) are handed
+ * back by the evaluator and the VM as a value like this one rather than
+ * thrown, so a failing evaluation costs about as much as a successful one.
+ * Builtins and array operations still throw, and so do the execution limits
+ * (ExecutionInterrupted).
+ */
+struct EvalError {
+    ErrorCode code = ErrorCode::None;
+    std::string message;
+    int line = 0;   // Of the token the failing node was parsed from (1-based); 0 if unknown
+    int column = 0;
+
+    explicit operator bool() const { return code != ErrorCode::None; }
+
+    void clear()
+    {
+        code = ErrorCode::None;
+        message.clear();
+        line = 0;
+        column = 0;
+    }
+};
@@ -1,4 +1,11 @@
 #include "evaluator.h"
+#include "arrayops.h"
+#include "budget.h"
+#include "builtins.h"
+#include "memocache.h"
+#include "outputsink.h"
+#include "parallelfor.h"
+#include "profiler.h"
 #include <cmath>
 #include <stdexcept>
 #include <algorithm>
@@ -12,14 +19,30 @@
 #define M_E 2.71828182845904523536
 #endif
 
+namespace
+{
+
+BinaryOperator compoundOperator(BinaryOperator op)
+{
+    switch (op) {
+    case BinaryOperator::PlusAssign: return BinaryOperator::Add;
+    case BinaryOperator::MinusAssign: return BinaryOperator::Subtract;
+    case BinaryOperator::MultiplyAssign: return BinaryOperator::Multiply;
+    default: return BinaryOperator::Divide;
+    }
+}
+
+} // anonymous namespace
+
 Evaluator::Evaluator()
-    : m_context(nullptr), m_result(), m_hasReturned(false)
+    : m_context(nullptr), m_result(), m_hasReturned(false), m_output(&OutputSink::standardOutput()),
+      m_profiler(nullptr), m_budget(nullptr), m_parallel(nullptr)
 {
 }
 
 Evaluator::~Evaluator() = default;
 
-Value Evaluator::evaluate(ASTNode *node, Context *context)
+bool Evaluator::evaluate(ASTNode *node, Context *context, Value &result)
 {
     if (!node)
     {
@@ -27,6 +50,13 @@ Value Evaluator::evaluate(ASTNode *node, Context *context)
     }
 
     m_context = context;
+    m_error.clear();
+    result = evaluateNode(node);
+    return !failed();
+}
+
+Value Evaluator::evaluateNode(ASTNode *node)
+{
     m_hasReturned = false;
     m_result = Value();
 
@@ -34,6 +64,15 @@ Value Evaluator::evaluate(ASTNode *node, Context *context)
     return m_result;
 }
 
+void Evaluator::fail(ErrorCode code, std::string message, const ASTNode *node)
+{
+    m_error.code = code;
+    m_error.message = std::move(message);
+    m_error.line = node->getLine();
+    m_error.column = node->getColumn();
+    m_result = Value();
+}
+
 void Evaluator::visit(LiteralNode *node)
 {
     m_result = node->getValue();
@@ -41,7 +80,7 @@ void Evaluator::visit(LiteralNode *node)
 
 void Evaluator::visit(IdentifierNode *node)
 {
-    std::string name = node->getName();
+    const std::string &name = node->getName();
 
     // Check for mathematical constants first
     if (name == "pi")
@@ -56,14 +95,31 @@ void Evaluator::visit(IdentifierNode *node)
     }
 
     // Check for variables in context
-    if (m_context && m_context->hasVariable(name))
+    if (m_context)
     {
-        m_result = m_context->getVariable(name);
-        return;
+        const VariableSlot &slot = variableSlot(node);
+        if (slot.defined)
+        {
+            if (m_profiler)
+            {
+                m_profiler->count(Profiler::VariableLoads);
+            }
+            m_result = slot.value;
+            return;
+        }
     }
 
-    // Variable not found
-    throw std::runtime_error("Undefined variable: " + name);
+    fail(ErrorCode::UndefinedVariable, "Undefined variable: " + name, node);
+}
+
+VariableSlot &Evaluator::variableSlot(IdentifierNode *node)
+{
+    // Trees that did not go through the Resolver get bound on first use
+    if (!node->isResolved()) {
+        SlotRef ref = m_context->resolveVariable(node->getName());
+        node->resolve(ref.depth, ref.index);
+    }
+    return m_context->slot(SlotRef{node->getScopeDepth(), node->getSlotIndex()});
 }
 
 void Evaluator::visit(BinaryOpNode *node)
@@ -75,51 +131,62 @@ void Evaluator::visit(BinaryOpNode *node)
         node->getOperator() == BinaryOperator::MultiplyAssign ||
         node->getOperator() == BinaryOperator::DivideAssign) {
         
-        if (auto *identNode = dynamic_cast<IdentifierNode *>(node->getLeft())) {
-            Value right = evaluate(node->getRight(), m_context);
+        if (auto *identNode = nodeCast<IdentifierNode>(node->getLeft())) {
+            Value right = evaluateNode(node->getRight());
+            if (failed()) {
+                return;
+            }
+            if (!m_context) {
+                throw std::runtime_error("No context for variable assignment");
+            }
             
+            VariableSlot &slot = variableSlot(identNode);
             if (node->getOperator() == BinaryOperator::Assign) {
-                if (m_context) {
-                    m_context->setVariable(identNode->getName(), right);
-                    m_result = right;
-                } else {
-                    throw std::runtime_error("No context for variable assignment");
-                }
+                slot.value = right;
+                slot.defined = true;
+                m_result = right;
             } else {
-                // For compound assignments, get the current value
-                Value current;
-                if (m_context && m_context->hasVariable(identNode->getName())) {
-                    current = m_context->getVariable(identNode->getName());
-                } else {
-                    throw std::runtime_error("Variable not found for compound assignment: " + identNode->getName());
+                // For compound assignments, update the current value in place
+                if (!slot.defined) {
+                    fail(ErrorCode::UndefinedVariable,
+                         "Variable not found for compound assignment: " + identNode->getName(), identNode);
+                    return;
                 }
                 
-                Value newValue;
-                if (node->getOperator() == BinaryOperator::PlusAssign) {
-                    newValue = current + right;
+                if (slot.value.isArray() || right.isArray()) {
+                    // An unshared array is updated in place
+                    slot.value = elementwise(compoundOperator(node->getOperator()), std::move(slot.value), std::move(right));
+                    checkSize(slot.value);
+                } else if (node->getOperator() == BinaryOperator::PlusAssign) {
+                    slot.value = slot.value + right;
+                    checkSize(slot.value);
                 } else if (node->getOperator() == BinaryOperator::MinusAssign) {
-                    newValue = current - right;
+                    slot.value = slot.value - right;
                 } else if (node->getOperator() == BinaryOperator::MultiplyAssign) {
-                    newValue = current * right;
+                    slot.value = slot.value * right;
                 } else if (node->getOperator() == BinaryOperator::DivideAssign) {
-                    newValue = current / right;
-                }
-                
-                if (m_context) {
-                    m_context->setVariable(identNode->getName(), newValue);
-                    m_result = newValue;
-                } else {
-                    throw std::runtime_error("No context for variable assignment");
+                    if (right.toNumber() == 0.0) {
+                        fail(ErrorCode::DivisionByZero, "Division by zero", node);
+                        return;
+                    }
+                    slot.value = slot.value / right;
                 }
+                m_result = slot.value;
+            }
+            if (m_profiler) {
+                m_profiler->count(Profiler::VariableStores);
             }
         } else {
-            throw std::runtime_error("Invalid assignment target");
+            fail(ErrorCode::InvalidTarget, "Invalid assignment target", node);
         }
         return;
     }
 
     // Evaluate left operand for other operations
-    Value left = evaluate(node->getLeft(), m_context);
+    Value left = evaluateNode(node->getLeft());
+    if (failed()) {
+        return;
+    }
 
     // Handle short-circuit evaluation for logical operators
     if (node->getOperator() == BinaryOperator::And) {
@@ -127,7 +194,10 @@ void Evaluator::visit(BinaryOpNode *node)
             m_result = Value(false);
             return;
         }
-        Value right = evaluate(node->getRight(), m_context);
+        Value right = evaluateNode(node->getRight());
+        if (failed()) {
+            return;
+        }
         m_result = Value(right.toBool());
         return;
     }
@@ -137,17 +207,30 @@ void Evaluator::visit(BinaryOpNode *node)
             m_result = Value(true);
             return;
         }
-        Value right = evaluate(node->getRight(), m_context);
+        Value right = evaluateNode(node->getRight());
+        if (failed()) {
+            return;
+        }
         m_result = Value(right.toBool());
         return;
     }
 
     // Evaluate right operand for other operators
-    Value right = evaluate(node->getRight(), m_context);
+    Value right = evaluateNode(node->getRight());
+    if (failed()) {
+        return;
+    }
+
+    if (left.isArray() || right.isArray()) {
+        m_result = elementwise(node->getOperator(), std::move(left), std::move(right));
+        checkSize(m_result);
+        return;
+    }
 
     switch (node->getOperator()) {
     case BinaryOperator::Add:
         m_result = left + right;
+        checkSize(m_result);
         break;
     case BinaryOperator::Subtract:
         m_result = left - right;
@@ -157,7 +240,8 @@ void Evaluator::visit(BinaryOpNode *node)
         break;
     case BinaryOperator::Divide:
         if (right.toNumber() == 0.0) {
-            throw std::runtime_error("Division by zero");
+            fail(ErrorCode::DivisionByZero, "Division by zero", node);
+            return;
         }
         m_result = left / right;
         break;
@@ -168,7 +252,8 @@ void Evaluator::visit(BinaryOpNode *node)
         double leftVal = left.toNumber();
         double rightVal = right.toNumber();
         if (rightVal == 0.0) {
-            throw std::runtime_error("Modulo by zero");
+            fail(ErrorCode::DivisionByZero, "Modulo by zero", node);
+            return;
         }
         // Use fmod for floating-point modulo
         m_result = Value(std::fmod(leftVal, rightVal));
@@ -177,7 +262,8 @@ void Evaluator::visit(BinaryOpNode *node)
         double leftVal = left.toNumber();
         double rightVal = right.toNumber();
         if (rightVal == 0.0) {
-            throw std::runtime_error("Integer division by zero");
+            fail(ErrorCode::DivisionByZero, "Integer division by zero", node);
+            return;
         }
         // Integer division - truncate towards zero
         m_result = Value(std::trunc(leftVal / rightVal));
@@ -210,76 +296,53 @@ void Evaluator::visit(UnaryOpNode *node)
     switch (node->getOperator())
     {
     case UnaryOperator::Negate: {
-        Value operand = evaluate(node->getOperand(), m_context);
-        m_result = Value(-operand.toNumber());
+        Value operand = evaluateNode(node->getOperand());
+        if (failed()) {
+            return;
+        }
+        m_result = operand.isArray() ? negateElements(std::move(operand)) : Value(-operand.toNumber());
         break;
     }
     case UnaryOperator::Not: {
-        Value operand = evaluate(node->getOperand(), m_context);
-        m_result = Value(!operand.toBool());
-        break;
-    }
-    case UnaryOperator::PreIncrement: {
-        // Pre-increment: ++x
-        if (auto *identNode = dynamic_cast<IdentifierNode *>(node->getOperand())) {
-            if (m_context && m_context->hasVariable(identNode->getName())) {
-                Value current = m_context->getVariable(identNode->getName());
-                Value newValue = Value(current.toNumber() + 1.0);
-                m_context->setVariable(identNode->getName(), newValue);
-                m_result = newValue;
-            } else {
-                throw std::runtime_error("Variable not found for pre-increment: " + identNode->getName());
-            }
-        } else {
-            throw std::runtime_error("Pre-increment can only be applied to variables");
+        Value operand = evaluateNode(node->getOperand());
+        if (failed()) {
+            return;
         }
+        m_result = Value(!operand.toBool());
         break;
     }
-    case UnaryOperator::PostIncrement: {
-        // Post-increment: x++
-        if (auto *identNode = dynamic_cast<IdentifierNode *>(node->getOperand())) {
-            if (m_context && m_context->hasVariable(identNode->getName())) {
-                Value current = m_context->getVariable(identNode->getName());
-                Value newValue = Value(current.toNumber() + 1.0);
-                m_context->setVariable(identNode->getName(), newValue);
-                m_result = current; // Return original value
-            } else {
-                throw std::runtime_error("Variable not found for post-increment: " + identNode->getName());
-            }
-        } else {
-            throw std::runtime_error("Post-increment can only be applied to variables");
+    case UnaryOperator::PreIncrement:
+    case UnaryOperator::PostIncrement:
+    case UnaryOperator::PreDecrement:
+    case UnaryOperator::PostDecrement: {
+        const bool isIncrement = node->getOperator() == UnaryOperator::PreIncrement ||
+                                 node->getOperator() == UnaryOperator::PostIncrement;
+        const bool isPost = node->getOperator() == UnaryOperator::PostIncrement ||
+                            node->getOperator() == UnaryOperator::PostDecrement;
+        const char *operation = isPost ? (isIncrement ? "post-increment" : "post-decrement")
+                                       : (isIncrement ? "pre-increment" : "pre-decrement");
+
+        auto *identNode = nodeCast<IdentifierNode>(node->getOperand());
+        if (!identNode) {
+            std::string message = std::string(operation) + " can only be applied to variables";
+            message[0] = 'P';
+            fail(ErrorCode::InvalidTarget, std::move(message), node);
+            return;
         }
-        break;
-    }
-    case UnaryOperator::PreDecrement: {
-        // Pre-decrement: --x
-        if (auto *identNode = dynamic_cast<IdentifierNode *>(node->getOperand())) {
-            if (m_context && m_context->hasVariable(identNode->getName())) {
-                Value current = m_context->getVariable(identNode->getName());
-                Value newValue = Value(current.toNumber() - 1.0);
-                m_context->setVariable(identNode->getName(), newValue);
-                m_result = newValue;
-            } else {
-                throw std::runtime_error("Variable not found for pre-decrement: " + identNode->getName());
-            }
-        } else {
-            throw std::runtime_error("Pre-decrement can only be applied to variables");
+
+        // One slot access covers the existence check, the read and the write
+        VariableSlot *slot = m_context ? &variableSlot(identNode) : nullptr;
+        if (!slot || !slot->defined) {
+            fail(ErrorCode::UndefinedVariable,
+                 std::string("Variable not found for ") + operation + ": " + identNode->getName(), identNode);
+            return;
         }
-        break;
-    }
-    case UnaryOperator::PostDecrement: {
-        // Post-decrement: x--
-        if (auto *identNode = dynamic_cast<IdentifierNode *>(node->getOperand())) {
-            if (m_context && m_context->hasVariable(identNode->getName())) {
-                Value current = m_context->getVariable(identNode->getName());
-                Value newValue = Value(current.toNumber() - 1.0);
-                m_context->setVariable(identNode->getName(), newValue);
-                m_result = current; // Return original value
-            } else {
-                throw std::runtime_error("Variable not found for post-decrement: " + identNode->getName());
-            }
-        } else {
-            throw std::runtime_error("Post-decrement can only be applied to variables");
+
+        Value current = slot->value;
+        slot->value = Value(current.toNumber() + (isIncrement ? 1.0 : -1.0));
+        m_result = isPost ? current : slot->value;
+        if (m_profiler) {
+            m_profiler->count(Profiler::VariableStores);
         }
         break;
     }
@@ -291,123 +354,163 @@ void Evaluator::visit(UnaryOpNode *node)
 void Evaluator::visit(FunctionCallNode *node)
 {
     // Get function name
-    IdentifierNode *funcNode = dynamic_cast<IdentifierNode *>(node->getFunction());
+    IdentifierNode *funcNode = nodeCast<IdentifierNode>(node->getFunction());
     if (!funcNode)
     {
-        throw std::runtime_error("Invalid function call");
-    }
-
-    std::string funcName = funcNode->getName();
-
-    // Evaluate arguments
-    std::vector<Value> args;
-    for (const auto &arg : node->getArguments())
-    {
-        args.push_back(evaluate(arg.get(), m_context));
+        fail(ErrorCode::InvalidTarget, "Invalid function call", node);
+        return;
     }
 
-    // Check for built-in functions
-    m_result = evaluateBuiltinFunction(funcName, args);
-}
+    const auto &arguments = node->getArguments();
 
-Value Evaluator::evaluateBuiltinFunction(const std::string &name, const std::vector<Value> &args)
-{
-    // Mathematical functions
-    if (name == "sin" && args.size() == 1)
-    {
-        return Value(std::sin(args[0].toNumber()));
-    }
-    else if (name == "cos" && args.size() == 1)
-    {
-        return Value(std::cos(args[0].toNumber()));
-    }
-    else if (name == "tan" && args.size() == 1)
+    // Evaluate arguments into a fixed buffer; only unusually wide calls allocate
+    constexpr size_t kInlineArguments = 8;
+    Value inlineArgs[kInlineArguments];
+    std::vector<Value> spilledArgs;
+    Value *args = inlineArgs;
+    if (arguments.size() > kInlineArguments)
     {
-        return Value(std::tan(args[0].toNumber()));
+        spilledArgs.resize(arguments.size());
+        args = spilledArgs.data();
     }
-    else if (name == "sqrt" && args.size() == 1)
+    for (size_t i = 0; i < arguments.size(); ++i)
     {
-        double val = args[0].toNumber();
-        if (val < 0)
+        args[i] = evaluateNode(arguments[i]);
+        if (failed())
         {
-            throw std::runtime_error("Square root of negative number");
+            return;
         }
-        return Value(std::sqrt(val));
     }
-    else if (name == "log" && args.size() == 1)
+
+    // Calls are normally bound by the Resolver; fall back to the standard table otherwise
+    const BuiltinFunction *builtin = node->getBuiltin();
+    if (!builtin)
     {
-        double val = args[0].toNumber();
-        if (val <= 0)
+        builtin = BuiltinRegistry::standard().find(funcNode->getName());
+        if (builtin && !builtin->accepts(arguments.size()))
         {
-            throw std::runtime_error("Logarithm of non-positive number");
+            builtin = nullptr;
         }
-        return Value(std::log(val));
     }
-    else if (name == "log10" && args.size() == 1)
+    if (builtin)
     {
-        double val = args[0].toNumber();
-        if (val <= 0)
+        if (m_profiler)
         {
-            throw std::runtime_error("Log10 of non-positive number");
+            Profiler::Clock::time_point start = Profiler::Clock::now();
+            m_result = builtin->function(Span<const Value>(args, arguments.size()));
+            m_profiler->builtinCall(*builtin, start);
+            checkSize(m_result);
+            return;
         }
-        return Value(std::log10(val));
+        m_result = builtin->function(Span<const Value>(args, arguments.size()));
+        checkSize(m_result);
+        return;
     }
-    else if (name == "exp" && args.size() == 1)
+
+    std::shared_ptr<UserFunction> function = m_context ? m_context->findFunction(funcNode->getName()) : nullptr;
+    if (!function)
     {
-        return Value(std::exp(args[0].toNumber()));
+        fail(ErrorCode::UnknownFunction,
+             "Unknown function: " + funcNode->getName() + " with " + std::to_string(arguments.size()) + " arguments",
+             node);
+        return;
     }
-    else if (name == "abs" && args.size() == 1)
+    m_result = callFunction(*function, args, arguments.size(), node);
+}
+
+void Evaluator::step()
+{
+    if (m_budget)
     {
-        return Value(std::abs(args[0].toNumber()));
+        m_budget->step();
     }
-    else if (name == "pow" && args.size() == 2)
+}
+
+void Evaluator::checkSize(const Value &value) const
+{
+    // Strings and arrays are checked when built, since a statement without a loop never meters memory
+    if (m_budget && value.getType() == Value::String)
     {
-        return Value(std::pow(args[0].toNumber(), args[1].toNumber()));
+        m_budget->checkString(value.asString().size());
     }
-    else if (name == "min" && args.size() == 2)
+    else if (m_budget && value.isArray())
     {
-        return Value(std::min(args[0].toNumber(), args[1].toNumber()));
+        m_budget->checkArray(value.asArray().size());
     }
-    else if (name == "max" && args.size() == 2)
-    {
-        return Value(std::max(args[0].toNumber(), args[1].toNumber()));
-    } // In evaluator.cpp, add to evaluateBuiltinFunction():
+}
 
-    else if (name == "root" && args.size() == 2)
+Value Evaluator::callFunction(UserFunction &function, const Value *args, size_t count, const ASTNode *call)
+{
+    step();
+    if (count != function.parameters.size())
     {
-        double n = args[0].toNumber(); // The root degree (2 for square root, 3 for cube root, etc.)
-        double x = args[1].toNumber(); // The number to take the root of
+        fail(ErrorCode::ArgumentCount,
+             "Function " + function.name + " expects " + std::to_string(function.parameters.size()) +
+                 " arguments, got " + std::to_string(count),
+             call);
+        return Value();
+    }
 
-        if (n == 0)
-        {
-            throw std::runtime_error("Root degree cannot be zero");
-        }
-        if (x < 0 && std::fmod(n, 2) == 0)
+    std::shared_ptr<MemoCache> memo = m_context->memoFor(function) ? function.memo : nullptr;
+    if (memo)
+    {
+        if (const Value *cached = memo->lookup(Span<const Value>(args, count)))
         {
-            throw std::runtime_error("Even root of negative number");
+            if (m_profiler)
+            {
+                m_profiler->memoHit(function.name);
+            }
+            return *cached;
         }
-
-        // nth root of x = x^(1/n)
-        return Value(std::pow(x, 1.0 / n));
     }
-    else if (name == "cbrt" && args.size() == 1)
+
+    m_context->pushFrame(function);
+    struct FrameGuard {
+        Context *context;
+        ~FrameGuard() { context->popFrame(); }
+    } guard{m_context};
+
+    for (size_t i = 0; i < count; ++i)
     {
-        // Cube root (alternative to root(3, x))
-        return Value(std::cbrt(args[0].toNumber()));
+        VariableSlot &slot = m_context->slot(SlotRef{SlotRef::FrameDepth, static_cast<std::uint32_t>(i)});
+        slot.value = args[i];
+        slot.defined = true;
     }
 
-    throw std::runtime_error("Unknown function: " + name + " with " + std::to_string(args.size()) + " arguments");
+    // Calls an error abandons are closed when the profiled statement ends
+    if (m_profiler)
+    {
+        m_profiler->enterFunction(function.name);
+    }
+    Value result = evaluateNode(function.body);
+    if (failed())
+    {
+        return Value();
+    }
+    if (m_profiler)
+    {
+        m_profiler->leaveFunction();
+    }
+    m_hasReturned = false; // A return ends the call, not the caller
+    if (memo)
+    {
+        memo->insert(Span<const Value>(args, count), result);
+    }
+    return result;
 }
 
 // Placeholder implementations for other node types
 void Evaluator::visit(IfNode *node)
 {
-    Value condition = evaluate(node->getCondition(), m_context);
+    Value condition = evaluateNode(node->getCondition());
+    if (failed()) {
+        return;
+    }
 
     if (condition.toBool()) {
-        m_result = evaluate(node->getThenBranch(), m_context);
+        m_result = evaluateNode(node->getThenBranch());
     } else if (node->getElseBranch()) {
-        m_result = evaluate(node->getElseBranch(), m_context);
+        m_result = evaluateNode(node->getElseBranch());
     } else {
         m_result = Value(); // null/void result for if without else
     }
@@ -419,13 +522,26 @@ void Evaluator::visit(WhileNode *node)
 
     while (true)
     {
-        Value condition = evaluate(node->getCondition(), m_context);
+        Value condition = evaluateNode(node->getCondition());
+        if (failed())
+        {
+            return;
+        }
         if (!condition.toBool())
         {
             break;
         }
 
-        m_result = evaluate(node->getBody(), m_context);
+        m_result = evaluateNode(node->getBody());
+        if (failed())
+        {
+            return;
+        }
+        if (m_profiler)
+        {
+            m_profiler->count(Profiler::LoopIterations);
+        }
+        step();
 
         if (m_hasReturned)
         {
@@ -439,8 +555,65 @@ void Evaluator::visit(WhileNode *node)
 
 void Evaluator::visit(ForNode *node)
 {
-    // Simplified for now
-    throw std::runtime_error("For loops not yet implemented");
+    if (node->isParallel())
+    {
+        // A failure leaves m_error at the position of the failing node in the loop
+        ParallelLoops &loops = m_parallel ? *m_parallel : ParallelLoops::sequential();
+        loops.run(node, *m_context, m_budget, m_error);
+        m_result = Value();
+        return;
+    }
+
+    if (node->getInit())
+    {
+        evaluateNode(node->getInit());
+        if (failed())
+        {
+            return;
+        }
+    }
+
+    // Like while loops, keep the last body result or null if no iterations
+    Value lastResult;
+    while (true)
+    {
+        if (node->getCondition())
+        {
+            Value condition = evaluateNode(node->getCondition());
+            if (failed())
+            {
+                return;
+            }
+            if (!condition.toBool())
+            {
+                break;
+            }
+        }
+        lastResult = evaluateNode(node->getBody());
+        if (failed())
+        {
+            return;
+        }
+        if (m_profiler)
+        {
+            m_profiler->count(Profiler::LoopIterations);
+        }
+        step();
+        if (m_hasReturned)
+        {
+            break;
+        }
+
+        if (node->getUpdate())
+        {
+            evaluateNode(node->getUpdate());
+            if (failed())
+            {
+                return;
+            }
+        }
+    }
+    m_result = lastResult;
 }
 
 void Evaluator::visit(BlockNode *node)
@@ -448,7 +621,10 @@ void Evaluator::visit(BlockNode *node)
     Value lastResult;
 
     for (const auto &statement : node->getStatements()) {
-        lastResult = evaluate(statement.get(), m_context);
+        lastResult = evaluateNode(statement);
+        if (failed()) {
+            return;
+        }
 
         // Check for early return
         if (m_hasReturned) {
@@ -462,15 +638,23 @@ void Evaluator::visit(BlockNode *node)
 
 void Evaluator::visit(FunctionDefNode *node)
 {
-    // Function definitions would be handled here
-    throw std::runtime_error("Function definitions not yet implemented");
+    if (!m_context)
+    {
+        throw std::runtime_error("No context for function definition");
+    }
+    m_context->defineFunction(node);
+    m_result = Value();
 }
 
 void Evaluator::visit(ReturnNode *node)
 {
     if (node->getValue())
     {
-        m_result = evaluate(node->getValue(), m_context);
+        m_result = evaluateNode(node->getValue());
+        if (failed())
+        {
+            return;
+        }
     }
     else
     {
@@ -489,15 +673,28 @@ void Evaluator::visit(ReturnNode *node)
 
 void Evaluator::visit(PrintNode *node)
 {
+    // Built locally: an argument may call a function that prints itself
     std::string output;
     
     for (const auto& expr : node->getExpressions()) {
-        Value result = evaluate(expr.get(), m_context);
-        output += result.toString();
+        Value result = evaluateNode(expr);
+        if (failed()) {
+            return;
+        }
+        result.appendTo(output);
     }
+    output += '\n';
     
-    // Output to console (you might want to customize this)
-    std::cout << output << std::endl;
+    // Only the write is timed: calls in the arguments are profiled on their own
+    Profiler::Clock::time_point start;
+    if (m_profiler) {
+        start = Profiler::Clock::now();
+    }
+    
+    m_output->write(output.data(), output.size());
+    if (m_profiler) {
+        m_profiler->print(start);
+    }
     
     // Print statements don't return a value, but we need to set something
     m_result = Value();
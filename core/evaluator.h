@@ -2,8 +2,14 @@
 
 #include "ast.h"
 #include "context.h"
+#include "evalerror.h"
 #include <memory>
 
+class ExecutionBudget;
+class OutputSink;
+class ParallelLoops;
+class Profiler;
+
 /**
  * @brief Evaluates AST nodes and returns values
  */
@@ -15,11 +21,45 @@ public:
     
     /**
      * @brief Evaluate an AST node with given context
+     *
+     * The errors listed in ErrorCode are returned without throwing, at the
+     * position of the node that failed. Builtins, array operations and the
+     * budget may still throw.
      * @param node The AST node to evaluate
      * @param context The execution context
-     * @return The result value
+     * @param result Receives the result value
+     * @return False if evaluation failed, with error() telling why
+     */
+    bool evaluate(ASTNode* node, Context* context, Value& result);
+
+    /**
+     * @brief Why the last evaluate() failed
+     */
+    const EvalError& error() const { return m_error; }
+
+    /**
+     * @brief Set where print statements write (OutputSink::standardOutput() by default)
+     * @param output Sink that outlives the evaluator
+     */
+    void setOutput(OutputSink* output) { m_output = output; }
+
+    /**
+     * @brief Report calls, loops and variable accesses to a profiler
+     * @param profiler Profiler that outlives the evaluator, or nullptr to stop profiling
+     */
+    void setProfiler(Profiler* profiler) { m_profiler = profiler; }
+
+    /**
+     * @brief Meter loop iterations and calls, and strings built by concatenation, against a budget
+     * @param budget Budget that outlives the evaluator, or nullptr to run unmetered
+     */
+    void setBudget(ExecutionBudget* budget) { m_budget = budget; }
+
+    /**
+     * @brief Run parallel for loops with the given loops (ParallelLoops::sequential() by default)
+     * @param loops Loops that outlive the evaluator, or nullptr for the default
      */
-    Value evaluate(ASTNode* node, Context* context);
+    void setParallelLoops(ParallelLoops* loops) { m_parallel = loops; }
     
     // ASTVisitor interface
     void visit(LiteralNode* node) override;
@@ -36,9 +76,28 @@ public:
     void visit(PrintNode* node) override;
 
 private:
+    /**
+     * @brief Evaluate a child node; check failed() before using the result
+     */
+    Value evaluateNode(ASTNode* node);
+
+    /**
+     * @brief Record an error at a node; visits return as soon as they see one
+     */
+    void fail(ErrorCode code, std::string message, const ASTNode* node);
+    bool failed() const { return m_error.code != ErrorCode::None; }
+
+    VariableSlot& variableSlot(IdentifierNode* node);
+    Value callFunction(UserFunction& function, const Value* args, size_t count, const ASTNode* call);
+    void step();
+    void checkSize(const Value& value) const;
+
     Context* m_context;
     Value m_result;
     bool m_hasReturned;
-    
-    Value evaluateBuiltinFunction(const std::string& name, const std::vector<Value>& args);
+    OutputSink* m_output;
+    Profiler* m_profiler;
+    ExecutionBudget* m_budget;
+    ParallelLoops* m_parallel;
+    EvalError m_error;
 };
\ No newline at end of file
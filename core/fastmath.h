@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+/**
+ * @brief Polynomial approximations of sin, cos, tan, exp, log and pow for the fast-math mode
+ *
+ * Each function reduces its argument to a small interval with a few exact
+ * operations (a multiple of pi/2 or ln 2 subtracted in three or two parts,
+ * or the exponent taken out of the bits) and evaluates a minimax polynomial
+ * on that interval. The kernels have no branches and no calls, so loops over
+ * them vectorize. Arguments a kernel does not reduce accurately (huge
+ * angles, non-positive bases of pow) are handed to libm by the wrappers.
+ *
+ * Called one value at a time, exp, log and log2 take 1.1 to 1.4 times and
+ * pow about 1.5 times as long as glibc's table-driven versions (glossai_bench
+ * --filter math/), so the fast-math builtins use these kernels only in
+ * batches. sin, cos, tan and log10 gain in both, and the builtins and the
+ * JIT call them too.
+ *
+ * Maximum relative errors against libm, over the reduced interval and
+ * sampled arguments (glossai_bench --filter math/ measures them again):
+ *
+ *     sin, cos, tan     9e-12 for |x| <= TrigLimit (libm beyond)
+ *     exp               1.2e-12 (subnormal results keep only their own precision)
+ *     log, log2, log10  6e-14
+ *     pow               1.2e-12 + 6e-14 |y ln x|; libm when x <= 0 or y is not finite
+ *
+ * sin(0), cos(0), exp(0), log(1) and pow(x, 0) are exact; results near the
+ * zeros of sin, cos and tan keep the error relative to their own size.
+ */
+namespace FastMath
+{
+
+/// |x| up to which sin, cos and tan reduce their argument exactly
+constexpr double TrigLimit = 1048576.0;
+
+/// Adding this to a double of magnitude below 2^51 rounds it to an integer kept in the low mantissa bits
+constexpr double RoundShift = 6755399441055744.0; // 1.5 * 2^52
+
+inline std::uint64_t bitsOf(double x)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+inline double fromBits(std::uint64_t bits)
+{
+    double x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// pi/2 split into two 33-bit parts and a tail, so k * part is exact for k < 2^20
+constexpr double TwoOverPi = 0.6366197723675814;
+constexpr double PiOver2Hi = 1.5707963267341256;
+constexpr double PiOver2Mid = 6.077100506303966e-11;
+constexpr double PiOver2Lo = 2.0222662487959506e-21;
+
+/**
+ * @brief x minus the nearest multiple k of pi/2, and k (in the low bits of quadrant)
+ */
+struct Quadrant {
+    double r; // In [-pi/4, pi/4]
+    std::uint64_t quadrant;
+};
+
+inline Quadrant reduceQuadrant(double x)
+{
+    double shifted = x * TwoOverPi + RoundShift;
+    double k = shifted - RoundShift;
+    double r = ((x - k * PiOver2Hi) - k * PiOver2Mid) - k * PiOver2Lo;
+    return {r, bitsOf(shifted)};
+}
+
+/// sin(r) for |r| <= pi/4: r (1 + r^2 S(r^2)), relative error below 9e-12 (and sin(-0) = -0)
+inline double sinPolynomial(double r)
+{
+    double z = r * r;
+    return r * (1.0 + z * (-0.16666666644219777 + z * (0.008333329329071243 +
+                           z * (-0.0001983926154509825 + z * 2.7173493937256626e-06))));
+}
+
+/// cos(r) for |r| <= pi/4: 1 - r^2/2 + r^4 C(r^2), relative error below 4e-13
+inline double cosPolynomial(double r)
+{
+    double z = r * r;
+    return 1.0 - 0.5 * z + z * z * (0.041666666647930485 + z * (-0.0013888885547024218 +
+                                    z * (2.479991154704386e-05 + z * -2.7237157773617603e-07)));
+}
+
+/**
+ * @brief a where mask is all ones, b where it is zero
+ *
+ * The kernels select with masks computed from the bits: GCC does not
+ * if-convert conditionals on doubles under the default -ftrapping-math,
+ * and SSE2 has no 64-bit integer compare.
+ */
+inline double blend(std::uint64_t mask, double a, double b)
+{
+    return fromBits((bitsOf(a) & mask) | (bitsOf(b) & ~mask));
+}
+
+/// odd if bit 0 of quadrant is set, otherwise even
+inline double selectOdd(std::uint64_t quadrant, double odd, double even)
+{
+    return blend(0 - (quadrant & 1), odd, even);
+}
+
+/// Flip the sign of x when bit 1 of quadrant is set
+inline double negateIf(double x, std::uint64_t quadrant)
+{
+    return fromBits(bitsOf(x) ^ ((quadrant & 2) << 62));
+}
+
+/**
+ * @brief sin(x) for |x| <= TrigLimit (NaN for NaN and infinities)
+ */
+inline double sinKernel(double x)
+{
+    Quadrant q = reduceQuadrant(x);
+    return negateIf(selectOdd(q.quadrant, cosPolynomial(q.r), sinPolynomial(q.r)), q.quadrant);
+}
+
+/**
+ * @brief cos(x) for |x| <= TrigLimit (NaN for NaN and infinities)
+ */
+inline double cosKernel(double x)
+{
+    Quadrant q = reduceQuadrant(x);
+    return negateIf(selectOdd(q.quadrant, sinPolynomial(q.r), cosPolynomial(q.r)), q.quadrant + 1);
+}
+
+/**
+ * @brief tan(x) for |x| <= TrigLimit (NaN for NaN and infinities)
+ */
+inline double tanKernel(double x)
+{
+    Quadrant q = reduceQuadrant(x);
+    double s = sinPolynomial(q.r);
+    double c = cosPolynomial(q.r);
+    // -c / s in odd quadrants
+    return negateIf(selectOdd(q.quadrant, c, s) / selectOdd(q.quadrant, s, c), q.quadrant << 1);
+}
+
+inline bool trigInRange(double x) { return std::abs(x) <= TrigLimit; }
+
+inline double sin(double x) { return trigInRange(x) ? sinKernel(x) : std::sin(x); }
+inline double cos(double x) { return trigInRange(x) ? cosKernel(x) : std::cos(x); }
+inline double tan(double x) { return trigInRange(x) ? tanKernel(x) : std::tan(x); }
+
+// ln 2 split so that k * Ln2Hi is exact for |k| < 2^11
+constexpr double Log2E = 1.4426950408889634;
+constexpr double Ln2Hi = 0.6931471803691238;
+constexpr double Ln2Lo = 1.9082149292705877e-10;
+constexpr double ExpLimit = 746.0; // exp(x) has overflowed to infinity or rounded to 0 beyond +-ExpLimit
+
+/**
+ * @brief exp(x): 2^k exp(r) with |r| <= ln(2)/2, exp(r) = 1 + r + r^2 E(r)
+ */
+inline double exp(double x)
+{
+    // Clamped so that the scale fits two normal powers of two, which then overflow or underflow by
+    // themselves; a single std::min on |x| (which keeps NaN) is the form GCC vectorizes
+    std::uint64_t sign = bitsOf(x) & (std::uint64_t(1) << 63);
+    double clamped = fromBits(bitsOf(std::min(std::abs(x), ExpLimit)) | sign);
+    double shifted = clamped * Log2E + RoundShift;
+    double k = shifted - RoundShift;
+    double r = (clamped - k * Ln2Hi) - k * Ln2Lo;
+    double polynomial = 1.0 + r + r * r * (0.5000000000427156 + r * (0.16666666784512488 +
+                                      r * (0.04166666440370271 + r * (0.008333281787457732 +
+                                      r * (0.0013889197256331989 + r * (0.00019908952494929695 +
+                                      r * 2.4708268778728628e-05))))));
+
+    // 2^k as 2^(k - h) * 2^h with h = floor(k / 2), in unsigned arithmetic (k + 2048 > 0) that vectorizes
+    std::uint64_t k2048 = bitsOf(shifted) - bitsOf(RoundShift) + 2048;
+    std::uint64_t half = k2048 >> 1;
+    return polynomial * fromBits((half - 1) << 52) * fromBits((k2048 - half - 1) << 52);
+}
+
+constexpr double SqrtHalf = 0.7071067811865476;
+constexpr double TwoTo52 = 4503599627370496.0;
+constexpr double Ln2 = 0.6931471805599453;
+constexpr double Log10Of2 = 0.3010299956639812;
+constexpr double Log10E = 0.4342944819032518;
+
+/**
+ * @brief x = 2^exponent * m with m in [sqrt(1/2), sqrt(2)), and ln(m)
+ */
+struct LogParts {
+    double exponent;
+    double logMantissa;
+};
+
+/**
+ * @brief Split a positive finite x for the logarithms
+ *
+ * ln(m) = 2 atanh(s) with s = (m - 1) / (m + 1), |s| < 0.172, evaluated as
+ * s (2 + s^2 L(s^2)) with relative error below 6e-14.
+ */
+inline LogParts splitLog(double x)
+{
+    // Subnormals (exponent field 0) are scaled into the normal range first
+    std::uint64_t subnormal = 0 - (((bitsOf(x) >> 52) - 1) >> 63);
+    double normal = blend(subnormal, x * TwoTo52, x);
+
+    // bits - bits(sqrt(1/2)) = exponent * 2^52 + the mantissa bits of m / sqrt(1/2)
+    std::uint64_t offset = bitsOf(normal) - bitsOf(SqrtHalf);
+    double m = fromBits((offset & 0x000fffffffffffffULL) + bitsOf(SqrtHalf));
+    // exponent + 2048 is positive; it is made a double by placing it in the mantissa of 2^52
+    double exponent = fromBits(((offset + (std::uint64_t(1) << 63)) >> 52) | bitsOf(TwoTo52)) - (TwoTo52 + 2048.0);
+
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double polynomial = 0.6666666667386476 + z * (0.3999999585398308 + z * (0.28572114795194864 +
+                                             z * (0.22175072692495257 + z * 0.19609302908061335)));
+    return {exponent - fromBits(bitsOf(52.0) & subnormal), s * (2.0 + z * polynomial)};
+}
+
+/**
+ * @brief result, or x itself where a positive x is infinity or NaN (exponent field all ones)
+ */
+inline double unlessNonFinite(double x, double result)
+{
+    return blend(0 - (((bitsOf(x) >> 52) + 1) >> 11), x, result);
+}
+
+// The logarithms are defined for x > 0; infinity and NaN are returned unchanged
+
+inline double log(double x)
+{
+    LogParts parts = splitLog(x);
+    return unlessNonFinite(x, parts.exponent * Ln2 + parts.logMantissa);
+}
+
+inline double log2(double x)
+{
+    LogParts parts = splitLog(x);
+    return unlessNonFinite(x, parts.exponent + parts.logMantissa * Log2E);
+}
+
+inline double log10(double x)
+{
+    LogParts parts = splitLog(x);
+    return unlessNonFinite(x, parts.exponent * Log10Of2 + parts.logMantissa * Log10E);
+}
+
+/**
+ * @brief Check that powKernel() handles x and y: a positive base and a finite exponent
+ */
+inline bool powInRange(double x, double y)
+{
+    return x > 0.0 && std::abs(y) < std::numeric_limits<double>::infinity();
+}
+
+/**
+ * @brief pow(x, y) = exp(y ln x) for powInRange(x, y)
+ *
+ * The logarithm's error is multiplied by |y ln x|, so results near the
+ * overflow threshold are up to 4e-11 off.
+ */
+inline double powKernel(double x, double y)
+{
+    return exp(y * log(x));
+}
+
+inline double pow(double x, double y) { return powInRange(x, y) ? powKernel(x, y) : std::pow(x, y); }
+
+} // namespace FastMath
@@ -1,17 +1,108 @@
 #include "interpreter.h"
 #include "lexer.h"
+#include "mappedfile.h"
+#include "memocache.h"
 #include "parser.h"
+#include "profiler.h"
 #include "evaluator.h"
+#include "compiledprogram.h"
+#include "compiler.h"
+#include "dependencygraph.h"
+#include "optimizer.h"
+#include "outputsink.h"
+#include "parallelfor.h"
+#include "programcache.h"
+#include "resolver.h"
+#include "snapshot.h"
+#include "tokenstream.h"
+#include "vm.h"
 #include "context.h"
 #include "ast.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
 #include <stdexcept>
 
+namespace
+{
+
+// Strip the whitespace executeMultiple() ignores around each line
+std::string_view trim(std::string_view line)
+{
+    size_t first = line.find_first_not_of(" \t\n\r");
+    if (first == std::string_view::npos) {
+        return std::string_view();
+    }
+    return line.substr(first, line.find_last_not_of(" \t\n\r") + 1 - first);
+}
+
+// Times one top-level statement when a profiler is given
+class ProfiledStatement
+{
+public:
+    ProfiledStatement(Profiler *profiler, int line, std::string_view source) : m_profiler(profiler)
+    {
+        if (m_profiler) {
+            m_profiler->beginStatement(line, source);
+        }
+    }
+    ~ProfiledStatement()
+    {
+        if (m_profiler) {
+            m_profiler->endStatement();
+        }
+    }
+
+    ProfiledStatement(const ProfiledStatement &) = delete;
+    ProfiledStatement &operator=(const ProfiledStatement &) = delete;
+
+private:
+    Profiler *m_profiler;
+};
+
+// Meters one top-level execution; a stop request ends with the execution it stopped
+class MeteredExecution
+{
+public:
+    MeteredExecution(ExecutionBudget &budget, const ExecutionLimits &limits, CancelToken &cancel,
+                     const Context *context)
+        : m_cancel(cancel)
+    {
+        budget.begin(limits, &cancel, context);
+    }
+    ~MeteredExecution() { m_cancel.reset(); }
+
+    MeteredExecution(const MeteredExecution &) = delete;
+    MeteredExecution &operator=(const MeteredExecution &) = delete;
+
+private:
+    CancelToken &m_cancel;
+};
+
+} // anonymous namespace
+
 Interpreter::Interpreter()
     : m_lexer(std::make_unique<Lexer>())
     , m_parser(std::make_unique<Parser>())
     , m_evaluator(std::make_unique<Evaluator>())
+    , m_compiler(std::make_unique<Compiler>())
+    , m_vm(std::make_unique<VirtualMachine>())
+    , m_parallel(std::make_unique<ParallelLoops>())
     , m_context(std::make_unique<Context>())
+    , m_executionMode(ExecutionMode::Bytecode)
+    , m_optimizationLevel(0)
+    , m_maxCallDepth(Context::DefaultMaxCallDepth)
+    , m_memoCapacity(Context::DefaultMemoCapacity)
+    , m_cache(std::make_unique<ProgramCache>(DefaultCacheCapacity))
+    , m_profiling(false)
+    , m_reactive(false)
 {
+    setOutput(std::cout);
+    m_vm->setBudget(&m_budget);
+    m_evaluator->setBudget(&m_budget);
+    m_parallel->setBuiltins(&m_builtins);
+    m_vm->setParallelLoops(m_parallel.get());
+    m_evaluator->setParallelLoops(m_parallel.get());
 }
 
 Interpreter::~Interpreter() = default;
@@ -19,70 +110,512 @@ Interpreter::~Interpreter() = default;
 // filepath: f:\sources\qt_prjs\glossai\core\interpreter.cpp
 std::string Interpreter::execute(const std::string &code)
 {
+    Result result = evaluate(code);
+    return result.ok() ? result.value.toString() : std::string();
+}
+
+Interpreter::Result Interpreter::evaluate(const std::string &code)
+{
+    Result result;
+    MeteredExecution metered(m_budget, m_limits, m_cancel, m_context.get());
     try {
         m_lastError.clear();
 
+        PreparedProgram &prepared = prepare(code);
+        if (!prepared.root) {
+            result.status = Status::SyntaxError;
+            result.line = prepared.errorLine;
+            result.column = prepared.errorColumn;
+            result.error = prepared.error;
+        } else {
+            ProfiledStatement profiled(m_profiling ? m_profiler.get() : nullptr, 0, code);
+            Value value;
+            if (!runStatement(prepared, code, value)) {
+                result.status = Status::RuntimeError;
+                result.code = m_runError.code;
+                result.line = m_runError.line;
+                result.column = m_runError.column;
+                result.error = m_runError.message;
+            } else if (!prepared.isStatement) {
+                // Statements don't show a result
+                result.value = std::move(value);
+            }
+        }
+    } catch (const ExecutionInterrupted &e) {
+        result.status = e.reason() == ExecutionInterrupted::Stopped ? Status::Stopped : Status::LimitExceeded;
+        result.error = e.what();
+    } catch (const std::exception &e) {
+        result.status = Status::RuntimeError;
+        result.code = ErrorCode::Other;
+        result.error = e.what();
+    } catch (...) {
+        result.status = Status::RuntimeError;
+        result.code = ErrorCode::Other;
+        result.error = "Unknown error occurred during execution";
+    }
+    if (!result.ok()) {
+        m_lastError = result.error;
+    }
+
+    // Printed lines become visible before the caller shows the result
+    m_output->flush();
+    return result;
+}
+
+bool Interpreter::stopped(bool &success)
+{
+    if (!m_cancel.isCancelled() && !m_budget.isExhausted()) {
+        return false;
+    }
+    // A statement that was stopped or ran out of budget has already reported the error
+    if (success) {
+        success = false;
+        m_lastError = "Execution stopped";
+    }
+    return true;
+}
+
+PreparedProgram &Interpreter::prepare(const std::string &code)
+{
+    if (PreparedProgram *cached = m_cache->lookup(code)) {
+        return *cached;
+    }
+    // Failures are cached too: the GUI re-checks the same partial input often
+    return *m_cache->insert(code, parse(code));
+}
+
+std::unique_ptr<PreparedProgram> Interpreter::parse(const std::string &code)
+{
+    auto prepared = std::make_unique<PreparedProgram>();
+    try {
         // Tokenize
         auto tokens = m_lexer->tokenize(code);
 
         // Parse
-        auto ast = m_parser->parse(tokens);
+        prepared->program = m_parser->parse(tokens);
+        if (!prepared->program) {
+            prepared->error = m_parser->getLastError();
+            prepared->errorLine = m_parser->getErrorLine();
+            prepared->errorColumn = m_parser->getErrorColumn();
+        } else {
+            optimize(*prepared, *prepared->program, prepared->program->root());
+        }
+    } catch (const std::exception &e) {
+        prepared->program.reset();
+        prepared->root = nullptr;
+        prepared->error = e.what();
+        // Lexing stops where it fails
+        prepared->errorLine = m_lexer->getCurrentLine();
+        prepared->errorColumn = m_lexer->getCurrentColumn();
+    }
+    return prepared;
+}
 
-        if (!ast) {
-            m_lastError = m_parser->getLastError();
-            return "";
+void Interpreter::optimize(PreparedProgram &prepared, Program &program, ASTNode *ast)
+{
+    prepared.isStatement = isStatementRoot(ast);
+
+    prepared.root = Optimizer(program, m_optimizationLevel, &m_builtins).optimize(ast);
+}
+
+bool Interpreter::run(PreparedProgram &prepared, Value &result)
+{
+    // Bind identifiers to context slots and calls to natives once per cached program
+    if (!prepared.resolved) {
+        Resolver().resolve(prepared.root, m_context.get(), &m_builtins);
+        prepared.resolved = true;
+    }
+
+    if (m_executionMode == ExecutionMode::TreeWalk) {
+        if (!m_evaluator->evaluate(prepared.root, m_context.get(), result)) {
+            m_runError = m_evaluator->error();
+            return false;
         }
+        return true;
+    }
+
+#ifdef GLOSSAI_ENABLE_JIT
+    // Hot programs are compiled once; native code bails out to the VM on anything unusual. It only
+    // polls the cancel token, so profiled and metered runs stay on the VM.
+    bool nativeAllowed = !m_profiling && !m_limits.isMetered();
+    if (nativeAllowed && !prepared.jitAttempted && (prepared.runs >= JitFunction::RunThreshold ||
+                                                    prepared.loopIterations >= JitFunction::LoopThreshold)) {
+        prepared.jitAttempted = true;
+        prepared.native = JitCompiler().compile(prepared.root, prepared.isStatement, &m_cancel.flag());
+    }
+    if (prepared.native && nativeAllowed && prepared.native->run(m_context.get(), result)) {
+        return true;
+    }
+#endif
+
+    if (!prepared.chunk) {
+        prepared.chunk = m_compiler->compile(prepared.root);
+    }
+    bool ok = m_vm->execute(*prepared.chunk, m_context.get(), result);
+#ifdef GLOSSAI_ENABLE_JIT
+    ++prepared.runs;
+    prepared.loopIterations += m_vm->loopIterations();
+#endif
+    if (!ok) {
+        m_runError = m_vm->error();
+    }
+    return ok;
+}
 
-        // Check if this is a statement that shouldn't show output
-        if (dynamic_cast<PrintNode *>(ast.get()) || 
-            dynamic_cast<BlockNode *>(ast.get()) ||
-            dynamic_cast<WhileNode *>(ast.get()) ||
-            dynamic_cast<ForNode *>(ast.get()) ||
-            dynamic_cast<IfNode *>(ast.get())) {
-            // For statements that don't need output, just evaluate and return empty string
-            m_evaluator->evaluate(ast.get(), m_context.get());
-            return ""; // Don't show result
+bool Interpreter::runStatement(PreparedProgram &prepared, std::string_view source, Value &result)
+{
+    if (!m_reactive) {
+        return run(prepared, result);
+    }
+
+    DependencyGraph &graph = m_context->dependencies();
+    StatementAccess access = analyzeAccess(prepared.root);
+    // A streamed statement leaves no source to recompute, so its formula counts as a plain value
+    bool defines = !access.defines.empty() && !source.empty();
+    if (defines) {
+        graph.checkAcyclic(access.defines, access.reads);
+    }
+    if (!recompute(access.reads)) {
+        return false;
+    }
+
+    // A statement that fails halfway may still have changed some of what it writes
+    auto changed = [&] {
+        for (const std::string &name : access.writes) {
+            graph.remove(name);
+            graph.invalidate(name);
         }
+    };
+    bool ok;
+    try {
+        ok = run(prepared, result);
+    } catch (...) {
+        changed();
+        throw;
+    }
+    changed();
+    if (ok && defines) {
+        graph.define(access.defines, std::string(source), std::move(access.reads));
+    }
+    return ok;
+}
 
-        // Evaluate normally for other expressions
-        auto result = m_evaluator->evaluate(ast.get(), m_context.get());
+bool Interpreter::recompute(const std::vector<std::string> &names)
+{
+    DependencyGraph &graph = m_context->dependencies();
+    for (const std::string &name : graph.staleOrder(names)) {
+        // Kept out of the cache, which may evict programs that are running
+        DependencyGraph::Definition &definition = *graph.find(name);
+        if (!definition.program) {
+            definition.program = parse(definition.source);
+        }
+        Value ignored;
+        try {
+            if (!run(*definition.program, ignored)) {
+                m_runError.message = "Recomputing " + name + ": " + m_runError.message;
+                return false;
+            }
+        } catch (const ExecutionInterrupted &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw std::runtime_error("Recomputing " + name + ": " + e.what());
+        }
+        graph.markFresh(name);
+    }
+    return true;
+}
 
-        // Return result as string
-        return result.toString();
+void Interpreter::setReactive(bool enabled)
+{
+    if (!enabled && m_reactive) {
+        refresh();
+        m_context->dependencies().clear();
+    }
+    m_reactive = enabled;
+}
+
+void Interpreter::setVariable(const std::string &name, const Value &value)
+{
+    m_context->setVariable(name, value);
+    if (m_reactive) {
+        m_context->dependencies().remove(name);
+        m_context->dependencies().invalidate(name);
+    }
+}
+
+Value Interpreter::getVariable(const std::string &name)
+{
+    if (m_reactive && m_context->dependencies().isStale(name) && !refreshNames({name})) {
+        return Value();
+    }
+    return m_context->getVariable(name);
+}
+
+bool Interpreter::refresh()
+{
+    return refreshNames(m_context->dependencies().staleOrder());
+}
 
+bool Interpreter::refreshNames(const std::vector<std::string> &names)
+{
+    MeteredExecution metered(m_budget, m_limits, m_cancel, m_context.get());
+    bool success = true;
+    try {
+        m_lastError.clear();
+        if (!recompute(names)) {
+            m_lastError = m_runError.message;
+            success = false;
+        }
     } catch (const std::exception &e) {
         m_lastError = e.what();
-        return "";
-    } catch (...) {
-        m_lastError = "Unknown error occurred during execution";
-        return "";
+        success = false;
     }
+    m_output->flush();
+    return success;
+}
+
+const DependencyGraph &Interpreter::getDependencies() const
+{
+    return m_context->dependencies();
 }
 
 std::vector<std::string> Interpreter::executeMultiple(const std::vector<std::string> &lines)
 {
     std::vector<std::string> results;
+    results.reserve(lines.size());
     for (const std::string &line : lines) {
-        if (!line.empty()) {
-            // Trim whitespace
-            std::string trimmed = line;
-            trimmed.erase(0, trimmed.find_first_not_of(" \t\n\r"));
-            trimmed.erase(trimmed.find_last_not_of(" \t\n\r") + 1);
-            
-            if (!trimmed.empty()) {
-                results.push_back(execute(trimmed));
-            }
+        std::string_view code = trim(line);
+        if (!code.empty()) {
+            // Lines rarely need trimming; those are passed on without a copy
+            results.push_back(execute(code.size() == line.size() ? line : std::string(code)));
         }
     }
     return results;
 }
 
+size_t Interpreter::evaluateMultiple(const std::vector<std::string> &lines, std::vector<Result> &results)
+{
+    results.clear();
+    size_t failures = 0;
+    for (const std::string &line : lines) {
+        std::string_view code = trim(line);
+        if (!code.empty()) {
+            results.push_back(evaluate(code.size() == line.size() ? line : std::string(code)));
+            failures += results.back().ok() ? 0 : 1;
+        }
+    }
+    return failures;
+}
+
+bool Interpreter::executeScript(std::istream &script, const std::function<void(const StatementResult &)> &onStatement)
+{
+    m_lastError.clear();
+    MeteredExecution metered(m_budget, m_limits, m_cancel, m_context.get());
+    bool success = true;
+
+    // A private parser: the shared one may be used by callbacks re-entering execute()
+    TokenStream stream(script);
+    Parser parser;
+    parser.beginStream(stream);
+
+    while (!parser.atEndOfStream()) {
+        if (stopped(success)) {
+            break;
+        }
+        StatementResult result{stream.peek().line, std::string(), std::string(), std::string_view()};
+        try {
+            PreparedProgram prepared;
+            prepared.program = parser.parseNext();
+            if (!prepared.program) {
+                if (parser.getLastError().empty()) {
+                    break; // Only separators were left
+                }
+                result.error = parser.getLastError();
+            } else {
+                optimize(prepared, *prepared.program, prepared.program->root());
+                ProfiledStatement profiled(m_profiling ? m_profiler.get() : nullptr, result.line, std::string_view());
+                Value value;
+                if (!runStatement(prepared, std::string_view(), value)) {
+                    result.error = m_runError.message;
+                } else if (!prepared.isStatement) {
+                    result.value = value.toString();
+                }
+            }
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        }
+        m_output->flush();
+
+        if (!result.error.empty() && success) {
+            success = false;
+            m_lastError = "Line " + std::to_string(result.line) + ": " + result.error;
+        }
+        if (onStatement) {
+            onStatement(result);
+        }
+    }
+    return success;
+}
+
+bool Interpreter::executeSource(std::string_view source,
+                                const std::function<void(const StatementResult &)> &onStatement)
+{
+    m_lastError.clear();
+    MeteredExecution metered(m_budget, m_limits, m_cancel, m_context.get());
+
+    // One lex and one parse for the whole script; every statement's nodes share one arena
+    std::vector<Parser::ScriptStatement> statements;
+    std::unique_ptr<Program> program;
+    try {
+        program = m_parser->parseScript(source, m_lexer->tokenize(source), statements);
+    } catch (const std::exception &e) {
+        m_lastError = e.what();
+        return false;
+    }
+
+    bool success = true;
+    for (const Parser::ScriptStatement &statement : statements) {
+        if (stopped(success)) {
+            break;
+        }
+        StatementResult result{statement.line, std::string(), statement.error, statement.source};
+        if (statement.node) {
+            try {
+                PreparedProgram prepared;
+                optimize(prepared, *program, statement.node);
+                ProfiledStatement profiled(m_profiling ? m_profiler.get() : nullptr, statement.line,
+                                           statement.source);
+                Value value;
+                if (!runStatement(prepared, statement.source, value)) {
+                    result.error = m_runError.message;
+                } else if (!prepared.isStatement) {
+                    result.value = value.toString();
+                }
+            } catch (const std::exception &e) {
+                result.error = e.what();
+            }
+        }
+        m_output->flush();
+
+        if (!result.error.empty() && success) {
+            success = false;
+            m_lastError = "Line " + std::to_string(result.line) + ": " + result.error;
+        }
+        if (onStatement) {
+            onStatement(result);
+        }
+    }
+    return success;
+}
+
+bool Interpreter::executeProgram(const std::string &path,
+                                 const std::function<void(const StatementResult &)> &onStatement)
+{
+    std::unique_ptr<MappedFile> file;
+    try {
+        file = std::make_unique<MappedFile>(path);
+    } catch (const std::exception &e) {
+        m_lastError = e.what();
+        return false;
+    }
+    return executeSource(file->view(), onStatement);
+}
+
+bool Interpreter::saveSnapshot(const std::string &path)
+{
+    m_lastError.clear();
+    std::string data = Snapshot::save(*m_context);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (file) {
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    if (!file) {
+        m_lastError = "Could not write file '" + path + "'";
+        return false;
+    }
+    return true;
+}
+
+bool Interpreter::loadSnapshot(const std::string &path)
+{
+    try {
+        m_lastError.clear();
+        MappedFile file(path);
+        Snapshot::restore(file.view(), *m_context, &m_builtins);
+        return true;
+    } catch (const std::exception &e) {
+        m_lastError = e.what();
+        return false;
+    }
+}
+
+std::string Interpreter::dumpTree(const std::string &code)
+{
+    try {
+        m_lastError.clear();
+        auto program = m_parser->parse(m_lexer->tokenize(code));
+        if (!program) {
+            m_lastError = m_parser->getLastError();
+            return "";
+        }
+        return Optimizer(*program, m_optimizationLevel, &m_builtins).optimize(program->root())->toString();
+    } catch (const std::exception &e) {
+        m_lastError = e.what();
+        return "";
+    }
+}
+
+bool Interpreter::evaluateBatch(const std::string &expression, const std::vector<BatchColumn> &columns,
+                                Span<double> out)
+{
+    try {
+        m_lastError.clear();
+
+        // Parsed privately: the batch compiler binds the tree to the columns, not to the context
+        auto program = m_parser->parse(m_lexer->tokenize(expression));
+        if (!program) {
+            m_lastError = m_parser->getLastError();
+            return false;
+        }
+        ASTNode *ast = Optimizer(*program, m_optimizationLevel, &m_builtins).optimize(program->root());
+        auto kernel = BatchCompiler().compile(ast, columns, *m_context, m_builtins);
+
+        BatchKernel::Result result = kernel->run(out);
+        if (result.failedRows == 0) {
+            return true;
+        }
+
+        // Replay the first failed row on the evaluator for its exact error message
+        Context row;
+        kernel->bindRow(row, result.firstFailedRow);
+        std::string message = "Evaluation failed";
+        try {
+            Value ignored;
+            if (!m_evaluator->evaluate(ast, &row, ignored)) {
+                message = m_evaluator->error().message;
+            }
+        } catch (const std::exception &e) {
+            message = e.what();
+        }
+        m_lastError = "Row " + std::to_string(result.firstFailedRow) + ": " + message + " (" +
+                      std::to_string(result.failedRows) + " of " + std::to_string(out.size()) + " rows failed)";
+        return false;
+    } catch (const std::exception &e) {
+        m_lastError = e.what();
+        return false;
+    }
+}
+
 bool Interpreter::isValidSyntax(const std::string &code)
 {
+    // Input still being typed usually has an open bracket or string; reject it
+    // without a parse and without a cache entry for every prefix
+    LexState state = Lexer::scan(code);
+    if (state.continues() || state.unbalanced) {
+        return false;
+    }
     try {
-        auto tokens = m_lexer->tokenize(code);
-        auto ast = m_parser->parse(tokens);
-        return ast != nullptr;
+        return prepare(code).root != nullptr;
     } catch (...) {
         return false;
     }
@@ -96,6 +629,25 @@ std::string Interpreter::getLastError() const
 void Interpreter::clearContext()
 {
     m_context = std::make_unique<Context>();
+    applyCallDepth();
+    m_context->setMemoCapacity(m_memoCapacity);
+    // Cached programs address slots of the old context
+    m_cache->clear();
+}
+
+std::shared_ptr<const CompiledProgram> Interpreter::compile(const std::string &code,
+                                                            std::shared_ptr<const SharedGlobals> globals) const
+{
+    CompiledProgram::Options options;
+    options.optimizationLevel = m_optimizationLevel;
+    options.builtins = std::make_shared<BuiltinRegistry>(m_builtins);
+    options.globals = std::move(globals);
+    return CompiledProgram::compile(code, options);
+}
+
+std::shared_ptr<const SharedGlobals> Interpreter::shareGlobals() const
+{
+    return std::make_shared<SharedGlobals>(m_context->getCurrentScopeVariables());
 }
 
 std::vector<std::string> Interpreter::getAvailableIdentifiers() const
@@ -105,20 +657,132 @@ std::vector<std::string> Interpreter::getAvailableIdentifiers() const
 
 std::vector<std::string> Interpreter::getBuiltinFunctions() const
 {
-    return {
-        // Trigonometric functions
-        "sin", "cos", "tan", "asin", "acos", "atan",
-        
-        // Logarithmic functions  
-        "log", "log10", "log2", "ln", "exp",
-        
-        // Root functions
-        "sqrt", "cbrt", "root",
-        
-        // Power and exponential
-        "pow", "abs",
-        
-        // Utility functions
-        "min", "max", "ceil", "floor", "round"
-    };
+    return m_builtins.names();
+}
+
+void Interpreter::registerFunction(const std::string &name, int minArgs, int maxArgs, NativeFunction function,
+                                   std::uint8_t flags)
+{
+    m_builtins.registerFunction(name, minArgs, maxArgs, function, flags);
+    // Cached programs may have bound, folded or rejected calls to this name
+    m_cache->clear();
+    m_context->dependencies().dropPrograms();
+}
+
+void Interpreter::setOptimizationLevel(int level)
+{
+    if (level != m_optimizationLevel) {
+        m_optimizationLevel = level;
+        m_cache->clear();
+        m_context->dependencies().dropPrograms();
+    }
+}
+
+void Interpreter::setFastMath(bool enabled)
+{
+    if (enabled != m_builtins.isFastMath()) {
+        m_builtins.setFastMath(enabled);
+        m_cache->clear();
+        m_context->dependencies().dropPrograms();
+        m_context->rebindFunctions(&m_builtins);
+    }
+}
+
+void Interpreter::setOutput(std::unique_ptr<OutputSink> output)
+{
+    if (m_output) {
+        m_output->flush();
+    }
+    m_output = std::move(output);
+    m_evaluator->setOutput(m_output.get());
+    m_vm->setOutput(m_output.get());
+}
+
+void Interpreter::setOutput(std::ostream &output)
+{
+    setOutput(std::make_unique<StreamSink>(output));
+}
+
+void Interpreter::setMaxCallDepth(size_t depth)
+{
+    m_maxCallDepth = depth;
+    applyCallDepth();
+}
+
+void Interpreter::setLimits(const ExecutionLimits &limits)
+{
+    m_limits = limits;
+    applyCallDepth();
+}
+
+void Interpreter::applyCallDepth()
+{
+    size_t depth = m_maxCallDepth;
+    if (m_limits.maxCallDepth > 0) {
+        depth = std::min(depth, m_limits.maxCallDepth);
+    }
+    m_context->setMaxCallDepth(depth);
+}
+
+void Interpreter::setMemoCapacity(size_t capacity)
+{
+    m_memoCapacity = capacity;
+    m_context->setMemoCapacity(capacity);
+}
+
+void Interpreter::setThreadCount(size_t threads)
+{
+    m_parallel->setThreadCount(threads);
+}
+
+size_t Interpreter::getThreadCount() const
+{
+    return m_parallel->threadCount();
+}
+
+std::vector<Interpreter::MemoStatistics> Interpreter::getMemoStatistics() const
+{
+    std::vector<MemoStatistics> statistics;
+    for (const auto &pair : m_context->getFunctions()) {
+        if (const MemoCache *memo = pair.second.memo.get()) {
+            statistics.push_back(MemoStatistics{pair.first, memo->hits(), memo->misses(), memo->evictions(),
+                                                memo->size(), memo->capacity()});
+        }
+    }
+    std::sort(statistics.begin(), statistics.end(),
+              [](const MemoStatistics &a, const MemoStatistics &b) { return a.function < b.function; });
+    return statistics;
+}
+
+void Interpreter::setProfiling(bool enabled)
+{
+    if (enabled && !m_profiler) {
+        m_profiler = std::make_unique<Profiler>();
+    }
+    m_profiling = enabled;
+    Profiler *profiler = enabled ? m_profiler.get() : nullptr;
+    m_vm->setProfiler(profiler);
+    m_evaluator->setProfiler(profiler);
+}
+
+void Interpreter::resetProfile()
+{
+    if (m_profiler) {
+        m_profiler->reset();
+    }
+}
+
+void Interpreter::setCacheCapacity(size_t capacity)
+{
+    m_cache->setCapacity(capacity);
+}
+
+Interpreter::CacheStatistics Interpreter::getCacheStatistics() const
+{
+    return CacheStatistics{m_cache->hits(), m_cache->misses(), m_cache->size(), m_cache->capacity()};
+}
+
+void Interpreter::clearCache()
+{
+    m_cache->clear();
 }
@@ -1,14 +1,32 @@
 #pragma once
 
+#include "batch.h"
+#include "budget.h"
+#include "builtins.h"
+#include "evalerror.h"
+#include <functional>
+#include <iosfwd>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
 class Lexer;
 class Parser;
 class Evaluator;
+class Compiler;
+class VirtualMachine;
 class Context;
 class ASTNode;
+class Program;
+class ProgramCache;
+class OutputSink;
+class ParallelLoops;
+class Profiler;
+class CompiledProgram;
+class SharedGlobals;
+class DependencyGraph;
+struct PreparedProgram;
 
 /**
  * @brief Main GlossAI interpreter class
@@ -20,6 +38,75 @@ class ASTNode;
 class Interpreter
 {
 public:
+    /**
+     * @brief Strategy used to run parsed code
+     */
+    enum class ExecutionMode {
+        Bytecode, // Compile to bytecode and run on the VM (default)
+        TreeWalk  // Walk the AST with the reference Evaluator
+    };
+
+    /**
+     * @brief Counters describing the parsed-program cache
+     */
+    struct CacheStatistics {
+        size_t hits;     // Lookups answered from the cache
+        size_t misses;   // Lookups that had to lex and parse
+        size_t size;     // Programs currently cached
+        size_t capacity; // Maximum number of cached programs
+    };
+
+    /**
+     * @brief Counters describing the result cache of one pure user function
+     */
+    struct MemoStatistics {
+        std::string function; // Function name
+        size_t hits;          // Calls answered from the cache
+        size_t misses;        // Calls that ran the body
+        size_t evictions;     // Results dropped to stay within capacity
+        size_t size;          // Results currently cached
+        size_t capacity;      // Maximum number of cached results
+    };
+
+    /**
+     * @brief Outcome of one top-level statement of a script
+     */
+    struct StatementResult {
+        int line;          // Script line the statement starts on
+        std::string value; // Result as text; empty for statements
+        std::string error; // Syntax or runtime error; empty on success
+        std::string_view source; // Statement text; only set by executeSource() and executeProgram()
+    };
+
+    /**
+     * @brief How an evaluation ended
+     */
+    enum class Status {
+        Ok,            // Ran to completion
+        SyntaxError,   // Could not be lexed, parsed or compiled; nothing ran
+        RuntimeError,  // Failed while running
+        Stopped,       // Stopped by requestStop() or the cancel token
+        LimitExceeded  // Ran out of one of the ExecutionLimits, or of call depth
+    };
+
+    /**
+     * @brief Outcome of evaluate(): the result as a Value, or what went wrong
+     */
+    struct Result {
+        Status status = Status::Ok;
+        Value value;       // Result; null for statements and on failure
+        int line = 0;      // Where the error was found (1-based); 0 if unknown
+        int column = 0;
+        std::string error; // Error message; empty on success
+        ErrorCode code = ErrorCode::None; // Kind of runtime error; None for the other statuses
+
+        bool ok() const { return status == Status::Ok; }
+        double number() const { return value.toNumber(); } // The result as a number; 0 if null
+    };
+
+    /// Number of parsed programs kept by default
+    static constexpr size_t DefaultCacheCapacity = 256;
+
     Interpreter();
     ~Interpreter();
 
@@ -37,8 +124,93 @@ public:
      */
     std::vector<std::string> executeMultiple(const std::vector<std::string> &lines);
 
+    /**
+     * @brief Execute code and hand back its result unformatted
+     *
+     * Behaves like execute() (getLastError() included), but returns the
+     * result as a Value, so callers that want a number need not parse text,
+     * and reports failures with a status and, for syntax errors, a location.
+     * @param code The code to execute
+     * @return The result or the failure
+     */
+    Result evaluate(const std::string &code);
+
+    /**
+     * @brief Evaluate several lines into a caller-provided buffer
+     *
+     * Lines are trimmed and empty lines skipped, as by executeMultiple().
+     * The buffer is cleared first but keeps its capacity, so reusing it across
+     * calls allocates nothing for results that are not strings or errors.
+     * @param lines The lines of code to execute
+     * @param results Receives one result per non-empty line
+     * @return Number of lines that failed
+     */
+    size_t evaluateMultiple(const std::vector<std::string> &lines, std::vector<Result> &results);
+
+    /**
+     * @brief Execute a script while it is being read
+     *
+     * The script is lexed and parsed one top-level statement at a time; each
+     * statement runs, and its tree is freed, before the next one is read, so
+     * memory use does not grow with the length of the script. Statements
+     * bypass the program cache. A syntax error skips the rest of its line.
+     * @param script Source of the script
+     * @param onStatement Called after every statement (may be empty)
+     * @return True if every statement succeeded; otherwise getLastError()
+     *         holds the first error
+     */
+    bool executeScript(std::istream &script, const std::function<void(const StatementResult &)> &onStatement = {});
+
+    /**
+     * @brief Execute a whole script held in memory
+     *
+     * The script is lexed and parsed once into a single program whose
+     * top-level statements then run in order, each reporting the line it
+     * starts on. Statements may span lines; lines whose first non-blank
+     * character is '#' are comments. Statements bypass the program cache. A
+     * syntax error skips the rest of its line, and no failing statement stops
+     * the ones after it.
+     * @param source Text of the script; must stay valid during the call
+     * @param onStatement Called after every statement (may be empty)
+     * @return True if the script lexed and every statement succeeded;
+     *         otherwise getLastError() holds the first error
+     */
+    bool executeSource(std::string_view source,
+                       const std::function<void(const StatementResult &)> &onStatement = {});
+
+    /**
+     * @brief Execute a script file with executeSource()
+     *
+     * The file is mapped into memory rather than read, so it is never copied.
+     * @param path Script file
+     * @param onStatement Called after every statement (may be empty)
+     * @return True if the file could be opened and executeSource() succeeded
+     */
+    bool executeProgram(const std::string &path,
+                        const std::function<void(const StatementResult &)> &onStatement = {});
+
+    /**
+     * @brief Save the global variables and user functions to a .gloc snapshot
+     * @param path File to write
+     * @return True if the file was written; otherwise getLastError() says why
+     */
+    bool saveSnapshot(const std::string &path);
+
+    /**
+     * @brief Add the variables and functions of a .gloc snapshot to the context
+     *
+     * Much faster than running the script that produced the snapshot: the file
+     * is mapped and decoded without lexing, parsing or evaluating anything.
+     * @param path Snapshot written by saveSnapshot()
+     * @return True if the snapshot was loaded; on false the context is unchanged
+     */
+    bool loadSnapshot(const std::string &path);
+
     /**
      * @brief Check if the given code is syntactically valid
+     *
+     * Code with unbalanced brackets or an unterminated string is rejected
+     * after lexing alone; anything else is parsed (and cached like execute()).
      * @param code The code to validate
      * @return True if valid, false otherwise
      */
@@ -67,10 +239,339 @@ public:
      */
     std::vector<std::string> getBuiltinFunctions() const;
 
+    /**
+     * @brief Make a native function callable from GlossAI code
+     *
+     * Registering an existing name replaces it (standard functions included).
+     * @param name Function name
+     * @param minArgs Minimum number of arguments
+     * @param maxArgs Maximum number of arguments
+     * @param function Implementation; report errors by throwing std::runtime_error
+     * @param flags Combination of BuiltinFunction::Flags (lets the optimizer fold calls)
+     */
+    void registerFunction(const std::string &name, int minArgs, int maxArgs, NativeFunction function,
+                          std::uint8_t flags = 0);
+
+    /**
+     * @brief Send the output of print statements to a sink
+     *
+     * By default output goes to std::cout in blocks. Sinks are flushed
+     * whenever execute() returns and after every statement of a script.
+     * Interpreters share no mutable state, so several may run on different
+     * threads at once as long as each has its own sink.
+     * @param output The new sink; the previous one is flushed and destroyed
+     */
+    void setOutput(std::unique_ptr<OutputSink> output);
+
+    /**
+     * @brief Send the output of print statements to a stream, in blocks
+     * @param output Stream that outlives the interpreter
+     */
+    void setOutput(std::ostream &output);
+
+    /**
+     * @brief Get the sink print statements write to
+     */
+    OutputSink &getOutput() const { return *m_output; }
+
+    /**
+     * @brief Select how parsed code is executed
+     * @param mode Bytecode VM or reference tree-walking evaluator
+     */
+    void setExecutionMode(ExecutionMode mode) { m_executionMode = mode; }
+
+    /**
+     * @brief Get the current execution strategy
+     */
+    ExecutionMode getExecutionMode() const { return m_executionMode; }
+
+    /**
+     * @brief Select how much the AST is optimized before execution
+     * @param level 0 = off (default), 1 = constant folding and dead-branch
+     *              elimination, 2 = also strength reduction and hoisting of
+     *              loop-invariant expressions
+     */
+    void setOptimizationLevel(int level);
+
+    /**
+     * @brief Get the current optimization level
+     */
+    int getOptimizationLevel() const { return m_optimizationLevel; }
+
+    /**
+     * @brief Select the fast-math versions of sin, cos, tan, exp, log, ln, log2, log10 and pow
+     *
+     * They are minimax polynomials with relative errors of at most about
+     * 1e-11 (see fastmath.h) and fail on the same arguments. Single calls
+     * of exp, log, ln, log2 and pow keep libm, which is faster for them;
+     * batches use the polynomials for all nine. The switch
+     * applies to everything executed or compiled afterwards, including the
+     * functions already defined; the ^ operator and registered functions
+     * are not affected. The setting survives clearContext().
+     * @param enabled True for fast math, false (the default) for libm
+     */
+    void setFastMath(bool enabled);
+
+    /**
+     * @brief Check whether the fast-math versions of the standard functions are used
+     */
+    bool isFastMath() const { return m_builtins.isFastMath(); }
+
+    /**
+     * @brief Limit how deeply user functions may call each other
+     *
+     * A call beyond the limit fails with an error instead of exhausting the
+     * native stack (the tree-walking evaluator recurses in C++). The limit
+     * survives clearContext().
+     * @param depth Maximum number of nested calls
+     */
+    void setMaxCallDepth(size_t depth);
+
+    /**
+     * @brief Get the maximum call depth
+     */
+    size_t getMaxCallDepth() const { return m_maxCallDepth; }
+
+    /**
+     * @brief Set how many results are kept for each pure user function
+     *
+     * Calls to functions that provably depend only on their arguments are
+     * answered from a per-function LRU cache keyed by the argument values.
+     * Defining or removing a function, or changing the capacity, drops the
+     * cached results. A capacity of 0 disables memoization. The setting
+     * survives clearContext().
+     * @param capacity Maximum number of results per function
+     */
+    void setMemoCapacity(size_t capacity);
+
+    /**
+     * @brief Get the number of results kept for each pure user function
+     */
+    size_t getMemoCapacity() const { return m_memoCapacity; }
+
+    /**
+     * @brief Set how many threads "parallel for" loops run on
+     *
+     * Loops cut their iterations into the same chunks whatever the number of
+     * threads, so their results do not depend on it. With one thread they
+     * run on the calling thread. The threads are started by the first loop
+     * that needs them.
+     * @param threads Number of threads; 0 (the default) uses one per hardware thread
+     */
+    void setThreadCount(size_t threads);
+
+    /**
+     * @brief Get the number of threads "parallel for" loops run on
+     */
+    size_t getThreadCount() const;
+
+    /**
+     * @brief Get the result cache counters of every memoized function, sorted by name
+     */
+    std::vector<MemoStatistics> getMemoStatistics() const;
+
+    /**
+     * @brief Turn the execution profiler on or off
+     *
+     * While on, every statement is timed by source line, and the engines
+     * report calls, prints, loop iterations and variable accesses (see
+     * Profiler). Hot programs then stay on the VM instead of running as
+     * native code, so that their time can be attributed. Turning profiling
+     * off keeps what was collected; without profiling the engines run their
+     * unprofiled paths.
+     * @param enabled True to collect
+     */
+    void setProfiling(bool enabled);
+
+    /**
+     * @brief Check whether the profiler is collecting
+     */
+    bool isProfiling() const { return m_profiling; }
+
+    /**
+     * @brief Get what the profiler collected (nullptr if profiling was never enabled)
+     */
+    const Profiler *getProfiler() const { return m_profiler.get(); }
+
+    /**
+     * @brief Forget what the profiler collected
+     */
+    void resetProfile();
+
+    /**
+     * @brief Limit the steps, time, call depth and memory of every execution
+     *
+     * Each call of evaluate() and friends, or each whole script, gets a fresh
+     * budget. Loop back-edges and calls count as steps; running out fails
+     * the execution with Status::LimitExceeded, unwinding the calls in
+     * progress. Variables keep the values they had, and the next execution
+     * starts with a full budget. Metered executions do not use the JIT.
+     * @param limits New limits; zero fields are unlimited
+     */
+    void setLimits(const ExecutionLimits &limits);
+
+    /**
+     * @brief Get the limits set by setLimits()
+     */
+    const ExecutionLimits &getLimits() const { return m_limits; }
+
+    /**
+     * @brief Get the token that stops this interpreter's executions
+     *
+     * Cancelling it from any thread (or a signal handler) makes the running
+     * execution fail soon with "Execution stopped" and Status::Stopped:
+     * loops and calls poll it every ExecutionBudget::CheckInterval steps.
+     * Scripts stop before their next statement. The token is reset when the
+     * execution it stopped returns; cancelling while idle stops the next one.
+     */
+    CancelToken &getCancelToken() { return m_cancel; }
+
+    /**
+     * @brief Ask the running execution to stop; same as getCancelToken().cancel()
+     */
+    void requestStop() { m_cancel.cancel(); }
+
+    /**
+     * @brief Turn reactive recomputation on or off
+     *
+     * While on, a top-level assignment whose expression reads other names
+     * ("y = 2*x + 1") is remembered as the formula of its variable. Changing
+     * a name, by setVariable() or by a statement assigning it, marks the
+     * formulas depending on it stale. They are recomputed, in dependency
+     * order, only when something reads them: a statement, getVariable() or
+     * refresh(). Assigning a plain value to a variable drops its formula.
+     * A definition that would depend on itself fails with an error. Scripts
+     * run statement by statement are tracked too, except those streamed by
+     * executeScript(), whose statements have no source text to keep.
+     * Turning it off brings stale variables up to date and forgets the formulas.
+     * @param enabled True to track definitions
+     */
+    void setReactive(bool enabled);
+
+    /**
+     * @brief Check whether formulas are tracked
+     */
+    bool isReactive() const { return m_reactive; }
+
+    /**
+     * @brief Set a global variable, marking the formulas that read it stale
+     */
+    void setVariable(const std::string &name, const Value &value);
+
+    /**
+     * @brief Get a global variable, recomputing it first if it is stale
+     * @return The value; null if it is not defined or its recomputation failed
+     *         (getLastError() then says why)
+     */
+    Value getVariable(const std::string &name);
+
+    /**
+     * @brief Recompute every stale formula
+     * @return True if all succeeded; otherwise getLastError() names the first failure
+     */
+    bool refresh();
+
+    /**
+     * @brief Get the formulas tracked in reactive mode
+     */
+    const DependencyGraph &getDependencies() const;
+
+    /**
+     * @brief Compile code into a program that many threads can run at once
+     *
+     * Uses this interpreter's optimization level and a copy of its native
+     * functions, but not its context: the program runs in ExecutionContexts,
+     * one per thread, and outlives the interpreter.
+     * @param code The code to compile
+     * @param globals Constants the program may read but not assign (may be null)
+     * @return The program; check CompiledProgram::ok()
+     */
+    std::shared_ptr<const CompiledProgram> compile(const std::string &code,
+                                                   std::shared_ptr<const SharedGlobals> globals = nullptr) const;
+
+    /**
+     * @brief Capture the current global variables as shared constants
+     *
+     * Typically called after running a script or loading a snapshot that
+     * defines them, to pass to compile().
+     */
+    std::shared_ptr<const SharedGlobals> shareGlobals() const;
+
+    /**
+     * @brief Parse and optimize code without running it
+     * @param code The code to inspect
+     * @return The optimized tree as text, or an empty string on parse error
+     */
+    std::string dumpTree(const std::string &code);
+
+    /**
+     * @brief Evaluate one expression for every row of a set of columns
+     *
+     * The expression is compiled once into column kernels and evaluated chunk
+     * by chunk without boxing values. Identifiers name input columns, or else
+     * variables of the context, which are read once. Only numeric expressions
+     * are supported: operators other than assignments and && / ||, and native
+     * function calls. Rows whose evaluation fails (division by zero, domain
+     * errors) get NaN and do not affect the other rows.
+     * @param expression The expression to evaluate
+     * @param columns Named input columns, each with at least out.size() rows
+     * @param out Receives one result per row
+     * @return True if every row succeeded; otherwise getLastError() describes
+     *         the compile error or the first failed row
+     */
+    bool evaluateBatch(const std::string &expression, const std::vector<BatchColumn> &columns, Span<double> out);
+
+    /**
+     * @brief Set how many parsed programs are kept for reuse
+     *
+     * execute() and isValidSyntax() look source text up in a least-recently-used
+     * cache before lexing and parsing it. A capacity of 0 disables caching.
+     * @param capacity Maximum number of cached programs
+     */
+    void setCacheCapacity(size_t capacity);
+
+    /**
+     * @brief Get the parsed-program cache counters
+     */
+    CacheStatistics getCacheStatistics() const;
+
+    /**
+     * @brief Drop all cached programs (counters are kept)
+     */
+    void clearCache();
+
 private:
     std::unique_ptr<Lexer> m_lexer;
     std::unique_ptr<Parser> m_parser;
     std::unique_ptr<Evaluator> m_evaluator;
+    std::unique_ptr<Compiler> m_compiler;
+    std::unique_ptr<VirtualMachine> m_vm;
+    std::unique_ptr<ParallelLoops> m_parallel;
     std::unique_ptr<Context> m_context;
+    BuiltinRegistry m_builtins;
     std::string m_lastError;
+    ExecutionMode m_executionMode;
+    int m_optimizationLevel;
+    size_t m_maxCallDepth;
+    size_t m_memoCapacity;
+    std::unique_ptr<ProgramCache> m_cache;
+    std::unique_ptr<Profiler> m_profiler;
+    bool m_profiling;
+    bool m_reactive;
+    ExecutionLimits m_limits;
+    CancelToken m_cancel;
+    ExecutionBudget m_budget;
+    std::unique_ptr<OutputSink> m_output;
+    EvalError m_runError; // Why the last run() failed
+
+    PreparedProgram &prepare(const std::string &code);
+    std::unique_ptr<PreparedProgram> parse(const std::string &code);
+    void optimize(PreparedProgram &prepared, Program &program, ASTNode *ast);
+    // These return false with m_runError set for the errors engines report without throwing
+    bool run(PreparedProgram &prepared, Value &result);
+    bool runStatement(PreparedProgram &prepared, std::string_view source, Value &result);
+    bool recompute(const std::vector<std::string> &names);
+    bool refreshNames(const std::vector<std::string> &names);
+    bool stopped(bool &success);
+    void applyCallDepth();
 };
@@ -0,0 +1,791 @@
+#include "jit.h"
+#include "builtins.h"
+#include "fastmath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GLOSSAI_JIT_X64 1
+#endif
+
+#ifdef GLOSSAI_JIT_X64
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace
+{
+
+/**
+ * @brief Thrown while lowering when the program uses something the JIT does not handle
+ */
+struct Unsupported {};
+
+// Frame layout, relative to the frame pointer held in rbx: variable i lives at
+// 16 * i with its "defined" byte at 16 * i + 8; the result is at -8 and spill
+// slots grow downwards from -16.
+constexpr std::int32_t kSlotSize = 16;
+constexpr std::int32_t kDefinedOffset = 8;
+constexpr std::int32_t kResultOffset = -8;
+
+// Condition codes of the rel32 jcc forms (0F xx); Always selects jmp
+constexpr std::uint8_t Always = 0;
+constexpr std::uint8_t Below = 0x82;
+constexpr std::uint8_t AboveEqual = 0x83;
+constexpr std::uint8_t Equal = 0x84;
+constexpr std::uint8_t NotEqual = 0x85;
+constexpr std::uint8_t BelowEqual = 0x86;
+constexpr std::uint8_t Above = 0x87;
+constexpr std::uint8_t Parity = 0x8A;
+
+// Scalar SSE2 opcodes (F2 0F xx)
+constexpr std::uint8_t MovsdLoad = 0x10;
+constexpr std::uint8_t MovsdStore = 0x11;
+constexpr std::uint8_t Addsd = 0x58;
+constexpr std::uint8_t Mulsd = 0x59;
+constexpr std::uint8_t Subsd = 0x5C;
+constexpr std::uint8_t Divsd = 0x5E;
+
+// Standard functions callable from native code. Functions that can fail
+// return NaN instead, and the generated code bails out on a NaN result so
+// the interpreter reports the error.
+double jitSin(double x) { return std::sin(x); }
+double jitCos(double x) { return std::cos(x); }
+double jitTan(double x) { return std::tan(x); }
+double jitAsin(double x) { return x < -1.0 || x > 1.0 ? std::numeric_limits<double>::quiet_NaN() : std::asin(x); }
+double jitAcos(double x) { return x < -1.0 || x > 1.0 ? std::numeric_limits<double>::quiet_NaN() : std::acos(x); }
+double jitAtan(double x) { return std::atan(x); }
+double jitLog(double x) { return x <= 0 ? std::numeric_limits<double>::quiet_NaN() : std::log(x); }
+double jitLog10(double x) { return x <= 0 ? std::numeric_limits<double>::quiet_NaN() : std::log10(x); }
+double jitLog2(double x) { return x <= 0 ? std::numeric_limits<double>::quiet_NaN() : std::log2(x); }
+double jitExp(double x) { return std::exp(x); }
+double jitSqrt(double x) { return x < 0 ? std::numeric_limits<double>::quiet_NaN() : std::sqrt(x); }
+double jitCbrt(double x) { return std::cbrt(x); }
+double jitRoot(double n, double x)
+{
+    if (n == 0 || (x < 0 && std::fmod(n, 2) == 0)) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return std::pow(x, 1.0 / n);
+}
+double jitPow(double x, double y) { return std::pow(x, y); }
+double jitAbs(double x) { return std::abs(x); }
+double jitMin(double x, double y) { return std::min(x, y); }
+double jitMax(double x, double y) { return std::max(x, y); }
+double jitCeil(double x) { return std::ceil(x); }
+double jitFloor(double x) { return std::floor(x); }
+double jitRound(double x) { return std::round(x); }
+double jitFmod(double x, double y) { return std::fmod(x, y); }
+double jitTrunc(double x) { return std::trunc(x); }
+
+double jitFastLog10(double x) { return x <= 0 ? std::numeric_limits<double>::quiet_NaN() : FastMath::log10(x); }
+
+struct NativeMath {
+    const char *name;
+    const void *function;
+    size_t arguments;
+    bool checked; // Returns NaN for arguments the builtin rejects
+};
+
+template <typename F>
+const void *address(F *function)
+{
+    return reinterpret_cast<const void *>(function);
+}
+
+const NativeMath kNativeMath[] = {
+    {"sin", address(jitSin), 1, false},
+    {"cos", address(jitCos), 1, false},
+    {"tan", address(jitTan), 1, false},
+    {"asin", address(jitAsin), 1, true},
+    {"acos", address(jitAcos), 1, true},
+    {"atan", address(jitAtan), 1, false},
+    {"log", address(jitLog), 1, true},
+    {"log10", address(jitLog10), 1, true},
+    {"log2", address(jitLog2), 1, true},
+    {"ln", address(jitLog), 1, true},
+    {"exp", address(jitExp), 1, false},
+    {"sqrt", address(jitSqrt), 1, true},
+    {"cbrt", address(jitCbrt), 1, false},
+    {"root", address(jitRoot), 2, true},
+    {"pow", address(jitPow), 2, false},
+    {"abs", address(jitAbs), 1, false},
+    {"min", address(jitMin), 2, false},
+    {"max", address(jitMax), 2, false},
+    {"ceil", address(jitCeil), 1, false},
+    {"floor", address(jitFloor), 1, false},
+    {"round", address(jitRound), 1, false},
+};
+
+// The fast-math builtins (BuiltinFunction::Approximate) that call a kernel; the others call libm as usual
+const NativeMath kFastNativeMath[] = {
+    {"sin", address(FastMath::sin), 1, false},
+    {"cos", address(FastMath::cos), 1, false},
+    {"tan", address(FastMath::tan), 1, false},
+    {"log10", address(jitFastLog10), 1, true},
+};
+
+template <size_t N>
+const NativeMath *findEntry(const NativeMath (&table)[N], const char *name)
+{
+    for (const NativeMath &entry : table) {
+        if (std::strcmp(entry.name, name) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const NativeMath *findNativeMath(const BuiltinFunction *builtin)
+{
+    if (builtin && builtin->isApproximate()) {
+        const NativeMath *fast = findEntry(kFastNativeMath, builtin->name);
+        return fast ? fast : findEntry(kNativeMath, builtin->name);
+    }
+    // Embedder functions (including overrides of standard names) are not compiled
+    if (!builtin || BuiltinRegistry::standard().find(builtin->name) != builtin) {
+        return nullptr;
+    }
+    return findEntry(kNativeMath, builtin->name);
+}
+
+#ifdef GLOSSAI_JIT_X64
+void *allocateExecutable(const std::vector<std::uint8_t> &code)
+{
+#ifdef _WIN32
+    void *memory = VirtualAlloc(nullptr, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!memory) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    DWORD previous;
+    if (!VirtualProtect(memory, code.size(), PAGE_EXECUTE_READ, &previous)) {
+        VirtualFree(memory, 0, MEM_RELEASE);
+        return nullptr;
+    }
+    return memory;
+#else
+    void *memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    // Never writable and executable at the same time
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        return nullptr;
+    }
+    return memory;
+#endif
+}
+
+void releaseExecutable(void *memory, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+#endif
+
+} // anonymous namespace
+
+JitFunction::~JitFunction()
+{
+#ifdef GLOSSAI_JIT_X64
+    if (m_code) {
+        releaseExecutable(m_code, m_codeSize);
+    }
+#endif
+}
+
+bool JitFunction::run(Context *context, Value &result) const
+{
+    // Spill slots and the result sit below the frame pointer, variables above it
+    std::vector<double> buffer(m_temporaries + 1 + 2 * m_slots.size());
+    double *frame = buffer.data() + m_temporaries + 1;
+
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        const VariableSlot &slot = context->slot(m_slots[i]);
+        if (slot.defined) {
+            if (!slot.value.isNumber()) {
+                return false;
+            }
+            frame[2 * i] = slot.value.asNumber();
+            reinterpret_cast<std::uint8_t *>(frame + 2 * i + 1)[0] = 1;
+        }
+    }
+
+    if (m_entry(frame) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        if (reinterpret_cast<const std::uint8_t *>(frame + 2 * i + 1)[0]) {
+            VariableSlot &slot = context->slot(m_slots[i]);
+            slot.value = Value(frame[2 * i]);
+            slot.defined = true;
+        }
+    }
+    result = m_hasResult ? Value(frame[-1]) : Value();
+    return true;
+}
+
+JitCompiler::JitCompiler()
+    : m_stop(nullptr), m_bailout(0), m_depth(0), m_maxDepth(0)
+{
+}
+
+JitCompiler::~JitCompiler() = default;
+
+std::unique_ptr<JitFunction> JitCompiler::compile(ASTNode *root, bool isStatement, const std::atomic<bool> *stop)
+{
+#ifdef GLOSSAI_JIT_X64
+    m_stop = stop;
+    m_code.clear();
+    m_labels.clear();
+    m_slots.clear();
+    m_depth = 0;
+    m_maxDepth = 0;
+    m_bailout = newLabel();
+    size_t exit = newLabel();
+
+    try {
+        // push rbx; mov rbx, <first argument>; sub rsp, 32 (keeps rsp 16-byte
+        // aligned for calls and provides the Win64 shadow space)
+#ifdef _WIN32
+        emitBytes({0x53, 0x48, 0x89, 0xCB, 0x48, 0x83, 0xEC, 0x20});
+#else
+        emitBytes({0x53, 0x48, 0x89, 0xFB, 0x48, 0x83, 0xEC, 0x20});
+#endif
+        if (isStatement) {
+            compileEffect(root);
+        } else {
+            compileValue(root);
+            emitFrameAccess(MovsdStore, 0, kResultOffset);
+        }
+        emitBytes({0x31, 0xC0}); // xor eax, eax
+        bindLabel(exit);
+        emitBytes({0x48, 0x83, 0xC4, 0x20, 0x5B, 0xC3}); // add rsp, 32; pop rbx; ret
+
+        bindLabel(m_bailout);
+        emitBytes({0xB8, 0x01, 0x00, 0x00, 0x00}); // mov eax, 1
+        emitJump(Always, exit);
+    } catch (const Unsupported &) {
+        return nullptr;
+    }
+
+    for (const Label &label : m_labels) {
+        for (size_t patch : label.patches) {
+            std::int32_t displacement = static_cast<std::int32_t>(label.position - (patch + 4));
+            std::memcpy(&m_code[patch], &displacement, sizeof(displacement));
+        }
+    }
+
+    void *memory = allocateExecutable(m_code);
+    if (!memory) {
+        return nullptr;
+    }
+
+    std::unique_ptr<JitFunction> function(new JitFunction());
+    function->m_code = memory;
+    function->m_codeSize = m_code.size();
+    function->m_entry = reinterpret_cast<JitFunction::Entry>(memory);
+    function->m_slots = m_slots;
+    function->m_temporaries = m_maxDepth;
+    function->m_hasResult = !isStatement;
+    return function;
+#else
+    (void)root;
+    (void)isStatement;
+    (void)stop;
+    return nullptr;
+#endif
+}
+
+void JitCompiler::compileEffect(ASTNode *node)
+{
+    if (auto *block = nodeCast<BlockNode>(node)) {
+        for (ASTNode *statement : block->getStatements()) {
+            compileEffect(statement);
+        }
+        return;
+    }
+
+    if (auto *loop = nodeCast<WhileNode>(node)) {
+        size_t start = newLabel();
+        size_t end = newLabel();
+        bindLabel(start);
+        compileBranch(loop->getCondition(), false, end);
+        compileEffect(loop->getBody());
+        emitCheckStop();
+        emitJump(Always, start);
+        bindLabel(end);
+        return;
+    }
+
+    if (auto *branch = nodeCast<IfNode>(node)) {
+        size_t otherwise = newLabel();
+        size_t end = newLabel();
+        compileBranch(branch->getCondition(), false, otherwise);
+        compileEffect(branch->getThenBranch());
+        emitJump(Always, end);
+        bindLabel(otherwise);
+        if (branch->getElseBranch()) {
+            compileEffect(branch->getElseBranch());
+        }
+        bindLabel(end);
+        return;
+    }
+
+    compileValue(node);
+}
+
+void JitCompiler::compileValue(ASTNode *node)
+{
+    if (auto *literal = nodeCast<LiteralNode>(node)) {
+        Value value = literal->getValue();
+        if (!value.isNumber()) {
+            throw Unsupported();
+        }
+        emitLoadConstant(0, value.asNumber());
+        return;
+    }
+
+    if (auto *identifier = nodeCast<IdentifierNode>(node)) {
+        // Mirror the evaluator's handling of built-in constants
+        if (identifier->getName() == "pi") {
+            emitLoadConstant(0, M_PI);
+            return;
+        }
+        if (identifier->getName() == "e") {
+            emitLoadConstant(0, M_E);
+            return;
+        }
+        std::int32_t offset = slotOffset(identifier);
+        emitCheckDefined(offset);
+        emitFrameAccess(MovsdLoad, 0, offset);
+        return;
+    }
+
+    if (auto *binary = nodeCast<BinaryOpNode>(node)) {
+        compileBinary(binary);
+        return;
+    }
+
+    if (auto *unary = nodeCast<UnaryOpNode>(node)) {
+        if (unary->getOperator() == UnaryOperator::Negate) {
+            compileValue(unary->getOperand());
+            emitLoadConstant(1, -0.0);
+            emitBytes({0x66, 0x0F, 0x57, 0xC1}); // xorpd xmm0, xmm1
+            return;
+        }
+        if (unary->getOperator() == UnaryOperator::Not) {
+            throw Unsupported(); // Produces a boolean
+        }
+        compileIncrement(unary);
+        return;
+    }
+
+    if (auto *call = nodeCast<FunctionCallNode>(node)) {
+        compileCall(call);
+        return;
+    }
+
+    if (auto *branch = nodeCast<IfNode>(node)) {
+        // Without an else branch the value may be null
+        if (!branch->getElseBranch()) {
+            throw Unsupported();
+        }
+        size_t otherwise = newLabel();
+        size_t end = newLabel();
+        compileBranch(branch->getCondition(), false, otherwise);
+        compileValue(branch->getThenBranch());
+        emitJump(Always, end);
+        bindLabel(otherwise);
+        compileValue(branch->getElseBranch());
+        bindLabel(end);
+        return;
+    }
+
+    // Loops and blocks as values, printing, function definitions
+    throw Unsupported();
+}
+
+void JitCompiler::compileBranch(ASTNode *node, bool jumpWhen, size_t label)
+{
+    if (auto *literal = nodeCast<LiteralNode>(node)) {
+        if (literal->getValue().toBool() == jumpWhen) {
+            emitJump(Always, label);
+        }
+        return;
+    }
+
+    if (auto *binary = nodeCast<BinaryOpNode>(node)) {
+        switch (binary->getOperator()) {
+        case BinaryOperator::And:
+        case BinaryOperator::Or: {
+            // a && b jumps when false if either side is false; || is the mirror image
+            const bool isAnd = binary->getOperator() == BinaryOperator::And;
+            if (jumpWhen != isAnd) {
+                compileBranch(binary->getLeft(), jumpWhen, label);
+                compileBranch(binary->getRight(), jumpWhen, label);
+            } else {
+                size_t skip = newLabel();
+                compileBranch(binary->getLeft(), !jumpWhen, skip);
+                compileBranch(binary->getRight(), jumpWhen, label);
+                bindLabel(skip);
+            }
+            return;
+        }
+        case BinaryOperator::Equal:
+        case BinaryOperator::NotEqual:
+        case BinaryOperator::Less:
+        case BinaryOperator::Greater:
+        case BinaryOperator::LessEqual:
+        case BinaryOperator::GreaterEqual:
+            compileComparison(binary, jumpWhen, label);
+            return;
+        default:
+            break;
+        }
+    }
+
+    if (auto *unary = nodeCast<UnaryOpNode>(node)) {
+        if (unary->getOperator() == UnaryOperator::Not) {
+            compileBranch(unary->getOperand(), !jumpWhen, label);
+            return;
+        }
+    }
+
+    // A number is true when it is not zero (NaN included)
+    compileValue(node);
+    emitBytes({0x66, 0x0F, 0x57, 0xC9}); // xorpd xmm1, xmm1
+    emitBytes({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+    if (jumpWhen) {
+        emitJump(Parity, label);
+        emitJump(NotEqual, label);
+    } else {
+        size_t skip = newLabel();
+        emitJump(Parity, skip);
+        emitJump(Equal, label);
+        bindLabel(skip);
+    }
+}
+
+void JitCompiler::compileComparison(BinaryOpNode *node, bool jumpWhen, size_t label)
+{
+    compileOperands(node->getLeft(), node->getRight());
+
+    // Unordered operands (NaN) set ZF, PF and CF: every comparison except != is false
+    switch (node->getOperator()) {
+    case BinaryOperator::Less:
+    case BinaryOperator::LessEqual:
+        emitBytes({0x66, 0x0F, 0x2E, 0xC8}); // ucomisd xmm1, xmm0
+        break;
+    default:
+        emitBytes({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+        break;
+    }
+
+    switch (node->getOperator()) {
+    case BinaryOperator::Less:
+    case BinaryOperator::Greater:
+        emitJump(jumpWhen ? Above : BelowEqual, label);
+        break;
+    case BinaryOperator::LessEqual:
+    case BinaryOperator::GreaterEqual:
+        emitJump(jumpWhen ? AboveEqual : Below, label);
+        break;
+    case BinaryOperator::Equal:
+    case BinaryOperator::NotEqual: {
+        const bool jumpWhenEqual = jumpWhen == (node->getOperator() == BinaryOperator::Equal);
+        if (jumpWhenEqual) {
+            size_t skip = newLabel();
+            emitJump(Parity, skip);
+            emitJump(Equal, label);
+            bindLabel(skip);
+        } else {
+            emitJump(Parity, label);
+            emitJump(NotEqual, label);
+        }
+        break;
+    }
+    default:
+        throw Unsupported();
+    }
+}
+
+void JitCompiler::compileBinary(BinaryOpNode *node)
+{
+    switch (node->getOperator()) {
+    case BinaryOperator::Assign:
+    case BinaryOperator::PlusAssign:
+    case BinaryOperator::MinusAssign:
+    case BinaryOperator::MultiplyAssign:
+    case BinaryOperator::DivideAssign:
+        compileAssignment(node);
+        return;
+    case BinaryOperator::Add:
+    case BinaryOperator::Subtract:
+    case BinaryOperator::Multiply:
+    case BinaryOperator::Divide:
+    case BinaryOperator::Power:
+    case BinaryOperator::Mod:
+    case BinaryOperator::Div:
+        break;
+    default:
+        // Comparisons and logic produce booleans
+        throw Unsupported();
+    }
+
+    compileOperands(node->getLeft(), node->getRight());
+    switch (node->getOperator()) {
+    case BinaryOperator::Add:
+        emitBytes({0xF2, 0x0F, Addsd, 0xC1});
+        break;
+    case BinaryOperator::Subtract:
+        emitBytes({0xF2, 0x0F, Subsd, 0xC1});
+        break;
+    case BinaryOperator::Multiply:
+        emitBytes({0xF2, 0x0F, Mulsd, 0xC1});
+        break;
+    case BinaryOperator::Divide:
+        emitCheckDivisor();
+        emitBytes({0xF2, 0x0F, Divsd, 0xC1});
+        break;
+    case BinaryOperator::Power:
+        emitCall(address(jitPow));
+        break;
+    case BinaryOperator::Mod:
+        emitCheckDivisor();
+        emitCall(address(jitFmod));
+        break;
+    default: // Div
+        emitCheckDivisor();
+        emitBytes({0xF2, 0x0F, Divsd, 0xC1});
+        emitCall(address(jitTrunc));
+        break;
+    }
+}
+
+void JitCompiler::compileAssignment(BinaryOpNode *node)
+{
+    auto *target = nodeCast<IdentifierNode>(node->getLeft());
+    if (!target) {
+        throw Unsupported();
+    }
+    std::int32_t offset = slotOffset(target);
+
+    compileValue(node->getRight());
+    if (node->getOperator() != BinaryOperator::Assign) {
+        emitBytes({0xF2, 0x0F, MovsdLoad, 0xC8}); // movsd xmm1, xmm0
+        emitCheckDefined(offset);
+        emitFrameAccess(MovsdLoad, 0, offset);
+        switch (node->getOperator()) {
+        case BinaryOperator::PlusAssign:
+            emitBytes({0xF2, 0x0F, Addsd, 0xC1});
+            break;
+        case BinaryOperator::MinusAssign:
+            emitBytes({0xF2, 0x0F, Subsd, 0xC1});
+            break;
+        case BinaryOperator::MultiplyAssign:
+            emitBytes({0xF2, 0x0F, Mulsd, 0xC1});
+            break;
+        default:
+            emitCheckDivisor();
+            emitBytes({0xF2, 0x0F, Divsd, 0xC1});
+            break;
+        }
+    }
+    emitFrameAccess(MovsdStore, 0, offset);
+    emitBytes({0xC6, 0x83}); // mov byte [rbx + disp32], 1
+    emitInt32(offset + kDefinedOffset);
+    emitBytes({0x01});
+}
+
+void JitCompiler::compileIncrement(UnaryOpNode *node)
+{
+    auto *target = nodeCast<IdentifierNode>(node->getOperand());
+    if (!target) {
+        throw Unsupported();
+    }
+    std::int32_t offset = slotOffset(target);
+    const bool isIncrement = node->getOperator() == UnaryOperator::PreIncrement ||
+                             node->getOperator() == UnaryOperator::PostIncrement;
+    const bool isPost = node->getOperator() == UnaryOperator::PostIncrement ||
+                        node->getOperator() == UnaryOperator::PostDecrement;
+
+    emitCheckDefined(offset);
+    emitFrameAccess(MovsdLoad, 0, offset);
+    emitBytes({0xF2, 0x0F, MovsdLoad, 0xC8}); // movsd xmm1, xmm0
+    emitLoadConstant(2, 1.0);
+    emitBytes({0xF2, 0x0F, isIncrement ? Addsd : Subsd, 0xCA}); // xmm1 +/-= xmm2
+    emitFrameAccess(MovsdStore, 1, offset);
+    if (!isPost) {
+        emitBytes({0xF2, 0x0F, MovsdLoad, 0xC1}); // movsd xmm0, xmm1
+    }
+}
+
+void JitCompiler::compileCall(FunctionCallNode *node)
+{
+    const NativeMath *math = findNativeMath(node->getBuiltin());
+    if (!math) {
+        throw Unsupported();
+    }
+
+    const auto &arguments = node->getArguments();
+    if (arguments.size() != math->arguments) {
+        throw Unsupported(); // min and max of a single argument are reductions
+    }
+    if (arguments.size() == 1) {
+        compileValue(arguments[0]);
+    } else if (arguments.size() == 2) {
+        compileOperands(arguments[0], arguments[1]);
+    } else {
+        throw Unsupported();
+    }
+
+    emitCall(math->function);
+    if (math->checked) {
+        emitBytes({0x66, 0x0F, 0x2E, 0xC0}); // ucomisd xmm0, xmm0
+        emitJump(Parity, m_bailout);
+    }
+}
+
+void JitCompiler::compileOperands(ASTNode *left, ASTNode *right)
+{
+    // Leaves the left operand in xmm0 and the right one in xmm1
+    compileValue(left);
+    std::int32_t spill = temporary();
+    emitFrameAccess(MovsdStore, 0, spill);
+    ++m_depth;
+    compileValue(right);
+    --m_depth;
+    emitBytes({0xF2, 0x0F, MovsdLoad, 0xC8}); // movsd xmm1, xmm0
+    emitFrameAccess(MovsdLoad, 0, spill);
+}
+
+std::int32_t JitCompiler::slotOffset(IdentifierNode *node)
+{
+    if (!node->isResolved()) {
+        throw Unsupported();
+    }
+    SlotRef ref{node->getScopeDepth(), node->getSlotIndex()};
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        if (m_slots[i].depth == ref.depth && m_slots[i].index == ref.index) {
+            return static_cast<std::int32_t>(i) * kSlotSize;
+        }
+    }
+    m_slots.push_back(ref);
+    return static_cast<std::int32_t>(m_slots.size() - 1) * kSlotSize;
+}
+
+void JitCompiler::emitBytes(std::initializer_list<std::uint8_t> bytes)
+{
+    m_code.insert(m_code.end(), bytes.begin(), bytes.end());
+}
+
+void JitCompiler::emitInt32(std::int32_t value)
+{
+    std::uint8_t bytes[4];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    m_code.insert(m_code.end(), bytes, bytes + 4);
+}
+
+void JitCompiler::emitFrameAccess(std::uint8_t opcode, int xmm, std::int32_t offset)
+{
+    // movsd xmm, [rbx + disp32] or movsd [rbx + disp32], xmm
+    emitBytes({0xF2, 0x0F, opcode, static_cast<std::uint8_t>(0x83 | (xmm << 3))});
+    emitInt32(offset);
+}
+
+void JitCompiler::emitLoadConstant(int xmm, double value)
+{
+    std::uint8_t bits[8];
+    std::memcpy(bits, &value, sizeof(bits));
+    emitBytes({0x48, 0xB8}); // mov rax, imm64
+    m_code.insert(m_code.end(), bits, bits + 8);
+    emitBytes({0x66, 0x48, 0x0F, 0x6E, static_cast<std::uint8_t>(0xC0 | (xmm << 3))}); // movq xmm, rax
+}
+
+void JitCompiler::emitCheckDefined(std::int32_t offset)
+{
+    emitBytes({0x80, 0xBB}); // cmp byte [rbx + disp32], 0
+    emitInt32(offset + kDefinedOffset);
+    emitBytes({0x00});
+    emitJump(Equal, m_bailout);
+}
+
+void JitCompiler::emitCheckDivisor()
+{
+    // The divisor is in xmm1; zero bails out so the interpreter raises the error
+    size_t skip = newLabel();
+    emitBytes({0x66, 0x0F, 0x57, 0xD2}); // xorpd xmm2, xmm2
+    emitBytes({0x66, 0x0F, 0x2E, 0xCA}); // ucomisd xmm1, xmm2
+    emitJump(Parity, skip);
+    emitJump(Equal, m_bailout);
+    bindLabel(skip);
+}
+
+void JitCompiler::emitCheckStop()
+{
+    if (!m_stop) {
+        return;
+    }
+    // A bailout leaves the context untouched; the interpreter then reruns and stops the program
+    static_assert(sizeof(std::atomic<bool>) == 1, "the stop flag is read as a byte");
+    std::uint64_t address = reinterpret_cast<std::uintptr_t>(m_stop);
+    std::uint8_t bytes[8];
+    std::memcpy(bytes, &address, sizeof(bytes));
+    emitBytes({0x48, 0xB8}); // mov rax, imm64
+    m_code.insert(m_code.end(), bytes, bytes + 8);
+    emitBytes({0x80, 0x38, 0x00}); // cmp byte [rax], 0
+    emitJump(NotEqual, m_bailout);
+}
+
+void JitCompiler::emitCall(const void *function)
+{
+    std::uint64_t target = reinterpret_cast<std::uintptr_t>(function);
+    std::uint8_t bytes[8];
+    std::memcpy(bytes, &target, sizeof(bytes));
+    emitBytes({0x48, 0xB8}); // mov rax, imm64
+    m_code.insert(m_code.end(), bytes, bytes + 8);
+    emitBytes({0xFF, 0xD0}); // call rax
+}
+
+void JitCompiler::emitJump(std::uint8_t condition, size_t label)
+{
+    if (condition == Always) {
+        emitBytes({0xE9});
+    } else {
+        emitBytes({0x0F, condition});
+    }
+    m_labels[label].patches.push_back(m_code.size());
+    emitInt32(0);
+}
+
+size_t JitCompiler::newLabel()
+{
+    m_labels.emplace_back();
+    return m_labels.size() - 1;
+}
+
+void JitCompiler::bindLabel(size_t label)
+{
+    m_labels[label].position = m_code.size();
+}
+
+std::int32_t JitCompiler::temporary()
+{
+    m_maxDepth = std::max(m_maxDepth, m_depth + 1);
+    return kResultOffset - 8 * static_cast<std::int32_t>(m_depth + 1);
+}
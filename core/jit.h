@@ -0,0 +1,120 @@
+#pragma once
+
+#include "ast.h"
+#include "context.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Native code produced by JitCompiler for one program
+ *
+ * The code works on a private copy of the variables it uses and only writes
+ * them back to the Context when it completes. Whenever it meets something it
+ * cannot handle (a variable that is not a number, an undefined variable, an
+ * operation that would raise an error) it bails out before any change is
+ * visible, so the caller can simply run the same program on the interpreter.
+ */
+class JitFunction
+{
+public:
+    /// Executions after which a program is compiled
+    static constexpr size_t RunThreshold = 16;
+    /// Loop iterations (over all executions) after which a program is compiled
+    static constexpr size_t LoopThreshold = 1000;
+
+    ~JitFunction();
+
+    JitFunction(const JitFunction &) = delete;
+    JitFunction &operator=(const JitFunction &) = delete;
+
+    /**
+     * @brief Run the native code
+     * @param context Context the program was resolved against
+     * @param result Receives the program's value (null for statements)
+     * @return False if the code bailed out; the context is then unchanged
+     */
+    bool run(Context *context, Value &result) const;
+
+private:
+    friend class JitCompiler;
+    using Entry = int (*)(double *frame);
+
+    JitFunction() = default;
+
+    void *m_code = nullptr;
+    size_t m_codeSize = 0;
+    Entry m_entry = nullptr;
+    std::vector<SlotRef> m_slots; // Frame entry to Context slot
+    size_t m_temporaries = 0;     // Spill slots below the result
+    bool m_hasResult = false;
+};
+
+/**
+ * @brief Compiles numeric-only programs to native x86-64 code
+ *
+ * Handles number literals, variables, arithmetic, assignments, increments,
+ * comparisons and logic in conditions, if/else, while loops, blocks and the
+ * standard math functions. Anything else (strings, printing, embedder
+ * functions, comparisons used as values) makes compile() return nullptr and
+ * the program stays on the interpreter. The tree must have been resolved.
+ * On other architectures compile() always returns nullptr.
+ */
+class JitCompiler
+{
+public:
+    JitCompiler();
+    ~JitCompiler();
+
+    /**
+     * @brief Compile a resolved program
+     * @param root Root node of the program
+     * @param isStatement True if the program's value is not needed
+     * @param stop Flag checked on every loop iteration; once set the code bails
+     *        out, so the interpreter stops the program (may be nullptr)
+     * @return The native function, or nullptr if the program is not supported
+     */
+    std::unique_ptr<JitFunction> compile(ASTNode *root, bool isStatement,
+                                         const std::atomic<bool> *stop = nullptr);
+
+private:
+    struct Label {
+        size_t position = SIZE_MAX;
+        std::vector<size_t> patches;
+    };
+
+    // Tree lowering
+    void compileEffect(ASTNode *node);
+    void compileValue(ASTNode *node);
+    void compileBranch(ASTNode *node, bool jumpWhen, size_t label);
+    void compileBinary(BinaryOpNode *node);
+    void compileAssignment(BinaryOpNode *node);
+    void compileIncrement(UnaryOpNode *node);
+    void compileCall(FunctionCallNode *node);
+    void compileComparison(BinaryOpNode *node, bool jumpWhen, size_t label);
+    void compileOperands(ASTNode *left, ASTNode *right);
+    std::int32_t slotOffset(IdentifierNode *node);
+
+    // Instruction emission
+    void emitBytes(std::initializer_list<std::uint8_t> bytes);
+    void emitInt32(std::int32_t value);
+    void emitFrameAccess(std::uint8_t opcode, int xmm, std::int32_t offset);
+    void emitLoadConstant(int xmm, double value);
+    void emitCheckDefined(std::int32_t offset);
+    void emitCheckDivisor();
+    void emitCheckStop();
+    void emitCall(const void *function);
+    void emitJump(std::uint8_t condition, size_t label);
+    size_t newLabel();
+    void bindLabel(size_t label);
+    std::int32_t temporary();
+
+    std::vector<std::uint8_t> m_code;
+    std::vector<Label> m_labels;
+    std::vector<SlotRef> m_slots;
+    const std::atomic<bool> *m_stop;
+    size_t m_bailout;
+    size_t m_depth;
+    size_t m_maxDepth;
+};
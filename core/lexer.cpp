@@ -1,9 +1,112 @@
 #include "lexer.h"
-#include <unordered_map>
 #include <cctype>
-#include <algorithm>
 #include <stdexcept>
 
+namespace
+{
+
+/**
+ * @brief Case-insensitive comparison against a lowercase ASCII word
+ */
+bool equalsLowercase(std::string_view text, std::string_view lowercase)
+{
+    for (size_t i = 0; i < lowercase.size(); ++i) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        if (c != lowercase[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Get the value of a named mathematical constant, or nullptr
+ *
+ * Switching on the length first means most identifiers are rejected without
+ * comparing any characters.
+ */
+const char *constantValue(std::string_view word)
+{
+    switch (word.size()) {
+    case 1:
+        if (equalsLowercase(word, "e")) return "2.71828182845904523536";
+        break;
+    case 2:
+        if (equalsLowercase(word, "pi")) return "3.14159265358979323846";
+        break;
+    case 3:
+        if (equalsLowercase(word, "tau")) return "6.28318530717958647692"; // tau = 2*pi
+        if (equalsLowercase(word, "phi")) return "1.61803398874989484820"; // Golden ratio
+        if (equalsLowercase(word, "ln2")) return "0.69314718055994530942"; // ln(2)
+        break;
+    case 4:
+        if (equalsLowercase(word, "ln10")) return "2.30258509299404568402"; // ln(10)
+        break;
+    case 5:
+        if (equalsLowercase(word, "sqrt2")) return "1.41421356237309504880"; // √2
+        if (equalsLowercase(word, "sqrt3")) return "1.73205080756887729353"; // √3
+        break;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Classify an identifier as a keyword (case-insensitive) or a plain identifier
+ */
+TokenType keywordType(std::string_view word)
+{
+    switch (word.size()) {
+    case 2:
+        if (equalsLowercase(word, "if")) return TokenType::If;
+        if (equalsLowercase(word, "or")) return TokenType::Or;
+        break;
+    case 3:
+        if (equalsLowercase(word, "for")) return TokenType::For;
+        if (equalsLowercase(word, "and")) return TokenType::And;
+        if (equalsLowercase(word, "not")) return TokenType::Not;
+        if (equalsLowercase(word, "mod")) return TokenType::Mod;
+        if (equalsLowercase(word, "div")) return TokenType::Div;
+        break;
+    case 4:
+        if (equalsLowercase(word, "else")) return TokenType::Else;
+        if (equalsLowercase(word, "true")) return TokenType::True;
+        break;
+    case 5:
+        if (equalsLowercase(word, "while")) return TokenType::While;
+        if (equalsLowercase(word, "print")) return TokenType::Print;
+        if (equalsLowercase(word, "false")) return TokenType::False;
+        break;
+    case 6:
+        if (equalsLowercase(word, "return")) return TokenType::Return;
+        break;
+    case 8:
+        if (equalsLowercase(word, "function")) return TokenType::Function;
+        if (equalsLowercase(word, "parallel")) return TokenType::Parallel;
+        break;
+    case 9:
+        if (equalsLowercase(word, "procedure")) return TokenType::Procedure;
+        break;
+    }
+    return TokenType::Identifier;
+}
+
+/**
+ * @brief Count a closing bracket against the open ones of its kind
+ */
+void closeBracket(std::uint16_t &open, LexState &state)
+{
+    if (open > 0) {
+        --open;
+    } else {
+        state.unbalanced = true;
+    }
+}
+
+} // anonymous namespace
+
 Lexer::Lexer()
     : m_position(0)
     , m_currentLine(1)
@@ -12,56 +115,156 @@ Lexer::Lexer()
 {
 }
 
-std::vector<Token> Lexer::tokenize(const std::string &input)
+std::vector<Token> Lexer::tokenize(std::string_view input)
+{
+    reset(input);
+    
+    std::vector<Token> tokens;
+    tokens.reserve(m_input.size() / 4 + 1); // Typical density of generated sources
+    
+    do {
+        tokens.push_back(nextToken());
+    } while (tokens.back().type != TokenType::EndOfFile);
+    
+    return tokens;
+}
+
+void Lexer::reset(std::string_view input)
 {
     m_input = input;
     m_position = 0;
     m_currentLine = 1;
     m_currentColumn = 1;
     m_currentChar = m_input.empty() ? '\0' : m_input[0];
+}
+
+Token Lexer::nextToken()
+{
+    skipWhitespace();
     
-    std::vector<Token> tokens;
-    
-    while (m_currentChar != '\0') {
-        if (std::isspace(m_currentChar)) {
-            skipWhitespace();
-            continue;
+    if (m_currentChar == '\0') {
+        return Token(TokenType::EndOfFile, "", m_currentLine, m_currentColumn);
+    }
+    if (isDigit(m_currentChar)) {
+        return readNumber();
+    }
+    if (m_currentChar == '"' || m_currentChar == '\'') {
+        return readString();
+    }
+    if (isAlpha(m_currentChar) || m_currentChar == '_') {
+        return readIdentifier();
+    }
+    return readOperator();
+}
+
+void Lexer::lexLine(std::string_view line, LexState &state, std::vector<LineToken> *tokens)
+{
+    reset(line);
+    if (tokens) {
+        tokens->clear();
+    }
+
+    if (state.inString) {
+        state.inString = !skipStringBody();
+        if (!state.inString) {
+            advance(); // Skip closing quote
+        }
+        if (tokens) {
+            tokens->push_back({TokenType::String, 0, static_cast<int>(m_position)});
+        }
+    }
+
+    while (!state.inString) {
+        while (std::isspace(m_currentChar)) {
+            advance();
         }
-        
-        if (isDigit(m_currentChar)) {
-            tokens.push_back(readNumber());
+        if (m_currentChar == '\0') {
+            break;
+        }
+
+        size_t start = m_position;
+        TokenType type;
+        if (m_currentChar == '#' && atLineStart()) {
+            type = TokenType::Comment;
+            while (m_currentChar != '\n' && m_currentChar != '\0') {
+                advance();
+            }
         } else if (m_currentChar == '"' || m_currentChar == '\'') {
-            tokens.push_back(readString());
-        } else if (isAlpha(m_currentChar) || m_currentChar == '_') {
-            tokens.push_back(readIdentifier());
+            type = TokenType::String;
+            advance(); // Skip opening quote
+            state.inString = !skipStringBody();
+            if (!state.inString) {
+                advance(); // Skip closing quote
+            }
         } else {
-            tokens.push_back(readOperator());
+            type = nextToken().type;
+        }
+
+        switch (type) {
+        case TokenType::LeftBrace: ++state.braces; break;
+        case TokenType::LeftParen: ++state.parens; break;
+        case TokenType::LeftBracket: ++state.brackets; break;
+        case TokenType::RightBrace: closeBracket(state.braces, state); break;
+        case TokenType::RightParen: closeBracket(state.parens, state); break;
+        case TokenType::RightBracket: closeBracket(state.brackets, state); break;
+        default: break;
+        }
+        if (tokens) {
+            tokens->push_back({type, static_cast<int>(start), static_cast<int>(m_position - start)});
         }
     }
-    
-    tokens.emplace_back(TokenType::EndOfFile, "", m_currentLine, m_currentColumn);
-    return tokens;
+}
+
+LexState Lexer::scan(std::string_view text)
+{
+    // The lexer follows newlines itself; only the state at the end is wanted
+    Lexer lexer;
+    LexState state;
+    lexer.lexLine(text, state);
+    return state;
 }
 
 void Lexer::skipWhitespace()
 {
-    while (std::isspace(m_currentChar)) {
-        advance();
+    for (;;) {
+        while (std::isspace(m_currentChar)) {
+            advance();
+        }
+        // A '#' starting a line comments out the rest of it, as in .glo files
+        if (m_currentChar != '#' || !atLineStart()) {
+            return;
+        }
+        while (m_currentChar != '\n' && m_currentChar != '\0') {
+            advance();
+        }
     }
 }
 
+bool Lexer::atLineStart() const
+{
+    for (size_t i = m_position; i > 0; --i) {
+        char c = m_input[i - 1];
+        if (c == '\n') {
+            return true;
+        }
+        if (c != ' ' && c != '\t' && c != '\r') {
+            return false;
+        }
+    }
+    return true;
+}
+
 Token Lexer::readNumber()
 {
-    std::string number;
+    size_t start = m_position;
     int startLine = m_currentLine;
     int startColumn = m_currentColumn;
     
     while (isDigit(m_currentChar) || m_currentChar == '.') {
-        number += m_currentChar;
         advance();
     }
     
-    return Token(TokenType::Number, number, startLine, startColumn);
+    return Token(TokenType::Number, m_input.substr(start, m_position - start), startLine, startColumn);
 }
 
 Token Lexer::readString()
@@ -70,98 +273,78 @@ Token Lexer::readString()
     int startColumn = m_currentColumn;
     
     advance(); // Skip opening quote
-    std::string value;
+    size_t start = m_position;
+    
+    if (!skipStringBody()) {
+        throw std::runtime_error("Unterminated string literal");
+    }
+    std::string_view raw = m_input.substr(start, m_position - start);
+    advance(); // Skip closing quote
     
+    return Token(TokenType::String, raw, startLine, startColumn);
+}
+
+bool Lexer::skipStringBody()
+{
+    // Escapes are only skipped here; unescape() decodes them when the literal is built
     while (m_currentChar != '"' && m_currentChar != '\0') {
         if (m_currentChar == '\\') {
             advance();
-            switch (m_currentChar) {
-            case 'n': value += '\n'; break;
-            case 't': value += '\t'; break;
-            case 'r': value += '\r'; break;
-            case '\\': value += '\\'; break;
-            case '"': value += '"'; break;
-            default: value += m_currentChar; break;
+            if (m_currentChar == '\0') {
+                break;
             }
-        } else {
-            value += m_currentChar;
         }
         advance();
     }
-    
-    if (m_currentChar == '"') {
-        advance(); // Skip closing quote
-    } else {
-        throw std::runtime_error("Unterminated string literal");
+    return m_currentChar == '"';
+}
+
+std::string Lexer::unescape(std::string_view raw)
+{
+    std::string value;
+    value.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\' || i + 1 == raw.size()) {
+            value += raw[i];
+            continue;
+        }
+        switch (raw[++i]) {
+        case 'n': value += '\n'; break;
+        case 't': value += '\t'; break;
+        case 'r': value += '\r'; break;
+        case '\\': value += '\\'; break;
+        case '"': value += '"'; break;
+        default: value += raw[i]; break;
+        }
     }
-    
-    return Token(TokenType::String, value, startLine, startColumn);
+    return value;
 }
 
 Token Lexer::readIdentifier()
 {
-    std::string identifier;
+    size_t start = m_position;
     int startLine = m_currentLine;
     int startColumn = m_currentColumn;
 
     while (isAlphaNumeric(m_currentChar) || m_currentChar == '_') {
-        identifier += m_currentChar;
         advance();
     }
-
-    // Convert to lowercase for case-insensitive matching
-    std::string lowerIdentifier = identifier;
-    std::transform(lowerIdentifier.begin(),
-                   lowerIdentifier.end(),
-                   lowerIdentifier.begin(),
-                   ::tolower);
+    std::string_view identifier = m_input.substr(start, m_position - start);
 
     // Mathematical constants - convert directly to numbers
-    static const std::unordered_map<std::string, std::string> constants = {
-        {"pi", "3.14159265358979323846"},
-        {"e", "2.71828182845904523536"},
-        {"tau", "6.28318530717958647692"},   // tau = 2*pi
-        {"phi", "1.61803398874989484820"},   // Golden ratio
-        {"sqrt2", "1.41421356237309504880"}, // √2
-        {"sqrt3", "1.73205080756887729353"}, // √3
-        {"ln2", "0.69314718055994530942"},   // ln(2)
-        {"ln10", "2.30258509299404568402"}   // ln(10)
-    };
-
-    auto constIt = constants.find(lowerIdentifier);
-    if (constIt != constants.end()) {
-        return Token(TokenType::Number, constIt->second, startLine, startColumn);
+    if (const char *constant = constantValue(identifier)) {
+        return Token(TokenType::Number, constant, startLine, startColumn);
     }
 
-    // Check for keywords
-    static const std::unordered_map<std::string, TokenType> keywords = {{"if", TokenType::If},
-                                                                        {"else", TokenType::Else},
-                                                                        {"while", TokenType::While},
-                                                                        {"for", TokenType::For},
-                                                                        {"function",
-                                                                         TokenType::Function},
-                                                                        {"procedure", TokenType::Procedure},
-                                                                        {"return",
-                                                                         TokenType::Return},
-                                                                        {"print", TokenType::Print},
-                                                                        {"true", TokenType::True},
-                                                                        {"false", TokenType::False},
-                                                                        {"and", TokenType::And},
-                                                                        {"or", TokenType::Or},
-                                                                        {"not", TokenType::Not},
-                                                                        {"mod", TokenType::Mod},
-                                                                        {"div", TokenType::Div}};
-
-    auto it = keywords.find(lowerIdentifier);
-    TokenType type = (it != keywords.end()) ? it->second : TokenType::Identifier;
-
-    return Token(type, identifier, startLine, startColumn);
+    // Keywords are case-insensitive; identifiers keep their spelling
+    return Token(keywordType(identifier), identifier, startLine, startColumn);
 }
 
 Token Lexer::readOperator()
 {
     int startLine = m_currentLine;
     int startColumn = m_currentColumn;
+    size_t start = m_position;
     char current = m_currentChar;
     
     advance();
@@ -233,10 +416,12 @@ Token Lexer::readOperator()
     case ')': return Token(TokenType::RightParen, ")", startLine, startColumn);
     case '{': return Token(TokenType::LeftBrace, "{", startLine, startColumn);
     case '}': return Token(TokenType::RightBrace, "}", startLine, startColumn);
+    case '[': return Token(TokenType::LeftBracket, "[", startLine, startColumn);
+    case ']': return Token(TokenType::RightBracket, "]", startLine, startColumn);
     case ',': return Token(TokenType::Comma, ",", startLine, startColumn);
     case ';': return Token(TokenType::Semicolon, ";", startLine, startColumn);
     default:
-        return Token(TokenType::Invalid, std::string(1, current), startLine, startColumn);
+        return Token(TokenType::Invalid, m_input.substr(start, 1), startLine, startColumn);
     }
 }
 
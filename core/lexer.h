@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 /**
@@ -50,6 +52,8 @@ enum class TokenType {
     RightParen,
     LeftBrace,
     RightBrace,
+    LeftBracket,
+    RightBracket,
     Comma,
     Semicolon,
     
@@ -58,6 +62,7 @@ enum class TokenType {
     Else,
     While,
     For,
+    Parallel,
     Function,
     Procedure,
     Return,
@@ -67,22 +72,64 @@ enum class TokenType {
     
     // Special
     EndOfFile,
-    Invalid
+    Invalid,
+    Comment         // Only reported by Lexer::lexLine()
 };
 
 /**
  * @brief Represents a single token in the source code
+ *
+ * The value is a view into the source passed to Lexer::tokenize() (or, for
+ * named constants, into static storage), so tokens are only valid while that
+ * source is. String literal tokens hold the raw text between the quotes; use
+ * Lexer::unescape() to obtain the string they denote.
  */
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
     int line;
     int column;
     
-    Token(TokenType t = TokenType::Invalid, const std::string &v = std::string(), int l = 0, int c = 0)
+    Token(TokenType t = TokenType::Invalid, std::string_view v = std::string_view(), int l = 0, int c = 0)
         : type(t), value(v), line(l), column(c) {}
 };
 
+/**
+ * @brief Lexer state at a line boundary
+ *
+ * Enough to lex a line without the lines before it: the brackets still open
+ * and whether the line starts inside a string literal. Brackets are counted
+ * on tokens, so those inside strings and comments do not count.
+ */
+struct LexState {
+    std::uint16_t braces = 0;   // Unclosed "{"
+    std::uint16_t parens = 0;   // Unclosed "("
+    std::uint16_t brackets = 0; // Unclosed "["
+    bool inString = false;      // Inside a string literal that continues on the next line
+    bool unbalanced = false;    // Some closing bracket had no opening one
+
+    /**
+     * @brief Check whether a statement ending here needs more lines
+     */
+    bool continues() const { return inString || braces > 0 || parens > 0 || brackets > 0; }
+
+    bool operator==(const LexState &other) const
+    {
+        return braces == other.braces && parens == other.parens && brackets == other.brackets &&
+               inString == other.inString && unbalanced == other.unbalanced;
+    }
+    bool operator!=(const LexState &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief A token of a single line, located for highlighting
+ */
+struct LineToken {
+    TokenType type; // String also for each line of a literal spanning lines
+    int start;      // Offset in the line
+    int length;
+};
+
 /**
  * @brief Lexical analyzer for the GlossAI language
  * Pure C++ implementation using only standard library
@@ -94,10 +141,48 @@ public:
     
     /**
      * @brief Tokenize the input string
-     * @param input The source code to tokenize
-     * @return Vector of tokens
+     * @param input The source code to tokenize; must outlive the tokens
+     * @return Vector of tokens viewing into the input
+     */
+    std::vector<Token> tokenize(std::string_view input);
+
+    /**
+     * @brief Start lexing input one token at a time with nextToken()
+     * @param input The source code to lex; must outlive the tokens
+     */
+    void reset(std::string_view input);
+
+    /**
+     * @brief Lex the next token of the input given to reset()
+     * @return The token, or EndOfFile once the input is exhausted
+     */
+    Token nextToken();
+
+    /**
+     * @brief Lex one line, continuing from the state the previous line ended in
+     *
+     * Lines lexed this way give the same tokens as tokenize() on the whole
+     * text, so the state after each line can be kept as a checkpoint and an
+     * edited line re-lexed on its own. Unterminated strings are not an error
+     * here; they leave the state inside the string.
+     * @param line Text of the line, without its newline
+     * @param state State at the start of the line; updated to the state at its end
+     * @param tokens If not null, receives the tokens of the line
+     */
+    void lexLine(std::string_view line, LexState &state, std::vector<LineToken> *tokens = nullptr);
+
+    /**
+     * @brief Lex a whole text, which may span lines, from the initial state
+     * @return State at the end of the text
+     */
+    static LexState scan(std::string_view text);
+
+    /**
+     * @brief Decode the escape sequences of a string literal token
+     * @param raw The token's value (text between the quotes)
+     * @return The string the literal denotes
      */
-    std::vector<Token> tokenize(const std::string &input);
+    static std::string unescape(std::string_view raw);
     
     /**
      * @brief Get the current line number
@@ -111,8 +196,10 @@ public:
 
 private:
     void skipWhitespace();
+    bool atLineStart() const;
     Token readNumber();
     Token readString();
+    bool skipStringBody();
     Token readIdentifier();
     Token readOperator();
     
@@ -120,7 +207,7 @@ private:
     bool isAlpha(char c) const;
     bool isAlphaNumeric(char c) const;
     
-    std::string m_input;
+    std::string_view m_input;
     size_t m_position;
     int m_currentLine;
     int m_currentColumn;
@@ -2,22 +2,15 @@
 #include <algorithm>
 #include <cctype>
 
-LineParser::LineParser()
-    : m_braceLevel(0)
-    , m_parenLevel(0)
-    , m_bracketLevel(0)
-    , m_inString(false)
-    , m_inComment(false)
-{
-}
+LineParser::LineParser() = default;
 
 bool LineParser::processLine(const std::string &line)
 {
     // Add the line to our buffer
     m_lines.push_back(line);
     
-    // Update nesting levels
-    updateLevels(line);
+    // Continue lexing where the previous line left off
+    m_lexer.lexLine(line, m_state);
     
     // Check if the statement is complete
     return isComplete();
@@ -36,11 +29,7 @@ std::string LineParser::getCode() const
 void LineParser::clear()
 {
     m_lines.clear();
-    m_braceLevel = 0;
-    m_parenLevel = 0;
-    m_bracketLevel = 0;
-    m_inString = false;
-    m_inComment = false;
+    m_state = LexState();
 }
 
 bool LineParser::needsContinuation() const
@@ -59,7 +48,7 @@ std::string LineParser::getContinuationPrompt() const
     std::string prompt = "... ";
     
     // Add indentation based on brace level
-    int indentLevel = m_braceLevel;
+    int indentLevel = m_state.braces;
     for (int i = 0; i < indentLevel; ++i) {
         prompt += "    "; // 4 spaces per indent level
     }
@@ -67,46 +56,6 @@ std::string LineParser::getContinuationPrompt() const
     return prompt;
 }
 
-void LineParser::updateLevels(const std::string &line)
-{
-    bool inString = false;
-    char stringChar = 0;
-    
-    for (size_t i = 0; i < line.length(); ++i) {
-        char c = line[i];
-        
-        // Handle string literals
-        if (!inString && (c == '"' || c == '\'')) {
-            inString = true;
-            stringChar = c;
-            continue;
-        }
-        
-        if (inString) {
-            if (c == stringChar && (i == 0 || line[i-1] != '\\')) {
-                inString = false;
-                stringChar = 0;
-            }
-            continue;
-        }
-        
-        // Handle comments
-        if (c == '#') {
-            break; // Rest of line is comment
-        }
-        
-        // Count nesting levels
-        switch (c) {
-            case '{': m_braceLevel++; break;
-            case '}': m_braceLevel--; break;
-            case '(': m_parenLevel++; break;
-            case ')': m_parenLevel--; break;
-            case '[': m_bracketLevel++; break;
-            case ']': m_bracketLevel--; break;
-        }
-    }
-}
-
 bool LineParser::isComplete() const
 {
     // If we don't have any lines, we're ready for input (not complete)
@@ -114,8 +63,8 @@ bool LineParser::isComplete() const
         return false;
     }
     
-    // If we have unmatched brackets, we need continuation
-    if (m_braceLevel > 0 || m_parenLevel > 0 || m_bracketLevel > 0) {
+    // If we have unmatched brackets or an unterminated string, we need continuation
+    if (m_state.continues()) {
         return false;
     }
     
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "lexer.h"
 #include <string>
 #include <vector>
 
@@ -8,6 +9,8 @@
  * 
  * This class determines when a line is complete or needs continuation,
  * handling multi-line constructs like blocks, functions, and control structures.
+ * Each line is lexed once, from the state the previous line ended in, so
+ * strings and comments are treated as the parser's lexer treats them.
  */
 class LineParser
 {
@@ -51,16 +54,17 @@ public:
      */
     std::string getIndentedCode() const;
 
+    /**
+     * @brief Get the lexer state after the last line, where the next line starts
+     */
+    const LexState &getState() const { return m_state; }
+
 private:
     std::vector<std::string> m_lines;
-    int m_braceLevel;
-    int m_parenLevel;
-    int m_bracketLevel;
-    bool m_inString;
-    bool m_inComment;
+    Lexer m_lexer;
+    LexState m_state;
     
     // Helper methods
-    void updateLevels(const std::string &line);
     bool isComplete() const;
     std::string trim(const std::string &str) const;
 };
@@ -0,0 +1,102 @@
+#include "mappedfile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path)
+    : m_data(nullptr)
+    , m_size(0)
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+{
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not open file '" + path + "'");
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        CloseHandle(m_file);
+        throw std::runtime_error("Could not read the size of file '" + path + "'");
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0) {
+        return; // Empty files cannot be mapped
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (m_mapping) {
+            CloseHandle(m_mapping);
+        }
+        CloseHandle(m_file);
+        throw std::runtime_error("Could not map file '" + path + "'");
+    }
+    m_data = static_cast<const char *>(view);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path)
+    : m_data(nullptr)
+    , m_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file '" + path + "'");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not read the size of file '" + path + "'");
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size == 0) {
+        close(fd);
+        return; // Empty files cannot be mapped
+    }
+
+    void *view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("Could not map file '" + path + "'");
+    }
+    // Scripts are lexed front to back exactly once
+    madvise(view, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char *>(view);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Read-only view of a whole file mapped into memory
+ *
+ * The operating system pages the file in as it is read instead of copying it
+ * into a buffer, so opening even a very large script allocates nothing.
+ */
+class MappedFile
+{
+public:
+    /**
+     * @brief Map a file
+     * @param path File to map
+     * @throws std::runtime_error if the file cannot be opened or mapped
+     */
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @brief The file's contents, valid for the lifetime of the mapping
+     */
+    std::string_view view() const { return std::string_view(m_data, m_size); }
+
+private:
+    const char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_file;    // HANDLE of the open file
+    void *m_mapping; // HANDLE of the file mapping
+#endif
+};
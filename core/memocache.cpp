@@ -0,0 +1,124 @@
+#include "memocache.h"
+#include <cstring>
+#include <functional>
+
+namespace
+{
+
+std::uint64_t numberBits(double number)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &number, sizeof bits);
+    return bits;
+}
+
+} // anonymous namespace
+
+size_t MemoCache::KeyHash::operator()(const Key &key) const
+{
+    size_t hash = key.size();
+    for (const Value &value : key) {
+        size_t element = value.getType();
+        switch (value.getType()) {
+        case Value::Number: element = std::hash<std::uint64_t>()(numberBits(value.asNumber())); break;
+        case Value::Boolean: element = value.toBool() ? 1 : 2; break;
+        case Value::String: element = std::hash<std::string>()(value.asString()); break;
+        case Value::Array:
+            for (double number : value.asArray()) {
+                element ^= std::hash<std::uint64_t>()(numberBits(number)) + (element << 6) + (element >> 2);
+            }
+            break;
+        case Value::Null: break;
+        }
+        hash ^= element + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+bool MemoCache::KeyEqual::operator()(const Key &left, const Key &right) const
+{
+    if (left.size() != right.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < left.size(); ++i) {
+        const Value &a = left[i];
+        const Value &b = right[i];
+        if (a.getType() != b.getType()) {
+            return false;
+        }
+        switch (a.getType()) {
+        case Value::Number:
+            if (numberBits(a.asNumber()) != numberBits(b.asNumber())) {
+                return false;
+            }
+            break;
+        case Value::Boolean:
+            if (a.toBool() != b.toBool()) {
+                return false;
+            }
+            break;
+        case Value::String:
+            if (a.asString() != b.asString()) {
+                return false;
+            }
+            break;
+        case Value::Array:
+            if (a.asArray().size() != b.asArray().size() ||
+                std::memcmp(a.asArray().data(), b.asArray().data(), a.asArray().size() * sizeof(double)) != 0) {
+                return false;
+            }
+            break;
+        case Value::Null:
+            break;
+        }
+    }
+    return true;
+}
+
+MemoCache::MemoCache(size_t capacity)
+    : m_capacity(capacity), m_hits(0), m_misses(0), m_evictions(0)
+{
+}
+
+const Value *MemoCache::lookup(Span<const Value> arguments)
+{
+    m_probe.assign(arguments.begin(), arguments.end());
+    auto it = m_index.find(m_probe);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &it->second->result;
+}
+
+void MemoCache::insert(Span<const Value> arguments, const Value &result)
+{
+    if (m_capacity == 0) {
+        return;
+    }
+
+    m_probe.assign(arguments.begin(), arguments.end());
+    auto it = m_index.find(m_probe);
+    if (it != m_index.end()) {
+        it->second->result = result;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+
+    m_entries.push_front(Entry{m_probe, result});
+    m_index.emplace(m_probe, m_entries.begin());
+    while (m_entries.size() > m_capacity) {
+        m_index.erase(m_entries.back().arguments);
+        m_entries.pop_back();
+        ++m_evictions;
+    }
+}
+
+void MemoCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+}
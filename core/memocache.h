@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ast.h"
+#include "span.h"
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Bounded least-recently-used cache of a pure function's results
+ *
+ * Keyed by the argument tuple. Arguments match only if they have the same
+ * type and the same exact value (numbers compare bitwise, so 0 and -0 are
+ * distinct keys). Calls that fail are never stored.
+ */
+class MemoCache
+{
+public:
+    explicit MemoCache(size_t capacity);
+
+    /**
+     * @brief Find the result for an argument tuple and mark it most recently used
+     * @return The result, or nullptr on a miss; valid until the next insert()
+     */
+    const Value *lookup(Span<const Value> arguments);
+
+    /**
+     * @brief Store a result, evicting the least recently used entries
+     */
+    void insert(Span<const Value> arguments, const Value &result);
+
+    /**
+     * @brief Drop all entries (statistics are kept)
+     */
+    void clear();
+
+    size_t capacity() const { return m_capacity; }
+    size_t size() const { return m_entries.size(); }
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    size_t evictions() const { return m_evictions; }
+
+private:
+    using Key = std::vector<Value>;
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Key &left, const Key &right) const;
+    };
+    struct Entry {
+        Key arguments;
+        Value result;
+    };
+
+    size_t m_capacity;
+    size_t m_hits;
+    size_t m_misses;
+    size_t m_evictions;
+    std::list<Entry> m_entries; // Most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash, KeyEqual> m_index;
+    Key m_probe;                // Reused by lookup() so hits do not allocate
+};
@@ -0,0 +1,590 @@
+#include "optimizer.h"
+#include "builtins.h"
+#include "program.h"
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef M_E
+#define M_E 2.71828182845904523536
+#endif
+
+namespace
+{
+
+bool isAssignment(BinaryOperator op)
+{
+    return op == BinaryOperator::Assign || op == BinaryOperator::PlusAssign ||
+           op == BinaryOperator::MinusAssign || op == BinaryOperator::MultiplyAssign ||
+           op == BinaryOperator::DivideAssign;
+}
+
+bool isIncrement(UnaryOperator op)
+{
+    return op == UnaryOperator::PreIncrement || op == UnaryOperator::PostIncrement ||
+           op == UnaryOperator::PreDecrement || op == UnaryOperator::PostDecrement;
+}
+
+const LiteralNode *asLiteral(const ASTNode *node)
+{
+    return nodeCast<LiteralNode>(node);
+}
+
+/**
+ * @brief Collects the names of all variables a subtree may write to
+ *
+ * Calls to user functions may write to any global, so they are only flagged.
+ */
+class AssignmentCollector : public ASTVisitor
+{
+public:
+    explicit AssignmentCollector(const BuiltinRegistry &builtins) : m_builtins(builtins) {}
+
+    std::vector<std::string> names;
+    bool callsUserFunction = false;
+
+    void collect(ASTNode *node)
+    {
+        if (node) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *) override {}
+    void visit(BinaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getLeft());
+        if (isAssignment(node->getOperator()) && target) {
+            add(target->getName());
+        }
+        collect(node->getLeft());
+        collect(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getOperand());
+        if (isIncrement(node->getOperator()) && target) {
+            add(target->getName());
+        }
+        collect(node->getOperand());
+    }
+    void visit(FunctionCallNode *node) override
+    {
+        auto *funcNode = nodeCast<IdentifierNode>(node->getFunction());
+        const BuiltinFunction *builtin = funcNode ? m_builtins.find(funcNode->getName()) : nullptr;
+        if (!builtin || !builtin->accepts(node->getArguments().size())) {
+            callsUserFunction = true;
+        }
+        for (ASTNode *arg : node->getArguments()) {
+            collect(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        collect(node->getCondition());
+        collect(node->getThenBranch());
+        collect(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        collect(node->getCondition());
+        collect(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        collect(node->getInit());
+        collect(node->getCondition());
+        collect(node->getUpdate());
+        collect(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            collect(statement);
+        }
+    }
+    void visit(FunctionDefNode *) override {}
+    void visit(ReturnNode *node) override { collect(node->getValue()); }
+    void visit(PrintNode *node) override
+    {
+        for (ASTNode *expr : node->getExpressions()) {
+            collect(expr);
+        }
+    }
+
+private:
+    void add(const std::string &name)
+    {
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(name);
+        }
+    }
+
+    const BuiltinRegistry &m_builtins;
+};
+
+} // anonymous namespace
+
+Optimizer::Optimizer(Program &program, int level, const BuiltinRegistry *builtins)
+    : m_program(program)
+    , m_level(level)
+    , m_builtins(builtins ? builtins : &BuiltinRegistry::standard())
+    , m_result(nullptr)
+    , m_temporaryCount(0)
+{
+}
+
+ASTNode *Optimizer::optimize(ASTNode *root)
+{
+    if (m_level <= 0) {
+        return root;
+    }
+    m_assignedBefore.clear();
+    return rewrite(root);
+}
+
+ASTNode *Optimizer::rewrite(ASTNode *node)
+{
+    if (!node) {
+        return nullptr;
+    }
+    m_result = node;
+    node->accept(this);
+    return m_result;
+}
+
+NodeList Optimizer::rewriteList(NodeList nodes, bool &changed)
+{
+    std::vector<ASTNode *> rewritten;
+    rewritten.reserve(nodes.size());
+    for (ASTNode *node : nodes) {
+        rewritten.push_back(rewrite(node));
+        changed = changed || rewritten.back() != node;
+    }
+    return changed ? m_program.makeList(rewritten) : nodes;
+}
+
+ASTNode *Optimizer::foldConstant(ASTNode *node)
+{
+    // Let the reference evaluator compute the value so folding can never
+    // disagree with run-time semantics; failures are left for run time
+    try {
+        Value value;
+        if (m_evaluator.evaluate(node, &m_scratch, value)) {
+            return m_program.make<LiteralNode>(value);
+        }
+    } catch (const std::exception &) {
+    }
+    return node;
+}
+
+const BuiltinFunction *Optimizer::pureBuiltin(FunctionCallNode *node) const
+{
+    auto *funcNode = nodeCast<IdentifierNode>(node->getFunction());
+    if (!funcNode) {
+        return nullptr;
+    }
+    const BuiltinFunction *builtin = m_builtins->find(funcNode->getName());
+    if (!builtin || !builtin->isPure() || !builtin->accepts(node->getArguments().size())) {
+        return nullptr;
+    }
+    return builtin;
+}
+
+void Optimizer::visit(LiteralNode *node)
+{
+    m_result = node;
+}
+
+void Optimizer::visit(IdentifierNode *node)
+{
+    // Mirror the evaluator's handling of built-in constants
+    if (node->getName() == "pi") {
+        m_result = m_program.make<LiteralNode>(Value(M_PI));
+    } else if (node->getName() == "e") {
+        m_result = m_program.make<LiteralNode>(Value(M_E));
+    } else {
+        m_result = node;
+    }
+}
+
+void Optimizer::visit(BinaryOpNode *node)
+{
+    BinaryOperator op = node->getOperator();
+
+    // Assignment targets stay as they are
+    ASTNode *left = isAssignment(op) ? node->getLeft() : rewrite(node->getLeft());
+    ASTNode *right = rewrite(node->getRight());
+
+    BinaryOpNode *result = node;
+    if (left != node->getLeft() || right != node->getRight()) {
+        result = m_program.makeAt<BinaryOpNode>(node, left, op, right);
+    }
+
+    if (isAssignment(op)) {
+        m_result = result;
+        return;
+    }
+
+    // A constant left operand can decide a logical operator on its own
+    const LiteralNode *leftLiteral = asLiteral(left);
+    if (leftLiteral && (op == BinaryOperator::And || op == BinaryOperator::Or)) {
+        bool value = leftLiteral->getValue().toBool();
+        if ((op == BinaryOperator::And && !value) || (op == BinaryOperator::Or && value)) {
+            m_result = m_program.make<LiteralNode>(Value(value));
+            return;
+        }
+    }
+
+    if (leftLiteral && asLiteral(right)) {
+        m_result = foldConstant(result);
+        return;
+    }
+
+    m_result = m_level >= 2 ? reduceStrength(result) : result;
+}
+
+ASTNode *Optimizer::reduceStrength(BinaryOpNode *node)
+{
+    const LiteralNode *rightLiteral = asLiteral(node->getRight());
+    if (!rightLiteral || !rightLiteral->getValue().isNumber()) {
+        return node;
+    }
+    double constant = rightLiteral->getValue().asNumber();
+
+    // x^2 -> x*x, duplicating only plain variable reads
+    auto *base = nodeCast<IdentifierNode>(node->getLeft());
+    if (node->getOperator() == BinaryOperator::Power && constant == 2.0 && base) {
+        return m_program.makeAt<BinaryOpNode>(node, base, BinaryOperator::Multiply,
+                                              m_program.makeAt<IdentifierNode>(base, base->getName()));
+    }
+
+    // x / 2^k -> x * 2^-k, which is exact while 2^-k is finite (k >= -1022)
+    int exponent = 0;
+    if (node->getOperator() == BinaryOperator::Divide && std::isfinite(constant) &&
+        std::abs(std::frexp(constant, &exponent)) == 0.5 && exponent >= -1021) {
+        return m_program.makeAt<BinaryOpNode>(node, node->getLeft(), BinaryOperator::Multiply,
+                                              m_program.make<LiteralNode>(Value(1.0 / constant)));
+    }
+
+    return node;
+}
+
+void Optimizer::visit(UnaryOpNode *node)
+{
+    // Increments and decrements address a variable and are never rewritten
+    if (isIncrement(node->getOperator())) {
+        m_result = node;
+        return;
+    }
+
+    ASTNode *operand = rewrite(node->getOperand());
+    UnaryOpNode *result = node;
+    if (operand != node->getOperand()) {
+        result = m_program.makeAt<UnaryOpNode>(node, node->getOperator(), operand);
+    }
+
+    m_result = asLiteral(operand) ? foldConstant(result) : result;
+}
+
+void Optimizer::visit(FunctionCallNode *node)
+{
+    bool changed = false;
+    NodeList arguments = rewriteList(node->getArguments(), changed);
+    FunctionCallNode *result = node;
+    if (changed) {
+        result = m_program.makeAt<FunctionCallNode>(node, node->getFunction(), arguments);
+    }
+    m_result = result;
+
+    const BuiltinFunction *builtin = pureBuiltin(result);
+    if (!builtin || !std::all_of(arguments.begin(), arguments.end(), asLiteral)) {
+        return;
+    }
+
+    std::vector<Value> values;
+    values.reserve(arguments.size());
+    for (ASTNode *arg : arguments) {
+        values.push_back(asLiteral(arg)->getValue());
+    }
+
+    try {
+        m_result = m_program.make<LiteralNode>(builtin->function(Span<const Value>(values)));
+    } catch (const std::exception &) {
+        // Domain errors are reported at run time
+    }
+}
+
+void Optimizer::visit(IfNode *node)
+{
+    ASTNode *condition = rewrite(node->getCondition());
+
+    if (const LiteralNode *literal = asLiteral(condition)) {
+        if (literal->getValue().toBool()) {
+            m_result = rewrite(node->getThenBranch());
+        } else if (node->getElseBranch()) {
+            m_result = rewrite(node->getElseBranch());
+        } else {
+            m_result = m_program.make<LiteralNode>(Value());
+        }
+        return;
+    }
+
+    ASTNode *thenBranch = rewrite(node->getThenBranch());
+    ASTNode *elseBranch = rewrite(node->getElseBranch());
+    if (condition != node->getCondition() || thenBranch != node->getThenBranch() ||
+        elseBranch != node->getElseBranch()) {
+        m_result = m_program.make<IfNode>(condition, thenBranch, elseBranch);
+    } else {
+        m_result = node;
+    }
+}
+
+void Optimizer::visit(WhileNode *node)
+{
+    ASTNode *condition = rewrite(node->getCondition());
+
+    // A loop that never runs evaluates to null
+    const LiteralNode *literal = asLiteral(condition);
+    if (literal && !literal->getValue().toBool()) {
+        m_result = m_program.make<LiteralNode>(Value());
+        return;
+    }
+
+    ASTNode *body = rewrite(node->getBody());
+    WhileNode *result = node;
+    if (condition != node->getCondition() || body != node->getBody()) {
+        result = m_program.make<WhileNode>(condition, body);
+    }
+
+    m_result = m_level >= 2 ? hoistInvariants(result) : result;
+}
+
+ASTNode *Optimizer::hoistInvariants(WhileNode *loop)
+{
+    AssignmentCollector collector(*m_builtins);
+    collector.collect(loop->getCondition());
+    collector.collect(loop->getBody());
+    if (collector.callsUserFunction) {
+        return loop;
+    }
+
+    std::vector<std::pair<std::string, ASTNode *>> hoisted;
+    ASTNode *condition = hoist(loop->getCondition(), collector.names, hoisted);
+    ASTNode *body = hoist(loop->getBody(), collector.names, hoisted);
+    if (hoisted.empty()) {
+        return loop;
+    }
+
+    // { $inv0 = ...; $inv1 = ...; while (...) ... } keeps the loop's value
+    std::vector<ASTNode *> statements;
+    for (const auto &entry : hoisted) {
+        statements.push_back(m_program.make<BinaryOpNode>(m_program.make<IdentifierNode>(entry.first),
+                                                          BinaryOperator::Assign, entry.second));
+    }
+    statements.push_back(m_program.make<WhileNode>(condition, body));
+    return m_program.make<BlockNode>(m_program.makeList(statements));
+}
+
+ASTNode *Optimizer::hoist(ASTNode *node, const std::vector<std::string> &assigned,
+                          std::vector<std::pair<std::string, ASTNode *>> &hoisted)
+{
+    if (!node || asLiteral(node) || nodeCast<IdentifierNode>(node)) {
+        return node;
+    }
+
+    if (isInvariant(node, assigned)) {
+        std::string name = "$inv" + std::to_string(m_temporaryCount++);
+        hoisted.emplace_back(name, node);
+        return m_program.make<IdentifierNode>(name);
+    }
+
+    auto hoistList = [&](NodeList nodes, bool &changed) {
+        std::vector<ASTNode *> result;
+        for (ASTNode *child : nodes) {
+            result.push_back(hoist(child, assigned, hoisted));
+            changed = changed || result.back() != child;
+        }
+        return changed ? m_program.makeList(result) : nodes;
+    };
+
+    if (auto *binary = nodeCast<BinaryOpNode>(node)) {
+        ASTNode *left = isAssignment(binary->getOperator()) ? binary->getLeft()
+                                                             : hoist(binary->getLeft(), assigned, hoisted);
+        ASTNode *right = hoist(binary->getRight(), assigned, hoisted);
+        if (left == binary->getLeft() && right == binary->getRight()) {
+            return node;
+        }
+        return m_program.makeAt<BinaryOpNode>(node, left, binary->getOperator(), right);
+    }
+    if (auto *unary = nodeCast<UnaryOpNode>(node)) {
+        if (isIncrement(unary->getOperator())) {
+            return node;
+        }
+        ASTNode *operand = hoist(unary->getOperand(), assigned, hoisted);
+        return operand == unary->getOperand() ? node
+                                               : m_program.makeAt<UnaryOpNode>(node, unary->getOperator(), operand);
+    }
+    if (auto *call = nodeCast<FunctionCallNode>(node)) {
+        bool changed = false;
+        NodeList arguments = hoistList(call->getArguments(), changed);
+        return changed ? m_program.makeAt<FunctionCallNode>(node, call->getFunction(), arguments) : node;
+    }
+    if (auto *ifNode = nodeCast<IfNode>(node)) {
+        ASTNode *condition = hoist(ifNode->getCondition(), assigned, hoisted);
+        ASTNode *thenBranch = hoist(ifNode->getThenBranch(), assigned, hoisted);
+        ASTNode *elseBranch = hoist(ifNode->getElseBranch(), assigned, hoisted);
+        if (condition == ifNode->getCondition() && thenBranch == ifNode->getThenBranch() &&
+            elseBranch == ifNode->getElseBranch()) {
+            return node;
+        }
+        return m_program.make<IfNode>(condition, thenBranch, elseBranch);
+    }
+    if (auto *whileNode = nodeCast<WhileNode>(node)) {
+        ASTNode *condition = hoist(whileNode->getCondition(), assigned, hoisted);
+        ASTNode *body = hoist(whileNode->getBody(), assigned, hoisted);
+        if (condition == whileNode->getCondition() && body == whileNode->getBody()) {
+            return node;
+        }
+        return m_program.make<WhileNode>(condition, body);
+    }
+    if (auto *block = nodeCast<BlockNode>(node)) {
+        bool changed = false;
+        NodeList statements = hoistList(block->getStatements(), changed);
+        return changed ? m_program.make<BlockNode>(statements) : node;
+    }
+    if (auto *print = nodeCast<PrintNode>(node)) {
+        bool changed = false;
+        NodeList expressions = hoistList(print->getExpressions(), changed);
+        return changed ? m_program.make<PrintNode>(expressions) : node;
+    }
+    if (auto *ret = nodeCast<ReturnNode>(node)) {
+        ASTNode *value = hoist(ret->getValue(), assigned, hoisted);
+        return value == ret->getValue() ? node : m_program.make<ReturnNode>(value);
+    }
+
+    // For loops and function definitions are left untouched
+    return node;
+}
+
+bool Optimizer::isInvariant(ASTNode *node, const std::vector<std::string> &assigned) const
+{
+    // Hoisted code runs even if the loop body never does, so only expressions
+    // that cannot fail qualify: no variable that might be undefined, no
+    // division by something that might be zero, no builtin that can throw.
+    // Whether a variable holds an array is only known at run time, so arrays
+    // of different lengths are the exception: combining them fails early.
+    if (asLiteral(node)) {
+        return true;
+    }
+    if (auto *identifier = nodeCast<IdentifierNode>(node)) {
+        const std::string &name = identifier->getName();
+        return std::find(assigned.begin(), assigned.end(), name) == assigned.end() && isDefinedBeforeLoop(name);
+    }
+    if (auto *binary = nodeCast<BinaryOpNode>(node)) {
+        BinaryOperator op = binary->getOperator();
+        if (isAssignment(op)) {
+            return false;
+        }
+        if (op == BinaryOperator::Divide || op == BinaryOperator::Mod || op == BinaryOperator::Div) {
+            const LiteralNode *divisor = asLiteral(binary->getRight());
+            if (!divisor || divisor->getValue().toNumber() == 0.0) {
+                return false;
+            }
+        }
+        return isInvariant(binary->getLeft(), assigned) && isInvariant(binary->getRight(), assigned);
+    }
+    if (auto *unary = nodeCast<UnaryOpNode>(node)) {
+        return !isIncrement(unary->getOperator()) && isInvariant(unary->getOperand(), assigned);
+    }
+    if (auto *call = nodeCast<FunctionCallNode>(node)) {
+        const BuiltinFunction *builtin = pureBuiltin(call);
+        if (!builtin || !builtin->isNoThrow()) {
+            return false;
+        }
+        for (ASTNode *arg : call->getArguments()) {
+            if (!isInvariant(arg, assigned)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Optimizer::isDefinedBeforeLoop(const std::string &name) const
+{
+    return std::find(m_assignedBefore.begin(), m_assignedBefore.end(), name) != m_assignedBefore.end();
+}
+
+void Optimizer::visit(ForNode *node)
+{
+    ASTNode *init = rewrite(node->getInit());
+    ASTNode *condition = rewrite(node->getCondition());
+    ASTNode *update = rewrite(node->getUpdate());
+    ASTNode *body = rewrite(node->getBody());
+    if (init != node->getInit() || condition != node->getCondition() || update != node->getUpdate() ||
+        body != node->getBody()) {
+        auto *loop = m_program.make<ForNode>(init, condition, update, body);
+        if (node->isParallel()) {
+            loop->setParallel(node->getReductions());
+        }
+        m_result = loop;
+    } else {
+        m_result = node;
+    }
+}
+
+void Optimizer::visit(BlockNode *node)
+{
+    size_t outerAssignments = m_assignedBefore.size();
+
+    bool changed = false;
+    std::vector<ASTNode *> statements;
+    statements.reserve(node->getStatements().size());
+    for (ASTNode *statement : node->getStatements()) {
+        statements.push_back(rewrite(statement));
+        changed = changed || statements.back() != statement;
+
+        // Plain assignments at block level define their target for what follows
+        auto *assignment = nodeCast<BinaryOpNode>(statements.back());
+        if (assignment && assignment->getOperator() == BinaryOperator::Assign) {
+            if (auto *target = nodeCast<IdentifierNode>(assignment->getLeft())) {
+                m_assignedBefore.push_back(target->getName());
+            }
+        }
+    }
+
+    m_assignedBefore.resize(outerAssignments);
+    m_result = changed ? m_program.make<BlockNode>(m_program.makeList(statements)) : node;
+}
+
+void Optimizer::visit(FunctionDefNode *node)
+{
+    // Only the parameters are known to be defined when the body starts
+    std::vector<std::string> outerAssignments;
+    outerAssignments.swap(m_assignedBefore);
+    m_assignedBefore = node->getParameters();
+    ASTNode *body = rewrite(node->getBody());
+    m_assignedBefore.swap(outerAssignments);
+
+    m_result = body == node->getBody() ? node
+                                       : m_program.make<FunctionDefNode>(node->getName(), node->getParameters(), body);
+}
+
+void Optimizer::visit(ReturnNode *node)
+{
+    ASTNode *value = rewrite(node->getValue());
+    m_result = value == node->getValue() ? node : m_program.make<ReturnNode>(value);
+}
+
+void Optimizer::visit(PrintNode *node)
+{
+    bool changed = false;
+    NodeList expressions = rewriteList(node->getExpressions(), changed);
+    m_result = changed ? m_program.make<PrintNode>(expressions) : node;
+}
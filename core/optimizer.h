@@ -0,0 +1,78 @@
+#pragma once
+
+#include "ast.h"
+#include "context.h"
+#include "evaluator.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+class BuiltinRegistry;
+class Program;
+
+/**
+ * @brief Rewrites an AST into a cheaper, equivalent tree
+ *
+ * Runs between parsing and resolution. Rewritten nodes are allocated in the
+ * Program that owns the tree; untouched subtrees are shared with the input.
+ *
+ * Level 1 folds operators and pure builtins over literals, replaces the
+ * built-in constants and drops branches and loops whose condition is
+ * constant. Level 2 also applies strength reduction (x^2 to x*x, division by
+ * a power of two to a multiplication) and hoists loop-invariant expressions
+ * out of while loops into temporaries. Anything that could fail at run time
+ * is left alone, so errors are still reported when and where they happen.
+ */
+class Optimizer : public ASTVisitor
+{
+public:
+    /**
+     * @brief Create an optimizer
+     * @param program Program owning the tree, receives the rewritten nodes
+     * @param level Optimization level: 0 (off), 1 or 2
+     * @param builtins Functions calls may refer to (the standard table if null)
+     */
+    Optimizer(Program &program, int level, const BuiltinRegistry *builtins = nullptr);
+
+    /**
+     * @brief Optimize a tree
+     * @param root Root node of the AST
+     * @return Root of the optimized tree (may be the input itself)
+     */
+    ASTNode *optimize(ASTNode *root);
+
+    // ASTVisitor interface
+    void visit(LiteralNode *node) override;
+    void visit(IdentifierNode *node) override;
+    void visit(BinaryOpNode *node) override;
+    void visit(UnaryOpNode *node) override;
+    void visit(FunctionCallNode *node) override;
+    void visit(IfNode *node) override;
+    void visit(WhileNode *node) override;
+    void visit(ForNode *node) override;
+    void visit(BlockNode *node) override;
+    void visit(FunctionDefNode *node) override;
+    void visit(ReturnNode *node) override;
+    void visit(PrintNode *node) override;
+
+private:
+    ASTNode *rewrite(ASTNode *node);
+    NodeList rewriteList(NodeList nodes, bool &changed);
+    ASTNode *foldConstant(ASTNode *node);
+    ASTNode *reduceStrength(BinaryOpNode *node);
+    ASTNode *hoistInvariants(WhileNode *loop);
+    ASTNode *hoist(ASTNode *node, const std::vector<std::string> &assigned,
+                   std::vector<std::pair<std::string, ASTNode *>> &hoisted);
+    bool isInvariant(ASTNode *node, const std::vector<std::string> &assigned) const;
+    const BuiltinFunction *pureBuiltin(FunctionCallNode *node) const;
+    bool isDefinedBeforeLoop(const std::string &name) const;
+
+    Program &m_program;
+    int m_level;
+    const BuiltinRegistry *m_builtins;
+    ASTNode *m_result;
+    unsigned m_temporaryCount;
+    std::vector<std::string> m_assignedBefore; // Names unconditionally assigned earlier in enclosing blocks
+    Evaluator m_evaluator;                      // Folds literal-only expressions with run-time semantics
+    Context m_scratch;
+};
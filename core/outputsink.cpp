@@ -0,0 +1,79 @@
+#include "outputsink.h"
+#include <iostream>
+#include <utility>
+
+OutputSink &OutputSink::standardOutput()
+{
+    // Block size 0: every write goes straight to the stream and the buffer stays unused
+    static StreamSink sink(std::cout, 0);
+    return sink;
+}
+
+BufferedSink::BufferedSink(size_t blockSize)
+    : m_blockSize(blockSize)
+{
+}
+
+void BufferedSink::write(const char *data, size_t size)
+{
+    if (m_buffer.size() + size > m_blockSize) {
+        if (!m_buffer.empty()) {
+            deliver(m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+        }
+        if (size >= m_blockSize) {
+            deliver(data, size);
+            return;
+        }
+    }
+    m_buffer.append(data, size);
+}
+
+void BufferedSink::flush()
+{
+    if (!m_buffer.empty()) {
+        deliver(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+    finishFlush();
+}
+
+StreamSink::StreamSink(std::ostream &stream, size_t blockSize)
+    : BufferedSink(blockSize)
+    , m_stream(stream)
+{
+}
+
+StreamSink::~StreamSink()
+{
+    flush();
+}
+
+void StreamSink::deliver(const char *data, size_t size)
+{
+    m_stream.write(data, static_cast<std::streamsize>(size));
+}
+
+void StreamSink::finishFlush()
+{
+    m_stream.flush();
+}
+
+CallbackSink::CallbackSink(Callback callback, size_t blockSize)
+    : BufferedSink(blockSize)
+    , m_callback(std::move(callback))
+{
+}
+
+CallbackSink::~CallbackSink()
+{
+    flush();
+}
+
+void CallbackSink::deliver(const char *data, size_t size)
+{
+    if (m_callback) {
+        m_block.assign(data, size);
+        m_callback(m_block);
+    }
+}
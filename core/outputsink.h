@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+/**
+ * @brief Destination of the text written by print statements
+ *
+ * Every print statement writes one complete line, newline included. Sinks
+ * may hold text back; the interpreter calls flush() whenever control returns
+ * to the embedder (after each execute() and after each statement of a
+ * script), so output is never seen out of order with results. flush() should
+ * not throw.
+ */
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    /**
+     * @brief Append text
+     * @param data First character
+     * @param size Number of characters
+     */
+    virtual void write(const char *data, size_t size) = 0;
+
+    /**
+     * @brief Deliver everything written so far
+     */
+    virtual void flush() {}
+
+    /**
+     * @brief Unbuffered sink writing to std::cout
+     *
+     * The default of a standalone Evaluator or VirtualMachine. Safe to share
+     * between threads as far as std::cout itself is.
+     */
+    static OutputSink &standardOutput();
+};
+
+/**
+ * @brief Sink collecting text into blocks before delivering it
+ *
+ * Output is handed on when a block fills up and on flush(), so a loop that
+ * prints a million lines costs a few hundred deliveries instead of a million.
+ */
+class BufferedSink : public OutputSink
+{
+public:
+    /// Characters collected before a delivery
+    static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+    void write(const char *data, size_t size) override;
+    void flush() override;
+
+protected:
+    /**
+     * @param blockSize Characters collected before a delivery; 0 delivers every write
+     */
+    explicit BufferedSink(size_t blockSize);
+
+    /**
+     * @brief Hand a block of text on
+     */
+    virtual void deliver(const char *data, size_t size) = 0;
+
+    /**
+     * @brief Called by flush() after the pending text has been delivered
+     */
+    virtual void finishFlush() {}
+
+private:
+    std::string m_buffer;
+    size_t m_blockSize;
+};
+
+/**
+ * @brief Writes to a std::ostream in blocks
+ *
+ * flush() also flushes the stream. Pending text is written on destruction.
+ */
+class StreamSink final : public BufferedSink
+{
+public:
+    /**
+     * @param stream Destination; must outlive the sink
+     * @param blockSize Characters collected before a write to the stream
+     */
+    explicit StreamSink(std::ostream &stream, size_t blockSize = DefaultBlockSize);
+    ~StreamSink() override;
+
+protected:
+    void deliver(const char *data, size_t size) override;
+    void finishFlush() override;
+
+private:
+    std::ostream &m_stream;
+};
+
+/**
+ * @brief Hands output to a callback in blocks
+ *
+ * For embedders that display output themselves, such as the GUI console.
+ * Each block ends with a newline. Pending text is delivered on destruction.
+ */
+class CallbackSink final : public BufferedSink
+{
+public:
+    using Callback = std::function<void(const std::string &text)>;
+
+    /**
+     * @param callback Receives each block of output
+     * @param blockSize Characters collected before an early delivery
+     */
+    explicit CallbackSink(Callback callback, size_t blockSize = DefaultBlockSize);
+    ~CallbackSink() override;
+
+protected:
+    void deliver(const char *data, size_t size) override;
+
+private:
+    Callback m_callback;
+    std::string m_block; // Reused to pass blocks to the callback
+};
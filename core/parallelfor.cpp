@@ -0,0 +1,667 @@
+#include "parallelfor.h"
+#include "arrayops.h"
+#include "budget.h"
+#include "builtins.h"
+#include "compiler.h"
+#include "context.h"
+#include "evaluator.h"
+#include "program.h"
+#include "resolver.h"
+#include "threadpool.h"
+#include "vm.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+
+// Iteration counts are computed in doubles; beyond this they are no longer exact
+constexpr double MaxIterations = 9007199254740992.0; // 2^53
+
+/**
+ * @brief Counting pattern of a parallel loop: for (v = start; v op bound; v += step)
+ */
+struct LoopShape {
+    std::string variable;
+    ASTNode *start = nullptr;
+    BinaryOperator comparison = BinaryOperator::Less;
+    ASTNode *bound = nullptr;
+    ASTNode *step = nullptr; // Null for ++ and --
+    double unitStep = 1.0;   // Step for ++ and --; sign of step otherwise
+};
+
+/**
+ * @brief Looks for an identifier in a subtree
+ */
+class NameFinder : public ASTVisitor
+{
+public:
+    explicit NameFinder(const std::string &name) : m_name(name) {}
+
+    bool found = false;
+
+    void find(ASTNode *node)
+    {
+        if (node && !found) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *node) override { found = found || node->getName() == m_name; }
+    void visit(BinaryOpNode *node) override
+    {
+        find(node->getLeft());
+        find(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override { find(node->getOperand()); }
+    void visit(FunctionCallNode *node) override
+    {
+        for (ASTNode *arg : node->getArguments()) {
+            find(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        find(node->getCondition());
+        find(node->getThenBranch());
+        find(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        find(node->getCondition());
+        find(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        find(node->getInit());
+        find(node->getCondition());
+        find(node->getUpdate());
+        find(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            find(statement);
+        }
+    }
+    void visit(FunctionDefNode *) override {}
+    void visit(ReturnNode *node) override { find(node->getValue()); }
+    void visit(PrintNode *node) override
+    {
+        for (ASTNode *expr : node->getExpressions()) {
+            find(expr);
+        }
+    }
+
+private:
+    const std::string &m_name;
+};
+
+bool mentions(ASTNode *node, const std::string &name)
+{
+    NameFinder finder(name);
+    finder.find(node);
+    return finder.found;
+}
+
+[[noreturn]] void unsupportedShape()
+{
+    throw std::runtime_error("parallel for needs the form for (i = start; i < bound; i += step), "
+                             "with <, <=, > or >= and an update of ++, --, += or -=");
+}
+
+LoopShape matchShape(ForNode *loop)
+{
+    LoopShape shape;
+    auto *init = nodeCast<BinaryOpNode>(loop->getInit());
+    auto *variable = init ? nodeCast<IdentifierNode>(init->getLeft()) : nullptr;
+    if (!variable || init->getOperator() != BinaryOperator::Assign) {
+        unsupportedShape();
+    }
+    shape.variable = variable->getName();
+    shape.start = init->getRight();
+
+    auto *condition = nodeCast<BinaryOpNode>(loop->getCondition());
+    auto *compared = condition ? nodeCast<IdentifierNode>(condition->getLeft()) : nullptr;
+    if (!compared || compared->getName() != shape.variable) {
+        unsupportedShape();
+    }
+    switch (condition->getOperator()) {
+    case BinaryOperator::Less:
+    case BinaryOperator::LessEqual:
+    case BinaryOperator::Greater:
+    case BinaryOperator::GreaterEqual:
+        shape.comparison = condition->getOperator();
+        break;
+    default:
+        unsupportedShape();
+    }
+    shape.bound = condition->getRight();
+
+    if (auto *unary = nodeCast<UnaryOpNode>(loop->getUpdate())) {
+        auto *target = nodeCast<IdentifierNode>(unary->getOperand());
+        UnaryOperator op = unary->getOperator();
+        if (!target || target->getName() != shape.variable || op == UnaryOperator::Negate ||
+            op == UnaryOperator::Not) {
+            unsupportedShape();
+        }
+        bool up = op == UnaryOperator::PreIncrement || op == UnaryOperator::PostIncrement;
+        shape.unitStep = up ? 1.0 : -1.0;
+    } else if (auto *update = nodeCast<BinaryOpNode>(loop->getUpdate())) {
+        auto *target = nodeCast<IdentifierNode>(update->getLeft());
+        BinaryOperator op = update->getOperator();
+        if (!target || target->getName() != shape.variable ||
+            (op != BinaryOperator::PlusAssign && op != BinaryOperator::MinusAssign)) {
+            unsupportedShape();
+        }
+        shape.step = update->getRight();
+        shape.unitStep = op == BinaryOperator::PlusAssign ? 1.0 : -1.0;
+    } else {
+        unsupportedShape();
+    }
+
+    if (mentions(shape.start, shape.variable) || mentions(shape.bound, shape.variable) ||
+        mentions(shape.step, shape.variable)) {
+        throw std::runtime_error("parallel for: the start, bound and step may not depend on the loop variable " +
+                                 shape.variable);
+    }
+    return shape;
+}
+
+bool holds(BinaryOperator comparison, double value, double bound)
+{
+    switch (comparison) {
+    case BinaryOperator::Less: return value < bound;
+    case BinaryOperator::LessEqual: return value <= bound;
+    case BinaryOperator::Greater: return value > bound;
+    default: return value >= bound;
+    }
+}
+
+/**
+ * @brief Number of values start + k*step, k = 0, 1, ..., for which the condition holds
+ * @throws std::runtime_error if the condition would hold forever
+ */
+double iterationCount(double start, BinaryOperator comparison, double bound, double step)
+{
+    if (!holds(comparison, start, bound)) {
+        return 0.0;
+    }
+    bool ascending = comparison == BinaryOperator::Less || comparison == BinaryOperator::LessEqual;
+    if (!(ascending ? step > 0.0 : step < 0.0)) {
+        throw std::runtime_error("parallel for never ends: the step moves away from the bound");
+    }
+    double estimate = std::floor((bound - start) / step) + 1.0;
+    if (!(estimate < MaxIterations)) {
+        throw std::runtime_error("parallel for has too many iterations");
+    }
+    // The division may be off by one either way; the condition decides
+    double count = std::max(estimate, 1.0);
+    while (count > 1.0 && !holds(comparison, start + (count - 1.0) * step, bound)) {
+        count -= 1.0;
+    }
+    while (holds(comparison, start + count * step, bound)) {
+        count += 1.0;
+    }
+    return count;
+}
+
+/**
+ * @brief Rejects loop bodies that are not safe to run in parallel
+ *
+ * Runs on the body bound as a function, so frame locals are the loop
+ * variable, the reductions and the variables the body assigns with '='.
+ * User functions called are followed into their bodies, once each.
+ */
+class BodyChecker : public ASTVisitor
+{
+public:
+    /**
+     * @param body Loop body bound as a function; its first parameter is the loop variable
+     * @param reductions Number of parameters after it that are reductions
+     */
+    BodyChecker(Context &context, const UserFunction &body, size_t reductions)
+        : m_context(context), m_body(body), m_reductions(reductions), m_function(nullptr)
+    {
+    }
+
+    /// User functions the body may call, for compiling them before the workers start
+    std::vector<std::shared_ptr<UserFunction>> callees;
+
+    void check(ASTNode *node)
+    {
+        if (node) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *node) override
+    {
+        const std::string &name = node->getName();
+        if (!m_function) {
+            if (isReduction(name)) {
+                fail("reads the reduction variable " + name + ", which may only be updated with +=, -=, ++ or --");
+            }
+        } else if (node->getScopeDepth() != SlotRef::FrameDepth &&
+                   std::find(m_body.locals.begin(), m_body.locals.end(), name) != m_body.locals.end()) {
+            // A plain loop would have made it a global the function could see
+            fail("reads " + name + ", which is local to each iteration");
+        }
+    }
+    void visit(BinaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getLeft());
+        switch (node->getOperator()) {
+        case BinaryOperator::Assign:
+        case BinaryOperator::PlusAssign:
+        case BinaryOperator::MinusAssign:
+        case BinaryOperator::MultiplyAssign:
+        case BinaryOperator::DivideAssign:
+            if (target) {
+                checkTarget(target, node->getOperator() == BinaryOperator::PlusAssign ||
+                                        node->getOperator() == BinaryOperator::MinusAssign,
+                            node->getOperator() == BinaryOperator::Assign);
+                check(node->getRight());
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        check(node->getLeft());
+        check(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getOperand());
+        if (target && node->getOperator() != UnaryOperator::Negate && node->getOperator() != UnaryOperator::Not) {
+            checkTarget(target, true, false);
+            return;
+        }
+        check(node->getOperand());
+    }
+    void visit(FunctionCallNode *node) override
+    {
+        if (const BuiltinFunction *builtin = node->getBuiltin()) {
+            if (!builtin->isPure()) {
+                fail(std::string("calls ") + builtin->name + ", which is not flagged pure");
+            }
+        } else if (auto *name = nodeCast<IdentifierNode>(node->getFunction())) {
+            // Unknown functions are left for the call to report
+            std::shared_ptr<UserFunction> function = m_context.findFunction(name->getName());
+            if (function && m_visited.insert(function->name).second) {
+                callees.push_back(function);
+                const std::string *outer = m_function;
+                m_function = &function->name;
+                check(function->body);
+                m_function = outer;
+            }
+        }
+        for (ASTNode *arg : node->getArguments()) {
+            check(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        check(node->getCondition());
+        check(node->getThenBranch());
+        check(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        check(node->getCondition());
+        check(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        check(node->getInit());
+        check(node->getCondition());
+        check(node->getUpdate());
+        check(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            check(statement);
+        }
+    }
+    void visit(FunctionDefNode *) override { fail("defines a function"); }
+    void visit(ReturnNode *node) override
+    {
+        if (!m_function) {
+            fail("may not return");
+        }
+        check(node->getValue());
+    }
+    void visit(PrintNode *) override { fail("prints"); }
+
+private:
+    bool isReduction(const std::string &name) const
+    {
+        auto first = m_body.parameters.begin() + 1;
+        return std::find(first, first + m_reductions, name) != first + m_reductions;
+    }
+
+    /**
+     * @param additive The update is +=, -=, ++ or --
+     * @param plain The update is '=', which makes the target local
+     */
+    void checkTarget(IdentifierNode *target, bool additive, bool plain)
+    {
+        const std::string &name = target->getName();
+        if (target->getScopeDepth() != SlotRef::FrameDepth) {
+            fail("assigns the global variable " + name + (m_function ? "" : "; list it as a reduction"));
+        }
+        if (m_function) {
+            return;
+        }
+        if (name == m_body.parameters.front()) {
+            fail("assigns the loop variable " + name);
+        }
+        if (isReduction(name)) {
+            if (!additive) {
+                fail("updates the reduction variable " + name + " with an operator other than +=, -=, ++ or --");
+            }
+            return;
+        }
+        // In a plain loop "x = ..." would assign the global; here it would only make a local
+        if (plain && !isTemporaryName(name) && m_context.hasVariable(name)) {
+            fail("assigns the global variable " + name);
+        }
+    }
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        if (m_function) {
+            throw std::runtime_error("Function " + *m_function + ", called by the parallel for body, " + what);
+        }
+        throw std::runtime_error("parallel for body " + what);
+    }
+
+    Context &m_context;
+    const UserFunction &m_body;
+    size_t m_reductions;
+    const std::string *m_function; // Callee being checked, or nullptr in the loop body
+    std::unordered_set<std::string> m_visited;
+};
+
+/**
+ * @brief What one chunk of iterations produced
+ */
+struct ChunkResult {
+    std::vector<Value> sums; // One per reduction
+    EvalError error;
+    std::exception_ptr exception;
+};
+
+/**
+ * @brief The loop body bound as a function, with what every chunk needs to run it
+ */
+struct LoopBody {
+    UserFunction function; // Parameters: the loop variable, then the reductions
+    std::unique_ptr<Chunk> chunk;
+    double start = 0.0;
+    double step = 0.0;
+    size_t reductions = 0;
+};
+
+// Ends the frame a chunk runs in, however it ends
+class FrameGuard
+{
+public:
+    explicit FrameGuard(Context &context) : m_context(context) {}
+    ~FrameGuard() { m_context.popFrame(); }
+
+    FrameGuard(const FrameGuard &) = delete;
+    FrameGuard &operator=(const FrameGuard &) = delete;
+
+private:
+    Context &m_context;
+};
+
+void runChunk(const LoopBody &body, std::uint64_t first, std::uint64_t last, Context &context, VirtualMachine &vm,
+              ExecutionBudget *budget, ChunkResult &result)
+{
+    context.pushFrame(body.function);
+    FrameGuard guard(context);
+    const size_t locals = body.function.locals.size();
+    for (size_t r = 1; r <= body.reductions; ++r) {
+        VariableSlot &slot = context.slot(SlotRef{SlotRef::FrameDepth, static_cast<std::uint32_t>(r)});
+        slot.value = Value(0.0);
+        slot.defined = true;
+    }
+
+    Value ignored;
+    for (std::uint64_t k = first; k < last; ++k) {
+        VariableSlot &variable = context.slot(SlotRef{SlotRef::FrameDepth, 0});
+        variable.value = Value(body.start + static_cast<double>(k) * body.step);
+        variable.defined = true;
+        for (size_t i = body.reductions + 1; i < locals; ++i) {
+            context.slot(SlotRef{SlotRef::FrameDepth, static_cast<std::uint32_t>(i)}) = VariableSlot();
+        }
+        if (budget) {
+            budget->step();
+        }
+        if (!vm.execute(*body.chunk, &context, ignored)) {
+            result.error = vm.error();
+            return;
+        }
+    }
+
+    result.sums.reserve(body.reductions);
+    for (size_t r = 1; r <= body.reductions; ++r) {
+        result.sums.push_back(context.slot(SlotRef{SlotRef::FrameDepth, static_cast<std::uint32_t>(r)}).value);
+    }
+}
+
+Value add(Value left, Value right)
+{
+    if (left.isArray() || right.isArray()) {
+        return elementwise(BinaryOperator::Add, std::move(left), std::move(right));
+    }
+    return left + right;
+}
+
+/**
+ * @brief State of one pool thread during a loop, set up by the first chunk it takes
+ */
+struct Worker {
+    std::unique_ptr<Context> context;
+    VirtualMachine vm;
+    ExecutionBudget budget;
+    std::uint64_t firstStep = 0;
+};
+
+} // anonymous namespace
+
+ParallelLoops::ParallelLoops(size_t threads)
+    : m_threads(threads > 0 ? threads : ThreadPool::defaultThreadCount()), m_builtins(nullptr)
+{
+}
+
+ParallelLoops::~ParallelLoops() = default;
+
+ParallelLoops &ParallelLoops::sequential()
+{
+    static ParallelLoops loops(1);
+    return loops;
+}
+
+void ParallelLoops::setThreadCount(size_t threads)
+{
+    threads = threads > 0 ? threads : ThreadPool::defaultThreadCount();
+    if (threads != m_threads) {
+        m_threads = threads;
+        m_pool.reset();
+    }
+}
+
+bool ParallelLoops::run(ForNode *loop, Context &context, ExecutionBudget *budget, EvalError &error)
+{
+    if (context.getCallDepth() > 0) {
+        throw std::runtime_error("parallel for can only run at the top level");
+    }
+    LoopShape shape = matchShape(loop);
+    const std::vector<std::string> &reductions = loop->getReductions();
+    for (size_t i = 0; i < reductions.size(); ++i) {
+        if (reductions[i] == shape.variable) {
+            throw std::runtime_error("parallel for: the loop variable " + shape.variable +
+                                     " cannot be a reduction");
+        }
+        if (std::find(reductions.begin(), reductions.begin() + i, reductions[i]) != reductions.begin() + i) {
+            throw std::runtime_error("parallel for: reduction " + reductions[i] + " is listed twice");
+        }
+    }
+
+    // Bind the body as a function of the loop variable and the reductions
+    LoopBody body;
+    body.reductions = reductions.size();
+    body.function.name = "parallel for";
+    body.function.parameters.push_back(shape.variable);
+    body.function.parameters.insert(body.function.parameters.end(), reductions.begin(), reductions.end());
+    body.function.program = std::make_shared<Program>();
+    body.function.body = body.function.program->copyTree(loop->getBody());
+    Resolver().resolveFunction(body.function, &context, m_builtins);
+
+    BodyChecker checker(context, body.function, reductions.size());
+    checker.check(body.function.body);
+
+    // Bounds, then the reductions, which a plain loop would fail to update if undefined
+    Evaluator evaluator;
+    double values[3] = {0.0, 0.0, shape.unitStep};
+    ASTNode *expressions[3] = {shape.start, shape.bound, shape.step};
+    for (int i = 0; i < 3; ++i) {
+        if (!expressions[i]) {
+            continue;
+        }
+        Value value;
+        if (!evaluator.evaluate(expressions[i], &context, value)) {
+            error = evaluator.error();
+            return false;
+        }
+        if (!value.isNumber()) {
+            throw std::runtime_error("parallel for: the start, bound and step must be numbers");
+        }
+        values[i] = i == 2 ? shape.unitStep * value.asNumber() : value.asNumber();
+    }
+    for (const std::string &name : reductions) {
+        if (!context.hasVariable(name)) {
+            error.code = ErrorCode::UndefinedVariable;
+            error.message = "Undefined variable: " + name;
+            error.line = loop->getLine();
+            error.column = loop->getColumn();
+            return false;
+        }
+        // Partial sums start from 0, which a string would concatenate out of order
+        const Value initial = context.getVariable(name);
+        if (!initial.isNumber() && !initial.isArray()) {
+            throw std::runtime_error("parallel for: reduction " + name + " must hold a number or an array");
+        }
+    }
+    body.start = values[0];
+    body.step = values[2];
+    const auto count = static_cast<std::uint64_t>(iterationCount(values[0], shape.comparison, values[1], values[2]));
+    if (count == 0) {
+        return true;
+    }
+
+    body.chunk = Compiler().compile(body.function.body);
+    for (const std::shared_ptr<UserFunction> &callee : checker.callees) {
+        // Compiled here so the workers' copies share the code
+        if (!callee->chunk) {
+            callee->chunk = Compiler().compile(callee->body);
+        }
+    }
+
+    const size_t chunks = static_cast<size_t>(std::min<std::uint64_t>(count, MaxChunks));
+    std::vector<ChunkResult> results(chunks);
+    auto range = [&](size_t c, std::uint64_t &first, std::uint64_t &last) {
+        first = count / chunks * c + std::min<std::uint64_t>(c, count % chunks);
+        last = first + count / chunks + (c < count % chunks ? 1 : 0);
+    };
+
+    if (m_threads == 1 || chunks == 1) {
+        VirtualMachine vm;
+        vm.setBudget(budget);
+        for (size_t c = 0; c < chunks; ++c) {
+            std::uint64_t first, last;
+            range(c, first, last);
+            runChunk(body, first, last, context, vm, budget, results[c]);
+            if (results[c].error) {
+                error = results[c].error;
+                return false;
+            }
+        }
+    } else {
+        if (!m_pool) {
+            m_pool = std::make_unique<ThreadPool>(m_threads);
+        }
+        std::vector<Worker> workers(m_pool->size());
+        std::atomic<size_t> firstFailure(chunks);
+        for (size_t c = 0; c < chunks; ++c) {
+            m_pool->submit([&, c] {
+                // Chunks after a failed one cannot change the outcome
+                if (c > firstFailure.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                ChunkResult &result = results[c];
+                try {
+                    Worker &worker = workers[m_pool->workerIndex()];
+                    if (!worker.context) {
+                        worker.context = context.copyGlobals();
+                        if (budget) {
+                            worker.budget.beginPart(*budget, worker.context.get());
+                            worker.firstStep = worker.budget.steps();
+                            worker.vm.setBudget(&worker.budget);
+                        }
+                    }
+                    std::uint64_t first, last;
+                    range(c, first, last);
+                    runChunk(body, first, last, *worker.context, worker.vm, budget ? &worker.budget : nullptr, result);
+                } catch (...) {
+                    result.exception = std::current_exception();
+                }
+                if (result.error || result.exception) {
+                    size_t failed = firstFailure.load(std::memory_order_relaxed);
+                    while (c < failed && !firstFailure.compare_exchange_weak(failed, c, std::memory_order_relaxed)) {
+                    }
+                }
+            });
+        }
+        m_pool->wait();
+
+        if (budget) {
+            std::uint64_t steps = 0;
+            for (const Worker &worker : workers) {
+                steps += worker.context ? worker.budget.steps() - worker.firstStep : 0;
+            }
+            budget->addSteps(steps);
+        }
+        size_t failed = firstFailure.load();
+        if (failed < chunks) {
+            if (results[failed].exception) {
+                std::rethrow_exception(results[failed].exception);
+            }
+            error = results[failed].error;
+            return false;
+        }
+    }
+
+    for (size_t r = 0; r < reductions.size(); ++r) {
+        Value total = context.getVariable(reductions[r]);
+        for (ChunkResult &result : results) {
+            total = add(std::move(total), std::move(result.sums[r]));
+        }
+        context.setVariable(reductions[r], total);
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "evalerror.h"
+#include <cstddef>
+#include <memory>
+
+class BuiltinRegistry;
+class Context;
+class ExecutionBudget;
+class ForNode;
+class ThreadPool;
+
+/**
+ * @brief Runs the iterations of "parallel for" loops on a ThreadPool
+ *
+ * A parallel loop counts one variable from a start to a bound by a fixed
+ * step, both computed once before the loop starts:
+ *
+ *     parallel (sum) for (i = 0; i < n; i += 1) { sum += f(i) }
+ *
+ * The iterations are cut into at most MaxChunks contiguous chunks, however
+ * many threads there are, and the pool's workers take chunks as they run
+ * out. Each worker runs in a copy of the global variables and functions.
+ * The body runs like the body of a function whose locals are the loop
+ * variable, the reductions and whatever it assigns with '='; locals start
+ * out undefined in every iteration and are gone after the loop, so the
+ * reductions are all it writes back.
+ *
+ * Reductions, listed in the parentheses after "parallel", must hold a
+ * number or an array before the loop and may only be updated with +=, -=,
+ * ++ and --. Every
+ * chunk sums its own updates starting from 0; the sums are then added to
+ * the variables in chunk order. The result therefore does not depend on the
+ * number of threads, but may differ in the last bits from a plain for loop,
+ * which adds in iteration order.
+ *
+ * Before anything runs, the body is checked not to print, return, define
+ * functions, assign global variables, or call a user function that does
+ * (directly or through its own calls). Native functions it calls must be
+ * flagged pure: they run on several threads at once.
+ *
+ * Errors the engines return without throwing are reported for the first
+ * failing iteration, as a plain loop would report them. The loop itself
+ * evaluates to null.
+ */
+class ParallelLoops
+{
+public:
+    /// Chunks the iterations are cut into, at most
+    static constexpr size_t MaxChunks = 256;
+
+    /**
+     * @param threads Number of threads; 0 uses ThreadPool::defaultThreadCount()
+     */
+    explicit ParallelLoops(size_t threads = 0);
+    ~ParallelLoops();
+
+    ParallelLoops(const ParallelLoops &) = delete;
+    ParallelLoops &operator=(const ParallelLoops &) = delete;
+
+    /**
+     * @brief Get the loops the engines use when none were set: one thread, no pool
+     *
+     * Chunks the iterations exactly like any other instance, so results match.
+     * Never starts threads, so it may be shared by engines on different threads.
+     */
+    static ParallelLoops &sequential();
+
+    /**
+     * @brief Set the number of threads loops run on; the pool is restarted on the next loop
+     * @param threads Number of threads; 0 uses ThreadPool::defaultThreadCount()
+     */
+    void setThreadCount(size_t threads);
+
+    /**
+     * @brief Number of threads loops run on
+     */
+    size_t threadCount() const { return m_threads; }
+
+    /**
+     * @brief Set the functions the loop bodies are bound to (the standard table if null)
+     * @param builtins Registry that outlives this object
+     */
+    void setBuiltins(const BuiltinRegistry *builtins) { m_builtins = builtins; }
+
+    /**
+     * @brief Run a parallel for loop
+     *
+     * Must be called at the top level of a context, outside any function
+     * call. The context is only read while the iterations run; the
+     * reductions are written once they have all finished.
+     * @param loop Loop to run (ForNode::isParallel())
+     * @param context Context the loop was resolved against
+     * @param budget Metering of the execution running the loop, or nullptr
+     * @param error Receives why the loop failed, when it returns false
+     * @return False if the bounds or an iteration failed with an ErrorCode
+     * @throws std::runtime_error if the loop is not of the supported form or
+     *         its body is not safe to run in parallel; otherwise whatever the
+     *         first failing iteration threw (builtins, arrays, the budget)
+     */
+    bool run(ForNode *loop, Context &context, ExecutionBudget *budget, EvalError &error);
+
+private:
+    size_t m_threads;
+    const BuiltinRegistry *m_builtins;
+    std::unique_ptr<ThreadPool> m_pool; // Started by the first loop that needs more than one thread
+};
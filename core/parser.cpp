@@ -1,47 +1,231 @@
 #include "parser.h"
+#include "tokenstream.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 
+namespace
+{
+
+/// Returned for any position past the end of the token stream
+const Token EndOfFileToken(TokenType::EndOfFile, "", 0, 0);
+
+/**
+ * @brief Convert a number token to its value without allocating
+ */
+double parseNumber(std::string_view text)
+{
+    // strtod needs a terminated string; number tokens are short enough for the stack
+    char buffer[64];
+    std::string storage;
+    const char *terminated = buffer;
+    if (text.size() < sizeof(buffer)) {
+        std::memcpy(buffer, text.data(), text.size());
+        buffer[text.size()] = '\0';
+    } else {
+        storage.assign(text);
+        terminated = storage.c_str();
+    }
+
+    char *end = nullptr;
+    errno = 0;
+    double value = std::strtod(terminated, &end);
+    if (end == terminated) {
+        throw std::runtime_error("Invalid number: " + std::string(text));
+    }
+    if (errno == ERANGE) {
+        throw std::runtime_error("Number out of range: " + std::string(text));
+    }
+    return value;
+}
+
+/**
+ * @brief Counts a nested construct for as long as it is being parsed
+ */
+struct NestingGuard {
+    int &depth;
+
+    explicit NestingGuard(int &counter) : depth(counter) { ++depth; }
+    ~NestingGuard() { --depth; }
+};
+
+} // anonymous namespace
+
 Parser::Parser()
-    : m_current(0)
+    : m_current(0), m_stream(nullptr), m_errorLine(0), m_errorColumn(0), m_program(nullptr), m_serialDepth(0)
 {
 }
 
-std::unique_ptr<ASTNode> Parser::parse(const std::vector<Token> &tokens)
+std::unique_ptr<Program> Parser::parse(const std::vector<Token> &tokens)
 {
     m_tokens = tokens;
     m_current = 0;
-    m_lastError.clear();
+    m_stream = nullptr;
+    clearError();
+    
+    auto program = std::make_unique<Program>();
+    m_program = program.get();
+    
+    try {
+        program->setRoot(parseStatement());
+        m_program = nullptr;
+        m_tokens = Span<const Token>();
+        return program;
+    } catch (const std::exception &e) {
+        recordError(e);
+        m_program = nullptr;
+        m_tokens = Span<const Token>();
+        return nullptr;
+    }
+}
+
+void Parser::beginStream(TokenStream &stream)
+{
+    m_tokens = Span<const Token>();
+    m_current = 0;
+    m_stream = &stream;
+    clearError();
+}
+
+std::unique_ptr<Program> Parser::parseNext()
+{
+    clearError();
+    
+    auto program = std::make_unique<Program>();
+    m_program = program.get();
     
     try {
-        return parseStatement();
+        m_stream->checkCurrent();
+        while (match(TokenType::Semicolon)) {
+        }
+        if (isAtEnd()) {
+            m_program = nullptr;
+            return nullptr;
+        }
+        program->setRoot(parseStatement());
+        m_program = nullptr;
+        return program;
     } catch (const std::exception &e) {
-        m_lastError = e.what();
+        recordError(e);
+        m_program = nullptr;
+        skipLine();
         return nullptr;
     }
 }
 
-Token Parser::currentToken() const
+std::unique_ptr<Program> Parser::parseScript(std::string_view source, const std::vector<Token> &tokens,
+                                             std::vector<ScriptStatement> &statements)
 {
+    m_tokens = tokens;
+    m_current = 0;
+    m_stream = nullptr;
+    clearError();
+
+    auto program = std::make_unique<Program>();
+    m_program = program.get();
+
+    // Token values need not be source text (operators, constants), so text is located by line and column
+    std::vector<size_t> lineStarts{0};
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (source[i] == '\n') {
+            lineStarts.push_back(i + 1);
+        }
+    }
+    auto textBegin = [&](const Token &token) {
+        return std::min(lineStarts[token.line - 1] + token.column - 1, source.size());
+    };
+    auto textEnd = [&](const Token &last, const Token &next) {
+        // A statement ends on the line of its last token; string literals may span lines
+        size_t end = textBegin(last) + (last.type == TokenType::String ? last.value.size() + 2 : 0);
+        end = std::min(source.find('\n', end), textBegin(next));
+        while (end > 0 && (std::isspace(static_cast<unsigned char>(source[end - 1])) || source[end - 1] == ';')) {
+            --end;
+        }
+        return end;
+    };
+
+    while (true) {
+        while (match(TokenType::Semicolon)) {
+        }
+        if (isAtEnd()) {
+            break;
+        }
+        const Token &first = currentToken();
+        ScriptStatement statement{nullptr, first.line, std::string_view(), std::string()};
+        try {
+            statement.node = parseStatement();
+        } catch (const std::exception &e) {
+            recordError(e);
+            statement.error = e.what();
+            skipLine();
+        }
+        size_t begin = textBegin(first);
+        statement.source = source.substr(begin, std::max(textEnd(previousToken(), currentToken()), begin) - begin);
+        statements.push_back(std::move(statement));
+    }
+
+    m_program = nullptr;
+    m_tokens = Span<const Token>();
+    return program;
+}
+
+void Parser::clearError()
+{
+    m_lastError.clear();
+    m_errorLine = 0;
+    m_errorColumn = 0;
+}
+
+void Parser::recordError(const std::exception &error)
+{
+    // Errors are raised while the offending token is current
+    m_lastError = error.what();
+    m_errorLine = currentToken().line;
+    m_errorColumn = currentToken().column;
+}
+
+const Token &Parser::currentToken() const
+{
+    if (m_stream) {
+        return m_stream->peek();
+    }
     if (m_current >= m_tokens.size()) {
-        // Return safe default with proper Token constructor parameters
-        return Token{TokenType::EndOfFile, "", 0, 0}; // type, value, line, column
+        return EndOfFileToken;
     }
     return m_tokens[m_current];
 }
 
-Token Parser::peekToken(int offset) const
+const Token &Parser::peekToken(int offset) const
 {
+    if (m_stream) {
+        return static_cast<size_t>(offset) < TokenStream::Lookahead ? m_stream->peek(offset) : EndOfFileToken;
+    }
     size_t pos = m_current + offset;
     if (pos >= m_tokens.size()) {
-        return m_tokens.back(); // EndOfFile token
+        return EndOfFileToken;
     }
     return m_tokens[pos];
 }
 
+const Token &Parser::previousToken() const
+{
+    if (m_stream) {
+        return m_stream->previous();
+    }
+    return m_current > 0 ? m_tokens[m_current - 1] : EndOfFileToken;
+}
+
 void Parser::advance()
 {
     if (!isAtEnd()) {
-        m_current++;
+        if (m_stream) {
+            m_stream->advance();
+        } else {
+            m_current++;
+        }
     }
 }
 
@@ -64,7 +248,15 @@ bool Parser::consume(TokenType type, const std::string &errorMessage)
     throw std::runtime_error(errorMessage);
 }
 
-std::unique_ptr<ASTNode> Parser::parseStatement()
+template <typename T, typename... Args>
+T *Parser::makeAt(const Token &token, Args &&...args)
+{
+    T *node = m_program->make<T>(std::forward<Args>(args)...);
+    node->setPosition(token.line, token.column);
+    return node;
+}
+
+ASTNode *Parser::parseStatement()
 {
     if (currentToken().type == TokenType::If) {
         return parseIfStatement();
@@ -74,6 +266,22 @@ std::unique_ptr<ASTNode> Parser::parseStatement()
         return parseWhileStatement();
     }
 
+    if (currentToken().type == TokenType::For) {
+        return parseForStatement();
+    }
+
+    if (currentToken().type == TokenType::Parallel) {
+        return parseParallelForStatement();
+    }
+
+    if (currentToken().type == TokenType::Function || currentToken().type == TokenType::Procedure) {
+        return parseFunctionDeclaration();
+    }
+
+    if (currentToken().type == TokenType::Return) {
+        return parseReturnStatement();
+    }
+
     if (currentToken().type == TokenType::Print) {
         return parsePrintStatement();
     }
@@ -89,95 +297,102 @@ std::unique_ptr<ASTNode> Parser::parseStatement()
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseExpression()
+ASTNode *Parser::parseExpression()
 {
     return parseAssignment();
 }
 
-std::unique_ptr<ASTNode> Parser::parseAssignment()
+ASTNode *Parser::parseAssignment()
 {
     auto expr = parseLogicalOr();
     
     if (match(TokenType::Assign)) {
+        Token op = previousToken();
         auto value = parseAssignment();
-        return std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::Assign, std::move(value));
+        return makeAt<BinaryOpNode>(op, expr, BinaryOperator::Assign, value);
     }
     
     if (match(TokenType::PlusAssign)) {
+        Token op = previousToken();
         auto value = parseAssignment();
-        return std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::PlusAssign, std::move(value));
+        return makeAt<BinaryOpNode>(op, expr, BinaryOperator::PlusAssign, value);
     }
     
     if (match(TokenType::MinusAssign)) {
+        Token op = previousToken();
         auto value = parseAssignment();
-        return std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::MinusAssign, std::move(value));
+        return makeAt<BinaryOpNode>(op, expr, BinaryOperator::MinusAssign, value);
     }
     
     if (match(TokenType::MultiplyAssign)) {
+        Token op = previousToken();
         auto value = parseAssignment();
-        return std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::MultiplyAssign, std::move(value));
+        return makeAt<BinaryOpNode>(op, expr, BinaryOperator::MultiplyAssign, value);
     }
     
     if (match(TokenType::DivideAssign)) {
+        Token op = previousToken();
         auto value = parseAssignment();
-        return std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::DivideAssign, std::move(value));
+        return makeAt<BinaryOpNode>(op, expr, BinaryOperator::DivideAssign, value);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseLogicalOr()
+ASTNode *Parser::parseLogicalOr()
 {
     auto expr = parseLogicalAnd();
     
     while (match(TokenType::Or)) {
+        Token op = previousToken();
         auto right = parseLogicalAnd();
-        expr = std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::Or, std::move(right));
+        expr = makeAt<BinaryOpNode>(op, expr, BinaryOperator::Or, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseLogicalAnd()
+ASTNode *Parser::parseLogicalAnd()
 {
     auto expr = parseEquality();
     
     while (match(TokenType::And)) {
+        Token op = previousToken();
         auto right = parseEquality();
-        expr = std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::And, std::move(right));
+        expr = makeAt<BinaryOpNode>(op, expr, BinaryOperator::And, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseEquality()
+ASTNode *Parser::parseEquality()
 {
     auto expr = parseComparison();
     
     while (currentToken().type == TokenType::Equal || currentToken().type == TokenType::NotEqual) {
-        TokenType op = currentToken().type;
+        Token op = currentToken();
         advance();
         auto right = parseComparison();
         
-        BinaryOperator binOp = (op == TokenType::Equal) ? BinaryOperator::Equal : BinaryOperator::NotEqual;
-        expr = std::make_unique<BinaryOpNode>(std::move(expr), binOp, std::move(right));
+        BinaryOperator binOp = (op.type == TokenType::Equal) ? BinaryOperator::Equal : BinaryOperator::NotEqual;
+        expr = makeAt<BinaryOpNode>(op, expr, binOp, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseComparison()
+ASTNode *Parser::parseComparison()
 {
     auto expr = parseTerm();
     
     while (currentToken().type == TokenType::Less || currentToken().type == TokenType::Greater ||
            currentToken().type == TokenType::LessEqual || currentToken().type == TokenType::GreaterEqual) {
-        TokenType op = currentToken().type;
+        Token op = currentToken();
         advance();
         auto right = parseTerm();
         
         BinaryOperator binOp;
-        switch (op) {
+        switch (op.type) {
         case TokenType::Less: binOp = BinaryOperator::Less; break;
         case TokenType::Greater: binOp = BinaryOperator::Greater; break;
         case TokenType::LessEqual: binOp = BinaryOperator::LessEqual; break;
@@ -185,40 +400,40 @@ std::unique_ptr<ASTNode> Parser::parseComparison()
         default: binOp = BinaryOperator::Less; break;
         }
         
-        expr = std::make_unique<BinaryOpNode>(std::move(expr), binOp, std::move(right));
+        expr = makeAt<BinaryOpNode>(op, expr, binOp, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseTerm()
+ASTNode *Parser::parseTerm()
 {
     auto expr = parseFactor();
     
     while (currentToken().type == TokenType::Plus || currentToken().type == TokenType::Minus) {
-        TokenType op = currentToken().type;
+        Token op = currentToken();
         advance();
         auto right = parseFactor();
         
-        BinaryOperator binOp = (op == TokenType::Plus) ? BinaryOperator::Add : BinaryOperator::Subtract;
-        expr = std::make_unique<BinaryOpNode>(std::move(expr), binOp, std::move(right));
+        BinaryOperator binOp = (op.type == TokenType::Plus) ? BinaryOperator::Add : BinaryOperator::Subtract;
+        expr = makeAt<BinaryOpNode>(op, expr, binOp, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseFactor()
+ASTNode *Parser::parseFactor()
 {
     auto expr = parseUnary();
 
     while (currentToken().type == TokenType::Multiply || currentToken().type == TokenType::Divide
            || currentToken().type == TokenType::Mod || currentToken().type == TokenType::Div) {
-        TokenType op = currentToken().type;
+        Token op = currentToken();
         advance();
         auto right = parseUnary();
 
         BinaryOperator binOp;
-        switch (op) {
+        switch (op.type) {
         case TokenType::Multiply:
             binOp = BinaryOperator::Multiply;
             break;
@@ -236,75 +451,92 @@ std::unique_ptr<ASTNode> Parser::parseFactor()
             break;
         }
 
-        expr = std::make_unique<BinaryOpNode>(std::move(expr), binOp, std::move(right));
+        expr = makeAt<BinaryOpNode>(op, expr, binOp, right);
     }
 
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseUnary()
+ASTNode *Parser::parseUnary()
 {
     if (currentToken().type == TokenType::Minus || currentToken().type == TokenType::Not) {
-        TokenType op = currentToken().type;
+        Token op = currentToken();
         advance();
         auto expr = parseUnary();
         
-        UnaryOperator unOp = (op == TokenType::Minus) ? UnaryOperator::Negate : UnaryOperator::Not;
-        return std::make_unique<UnaryOpNode>(unOp, std::move(expr));
+        UnaryOperator unOp = (op.type == TokenType::Minus) ? UnaryOperator::Negate : UnaryOperator::Not;
+        return makeAt<UnaryOpNode>(op, unOp, expr);
     }
     
     // Handle prefix increment/decrement
     if (currentToken().type == TokenType::Increment) {
+        Token op = currentToken();
         advance();
         auto expr = parseUnary();
-        return std::make_unique<UnaryOpNode>(UnaryOperator::PreIncrement, std::move(expr));
+        return makeAt<UnaryOpNode>(op, UnaryOperator::PreIncrement, expr);
     }
     
     if (currentToken().type == TokenType::Decrement) {
+        Token op = currentToken();
         advance();
         auto expr = parseUnary();
-        return std::make_unique<UnaryOpNode>(UnaryOperator::PreDecrement, std::move(expr));
+        return makeAt<UnaryOpNode>(op, UnaryOperator::PreDecrement, expr);
     }
     
     return parsePostfix();
 }
 
-std::unique_ptr<ASTNode> Parser::parsePostfix()
+ASTNode *Parser::parsePostfix()
 {
     auto expr = parsePower();
     
-    // Handle postfix increment/decrement
+    // Handle postfix increment/decrement; on the next line, ++ and -- are prefix operators of a new statement
+    if (currentToken().line != previousToken().line) {
+        return expr;
+    }
     if (currentToken().type == TokenType::Increment) {
         advance();
-        return std::make_unique<UnaryOpNode>(UnaryOperator::PostIncrement, std::move(expr));
+        return makeAt<UnaryOpNode>(previousToken(), UnaryOperator::PostIncrement, expr);
     }
     
     if (currentToken().type == TokenType::Decrement) {
         advance();
-        return std::make_unique<UnaryOpNode>(UnaryOperator::PostDecrement, std::move(expr));
+        return makeAt<UnaryOpNode>(previousToken(), UnaryOperator::PostDecrement, expr);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parsePower()
+ASTNode *Parser::parsePower()
 {
     auto expr = parseCall();
     
     if (match(TokenType::Power)) {
+        Token op = previousToken();
         auto right = parseUnary(); // Right associative
-        return std::make_unique<BinaryOpNode>(std::move(expr), BinaryOperator::Power, std::move(right));
+        return makeAt<BinaryOpNode>(op, expr, BinaryOperator::Power, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parseCall()
+ASTNode *Parser::parseCall()
 {
     auto expr = parsePrimary();
     
-    while (match(TokenType::LeftParen)) {
-        std::vector<std::unique_ptr<ASTNode>> arguments;
+    // On the next line, '[' starts an array literal of a new statement
+    while (currentToken().type == TokenType::LeftParen ||
+           (currentToken().type == TokenType::LeftBracket && currentToken().line == previousToken().line)) {
+        Token open = currentToken();
+        if (match(TokenType::LeftBracket)) {
+            // a[i] is the builtin call at(a, i)
+            std::vector<ASTNode *> arguments{expr, parseExpression()};
+            consume(TokenType::RightBracket, "Expected ']' after index");
+            expr = makeAt<FunctionCallNode>(open, makeAt<IdentifierNode>(open, "at"), m_program->makeList(arguments));
+            continue;
+        }
+        advance(); // consume '('
+        std::vector<ASTNode *> arguments;
         
         if (currentToken().type != TokenType::RightParen) {
             do {
@@ -313,34 +545,35 @@ std::unique_ptr<ASTNode> Parser::parseCall()
         }
         
         consume(TokenType::RightParen, "Expected ')' after function arguments");
-        expr = std::make_unique<FunctionCallNode>(std::move(expr), std::move(arguments));
+        expr = makeAt<FunctionCallNode>(open, expr, m_program->makeList(arguments));
     }
     
     return expr;
 }
 
-std::unique_ptr<ASTNode> Parser::parsePrimary()
+ASTNode *Parser::parsePrimary()
 {
-    if (currentToken().type == TokenType::Number) {
-        std::string value = currentToken().value;
+    Token first = currentToken();
+    if (first.type == TokenType::Number) {
+        double value = parseNumber(first.value);
         advance();
-        return std::make_unique<LiteralNode>(Value(std::stod(value)));
+        return makeAt<LiteralNode>(first, Value(value));
     }
     
-    if (currentToken().type == TokenType::String) {
-        std::string value = currentToken().value;
+    if (first.type == TokenType::String) {
+        std::string value = Lexer::unescape(first.value);
         advance();
-        return std::make_unique<LiteralNode>(Value(value));
+        return makeAt<LiteralNode>(first, Value(value));
     }
     
-    if (currentToken().type == TokenType::Identifier) {
-        std::string name = currentToken().value;
+    if (first.type == TokenType::Identifier) {
+        std::string name(first.value);
         advance();
         
         // Check for function call
         if (currentToken().type == TokenType::LeftParen) {
             advance(); // consume '('
-            std::vector<std::unique_ptr<ASTNode>> args;
+            std::vector<ASTNode *> args;
             
             if (currentToken().type != TokenType::RightParen) {
                 do {
@@ -356,11 +589,11 @@ std::unique_ptr<ASTNode> Parser::parsePrimary()
             consume(TokenType::RightParen, "Expected ')' after function arguments");
             
             // Create IdentifierNode first, then FunctionCallNode
-            auto nameNode = std::make_unique<IdentifierNode>(name);
-            return std::make_unique<FunctionCallNode>(std::move(nameNode), std::move(args));
+            auto nameNode = makeAt<IdentifierNode>(first, name);
+            return makeAt<FunctionCallNode>(first, nameNode, m_program->makeList(args));
         }
         
-        return std::make_unique<IdentifierNode>(name);
+        return makeAt<IdentifierNode>(first, name);
     }
     
     // Handle if expressions
@@ -375,11 +608,23 @@ std::unique_ptr<ASTNode> Parser::parsePrimary()
         return expr;
     }
     
-    m_lastError = "Unexpected token: " + currentToken().value;
+    // Array literals are calls of the builtin array
+    if (match(TokenType::LeftBracket)) {
+        std::vector<ASTNode *> elements;
+        if (currentToken().type != TokenType::RightBracket) {
+            do {
+                elements.push_back(parseExpression());
+            } while (match(TokenType::Comma));
+        }
+        consume(TokenType::RightBracket, "Expected ']' after array elements");
+        return makeAt<FunctionCallNode>(first, makeAt<IdentifierNode>(first, "array"), m_program->makeList(elements));
+    }
+    
+    m_lastError = "Unexpected token: " + std::string(currentToken().value);
     throw std::runtime_error(m_lastError);
 }
 
-std::unique_ptr<ASTNode> Parser::parseIfStatement()
+ASTNode *Parser::parseIfStatement()
 {
     consume(TokenType::If, "Expected 'if'");
     consume(TokenType::LeftParen, "Expected '(' after 'if'");
@@ -387,18 +632,18 @@ std::unique_ptr<ASTNode> Parser::parseIfStatement()
     consume(TokenType::RightParen, "Expected ')' after if condition");
 
     auto thenBranch = parseStatement();
-    std::unique_ptr<ASTNode> elseBranch = nullptr;
+    ASTNode *elseBranch = nullptr;
 
     if (match(TokenType::Else)) {
         elseBranch = parseStatement();
     }
 
-    return std::make_unique<IfNode>(std::move(condition),
-                                    std::move(thenBranch),
-                                    std::move(elseBranch));
+    return m_program->make<IfNode>(condition,
+                                    thenBranch,
+                                    elseBranch);
 }
 
-std::unique_ptr<ASTNode> Parser::parseIfExpression()
+ASTNode *Parser::parseIfExpression()
 {
     consume(TokenType::LeftParen, "Expected '(' after 'if'");
     auto condition = parseExpression();
@@ -409,7 +654,7 @@ std::unique_ptr<ASTNode> Parser::parseIfExpression()
     consume(TokenType::Else, "Expected 'else' in if expression");
 
     // Check if the else branch is another if statement
-    std::unique_ptr<ASTNode> elseBranch;
+    ASTNode *elseBranch = nullptr;
     if (currentToken().type == TokenType::If) {
         advance();                        // consume 'if'
         elseBranch = parseIfExpression(); // Recursive call for nested if
@@ -417,12 +662,12 @@ std::unique_ptr<ASTNode> Parser::parseIfExpression()
         elseBranch = parseExpression(); // Regular expression
     }
 
-    return std::make_unique<IfNode>(std::move(condition),
-                                    std::move(thenBranch),
-                                    std::move(elseBranch));
+    return m_program->make<IfNode>(condition,
+                                    thenBranch,
+                                    elseBranch);
 }
 
-std::unique_ptr<ASTNode> Parser::parseWhileStatement()
+ASTNode *Parser::parseWhileStatement()
 {
     consume(TokenType::While, "Expected 'while'");
     consume(TokenType::LeftParen, "Expected '(' after 'while'");
@@ -430,30 +675,69 @@ std::unique_ptr<ASTNode> Parser::parseWhileStatement()
     consume(TokenType::RightParen, "Expected ')' after while condition");
     
     auto body = parseStatement();
-    return std::make_unique<WhileNode>(std::move(condition), std::move(body));
+    return m_program->make<WhileNode>(condition, body);
 }
 
-std::unique_ptr<ASTNode> Parser::parseForStatement()
+ASTNode *Parser::parseForStatement()
 {
+    consume(TokenType::For, "Expected 'for'");
     consume(TokenType::LeftParen, "Expected '(' after 'for'");
     
-    auto init = parseStatement();
+    // Each clause may be left empty, as in for (;;)
+    ASTNode *init = nullptr;
+    if (currentToken().type != TokenType::Semicolon) {
+        init = parseExpression();
+    }
     consume(TokenType::Semicolon, "Expected ';' after for loop initializer");
     
-    auto condition = parseExpression();
+    ASTNode *condition = nullptr;
+    if (currentToken().type != TokenType::Semicolon) {
+        condition = parseExpression();
+    }
     consume(TokenType::Semicolon, "Expected ';' after for loop condition");
     
-    auto update = parseExpression();
+    ASTNode *update = nullptr;
+    if (currentToken().type != TokenType::RightParen) {
+        update = parseExpression();
+    }
     consume(TokenType::RightParen, "Expected ')' after for loop clauses");
     
     auto body = parseStatement();
-    return std::make_unique<ForNode>(std::move(init), std::move(condition), std::move(update), std::move(body));
+    return m_program->make<ForNode>(init, condition, update, body);
+}
+
+ASTNode *Parser::parseParallelForStatement()
+{
+    consume(TokenType::Parallel, "Expected 'parallel'");
+    if (m_serialDepth > 0) {
+        // Function bodies run inside a call, and loop bodies on the workers
+        m_lastError = "parallel for is not allowed inside a function or another parallel for";
+        throw std::runtime_error(m_lastError);
+    }
+
+    std::vector<std::string> reductions;
+    if (match(TokenType::LeftParen)) {
+        do {
+            consume(TokenType::Identifier, "Expected reduction variable name");
+            reductions.emplace_back(previousToken().value);
+        } while (match(TokenType::Comma));
+        consume(TokenType::RightParen, "Expected ')' after reduction variables");
+    }
+    if (currentToken().type != TokenType::For) {
+        m_lastError = "Expected 'for' after 'parallel'";
+        throw std::runtime_error(m_lastError);
+    }
+
+    NestingGuard serial(m_serialDepth);
+    auto *loop = nodeCast<ForNode>(parseForStatement());
+    loop->setParallel(std::move(reductions));
+    return loop;
 }
 
-std::unique_ptr<ASTNode> Parser::parsePrintStatement()
+ASTNode *Parser::parsePrintStatement()
 {
     consume(TokenType::Print, "Expected 'print'");
-    std::vector<std::unique_ptr<ASTNode>> expressions;
+    std::vector<ASTNode *> expressions;
     
     // Parse comma-separated expressions
     do {
@@ -466,14 +750,14 @@ std::unique_ptr<ASTNode> Parser::parsePrintStatement()
         }
     } while (currentToken().type != TokenType::EndOfFile);
     
-    return std::make_unique<PrintNode>(std::move(expressions));
+    return m_program->make<PrintNode>(m_program->makeList(expressions));
 }
 
-std::unique_ptr<ASTNode> Parser::parseBlock()
+ASTNode *Parser::parseBlock()
 {
     consume(TokenType::LeftBrace, "Expected '{'");
 
-    std::vector<std::unique_ptr<ASTNode>> statements;
+    std::vector<ASTNode *> statements;
 
     while (currentToken().type != TokenType::RightBrace
            && currentToken().type != TokenType::EndOfFile) {
@@ -490,13 +774,14 @@ std::unique_ptr<ASTNode> Parser::parseBlock()
 
     consume(TokenType::RightBrace, "Expected '}'");
 
-    return std::make_unique<BlockNode>(std::move(statements));
+    return m_program->make<BlockNode>(m_program->makeList(statements));
 }
 
-std::unique_ptr<ASTNode> Parser::parseFunctionDeclaration()
+ASTNode *Parser::parseFunctionDeclaration()
 {
+    advance(); // 'function' or 'procedure'
     consume(TokenType::Identifier, "Expected function name");
-    std::string name = m_tokens[m_current - 1].value;
+    std::string name(previousToken().value);
     
     consume(TokenType::LeftParen, "Expected '(' after function name");
     
@@ -504,31 +789,32 @@ std::unique_ptr<ASTNode> Parser::parseFunctionDeclaration()
     if (currentToken().type != TokenType::RightParen) {
         do {
             consume(TokenType::Identifier, "Expected parameter name");
-            parameters.push_back(m_tokens[m_current - 1].value);
+            parameters.emplace_back(previousToken().value);
         } while (match(TokenType::Comma));
     }
     
     consume(TokenType::RightParen, "Expected ')' after parameters");
     
+    NestingGuard serial(m_serialDepth);
     auto body = parseStatement();
-    return std::make_unique<FunctionDefNode>(name, parameters, std::move(body));
+    return m_program->make<FunctionDefNode>(name, parameters, body);
 }
 
-std::unique_ptr<ASTNode> Parser::parseReturnStatement()
+ASTNode *Parser::parseReturnStatement()
 {
-    std::unique_ptr<ASTNode> value = nullptr;
+    consume(TokenType::Return, "Expected 'return'");
+    ASTNode *value = nullptr;
     
-    if (currentToken().type != TokenType::Semicolon && !isAtEnd()) {
+    if (currentToken().type != TokenType::Semicolon && currentToken().type != TokenType::RightBrace && !isAtEnd()) {
         value = parseExpression();
     }
     
-    return std::make_unique<ReturnNode>(std::move(value));
+    return m_program->make<ReturnNode>(value);
 }
 
 bool Parser::isAtEnd() const
 {
-    return m_current >= m_tokens.size()
-           || (m_current < m_tokens.size() && m_tokens[m_current].type == TokenType::EndOfFile);
+    return currentToken().type == TokenType::EndOfFile;
 }
 
 void Parser::synchronize()
@@ -536,19 +822,15 @@ void Parser::synchronize()
     advance();
 
     while (!isAtEnd()) {
-        if (m_tokens[m_current - 1].type == TokenType::Semicolon) {
+        if (previousToken().type == TokenType::Semicolon) {
             return;
         }
 
-        // Add bounds check before accessing currentToken
-        if (m_current >= m_tokens.size()) {
-            break;
-        }
-
         switch (currentToken().type) {
         case TokenType::If:
         case TokenType::While:
         case TokenType::For:
+        case TokenType::Parallel:
         case TokenType::Function:
             return;
         default:
@@ -557,3 +839,15 @@ void Parser::synchronize()
         }
     }
 }
+
+void Parser::skipLine()
+{
+    int line = currentToken().line;
+    while (!isAtEnd() && currentToken().line == line) {
+        try {
+            advance();
+        } catch (const std::exception &) {
+            // Lexing errors inside the skipped line are part of the same mistake
+        }
+    }
+}
@@ -2,8 +2,13 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include "program.h"
+#include "span.h"
+#include <exception>
 #include <memory>
 
+class TokenStream;
+
 /**
  * @brief Parser for the GlossAI language
  * 
@@ -17,10 +22,57 @@ public:
     
     /**
      * @brief Parse tokens into an AST
-     * @param tokens Vector of tokens to parse
-     * @return Root node of the AST, or nullptr on error
+     * @param tokens Vector of tokens to parse; only borrowed for the call
+     * @return The program owning the AST, or nullptr on error
+     */
+    std::unique_ptr<Program> parse(const std::vector<Token> &tokens);
+
+    /**
+     * @brief Start parsing a script statement by statement with parseNext()
+     * @param stream Source of tokens; must outlive the parse
+     */
+    void beginStream(TokenStream &stream);
+
+    /**
+     * @brief Parse the next top-level statement of the stream
+     *
+     * Each statement gets its own Program, so it can be executed and freed
+     * before the rest of the script is read. Statements may be separated by
+     * semicolons. After a syntax error the rest of the offending line is
+     * skipped and parsing can continue.
+     * @return The statement, or nullptr at the end of the stream or on a
+     *         syntax error (getLastError() is then set)
+     */
+    std::unique_ptr<Program> parseNext();
+
+    /**
+     * @brief A top-level statement of a whole-script parse
+     */
+    struct ScriptStatement {
+        ASTNode *node;           // Null if the statement has a syntax error
+        int line;                // Script line the statement starts on
+        std::string_view source; // Statement text, viewing into the script
+        std::string error;       // Syntax error when node is null
+    };
+
+    /**
+     * @brief Parse every top-level statement of a script into one program
+     *
+     * Statements may span lines and be separated by semicolons. After a
+     * syntax error the rest of the offending line is skipped and parsing
+     * continues, as with parseNext().
+     * @param source Text the tokens were lexed from
+     * @param tokens All tokens of the script; only borrowed for the call
+     * @param statements Receives the statements in source order
+     * @return The program owning the nodes of every statement
      */
-    std::unique_ptr<ASTNode> parse(const std::vector<Token> &tokens);
+    std::unique_ptr<Program> parseScript(std::string_view source, const std::vector<Token> &tokens,
+                                         std::vector<ScriptStatement> &statements);
+
+    /**
+     * @brief Check whether the stream has no statements left
+     */
+    bool atEndOfStream() const { return isAtEnd(); }
     
     /**
      * @brief Get the last parse error
@@ -28,47 +80,73 @@ public:
      */
     std::string getLastError() const { return m_lastError; }
 
+    /**
+     * @brief Get the line of the token the last parse error was reported at
+     */
+    int getErrorLine() const { return m_errorLine; }
+
+    /**
+     * @brief Get the column of the token the last parse error was reported at
+     */
+    int getErrorColumn() const { return m_errorColumn; }
+
 private:
     // Token management
-    Token currentToken() const;
-    Token peekToken(int offset = 1) const;
+    const Token &currentToken() const;
+    const Token &peekToken(int offset = 1) const;
+    const Token &previousToken() const;
     void advance();
     bool match(TokenType type);
     bool consume(TokenType type, const std::string &errorMessage);
+
+    /**
+     * @brief Create a node of the current program positioned at a token
+     */
+    template <typename T, typename... Args>
+    T *makeAt(const Token &token, Args &&...args);
     
     // Grammar rules (recursive descent)
-    std::unique_ptr<ASTNode> parseStatement();
-    std::unique_ptr<ASTNode> parseExpression();
-    std::unique_ptr<ASTNode> parseAssignment();
-    std::unique_ptr<ASTNode> parseLogicalOr();
-    std::unique_ptr<ASTNode> parseLogicalAnd();
-    std::unique_ptr<ASTNode> parseEquality();
-    std::unique_ptr<ASTNode> parseComparison();
-    std::unique_ptr<ASTNode> parseTerm();
-    std::unique_ptr<ASTNode> parseFactor();
-    std::unique_ptr<ASTNode> parseUnary();
-    std::unique_ptr<ASTNode> parsePostfix();
-    std::unique_ptr<ASTNode> parsePower();
-    std::unique_ptr<ASTNode> parsePrimary();
-    std::unique_ptr<ASTNode> parseCall();
+    ASTNode *parseStatement();
+    ASTNode *parseExpression();
+    ASTNode *parseAssignment();
+    ASTNode *parseLogicalOr();
+    ASTNode *parseLogicalAnd();
+    ASTNode *parseEquality();
+    ASTNode *parseComparison();
+    ASTNode *parseTerm();
+    ASTNode *parseFactor();
+    ASTNode *parseUnary();
+    ASTNode *parsePostfix();
+    ASTNode *parsePower();
+    ASTNode *parsePrimary();
+    ASTNode *parseCall();
     
     // Control flow
-    std::unique_ptr<ASTNode> parseIfStatement();
-    std::unique_ptr<ASTNode> parseIfExpression();
-    std::unique_ptr<ASTNode> parseWhileStatement();
-    std::unique_ptr<ASTNode> parseForStatement();
-    std::unique_ptr<ASTNode> parsePrintStatement();
-    std::unique_ptr<ASTNode> parseBlock();
+    ASTNode *parseIfStatement();
+    ASTNode *parseIfExpression();
+    ASTNode *parseWhileStatement();
+    ASTNode *parseForStatement();
+    ASTNode *parseParallelForStatement();
+    ASTNode *parsePrintStatement();
+    ASTNode *parseBlock();
     
     // Function definitions
-    std::unique_ptr<ASTNode> parseFunctionDeclaration();
-    std::unique_ptr<ASTNode> parseReturnStatement();
+    ASTNode *parseFunctionDeclaration();
+    ASTNode *parseReturnStatement();
     
     // Utilities
     bool isAtEnd() const;
+    void clearError();
+    void recordError(const std::exception &error);
     void synchronize(); // Error recovery
+    void skipLine();    // Stream error recovery
     
-    std::vector<Token> m_tokens;
+    Span<const Token> m_tokens; // Tokens of the current parse (not owned)
     size_t m_current;
+    TokenStream *m_stream;      // Replaces m_tokens while streaming
     std::string m_lastError;
+    int m_errorLine;
+    int m_errorColumn;
+    Program *m_program; // Program receiving the nodes of the current parse
+    int m_serialDepth;  // Function and parallel loop bodies being parsed, where parallel for is not allowed
 };
@@ -0,0 +1,277 @@
+#include "profiler.h"
+#include "builtins.h"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+namespace
+{
+
+std::uint64_t nanosecondsSince(Profiler::Clock::time_point start)
+{
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Profiler::Clock::now() - start).count());
+}
+
+// Statement text on one line, short enough for a table or a flame graph frame
+std::string label(std::string_view source, size_t width)
+{
+    std::string text;
+    for (char c : source) {
+        if (text.size() == width) {
+            text.replace(width - 3, 3, "...");
+            break;
+        }
+        text += (c == '\n' || c == '\r' || c == '\t') ? ' ' : c;
+    }
+    return text;
+}
+
+std::string milliseconds(std::uint64_t nanoseconds)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3) << nanoseconds / 1e6 << " ms";
+    return text.str();
+}
+
+} // anonymous namespace
+
+Profiler::Profiler()
+{
+    reset();
+}
+
+void Profiler::reset()
+{
+    m_lines.clear();
+    m_functions.clear();
+    m_builtins.clear();
+    m_prints = CallRecord();
+    std::fill(std::begin(m_counters), std::end(m_counters), 0);
+    m_tree.assign(1, TreeNode{std::string(), 0, 0, {}});
+    m_stack.clear();
+    m_statements.clear();
+}
+
+size_t Profiler::child(size_t parent, const std::string &name)
+{
+    auto found = m_tree[parent].children.find(name);
+    if (found != m_tree[parent].children.end()) {
+        return found->second;
+    }
+    size_t node = m_tree.size();
+    m_tree[parent].children.emplace(name, node);
+    m_tree.push_back(TreeNode{name, parent, 0, {}});
+    return node;
+}
+
+void Profiler::push(const std::string &name, LineRecord *line, CallRecord *function)
+{
+    size_t parent = m_stack.empty() ? 0 : m_stack.back().node;
+    size_t node = child(parent, name);
+    m_stack.push_back(Frame{node, Clock::now(), 0, line, function});
+}
+
+void Profiler::pop()
+{
+    Frame frame = m_stack.back();
+    m_stack.pop_back();
+    std::uint64_t elapsed = nanosecondsSince(frame.start);
+    m_tree[frame.node].selfNanoseconds += elapsed - std::min(elapsed, frame.childNanoseconds);
+    if (!m_stack.empty()) {
+        m_stack.back().childNanoseconds += elapsed;
+    }
+    if (frame.line) {
+        frame.line->nanoseconds += elapsed;
+    }
+    if (frame.function && --frame.function->active == 0) {
+        frame.function->nanoseconds += elapsed;
+    }
+}
+
+std::uint64_t Profiler::leaf(const std::string &name, Clock::time_point start)
+{
+    std::uint64_t elapsed = nanosecondsSince(start);
+    size_t parent = m_stack.empty() ? 0 : m_stack.back().node;
+    m_tree[child(parent, name)].selfNanoseconds += elapsed;
+    if (!m_stack.empty()) {
+        m_stack.back().childNanoseconds += elapsed;
+    }
+    return elapsed;
+}
+
+void Profiler::beginStatement(int line, std::string_view source)
+{
+    LineRecord &record = m_lines[{line, std::string(source)}];
+    ++record.runs;
+    m_statements.push_back(m_stack.size());
+    // ';' separates frames in folded stacks
+    std::string frame = line > 0 ? "line " + std::to_string(line) : label(source, 60);
+    std::replace(frame.begin(), frame.end(), ';', ',');
+    push(frame, &record, nullptr);
+}
+
+void Profiler::endStatement()
+{
+    if (m_statements.empty()) {
+        return;
+    }
+    size_t depth = m_statements.back();
+    m_statements.pop_back();
+    while (m_stack.size() > depth) {
+        pop();
+    }
+}
+
+void Profiler::enterFunction(const std::string &name)
+{
+    CallRecord &record = m_functions[name];
+    ++record.calls;
+    ++record.active;
+    push(name, nullptr, &record);
+}
+
+void Profiler::leaveFunction()
+{
+    // A statement frame is never closed from inside it
+    if (!m_stack.empty() && m_stack.back().function) {
+        pop();
+    }
+}
+
+void Profiler::memoHit(const std::string &name)
+{
+    ++m_functions[name].memoHits;
+}
+
+void Profiler::builtinCall(const BuiltinFunction &function, Clock::time_point start)
+{
+    CallRecord &record = m_builtins[&function];
+    ++record.calls;
+    record.nanoseconds += leaf(function.name, start);
+}
+
+void Profiler::print(Clock::time_point start)
+{
+    ++m_prints.calls;
+    m_prints.nanoseconds += leaf("print", start);
+}
+
+std::vector<Profiler::LineStats> Profiler::lines() const
+{
+    std::vector<LineStats> lines;
+    for (const auto &entry : m_lines) {
+        lines.push_back(LineStats{entry.first.first, entry.first.second, entry.second.runs, entry.second.nanoseconds});
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const LineStats &a, const LineStats &b) { return a.nanoseconds > b.nanoseconds; });
+    return lines;
+}
+
+std::vector<Profiler::NodeStats> Profiler::nodes() const
+{
+    std::vector<NodeStats> nodes;
+    for (const auto &entry : m_functions) {
+        if (entry.second.calls > 0) {
+            nodes.push_back(NodeStats{"FunctionCallNode " + entry.first, entry.second.calls,
+                                      entry.second.nanoseconds, true});
+        }
+    }
+    for (const auto &entry : m_builtins) {
+        nodes.push_back(NodeStats{std::string("FunctionCallNode ") + entry.first->name + " (builtin)",
+                                  entry.second.calls, entry.second.nanoseconds, true});
+    }
+    if (m_prints.calls > 0) {
+        nodes.push_back(NodeStats{"PrintNode", m_prints.calls, m_prints.nanoseconds, true});
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NodeStats &a, const NodeStats &b) {
+        return a.nanoseconds != b.nanoseconds ? a.nanoseconds > b.nanoseconds : a.kind < b.kind;
+    });
+
+    for (const auto &entry : m_functions) {
+        if (entry.second.memoHits > 0) {
+            nodes.push_back(NodeStats{"FunctionCallNode " + entry.first + " (memo hits)", entry.second.memoHits, 0,
+                                      false});
+        }
+    }
+    const char *const counters[CounterCount] = {"WhileNode/ForNode iterations", "IdentifierNode loads",
+                                                "Assignments"};
+    for (int counter = 0; counter < CounterCount; ++counter) {
+        if (m_counters[counter] > 0) {
+            nodes.push_back(NodeStats{counters[counter], m_counters[counter], 0, false});
+        }
+    }
+    return nodes;
+}
+
+std::uint64_t Profiler::totalNanoseconds() const
+{
+    std::uint64_t total = 0;
+    for (const auto &entry : m_lines) {
+        total += entry.second.nanoseconds;
+    }
+    return total;
+}
+
+void Profiler::writeReport(std::ostream &out, size_t limit) const
+{
+    std::vector<LineStats> lines = this->lines();
+    std::uint64_t total = totalNanoseconds();
+    std::uint64_t runs = 0;
+    for (const LineStats &line : lines) {
+        runs += line.runs;
+    }
+    out << "Profile: " << runs << " statements in " << milliseconds(total) << "\n";
+    if (lines.empty()) {
+        return;
+    }
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "\nHot lines:\n";
+    out << std::setw(14) << "Time" << std::setw(8) << "%" << std::setw(10) << "Runs" << "  Line\n";
+    for (size_t i = 0; i < lines.size() && i < limit; ++i) {
+        const LineStats &line = lines[i];
+        out << std::setw(14) << milliseconds(line.nanoseconds) << std::setw(7) << std::fixed << std::setprecision(1)
+            << (total ? 100.0 * line.nanoseconds / total : 0.0) << "%" << std::setw(10) << line.runs << "  ";
+        if (line.line > 0) {
+            out << line.line << ": ";
+        }
+        out << label(line.source, 60) << "\n";
+    }
+
+    std::vector<NodeStats> nodes = this->nodes();
+    if (!nodes.empty()) {
+        out << "\nHot spots:\n";
+        out << std::setw(14) << "Time" << std::setw(14) << "Count" << "  Node\n";
+        size_t timed = 0;
+        for (const NodeStats &node : nodes) {
+            if (node.timed && timed++ >= limit) {
+                continue;
+            }
+            out << std::setw(14) << (node.timed ? milliseconds(node.nanoseconds) : std::string()) << std::setw(14)
+                << node.count << "  " << node.kind << "\n";
+        }
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void Profiler::writeFoldedStacks(std::ostream &out) const
+{
+    for (size_t node = 1; node < m_tree.size(); ++node) {
+        std::uint64_t self = m_tree[node].selfNanoseconds;
+        if (self == 0) {
+            continue;
+        }
+        std::vector<const std::string *> path;
+        for (size_t at = node; at != 0; at = m_tree[at].parent) {
+            path.push_back(&m_tree[at].name);
+        }
+        for (size_t i = path.size(); i-- > 0;) {
+            out << *path[i] << (i ? ";" : " ");
+        }
+        out << self << "\n";
+    }
+}
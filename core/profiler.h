@@ -0,0 +1,166 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct BuiltinFunction;
+
+/**
+ * @brief Collects where the time of profiled statements goes
+ *
+ * Statements are timed as a whole and grouped by source line. Inside them the
+ * engines report user function calls, builtin calls and prints (counted and
+ * timed) and loop iterations and variable accesses (counted only: timing
+ * them would cost more than they do). Calls form a tree that can be written
+ * as folded stacks for flame graph tools.
+ */
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Events that are counted but not timed
+    enum Counter {
+        LoopIterations,
+        VariableLoads,
+        VariableStores,
+        CounterCount
+    };
+
+    /**
+     * @brief Totals of one statement, or of one source line of a script
+     */
+    struct LineStats {
+        int line;              // Script line, 0 for statements that are not part of a script
+        std::string source;    // Statement text (may be empty)
+        std::uint64_t runs;
+        std::uint64_t nanoseconds;
+    };
+
+    /**
+     * @brief Totals of one kind of node, e.g. calls of one builtin
+     */
+    struct NodeStats {
+        std::string kind;
+        std::uint64_t count;
+        std::uint64_t nanoseconds; // Inclusive; 0 for kinds that are not timed
+        bool timed;
+    };
+
+    Profiler();
+
+    /**
+     * @brief Start timing a top-level statement
+     * @param line Script line the statement starts on (0 if none)
+     * @param source Statement text, used to label it
+     */
+    void beginStatement(int line, std::string_view source);
+
+    /**
+     * @brief Stop timing the innermost statement, closing calls an error abandoned
+     */
+    void endStatement();
+
+    /// A user function starts running
+    void enterFunction(const std::string &name);
+    /// The innermost user function returned
+    void leaveFunction();
+    /// A call of a pure user function was answered from its memo
+    void memoHit(const std::string &name);
+
+    /**
+     * @brief A builtin call that started at start has returned
+     */
+    void builtinCall(const BuiltinFunction &function, Clock::time_point start);
+
+    /**
+     * @brief A print statement that started at start has written its line
+     */
+    void print(Clock::time_point start);
+
+    void count(Counter counter) { ++m_counters[counter]; }
+
+    /**
+     * @brief Forget everything recorded so far
+     */
+    void reset();
+
+    /**
+     * @brief Statements grouped by line and text, slowest first
+     */
+    std::vector<LineStats> lines() const;
+
+    /**
+     * @brief Node kinds, timed ones slowest first, then counters
+     */
+    std::vector<NodeStats> nodes() const;
+
+    /**
+     * @brief Total time of all profiled statements
+     */
+    std::uint64_t totalNanoseconds() const;
+
+    /**
+     * @brief Write a readable summary of the hottest lines and node kinds
+     * @param out Destination
+     * @param limit Maximum number of rows per table
+     */
+    void writeReport(std::ostream &out, size_t limit = 10) const;
+
+    /**
+     * @brief Write the call tree as folded stacks ("line 3;fib;fib;sqrt 1520")
+     *
+     * One line per call path with its self time in nanoseconds, the format
+     * read by flamegraph.pl, speedscope and similar tools.
+     */
+    void writeFoldedStacks(std::ostream &out) const;
+
+private:
+    struct LineRecord {
+        std::uint64_t runs = 0;
+        std::uint64_t nanoseconds = 0;
+    };
+
+    struct CallRecord {
+        std::uint64_t calls = 0;
+        std::uint64_t memoHits = 0;
+        std::uint64_t nanoseconds = 0; // Outermost activations only, so recursion is not counted twice
+        unsigned active = 0;
+    };
+
+    struct TreeNode {
+        std::string name;
+        size_t parent;
+        std::uint64_t selfNanoseconds;
+        std::unordered_map<std::string, size_t> children;
+    };
+
+    struct Frame {
+        size_t node;
+        Clock::time_point start;
+        std::uint64_t childNanoseconds;
+        LineRecord *line;     // Set for statements
+        CallRecord *function; // Set for user functions
+    };
+
+    size_t child(size_t parent, const std::string &name);
+    void push(const std::string &name, LineRecord *line, CallRecord *function);
+    void pop();
+    std::uint64_t leaf(const std::string &name, Clock::time_point start);
+
+    std::map<std::pair<int, std::string>, LineRecord> m_lines;
+    std::unordered_map<std::string, CallRecord> m_functions;
+    std::unordered_map<const BuiltinFunction *, CallRecord> m_builtins;
+    CallRecord m_prints;
+    std::uint64_t m_counters[CounterCount];
+    std::vector<TreeNode> m_tree;    // Node 0 is the root above all statements
+    std::vector<Frame> m_stack;
+    std::vector<size_t> m_statements; // m_stack sizes at which the open statements began
+};
@@ -0,0 +1,113 @@
+#include "program.h"
+
+namespace
+{
+
+/**
+ * @brief Rebuilds a subtree node by node in a target program
+ */
+class TreeCopier : public ASTVisitor
+{
+public:
+    explicit TreeCopier(Program &program) : m_program(program), m_result(nullptr) {}
+
+    ASTNode *copy(ASTNode *node)
+    {
+        if (!node) {
+            return nullptr;
+        }
+        node->accept(this);
+        m_result->setPosition(node->getLine(), node->getColumn());
+        return m_result;
+    }
+
+    void visit(LiteralNode *node) override { m_result = m_program.make<LiteralNode>(node->getValue()); }
+    void visit(IdentifierNode *node) override
+    {
+        auto *copy = m_program.make<IdentifierNode>(node->getName());
+        if (node->isResolved()) {
+            copy->resolve(node->getScopeDepth(), node->getSlotIndex());
+        }
+        m_result = copy;
+    }
+    void visit(BinaryOpNode *node) override
+    {
+        ASTNode *left = copy(node->getLeft());
+        ASTNode *right = copy(node->getRight());
+        m_result = m_program.make<BinaryOpNode>(left, node->getOperator(), right);
+    }
+    void visit(UnaryOpNode *node) override
+    {
+        m_result = m_program.make<UnaryOpNode>(node->getOperator(), copy(node->getOperand()));
+    }
+    void visit(FunctionCallNode *node) override
+    {
+        ASTNode *function = copy(node->getFunction());
+        auto *call = m_program.make<FunctionCallNode>(function, copyList(node->getArguments()));
+        call->setBuiltin(node->getBuiltin());
+        m_result = call;
+    }
+    void visit(IfNode *node) override
+    {
+        ASTNode *condition = copy(node->getCondition());
+        ASTNode *thenBranch = copy(node->getThenBranch());
+        ASTNode *elseBranch = copy(node->getElseBranch());
+        m_result = m_program.make<IfNode>(condition, thenBranch, elseBranch);
+    }
+    void visit(WhileNode *node) override
+    {
+        ASTNode *condition = copy(node->getCondition());
+        m_result = m_program.make<WhileNode>(condition, copy(node->getBody()));
+    }
+    void visit(ForNode *node) override
+    {
+        ASTNode *init = copy(node->getInit());
+        ASTNode *condition = copy(node->getCondition());
+        ASTNode *update = copy(node->getUpdate());
+        auto *loop = m_program.make<ForNode>(init, condition, update, copy(node->getBody()));
+        if (node->isParallel()) {
+            loop->setParallel(node->getReductions());
+        }
+        m_result = loop;
+    }
+    void visit(BlockNode *node) override { m_result = m_program.make<BlockNode>(copyList(node->getStatements())); }
+    void visit(FunctionDefNode *node) override
+    {
+        auto *definition = m_program.make<FunctionDefNode>(node->getName(), node->getParameters(),
+                                                           copy(node->getBody()));
+        if (node->isResolved()) {
+            definition->setLocals(node->getLocals());
+        }
+        m_result = definition;
+    }
+    void visit(ReturnNode *node) override { m_result = m_program.make<ReturnNode>(copy(node->getValue())); }
+    void visit(PrintNode *node) override { m_result = m_program.make<PrintNode>(copyList(node->getExpressions())); }
+
+private:
+    NodeList copyList(NodeList nodes)
+    {
+        std::vector<ASTNode *> copies;
+        copies.reserve(nodes.size());
+        for (ASTNode *node : nodes) {
+            copies.push_back(copy(node));
+        }
+        return m_program.makeList(copies);
+    }
+
+    Program &m_program;
+    ASTNode *m_result;
+};
+
+} // anonymous namespace
+
+Program::Program()
+    : m_root(nullptr), m_nodeCount(0)
+{
+}
+
+Program::~Program() = default;
+
+ASTNode *Program::copyTree(ASTNode *node)
+{
+    return TreeCopier(*this).copy(node);
+}
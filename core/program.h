@@ -0,0 +1,84 @@
+#pragma once
+
+#include "arena.h"
+#include "ast.h"
+#include <vector>
+
+/**
+ * @brief A parsed compilation unit that owns its syntax tree
+ *
+ * Every node of the tree, and every child list, lives in the program's
+ * arena: nodes are laid out contiguously in the order the parser created
+ * them and are all released together when the Program is destroyed. Node
+ * pointers are only valid for the lifetime of their Program.
+ */
+class Program
+{
+public:
+    Program();
+    ~Program();
+
+    Program(const Program &) = delete;
+    Program &operator=(const Program &) = delete;
+
+    /**
+     * @brief Root node of the tree (nullptr until set)
+     */
+    ASTNode *root() const { return m_root; }
+    void setRoot(ASTNode *root) { m_root = root; }
+
+    /**
+     * @brief Create a node owned by this program
+     */
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        ++m_nodeCount;
+        return m_arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Create a node that replaces another one, at the other node's source position
+     */
+    template <typename T, typename... Args>
+    T *makeAt(const ASTNode *original, Args &&...args)
+    {
+        T *node = make<T>(std::forward<Args>(args)...);
+        node->setPosition(original->getLine(), original->getColumn());
+        return node;
+    }
+
+    /**
+     * @brief Store a child list in the arena
+     */
+    NodeList makeList(const std::vector<ASTNode *> &nodes)
+    {
+        Span<ASTNode *> list = m_arena.copy(nodes);
+        return NodeList(list.data(), list.size());
+    }
+
+    /**
+     * @brief Copy a subtree of another program into this one
+     *
+     * Bindings made by the Resolver (variable slots, native functions,
+     * function frame layouts) are copied along with the nodes.
+     * @param node Root of the subtree (may be nullptr)
+     * @return Root of the copy
+     */
+    ASTNode *copyTree(ASTNode *node);
+
+    /**
+     * @brief Number of nodes created in this program
+     */
+    size_t nodeCount() const { return m_nodeCount; }
+
+    /**
+     * @brief Bytes reserved by the arena backing the tree
+     */
+    size_t bytesReserved() const { return m_arena.bytesReserved(); }
+
+private:
+    Arena m_arena;
+    ASTNode *m_root;
+    size_t m_nodeCount;
+};
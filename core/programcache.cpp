@@ -0,0 +1,78 @@
+#include "programcache.h"
+
+bool isStatementRoot(ASTNode *root)
+{
+    if (!root) {
+        return false;
+    }
+    switch (root->getKind()) {
+    case NodeKind::Print:
+    case NodeKind::Block:
+    case NodeKind::While:
+    case NodeKind::For:
+    case NodeKind::FunctionDef:
+    case NodeKind::If:
+        return true;
+    default:
+        return false;
+    }
+}
+
+ProgramCache::ProgramCache(size_t capacity)
+    : m_capacity(capacity), m_hits(0), m_misses(0)
+{
+}
+
+PreparedProgram *ProgramCache::lookup(const std::string &source)
+{
+    auto it = m_index.find(source);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->prepared.get();
+}
+
+PreparedProgram *ProgramCache::insert(const std::string &source, std::unique_ptr<PreparedProgram> prepared)
+{
+    if (m_capacity == 0) {
+        m_uncached = std::move(prepared);
+        return m_uncached.get();
+    }
+
+    auto it = m_index.find(source);
+    if (it != m_index.end()) {
+        it->second->prepared = std::move(prepared);
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->prepared.get();
+    }
+
+    m_entries.push_front(Entry{source, std::move(prepared)});
+    m_index.emplace(source, m_entries.begin());
+    evict();
+    return m_entries.front().prepared.get();
+}
+
+void ProgramCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_uncached.reset();
+}
+
+void ProgramCache::setCapacity(size_t capacity)
+{
+    m_capacity = capacity;
+    evict();
+}
+
+void ProgramCache::evict()
+{
+    while (m_entries.size() > m_capacity) {
+        m_index.erase(m_entries.back().source);
+        m_entries.pop_back();
+    }
+}
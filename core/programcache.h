@@ -0,0 +1,99 @@
+#pragma once
+
+#include "bytecode.h"
+#include "program.h"
+#ifdef GLOSSAI_ENABLE_JIT
+#include "jit.h"
+#endif
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Everything Interpreter derives from a piece of source text
+ *
+ * Holds the parsed (and optimized) tree, or the error that prevented it.
+ * Resolution and compilation happen on first execution, so entries that are
+ * only syntax-checked never touch the Context.
+ */
+struct PreparedProgram {
+    std::unique_ptr<Program> program; // Owns the tree; null if preparation failed
+    ASTNode *root = nullptr;          // Optimized root
+    bool isStatement = false;         // Statements do not report a result
+    bool resolved = false;            // Identifiers bound to Context slots
+    std::unique_ptr<Chunk> chunk;     // Bytecode, compiled on first VM run
+    std::string error;                // Lex or parse error when root is null
+    int errorLine = 0;                // Where the error was found (1-based; 0 if unknown)
+    int errorColumn = 0;
+#ifdef GLOSSAI_ENABLE_JIT
+    size_t runs = 0;                  // Executions on the VM
+    size_t loopIterations = 0;        // Loop iterations over all VM executions
+    bool jitAttempted = false;        // Promotion happens at most once
+    std::unique_ptr<JitFunction> native;
+#endif
+};
+
+/**
+ * @brief Check whether a parsed root is a statement, which reports no result
+ *
+ * Decided on the tree as written, since optimization may change the root's kind.
+ */
+bool isStatementRoot(ASTNode *root);
+
+/**
+ * @brief Bounded least-recently-used cache of prepared programs
+ *
+ * Keyed by the exact source text. Entries hold resolved slot addresses and
+ * bound builtins, so the owner must clear the cache whenever the context or
+ * the function table it was prepared against changes. With a capacity of
+ * zero nothing is retained: insert() keeps only the latest entry alive until
+ * the next insert.
+ */
+class ProgramCache
+{
+public:
+    explicit ProgramCache(size_t capacity);
+
+    /**
+     * @brief Find a prepared program and mark it most recently used
+     * @return The entry, or nullptr on a miss
+     */
+    PreparedProgram *lookup(const std::string &source);
+
+    /**
+     * @brief Store a prepared program, evicting the least recently used entries
+     * @return The stored entry, valid until it is evicted
+     */
+    PreparedProgram *insert(const std::string &source, std::unique_ptr<PreparedProgram> prepared);
+
+    /**
+     * @brief Drop all entries (statistics are kept)
+     */
+    void clear();
+
+    /**
+     * @brief Change the maximum number of entries, evicting as needed
+     */
+    void setCapacity(size_t capacity);
+
+    size_t capacity() const { return m_capacity; }
+    size_t size() const { return m_entries.size(); }
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+private:
+    struct Entry {
+        std::string source;
+        std::unique_ptr<PreparedProgram> prepared;
+    };
+
+    void evict();
+
+    size_t m_capacity;
+    size_t m_hits;
+    size_t m_misses;
+    std::list<Entry> m_entries; // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    std::unique_ptr<PreparedProgram> m_uncached; // Latest entry when caching is disabled
+};
@@ -0,0 +1,224 @@
+#include "resolver.h"
+#include "builtins.h"
+#include "context.h"
+#include <algorithm>
+
+namespace
+{
+
+/**
+ * @brief Collects the names a function body assigns with '=', in order of appearance
+ */
+class LocalCollector : public ASTVisitor
+{
+public:
+    explicit LocalCollector(std::vector<std::string> &names) : m_names(names) {}
+
+    void collect(ASTNode *node)
+    {
+        if (node) {
+            node->accept(this);
+        }
+    }
+
+    void visit(LiteralNode *) override {}
+    void visit(IdentifierNode *) override {}
+    void visit(BinaryOpNode *node) override
+    {
+        auto *target = nodeCast<IdentifierNode>(node->getLeft());
+        if (node->getOperator() == BinaryOperator::Assign && target &&
+            std::find(m_names.begin(), m_names.end(), target->getName()) == m_names.end()) {
+            m_names.push_back(target->getName());
+        }
+        collect(node->getLeft());
+        collect(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override { collect(node->getOperand()); }
+    void visit(FunctionCallNode *node) override
+    {
+        for (ASTNode *arg : node->getArguments()) {
+            collect(arg);
+        }
+    }
+    void visit(IfNode *node) override
+    {
+        collect(node->getCondition());
+        collect(node->getThenBranch());
+        collect(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        collect(node->getCondition());
+        collect(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        collect(node->getInit());
+        collect(node->getCondition());
+        collect(node->getUpdate());
+        collect(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        for (ASTNode *statement : node->getStatements()) {
+            collect(statement);
+        }
+    }
+    void visit(FunctionDefNode *) override {} // Nested functions have frames of their own
+    void visit(ReturnNode *node) override { collect(node->getValue()); }
+    void visit(PrintNode *node) override
+    {
+        for (ASTNode *expr : node->getExpressions()) {
+            collect(expr);
+        }
+    }
+
+private:
+    std::vector<std::string> &m_names;
+};
+
+} // anonymous namespace
+
+Resolver::Resolver()
+    : m_context(nullptr), m_builtins(nullptr), m_locals(nullptr)
+{
+}
+
+void Resolver::resolve(ASTNode *root, Context *context, const BuiltinRegistry *builtins)
+{
+    m_context = context;
+    m_builtins = builtins ? builtins : &BuiltinRegistry::standard();
+    resolveChild(root);
+    m_context = nullptr;
+    m_builtins = nullptr;
+}
+
+void Resolver::resolveFunction(UserFunction &function, Context *context, const BuiltinRegistry *builtins)
+{
+    m_context = context;
+    m_builtins = builtins ? builtins : &BuiltinRegistry::standard();
+    function.locals = resolveBody(function.parameters, function.body);
+    m_context = nullptr;
+    m_builtins = nullptr;
+}
+
+std::vector<std::string> Resolver::resolveBody(const std::vector<std::string> &parameters, ASTNode *body)
+{
+    std::vector<std::string> locals = parameters;
+    LocalCollector(locals).collect(body);
+
+    const std::vector<std::string> *outer = m_locals;
+    m_locals = &locals;
+    resolveChild(body);
+    m_locals = outer;
+    return locals;
+}
+
+void Resolver::resolveChild(ASTNode *node)
+{
+    if (node) {
+        node->accept(this);
+    }
+}
+
+void Resolver::visit(LiteralNode *node)
+{
+    (void)node;
+}
+
+void Resolver::visit(IdentifierNode *node)
+{
+    // Built-in constants never live in a slot
+    const std::string &name = node->getName();
+    if (name == "pi" || name == "e") {
+        return;
+    }
+
+    if (m_locals) {
+        auto it = std::find(m_locals->begin(), m_locals->end(), name);
+        if (it != m_locals->end()) {
+            node->resolve(SlotRef::FrameDepth, static_cast<std::uint32_t>(it - m_locals->begin()));
+            return;
+        }
+    }
+
+    SlotRef ref = m_context->resolveVariable(name);
+    node->resolve(ref.depth, ref.index);
+}
+
+void Resolver::visit(BinaryOpNode *node)
+{
+    resolveChild(node->getLeft());
+    resolveChild(node->getRight());
+}
+
+void Resolver::visit(UnaryOpNode *node)
+{
+    resolveChild(node->getOperand());
+}
+
+void Resolver::visit(FunctionCallNode *node)
+{
+    // The callee names a function, not a variable, so it is bound to a native
+    // implementation instead of a slot. Unknown names and arity mismatches stay
+    // unbound and are reported when the call executes.
+    node->setBuiltin(nullptr);
+    if (auto *funcNode = nodeCast<IdentifierNode>(node->getFunction())) {
+        const BuiltinFunction *builtin = m_builtins->find(funcNode->getName());
+        if (builtin && builtin->accepts(node->getArguments().size())) {
+            node->setBuiltin(builtin);
+        }
+    }
+
+    for (const auto &arg : node->getArguments()) {
+        resolveChild(arg);
+    }
+}
+
+void Resolver::visit(IfNode *node)
+{
+    resolveChild(node->getCondition());
+    resolveChild(node->getThenBranch());
+    resolveChild(node->getElseBranch());
+}
+
+void Resolver::visit(WhileNode *node)
+{
+    resolveChild(node->getCondition());
+    resolveChild(node->getBody());
+}
+
+void Resolver::visit(ForNode *node)
+{
+    resolveChild(node->getInit());
+    resolveChild(node->getCondition());
+    resolveChild(node->getUpdate());
+    resolveChild(node->getBody());
+}
+
+void Resolver::visit(BlockNode *node)
+{
+    for (const auto &statement : node->getStatements()) {
+        resolveChild(statement);
+    }
+}
+
+void Resolver::visit(FunctionDefNode *node)
+{
+    // Copies of the body made when the definition runs keep these bindings
+    if (!node->isResolved()) {
+        node->setLocals(resolveBody(node->getParameters(), node->getBody()));
+    }
+}
+
+void Resolver::visit(ReturnNode *node)
+{
+    resolveChild(node->getValue());
+}
+
+void Resolver::visit(PrintNode *node)
+{
+    for (const auto &expr : node->getExpressions()) {
+        resolveChild(expr);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ast.h"
+#include <string>
+#include <vector>
+
+class BuiltinRegistry;
+class Context;
+struct UserFunction;
+
+/**
+ * @brief Binds variable references in an AST to Context slots
+ *
+ * Runs once after parsing. Every IdentifierNode that names a variable gets
+ * the (scope depth, slot index) address it will use at run time, so neither
+ * the evaluator nor the VM has to look variables up by name. Function calls
+ * are bound to their native implementation the same way.
+ *
+ * Inside a function body, parameters and variables assigned with '=' are
+ * locals bound to the call frame (SlotRef::FrameDepth); every other name
+ * refers to a global.
+ */
+class Resolver : public ASTVisitor
+{
+public:
+    Resolver();
+
+    /**
+     * @brief Resolve all variable references in a tree
+     * @param root Root node of the AST
+     * @param context The context the tree will be executed in
+     * @param builtins Functions available to calls (the standard table if null)
+     */
+    void resolve(ASTNode *root, Context *context, const BuiltinRegistry *builtins = nullptr);
+
+    /**
+     * @brief Resolve the body of a function and compute its frame layout
+     * @param function Function whose body and locals are bound
+     * @param context The context the function will be called in
+     * @param builtins Functions available to calls (the standard table if null)
+     */
+    void resolveFunction(UserFunction &function, Context *context, const BuiltinRegistry *builtins = nullptr);
+
+    // ASTVisitor interface
+    void visit(LiteralNode *node) override;
+    void visit(IdentifierNode *node) override;
+    void visit(BinaryOpNode *node) override;
+    void visit(UnaryOpNode *node) override;
+    void visit(FunctionCallNode *node) override;
+    void visit(IfNode *node) override;
+    void visit(WhileNode *node) override;
+    void visit(ForNode *node) override;
+    void visit(BlockNode *node) override;
+    void visit(FunctionDefNode *node) override;
+    void visit(ReturnNode *node) override;
+    void visit(PrintNode *node) override;
+
+private:
+    void resolveChild(ASTNode *node);
+    std::vector<std::string> resolveBody(const std::vector<std::string> &parameters, ASTNode *body);
+
+    Context *m_context;
+    const BuiltinRegistry *m_builtins;
+    const std::vector<std::string> *m_locals; // Frame layout of the function being resolved, if any
+};
@@ -0,0 +1,637 @@
+#include "server.h"
+#include "interpreter.h"
+#include "outputsink.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Latencies kept for the percentiles of ":stats"
+constexpr size_t LatencyWindow = 4096;
+
+// Keep an answer on one line
+void appendEscaped(std::string &out, std::string_view text)
+{
+    for (char c : text) {
+        if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (c == '\\') {
+            out += "\\\\";
+        } else {
+            out += c;
+        }
+    }
+}
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // anonymous namespace
+
+#ifdef __linux__
+
+namespace
+{
+
+// Event loop tokens that are not connections
+constexpr std::uint64_t ListenerToken = 0;
+constexpr std::uint64_t WakeToken = 1;
+
+std::runtime_error systemError(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // anonymous namespace
+
+struct Server::State {
+    struct Request {
+        std::string text;
+        Clock::time_point received;
+    };
+
+    /**
+     * @brief One client; the session and the batch belong to a worker while busy
+     */
+    struct Connection {
+        std::uint64_t token = 0;
+        int fd = -1;
+        std::string input;            // Bytes after the last complete line
+        std::deque<Request> pending;  // Received, waiting for the running batch
+        std::string output;           // Answers not yet written
+        bool busy = false;            // A batch is running on a worker
+        bool peerClosed = false;      // No more requests will come
+        bool quit = false;            // Close once the output is written
+        std::uint32_t watched = EPOLLIN; // Events registered with epoll
+
+        std::unique_ptr<Interpreter> session;
+        std::string printed;          // Output of the request being answered
+        std::vector<Request> batch;
+        std::string answers;          // Answers of the finished batch
+        size_t batchErrors = 0;
+    };
+
+    int epollFd = -1;
+    int listenFd = -1;
+    std::string socketPath; // Removed on destruction
+    std::unordered_map<std::uint64_t, std::shared_ptr<Connection>> connections;
+    std::uint64_t nextToken = WakeToken + 1;
+    std::unique_ptr<ThreadPool> pool;
+
+    std::mutex doneMutex;
+    std::vector<std::shared_ptr<Connection>> done; // Batches finished since the last wake-up
+
+    mutable std::mutex statsMutex;
+    Statistics stats;
+    double totalLatency = 0.0;
+    std::vector<double> latencies; // Ring of the most recent latencies
+    size_t nextLatency = 0;
+
+    ~State()
+    {
+        pool.reset(); // Running batches finish before their connections go away
+        for (auto &entry : connections) {
+            if (entry.second->fd >= 0) {
+                close(entry.second->fd);
+            }
+        }
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        if (epollFd >= 0) {
+            close(epollFd);
+        }
+        if (!socketPath.empty()) {
+            unlink(socketPath.c_str());
+        }
+    }
+
+    void watch(int fd, std::uint64_t token, std::uint32_t events, int operation)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = token;
+        if (epoll_ctl(epollFd, operation, fd, &event) < 0) {
+            throw systemError("Could not watch a socket");
+        }
+    }
+
+    void record(size_t answered, size_t errors, Clock::time_point received, Clock::time_point now)
+    {
+        double latency = std::chrono::duration<double, std::micro>(now - received).count();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.requests += answered;
+        stats.errors += errors;
+        stats.queueDepth -= answered;
+        totalLatency += latency * static_cast<double>(answered);
+        stats.maxLatencyMicroseconds = std::max(stats.maxLatencyMicroseconds, latency);
+        for (size_t i = 0; i < answered; ++i) {
+            if (latencies.size() < LatencyWindow) {
+                latencies.push_back(latency);
+            } else {
+                latencies[nextLatency] = latency;
+                nextLatency = (nextLatency + 1) % LatencyWindow;
+            }
+        }
+    }
+
+    void received(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.queueDepth += count;
+        stats.maxQueueDepth = std::max(stats.maxQueueDepth, stats.queueDepth);
+    }
+};
+
+Server::Server(const Options &options)
+    : m_options(options)
+    , m_state(std::make_unique<State>())
+    , m_stopping(false)
+    , m_wakeFd(-1)
+{
+    m_state->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_state->epollFd < 0 || m_wakeFd < 0) {
+        if (m_wakeFd >= 0) {
+            close(m_wakeFd);
+        }
+        throw systemError("Could not create the event loop");
+    }
+    m_state->watch(m_wakeFd, WakeToken, EPOLLIN, EPOLL_CTL_ADD);
+    m_state->pool = std::make_unique<ThreadPool>(options.workers);
+}
+
+Server::~Server()
+{
+    m_state.reset();
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+    }
+}
+
+void Server::listen(const std::string &address)
+{
+    if (m_state->listenFd >= 0) {
+        throw std::runtime_error("The server is already listening");
+    }
+
+    bool isPort = !address.empty() && std::all_of(address.begin(), address.end(), ::isdigit);
+    size_t colon = address.rfind(':');
+    bool isInet = isPort || (colon != std::string::npos && colon + 1 < address.size() &&
+                             std::all_of(address.begin() + colon + 1, address.end(), ::isdigit));
+    int fd = socket(isInet ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw systemError("Could not create a socket");
+    }
+
+    int result;
+    if (isInet) {
+        sockaddr_in inet{};
+        inet.sin_family = AF_INET;
+        std::string host = isPort ? "127.0.0.1" : address.substr(0, colon);
+        unsigned long port = std::stoul(isPort ? address : address.substr(colon + 1));
+        if (port > 65535 || inet_pton(AF_INET, host.c_str(), &inet.sin_addr) != 1) {
+            close(fd);
+            throw std::runtime_error("Invalid address '" + address + "'");
+        }
+        inet.sin_port = htons(static_cast<std::uint16_t>(port));
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        result = bind(fd, reinterpret_cast<sockaddr *>(&inet), sizeof(inet));
+    } else {
+        sockaddr_un local{};
+        local.sun_family = AF_UNIX;
+        if (address.empty() || address.size() >= sizeof(local.sun_path)) {
+            close(fd);
+            throw std::runtime_error("Invalid socket path '" + address + "'");
+        }
+        std::memcpy(local.sun_path, address.c_str(), address.size() + 1);
+        // A socket left behind by a server that did not exit cleanly is replaced
+        struct stat info;
+        if (stat(address.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            unlink(address.c_str());
+        }
+        result = bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local));
+    }
+    if (result < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        std::runtime_error error = systemError("Could not listen on '" + address + "'");
+        close(fd);
+        throw error;
+    }
+
+    m_state->listenFd = fd;
+    m_state->watch(fd, ListenerToken, EPOLLIN, EPOLL_CTL_ADD);
+    if (isInet) {
+        sockaddr_in bound{};
+        socklen_t length = sizeof(bound);
+        getsockname(fd, reinterpret_cast<sockaddr *>(&bound), &length);
+        char host[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &bound.sin_addr, host, sizeof(host));
+        m_address = std::string(host) + ":" + std::to_string(ntohs(bound.sin_port));
+    } else {
+        m_state->socketPath = address;
+        m_address = address;
+    }
+}
+
+void Server::stop()
+{
+    m_stopping.store(true);
+    std::uint64_t one = 1;
+    ssize_t written = write(m_wakeFd, &one, sizeof(one));
+    (void)written; // A full counter already wakes the loop
+}
+
+void Server::run()
+{
+    if (m_state->listenFd < 0) {
+        throw std::runtime_error("The server is not listening");
+    }
+    State &state = *m_state;
+    using Connection = State::Connection;
+
+    auto flush = [&](Connection &connection) {
+        while (!connection.output.empty() && connection.fd >= 0) {
+            ssize_t sent = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    connection.output.clear(); // The client went away; its answers are dropped
+                    connection.quit = true;
+                }
+                break;
+            }
+            connection.output.erase(0, static_cast<size_t>(sent));
+        }
+    };
+
+    auto closeConnection = [&](Connection &connection) {
+        if (connection.fd < 0) {
+            return;
+        }
+        epoll_ctl(state.epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        connection.fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(state.statsMutex);
+            --state.stats.connections;
+            state.stats.queueDepth -= connection.pending.size(); // A running batch is counted when it ends
+        }
+        connection.pending.clear();
+        state.connections.erase(connection.token); // A worker may still hold it
+    };
+
+    // Answers ":" commands and starts the next batch; commands wait for the batches before them
+    std::function<void(const std::shared_ptr<Connection> &)> process;
+    process = [&](const std::shared_ptr<Connection> &connection) {
+        Connection &c = *connection;
+        while (!c.busy && !c.quit && !c.pending.empty()) {
+            if (c.pending.front().text[0] == ':') {
+                State::Request request = std::move(c.pending.front());
+                c.pending.pop_front();
+                bool failed = false;
+                if (request.text == ":stats") {
+                    c.output += "ok " + statisticsJson() + "\n";
+                } else if (request.text == ":reset") {
+                    c.session.reset();
+                    c.output += "ok\n";
+                } else if (request.text == ":quit") {
+                    c.output += "ok\n";
+                    c.quit = true;
+                } else {
+                    c.output += "error Unknown command: ";
+                    appendEscaped(c.output, request.text);
+                    c.output += "\n";
+                    failed = true;
+                }
+                state.record(1, failed ? 1 : 0, request.received, Clock::now());
+                continue;
+            }
+
+            c.batch.clear();
+            while (!c.pending.empty() && c.pending.front().text[0] != ':') {
+                c.batch.push_back(std::move(c.pending.front()));
+                c.pending.pop_front();
+            }
+            c.busy = true;
+            state.pool->submit([this, connection] {
+                Connection &worker = *connection;
+                std::string answers;
+                size_t errors = 0;
+                if (!worker.session) {
+                    auto session = std::make_unique<Interpreter>();
+                    session->setOptimizationLevel(m_options.optimizationLevel);
+                    session->setFastMath(m_options.fastMath);
+                    session->setLimits(m_options.limits);
+                    session->setOutput(std::make_unique<CallbackSink>(
+                        [&worker](const std::string &text) { worker.printed += text; }));
+                    for (const std::string &snapshot : m_options.snapshots) {
+                        session->loadSnapshot(snapshot); // Checked when the server started
+                    }
+                    worker.session = std::move(session);
+                }
+                for (const State::Request &request : worker.batch) {
+                    worker.printed.clear();
+                    Interpreter::Result result = worker.session->evaluate(request.text);
+                    for (size_t start = 0; start < worker.printed.size();) {
+                        size_t end = worker.printed.find('\n', start);
+                        end = end == std::string::npos ? worker.printed.size() : end;
+                        answers += "out ";
+                        appendEscaped(answers, std::string_view(worker.printed).substr(start, end - start));
+                        answers += "\n";
+                        start = end + 1;
+                    }
+                    if (result.ok()) {
+                        answers += "ok";
+                        if (result.value.getType() != Value::Null) {
+                            answers += " ";
+                            appendEscaped(answers, result.value.toString());
+                        }
+                    } else {
+                        answers += "error ";
+                        appendEscaped(answers, result.error);
+                        ++errors;
+                    }
+                    answers += "\n";
+                }
+                worker.answers = std::move(answers);
+                worker.batchErrors = errors;
+                {
+                    std::lock_guard<std::mutex> lock(m_state->doneMutex);
+                    m_state->done.push_back(connection);
+                }
+                std::uint64_t one = 1;
+                ssize_t written = write(m_wakeFd, &one, sizeof(one));
+                (void)written;
+            });
+        }
+
+        if (!c.busy && c.pending.empty() && c.peerClosed) {
+            c.quit = true;
+        }
+        flush(c);
+        if (c.fd < 0) {
+            return;
+        }
+        if (c.quit && (c.output.empty() || c.peerClosed)) {
+            closeConnection(c);
+            return;
+        }
+        // After EOF, which stays readable, only writes are watched: the loop would spin on it otherwise
+        std::uint32_t events = 0;
+        if (!c.peerClosed) {
+            events |= EPOLLIN;
+        }
+        if (!c.output.empty()) {
+            events |= EPOLLOUT;
+        }
+        if (events != c.watched) {
+            state.watch(c.fd, c.token, events, EPOLL_CTL_MOD);
+            c.watched = events;
+        }
+    };
+
+    auto finishBatches = [&] {
+        std::vector<std::shared_ptr<Connection>> finished;
+        {
+            std::lock_guard<std::mutex> lock(state.doneMutex);
+            finished.swap(state.done);
+        }
+        Clock::time_point now = Clock::now();
+        for (const std::shared_ptr<Connection> &connection : finished) {
+            Connection &c = *connection;
+            for (const State::Request &request : c.batch) {
+                state.record(1, 0, request.received, now);
+            }
+            {
+                std::lock_guard<std::mutex> lock(state.statsMutex);
+                state.stats.errors += c.batchErrors;
+            }
+            c.busy = false;
+            c.batch.clear();
+            if (c.fd >= 0) {
+                c.output += c.answers;
+                c.answers.clear();
+                process(connection);
+            }
+        }
+    };
+
+    auto readFrom = [&](const std::shared_ptr<Connection> &connection) {
+        Connection &c = *connection;
+        char buffer[65536];
+        while (!c.peerClosed) {
+            ssize_t count = recv(c.fd, buffer, sizeof(buffer), 0);
+            if (count > 0) {
+                c.input.append(buffer, static_cast<size_t>(count));
+                continue;
+            }
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                c.peerClosed = true;
+            }
+            break;
+        }
+
+        Clock::time_point now = Clock::now();
+        size_t start = 0;
+        size_t count = 0;
+        for (size_t end; (end = c.input.find('\n', start)) != std::string::npos; start = end + 1) {
+            size_t length = end - start;
+            if (length > 0 && c.input[end - 1] == '\r') {
+                --length;
+            }
+            if (length > 0) {
+                c.pending.push_back(State::Request{c.input.substr(start, length), now});
+                ++count;
+            }
+        }
+        c.input.erase(0, start);
+        state.received(count);
+        if (c.input.size() > m_options.maxRequestSize) {
+            c.pending.clear();
+            {
+                std::lock_guard<std::mutex> lock(state.statsMutex);
+                state.stats.queueDepth -= count;
+            }
+            c.output += "error Request too long\n";
+            c.quit = true;
+        }
+        process(connection);
+    };
+
+    auto acceptAll = [&] {
+        while (true) {
+            int fd = accept4(state.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                return; // EAGAIN, or out of descriptors until a connection closes
+            }
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)); // Fails harmlessly on Unix sockets
+            auto connection = std::make_shared<Connection>();
+            connection->fd = fd;
+            connection->token = state.nextToken++;
+            state.watch(fd, connection->token, EPOLLIN, EPOLL_CTL_ADD);
+            state.connections.emplace(connection->token, connection);
+            std::lock_guard<std::mutex> lock(state.statsMutex);
+            ++state.stats.connections;
+            ++state.stats.totalConnections;
+        }
+    };
+
+    epoll_event events[64];
+    while (!m_stopping.load()) {
+        int count = epoll_wait(state.epollFd, events, 64, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw systemError("Event loop failed");
+        }
+        for (int i = 0; i < count; ++i) {
+            std::uint64_t token = events[i].data.u64;
+            if (token == ListenerToken) {
+                acceptAll();
+            } else if (token == WakeToken) {
+                std::uint64_t value;
+                ssize_t drained = read(m_wakeFd, &value, sizeof(value));
+                (void)drained;
+                finishBatches();
+            } else {
+                auto found = state.connections.find(token);
+                if (found == state.connections.end()) {
+                    continue; // Closed earlier in this round
+                }
+                std::shared_ptr<Connection> connection = found->second;
+                if (connection->peerClosed && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                    // Reported whatever is watched; once the client has gone both ways nothing can be sent
+                    closeConnection(*connection);
+                } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readFrom(connection);
+                } else if (events[i].events & EPOLLOUT) {
+                    process(connection);
+                }
+            }
+        }
+    }
+
+    // Let running batches finish and send what can be sent without waiting
+    state.pool->wait();
+    finishBatches();
+    std::vector<std::shared_ptr<Connection>> open;
+    for (auto &entry : state.connections) {
+        open.push_back(entry.second);
+    }
+    for (const std::shared_ptr<Connection> &connection : open) {
+        flush(*connection);
+        closeConnection(*connection);
+    }
+}
+
+#else
+
+struct Server::State {
+    Statistics stats;
+    double totalLatency = 0.0;
+    std::vector<double> latencies;
+    mutable std::mutex statsMutex;
+};
+
+Server::Server(const Options &options)
+    : m_options(options)
+    , m_state(std::make_unique<State>())
+    , m_stopping(false)
+    , m_wakeFd(-1)
+{
+}
+
+Server::~Server() = default;
+
+void Server::listen(const std::string &)
+{
+    throw std::runtime_error("Server mode needs Linux (epoll)");
+}
+
+void Server::run()
+{
+    throw std::runtime_error("Server mode needs Linux (epoll)");
+}
+
+void Server::stop()
+{
+    m_stopping.store(true);
+}
+
+#endif
+
+Server::Statistics Server::statistics() const
+{
+    std::vector<double> latencies;
+    Statistics statistics;
+    {
+        std::lock_guard<std::mutex> lock(m_state->statsMutex);
+        statistics = m_state->stats;
+        latencies = m_state->latencies;
+        if (statistics.requests > 0) {
+            statistics.meanLatencyMicroseconds = m_state->totalLatency / static_cast<double>(statistics.requests);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    statistics.p50LatencyMicroseconds = percentile(latencies, 0.50);
+    statistics.p99LatencyMicroseconds = percentile(latencies, 0.99);
+    return statistics;
+}
+
+std::string Server::statisticsJson() const
+{
+    Statistics s = statistics();
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(1);
+    json << "{\"connections\": " << s.connections << ", \"total_connections\": " << s.totalConnections
+         << ", \"requests\": " << s.requests << ", \"errors\": " << s.errors << ", \"queue_depth\": " << s.queueDepth
+         << ", \"max_queue_depth\": " << s.maxQueueDepth << ", \"latency_us\": {\"mean\": "
+         << s.meanLatencyMicroseconds << ", \"p50\": " << s.p50LatencyMicroseconds << ", \"p99\": "
+         << s.p99LatencyMicroseconds << ", \"max\": " << s.maxLatencyMicroseconds << "}}";
+    return json.str();
+}
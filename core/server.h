@@ -0,0 +1,117 @@
+#pragma once
+
+#include "budget.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Evaluates GlossAI requests from many clients over sockets
+ *
+ * Clients connect over TCP or a Unix socket and send newline-terminated
+ * requests, each one statement or expression (empty lines are ignored).
+ * Every connection has a session of its own, an Interpreter created on its
+ * first request, so variables persist and the parsed-program cache is
+ * reused across the connection's requests. Clients may send many requests
+ * without waiting for answers: the lines that arrived together run as one
+ * batch on a worker thread, in order, and are answered with one write.
+ * Different connections run in parallel.
+ *
+ * For each request the server sends the lines it printed as "out <text>",
+ * then "ok <result>" ("ok" alone for statements) or "error <message>".
+ * Newlines and backslashes inside text are sent as \n and \\. Lines that
+ * start with ':' are server commands: ":stats" answers "ok <json>" with
+ * connection and request counters, queue depth and latencies; ":reset"
+ * gives the connection a fresh session; ":quit" closes it once the answers
+ * before it have been sent.
+ *
+ * The event loop uses epoll, so the server is only available on Linux.
+ */
+class Server
+{
+public:
+    struct Options {
+        size_t workers = 0;                 // Worker threads; 0 = one per core
+        int optimizationLevel = 0;          // As Interpreter::setOptimizationLevel()
+        bool fastMath = false;              // As Interpreter::setFastMath()
+        ExecutionLimits limits;             // Applied to every request
+        std::vector<std::string> snapshots; // .gloc files loaded into every new session
+        size_t maxRequestSize = 1 << 20;    // A longer line closes the connection
+    };
+
+    /**
+     * @brief Counters of a running server
+     *
+     * Latencies run from the arrival of a request to its answer being queued
+     * for writing. Percentiles are over the most recent requests.
+     */
+    struct Statistics {
+        std::uint64_t connections = 0;      // Open now
+        std::uint64_t totalConnections = 0; // Accepted since start
+        std::uint64_t requests = 0;         // Answered
+        std::uint64_t errors = 0;           // Answered with an error
+        std::uint64_t queueDepth = 0;       // Received and not yet answered
+        std::uint64_t maxQueueDepth = 0;
+        double meanLatencyMicroseconds = 0.0;
+        double p50LatencyMicroseconds = 0.0;
+        double p99LatencyMicroseconds = 0.0;
+        double maxLatencyMicroseconds = 0.0;
+    };
+
+    explicit Server(const Options &options);
+
+    /**
+     * @brief Stop the workers, close every connection and remove the socket file
+     */
+    ~Server();
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    /**
+     * @brief Start listening
+     * @param address A port ("8080", on the loopback interface), an IPv4
+     *                address and port ("0.0.0.0:8080") or the path of a Unix socket
+     * @throws std::runtime_error if the socket cannot be created or bound
+     */
+    void listen(const std::string &address);
+
+    /**
+     * @brief Where the server listens, with the actual port if 0 was asked for
+     */
+    const std::string &address() const { return m_address; }
+
+    /**
+     * @brief Serve connections until stop() is called
+     *
+     * Batches that are running when the server stops are finished and their
+     * answers sent if the sockets accept them without blocking.
+     */
+    void run();
+
+    /**
+     * @brief Make run() return; safe from any thread and from signal handlers
+     */
+    void stop();
+
+    /**
+     * @brief Current counters (any thread)
+     */
+    Statistics statistics() const;
+
+    /**
+     * @brief Current counters as one line of JSON, as answered to ":stats"
+     */
+    std::string statisticsJson() const;
+
+private:
+    struct State;
+
+    Options m_options;
+    std::string m_address;
+    std::unique_ptr<State> m_state;
+    std::atomic<bool> m_stopping;
+    int m_wakeFd; // Tells the event loop that batches finished or that it should stop
+};
@@ -0,0 +1,463 @@
+#include "snapshot.h"
+#include "context.h"
+#include "program.h"
+#include "resolver.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+const char Magic[4] = {'G', 'L', 'O', 'C'};
+
+// Tag written before every node; NoNode stands for a missing child
+enum NodeTag : std::uint8_t {
+    NoNode,
+    LiteralTag,
+    IdentifierTag,
+    BinaryOpTag,
+    UnaryOpTag,
+    FunctionCallTag,
+    IfTag,
+    WhileTag,
+    ForTag,
+    BlockTag,
+    FunctionDefTag,
+    ReturnTag,
+    PrintTag
+};
+
+/**
+ * @brief Encodes values and trees, collecting the strings they use into one table
+ *
+ * Bindings made by the Resolver are not written: slot indices belong to the
+ * saving context, so restored trees are resolved again.
+ */
+class Writer : public ASTVisitor
+{
+public:
+    void u8(std::uint8_t value) { m_body += static_cast<char>(value); }
+
+    void u32(std::uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8) {
+            m_body += static_cast<char>((value >> shift) & 0xFF);
+        }
+    }
+
+    void number(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        for (int shift = 0; shift < 64; shift += 8) {
+            m_body += static_cast<char>((bits >> shift) & 0xFF);
+        }
+    }
+
+    void string(const std::string &text)
+    {
+        auto inserted = m_index.emplace(text, static_cast<std::uint32_t>(m_strings.size()));
+        if (inserted.second) {
+            m_strings.push_back(&inserted.first->first);
+        }
+        u32(inserted.first->second);
+    }
+
+    void strings(const std::vector<std::string> &texts)
+    {
+        u32(static_cast<std::uint32_t>(texts.size()));
+        for (const std::string &text : texts) {
+            string(text);
+        }
+    }
+
+    void value(const Value &value)
+    {
+        u8(value.getType());
+        switch (value.getType()) {
+        case Value::Boolean: u8(value.toBool() ? 1 : 0); break;
+        case Value::Number: number(value.asNumber()); break;
+        case Value::String: string(value.asString()); break;
+        case Value::Array:
+            u32(static_cast<std::uint32_t>(value.asArray().size()));
+            for (double element : value.asArray()) {
+                number(element);
+            }
+            break;
+        case Value::Null: break;
+        }
+    }
+
+    void node(ASTNode *node)
+    {
+        if (node) {
+            node->accept(this);
+        } else {
+            u8(NoNode);
+        }
+    }
+
+    void list(NodeList nodes)
+    {
+        u32(static_cast<std::uint32_t>(nodes.size()));
+        for (ASTNode *node : nodes) {
+            this->node(node);
+        }
+    }
+
+    void visit(LiteralNode *node) override
+    {
+        u8(LiteralTag);
+        value(node->getValue());
+    }
+    void visit(IdentifierNode *node) override
+    {
+        u8(IdentifierTag);
+        string(node->getName());
+    }
+    void visit(BinaryOpNode *node) override
+    {
+        u8(BinaryOpTag);
+        u8(static_cast<std::uint8_t>(node->getOperator()));
+        this->node(node->getLeft());
+        this->node(node->getRight());
+    }
+    void visit(UnaryOpNode *node) override
+    {
+        u8(UnaryOpTag);
+        u8(static_cast<std::uint8_t>(node->getOperator()));
+        this->node(node->getOperand());
+    }
+    void visit(FunctionCallNode *node) override
+    {
+        u8(FunctionCallTag);
+        this->node(node->getFunction());
+        list(node->getArguments());
+    }
+    void visit(IfNode *node) override
+    {
+        u8(IfTag);
+        this->node(node->getCondition());
+        this->node(node->getThenBranch());
+        this->node(node->getElseBranch());
+    }
+    void visit(WhileNode *node) override
+    {
+        u8(WhileTag);
+        this->node(node->getCondition());
+        this->node(node->getBody());
+    }
+    void visit(ForNode *node) override
+    {
+        u8(ForTag);
+        this->node(node->getInit());
+        this->node(node->getCondition());
+        this->node(node->getUpdate());
+        this->node(node->getBody());
+    }
+    void visit(BlockNode *node) override
+    {
+        u8(BlockTag);
+        list(node->getStatements());
+    }
+    void visit(FunctionDefNode *node) override
+    {
+        u8(FunctionDefTag);
+        string(node->getName());
+        strings(node->getParameters());
+        this->node(node->getBody());
+    }
+    void visit(ReturnNode *node) override
+    {
+        u8(ReturnTag);
+        this->node(node->getValue());
+    }
+    void visit(PrintNode *node) override
+    {
+        u8(PrintTag);
+        list(node->getExpressions());
+    }
+
+    /**
+     * @brief Assemble the header, the string table and everything written so far
+     */
+    std::string finish()
+    {
+        std::string body = std::move(m_body);
+        m_body.assign(Magic, sizeof Magic);
+        u32(Snapshot::Version);
+        u32(static_cast<std::uint32_t>(m_strings.size()));
+        for (const std::string *text : m_strings) {
+            u32(static_cast<std::uint32_t>(text->size()));
+            m_body += *text;
+        }
+        m_body += body;
+        return std::move(m_body);
+    }
+
+private:
+    std::string m_body;
+    std::unordered_map<std::string, std::uint32_t> m_index;
+    std::vector<const std::string *> m_strings; // Keys of m_index in table order
+};
+
+/**
+ * @brief Decodes a snapshot into nodes of a Program, checking every read
+ */
+class Reader
+{
+public:
+    Reader(std::string_view data, Program &program) : m_data(data), m_position(0), m_program(program) {}
+
+    void header()
+    {
+        need(sizeof Magic);
+        if (std::memcmp(m_data.data(), Magic, sizeof Magic) != 0) {
+            throw std::runtime_error("Not a GlossAI snapshot");
+        }
+        m_position += sizeof Magic;
+        std::uint32_t version = u32();
+        if (version != Snapshot::Version) {
+            throw std::runtime_error("Unsupported snapshot version " + std::to_string(version) + " (expected " +
+                                     std::to_string(Snapshot::Version) + ")");
+        }
+
+        std::uint32_t count = u32();
+        need(count); // Every entry takes at least a byte; rejects absurd counts before allocating
+        m_strings.reserve(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint32_t size = u32();
+            need(size);
+            m_strings.emplace_back(m_data.substr(m_position, size));
+            m_position += size;
+        }
+    }
+
+    bool atEnd() const { return m_position == m_data.size(); }
+
+    std::uint8_t u8()
+    {
+        need(1);
+        return static_cast<std::uint8_t>(m_data[m_position++]);
+    }
+
+    std::uint32_t u32()
+    {
+        need(4);
+        std::uint32_t value = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            value |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(m_data[m_position++])) << shift;
+        }
+        return value;
+    }
+
+    /// Element count that is followed by at least one byte per element
+    std::uint32_t count()
+    {
+        std::uint32_t value = u32();
+        need(value);
+        return value;
+    }
+
+    double number()
+    {
+        need(8);
+        std::uint64_t bits = 0;
+        for (int shift = 0; shift < 64; shift += 8) {
+            bits |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(m_data[m_position++])) << shift;
+        }
+        double value;
+        std::memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+
+    const std::string &string()
+    {
+        std::uint32_t index = u32();
+        if (index >= m_strings.size()) {
+            corrupt();
+        }
+        return m_strings[index];
+    }
+
+    std::vector<std::string> strings()
+    {
+        std::vector<std::string> texts(count());
+        for (std::string &text : texts) {
+            text = string();
+        }
+        return texts;
+    }
+
+    Value value()
+    {
+        switch (u8()) {
+        case Value::Null: return Value();
+        case Value::Boolean: return Value(u8() != 0);
+        case Value::Number: return Value(number());
+        case Value::String: return Value(string());
+        case Value::Array: {
+            std::vector<double> elements(count());
+            for (double &element : elements) {
+                element = number();
+            }
+            return Value(std::move(elements));
+        }
+        default: corrupt();
+        }
+    }
+
+    ASTNode *node()
+    {
+        switch (u8()) {
+        case NoNode:
+            return nullptr;
+        case LiteralTag:
+            return m_program.make<LiteralNode>(value());
+        case IdentifierTag:
+            return m_program.make<IdentifierNode>(string());
+        case BinaryOpTag: {
+            auto op = enumerator<BinaryOperator>(BinaryOperator::DivideAssign);
+            ASTNode *left = node();
+            return m_program.make<BinaryOpNode>(left, op, node());
+        }
+        case UnaryOpTag: {
+            auto op = enumerator<UnaryOperator>(UnaryOperator::PostDecrement);
+            return m_program.make<UnaryOpNode>(op, node());
+        }
+        case FunctionCallTag: {
+            ASTNode *function = node();
+            return m_program.make<FunctionCallNode>(function, list());
+        }
+        case IfTag: {
+            ASTNode *condition = node();
+            ASTNode *thenBranch = node();
+            return m_program.make<IfNode>(condition, thenBranch, node());
+        }
+        case WhileTag: {
+            ASTNode *condition = node();
+            return m_program.make<WhileNode>(condition, node());
+        }
+        case ForTag: {
+            ASTNode *init = node();
+            ASTNode *condition = node();
+            ASTNode *update = node();
+            return m_program.make<ForNode>(init, condition, update, node());
+        }
+        case BlockTag:
+            return m_program.make<BlockNode>(list());
+        case FunctionDefTag:
+            return definition();
+        case ReturnTag:
+            return m_program.make<ReturnNode>(node());
+        case PrintTag:
+            return m_program.make<PrintNode>(list());
+        default:
+            corrupt();
+        }
+    }
+
+    FunctionDefNode *definition()
+    {
+        std::string name = string();
+        std::vector<std::string> parameters = strings();
+        return m_program.make<FunctionDefNode>(name, parameters, node());
+    }
+
+private:
+    void need(size_t bytes) const
+    {
+        if (m_data.size() - m_position < bytes) {
+            corrupt();
+        }
+    }
+
+    template <typename Enum>
+    Enum enumerator(Enum last)
+    {
+        std::uint8_t value = u8();
+        if (value > static_cast<std::uint8_t>(last)) {
+            corrupt();
+        }
+        return static_cast<Enum>(value);
+    }
+
+    NodeList list()
+    {
+        std::vector<ASTNode *> nodes(count());
+        for (ASTNode *&node : nodes) {
+            node = this->node();
+        }
+        return m_program.makeList(nodes);
+    }
+
+    [[noreturn]] static void corrupt() { throw std::runtime_error("Corrupt snapshot"); }
+
+    std::string_view m_data;
+    size_t m_position;
+    Program &m_program;
+    std::vector<std::string> m_strings;
+};
+
+} // anonymous namespace
+
+std::string Snapshot::save(const Context &context)
+{
+    // Sorted, so that saving the same state always gives the same bytes
+    auto variables = context.getCurrentScopeVariables();
+    std::vector<std::pair<std::string, Value>> sortedVariables(variables.begin(), variables.end());
+    std::sort(sortedVariables.begin(), sortedVariables.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    auto functions = context.getFunctions();
+    std::vector<std::pair<std::string, UserFunction>> sortedFunctions(functions.begin(), functions.end());
+    std::sort(sortedFunctions.begin(), sortedFunctions.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    Writer writer;
+    writer.u32(static_cast<std::uint32_t>(sortedVariables.size()));
+    for (const auto &variable : sortedVariables) {
+        writer.string(variable.first);
+        writer.value(variable.second);
+    }
+    writer.u32(static_cast<std::uint32_t>(sortedFunctions.size()));
+    for (const auto &function : sortedFunctions) {
+        writer.string(function.first);
+        writer.strings(function.second.parameters);
+        writer.node(function.second.body);
+    }
+    return writer.finish();
+}
+
+void Snapshot::restore(std::string_view data, Context &context, const BuiltinRegistry *builtins)
+{
+    Program program;
+    Reader reader(data, program);
+    reader.header();
+
+    std::vector<std::pair<std::string, Value>> variables(reader.count());
+    for (auto &variable : variables) {
+        variable.first = reader.string();
+        variable.second = reader.value();
+    }
+    std::vector<FunctionDefNode *> functions(reader.count());
+    for (FunctionDefNode *&function : functions) {
+        function = reader.definition();
+    }
+    if (!reader.atEnd()) {
+        throw std::runtime_error("Corrupt snapshot");
+    }
+
+    for (const auto &variable : variables) {
+        context.setVariable(variable.first, variable.second);
+    }
+    for (FunctionDefNode *function : functions) {
+        // Bound against this context; defineFunction() copies the body out of the temporary program
+        Resolver().resolve(function, &context, builtins);
+        context.defineFunction(function);
+    }
+}
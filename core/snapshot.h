@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class BuiltinRegistry;
+class Context;
+
+/**
+ * @brief Binary image of a context's global variables and user functions (.gloc)
+ *
+ * Layout, all integers little-endian: the magic "GLOC", the format version,
+ * a table holding every distinct string once (names and string values),
+ * then the global variables with their values and the user functions with
+ * their parameters and a pre-order encoding of their bodies. Restoring
+ * rebuilds the trees directly, without lexing, parsing or running anything.
+ */
+class Snapshot
+{
+public:
+    /// Layout version; snapshots of other versions are rejected
+    static constexpr std::uint32_t Version = 1;
+
+    /**
+     * @brief Encode the global variables and user functions of a context
+     * @param context Context between executions (only its global scope is saved)
+     * @return The snapshot bytes
+     */
+    static std::string save(const Context &context);
+
+    /**
+     * @brief Add the variables and functions of a snapshot to a context
+     *
+     * Variables and functions that already exist under the same names are
+     * replaced. The whole snapshot is decoded before the context is touched.
+     * @param data Bytes produced by save()
+     * @param context Context to populate
+     * @param builtins Natives that calls in function bodies are bound to (may be nullptr)
+     * @throws std::runtime_error if data is not a valid snapshot; the context is then unchanged
+     */
+    static void restore(std::string_view data, Context &context, const BuiltinRegistry *builtins = nullptr);
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Non-owning view over a contiguous sequence (a minimal C++17 std::span)
+ */
+template <typename T>
+class Span
+{
+public:
+    constexpr Span() : m_data(nullptr), m_size(0) {}
+    constexpr Span(T *data, size_t size) : m_data(data), m_size(size) {}
+
+    template <size_t N>
+    constexpr Span(T (&array)[N]) : m_data(array), m_size(N) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible<U (*)[], T (*)[]>::value>>
+    Span(std::vector<U> &vector) : m_data(vector.data()), m_size(vector.size()) {}
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible<const U (*)[], T (*)[]>::value>>
+    Span(const std::vector<U> &vector) : m_data(vector.data()), m_size(vector.size()) {}
+
+    constexpr T *data() const { return m_data; }
+    constexpr size_t size() const { return m_size; }
+    constexpr bool empty() const { return m_size == 0; }
+
+    constexpr T &operator[](size_t index) const { return m_data[index]; }
+    constexpr T *begin() const { return m_data; }
+    constexpr T *end() const { return m_data + m_size; }
+
+    constexpr Span subspan(size_t offset, size_t count) const { return Span(m_data + offset, count); }
+
+private:
+    T *m_data;
+    size_t m_size;
+};
@@ -0,0 +1,57 @@
+#include "stringtable.h"
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+
+struct Table {
+    std::mutex mutex;
+    std::unordered_map<std::string_view, StringData *> entries; // Keys view StringData::text
+};
+
+Table &table()
+{
+    // Never destroyed, so Values with static storage duration can outlive it safely
+    static Table *instance = new Table();
+    return *instance;
+}
+
+} // anonymous namespace
+
+StringData *StringTable::intern(const std::string &text)
+{
+    Table &t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+
+    auto it = t.entries.find(std::string_view(text));
+    if (it != t.entries.end()) {
+        it->second->refs.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+
+    auto *data = new StringData(text);
+    t.entries.emplace(std::string_view(data->text), data);
+    return data;
+}
+
+void StringTable::releaseLast(StringData *data)
+{
+    Table &t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+
+    // intern() may have handed out a new reference while we waited for the lock
+    if (data->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    t.entries.erase(std::string_view(data->text));
+    delete data;
+}
+
+size_t StringTable::size()
+{
+    Table &t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    return t.entries.size();
+}
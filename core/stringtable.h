@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Shared, immutable string payload referenced by Value
+ *
+ * Each distinct text exists once; Values hold a counted reference to it.
+ */
+struct StringData {
+    std::atomic<std::uint32_t> refs;
+    std::string text;
+
+    explicit StringData(const std::string &str) : refs(1), text(str) {}
+};
+
+/**
+ * @brief Process-wide table of interned strings
+ *
+ * Equal texts share a single StringData, so copying a string Value is a
+ * reference count increment and comparing two strings is usually a pointer
+ * check. Entries are removed when their last reference goes away. All
+ * operations are thread-safe.
+ */
+class StringTable
+{
+public:
+    /**
+     * @brief Get the shared payload for a text
+     * @param text The string contents
+     * @return The interned payload, with one reference owned by the caller
+     */
+    static StringData *intern(const std::string &text);
+
+    /**
+     * @brief Take an additional reference to a payload
+     */
+    static void retain(StringData *data)
+    {
+        data->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Drop a reference, freeing the payload when it was the last one
+     */
+    static void release(StringData *data)
+    {
+        // Only the final reference has to synchronize with intern()
+        std::uint32_t refs = data->refs.load(std::memory_order_relaxed);
+        while (refs > 1) {
+            if (data->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel)) {
+                return;
+            }
+        }
+        releaseLast(data);
+    }
+
+    /**
+     * @brief Get the number of distinct strings currently alive
+     */
+    static size_t size();
+
+private:
+    static void releaseLast(StringData *data);
+};
@@ -6,6 +6,7 @@
 #include <cmath>
 #include <sstream>
 #include "ast.h"
+#include "program.h"
 
 // Test framework for AST testing
 class ASTTestRunner {
@@ -75,6 +76,7 @@ public:
     void visit(BlockNode *node) override { last_visited = "BlockNode"; }
     void visit(FunctionDefNode *node) override { last_visited = "FunctionDefNode"; }
     void visit(ReturnNode *node) override { last_visited = "ReturnNode"; }
+    void visit(PrintNode *node) override { last_visited = "PrintNode"; }
 };
 
 void test_value_constructors() {
@@ -160,15 +162,18 @@ void test_value_comparison_operations() {
 void test_literal_node() {
     std::cout << "\n=== Testing LiteralNode ===" << std::endl;
     
+    // Nodes are owned by the program and freed together with it
+    Program program;
+    
     // Test number literal
     Value numVal(42.0);
-    auto numLiteral = std::make_unique<LiteralNode>(numVal);
+    auto numLiteral = program.make<LiteralNode>(numVal);
     ASTTestRunner::assert_double_equal(42.0, numLiteral->getValue().toNumber(), "LiteralNode stores number value");
     ASTTestRunner::assert_equal("42", numLiteral->toString(), "LiteralNode toString for number");
     
     // Test string literal
     Value strVal("test");
-    auto strLiteral = std::make_unique<LiteralNode>(strVal);
+    auto strLiteral = program.make<LiteralNode>(strVal);
     ASTTestRunner::assert_equal("test", strLiteral->getValue().toString(), "LiteralNode stores string value");
     
     // Test visitor pattern
@@ -180,7 +185,9 @@ void test_literal_node() {
 void test_identifier_node() {
     std::cout << "\n=== Testing IdentifierNode ===" << std::endl;
     
-    auto identifier = std::make_unique<IdentifierNode>("variable_name");
+    Program program;
+    
+    auto identifier = program.make<IdentifierNode>("variable_name");
     ASTTestRunner::assert_equal("variable_name", identifier->getName(), "IdentifierNode stores name");
     ASTTestRunner::assert_equal("variable_name", identifier->toString(), "IdentifierNode toString");
     
@@ -193,12 +200,14 @@ void test_identifier_node() {
 void test_binary_op_node() {
     std::cout << "\n=== Testing BinaryOpNode ===" << std::endl;
     
+    Program program;
+    
     // Create operands
-    auto left = std::make_unique<LiteralNode>(Value(5.0));
-    auto right = std::make_unique<LiteralNode>(Value(3.0));
+    auto left = program.make<LiteralNode>(Value(5.0));
+    auto right = program.make<LiteralNode>(Value(3.0));
     
     // Test addition node
-    auto addNode = std::make_unique<BinaryOpNode>(std::move(left), BinaryOperator::Add, std::move(right));
+    auto addNode = program.make<BinaryOpNode>(left, BinaryOperator::Add, right);
     ASTTestRunner::assert_true(addNode->getOperator() == BinaryOperator::Add, "BinaryOpNode stores operator");
     ASTTestRunner::assert_true(addNode->getLeft() != nullptr, "BinaryOpNode stores left operand");
     ASTTestRunner::assert_true(addNode->getRight() != nullptr, "BinaryOpNode stores right operand");
@@ -209,17 +218,19 @@ void test_binary_op_node() {
     ASTTestRunner::assert_equal("BinaryOpNode", visitor.last_visited, "BinaryOpNode accept calls correct visitor method");
     
     // Test mathematical operations
-    auto left2 = std::make_unique<LiteralNode>(Value(10.0));
-    auto right2 = std::make_unique<LiteralNode>(Value(2.0));
-    auto divNode = std::make_unique<BinaryOpNode>(std::move(left2), BinaryOperator::Divide, std::move(right2));
+    auto left2 = program.make<LiteralNode>(Value(10.0));
+    auto right2 = program.make<LiteralNode>(Value(2.0));
+    auto divNode = program.make<BinaryOpNode>(left2, BinaryOperator::Divide, right2);
     ASTTestRunner::assert_true(divNode->getOperator() == BinaryOperator::Divide, "BinaryOpNode division operator");
 }
 
 void test_unary_op_node() {
     std::cout << "\n=== Testing UnaryOpNode ===" << std::endl;
     
-    auto operand = std::make_unique<LiteralNode>(Value(5.0));
-    auto negateNode = std::make_unique<UnaryOpNode>(UnaryOperator::Negate, std::move(operand));
+    Program program;
+    
+    auto operand = program.make<LiteralNode>(Value(5.0));
+    auto negateNode = program.make<UnaryOpNode>(UnaryOperator::Negate, operand);
     
     ASTTestRunner::assert_true(negateNode->getOperator() == UnaryOperator::Negate, "UnaryOpNode stores operator");
     ASTTestRunner::assert_true(negateNode->getOperand() != nullptr, "UnaryOpNode stores operand");
@@ -233,22 +244,24 @@ void test_unary_op_node() {
 void test_function_call_node() {
     std::cout << "\n=== Testing FunctionCallNode ===" << std::endl;
     
+    Program program;
+    
     // Create function name and arguments for mathematical function
-    auto funcName = std::make_unique<IdentifierNode>("sqrt");
-    std::vector<std::unique_ptr<ASTNode>> args;
-    args.push_back(std::make_unique<LiteralNode>(Value(16.0)));
+    auto funcName = program.make<IdentifierNode>("sqrt");
+    std::vector<ASTNode *> args;
+    args.push_back(program.make<LiteralNode>(Value(16.0)));
     
-    auto funcCall = std::make_unique<FunctionCallNode>(std::move(funcName), std::move(args));
+    auto funcCall = program.make<FunctionCallNode>(funcName, program.makeList(args));
     ASTTestRunner::assert_true(funcCall->getFunction() != nullptr, "FunctionCallNode stores function");
     ASTTestRunner::assert_true(funcCall->getArguments().size() == 1, "FunctionCallNode stores arguments");
     
     // Test mathematical function with multiple arguments
-    auto funcName2 = std::make_unique<IdentifierNode>("pow");
-    std::vector<std::unique_ptr<ASTNode>> args2;
-    args2.push_back(std::make_unique<LiteralNode>(Value(2.0)));
-    args2.push_back(std::make_unique<LiteralNode>(Value(3.0)));
+    auto funcName2 = program.make<IdentifierNode>("pow");
+    std::vector<ASTNode *> args2;
+    args2.push_back(program.make<LiteralNode>(Value(2.0)));
+    args2.push_back(program.make<LiteralNode>(Value(3.0)));
     
-    auto powCall = std::make_unique<FunctionCallNode>(std::move(funcName2), std::move(args2));
+    auto powCall = program.make<FunctionCallNode>(funcName2, program.makeList(args2));
     ASTTestRunner::assert_true(powCall->getArguments().size() == 2, "FunctionCallNode pow function with 2 args");
     
     // Test visitor pattern
@@ -260,21 +273,23 @@ void test_function_call_node() {
 void test_control_flow_nodes() {
     std::cout << "\n=== Testing Control Flow Nodes ===" << std::endl;
     
+    Program program;
+    
     // Test IfNode
-    auto condition = std::make_unique<LiteralNode>(Value(true));
-    auto thenBranch = std::make_unique<LiteralNode>(Value(1.0));
-    auto elseBranch = std::make_unique<LiteralNode>(Value(0.0));
+    auto condition = program.make<LiteralNode>(Value(true));
+    auto thenBranch = program.make<LiteralNode>(Value(1.0));
+    auto elseBranch = program.make<LiteralNode>(Value(0.0));
     
-    auto ifNode = std::make_unique<IfNode>(std::move(condition), std::move(thenBranch), std::move(elseBranch));
+    auto ifNode = program.make<IfNode>(condition, thenBranch, elseBranch);
     ASTTestRunner::assert_true(ifNode->getCondition() != nullptr, "IfNode stores condition");
     ASTTestRunner::assert_true(ifNode->getThenBranch() != nullptr, "IfNode stores then branch");
     ASTTestRunner::assert_true(ifNode->getElseBranch() != nullptr, "IfNode stores else branch");
     
     // Test WhileNode
-    auto whileCondition = std::make_unique<LiteralNode>(Value(true));
-    auto whileBody = std::make_unique<LiteralNode>(Value(1.0));
+    auto whileCondition = program.make<LiteralNode>(Value(true));
+    auto whileBody = program.make<LiteralNode>(Value(1.0));
     
-    auto whileNode = std::make_unique<WhileNode>(std::move(whileCondition), std::move(whileBody));
+    auto whileNode = program.make<WhileNode>(whileCondition, whileBody);
     ASTTestRunner::assert_true(whileNode->getCondition() != nullptr, "WhileNode stores condition");
     ASTTestRunner::assert_true(whileNode->getBody() != nullptr, "WhileNode stores body");
     
@@ -290,41 +305,43 @@ void test_control_flow_nodes() {
 void test_complex_mathematical_expressions() {
     std::cout << "\n=== Testing Complex Mathematical Expressions ===" << std::endl;
     
+    Program program;
+    
     // Test nested arithmetic: (5 + 3) * 2
-    auto left_inner = std::make_unique<LiteralNode>(Value(5.0));
-    auto right_inner = std::make_unique<LiteralNode>(Value(3.0));
-    auto addition = std::make_unique<BinaryOpNode>(std::move(left_inner), BinaryOperator::Add, std::move(right_inner));
+    auto left_inner = program.make<LiteralNode>(Value(5.0));
+    auto right_inner = program.make<LiteralNode>(Value(3.0));
+    auto addition = program.make<BinaryOpNode>(left_inner, BinaryOperator::Add, right_inner);
     
-    auto multiplier = std::make_unique<LiteralNode>(Value(2.0));
-    auto multiplication = std::make_unique<BinaryOpNode>(std::move(addition), BinaryOperator::Multiply, std::move(multiplier));
+    auto multiplier = program.make<LiteralNode>(Value(2.0));
+    auto multiplication = program.make<BinaryOpNode>(addition, BinaryOperator::Multiply, multiplier);
     
     ASTTestRunner::assert_true(multiplication->getOperator() == BinaryOperator::Multiply, "Complex expression operator");
     ASTTestRunner::assert_true(multiplication->getLeft() != nullptr, "Complex expression left operand");
     ASTTestRunner::assert_true(multiplication->getRight() != nullptr, "Complex expression right operand");
     
     // Test function call with arithmetic: sqrt(pow(3, 2) + pow(4, 2))
-    auto base1 = std::make_unique<LiteralNode>(Value(3.0));
-    auto exp1 = std::make_unique<LiteralNode>(Value(2.0));
-    std::vector<std::unique_ptr<ASTNode>> pow1Args;
-    pow1Args.push_back(std::move(base1));
-    pow1Args.push_back(std::move(exp1));
-    auto pow1Func = std::make_unique<IdentifierNode>("pow");
-    auto pow1Call = std::make_unique<FunctionCallNode>(std::move(pow1Func), std::move(pow1Args));
-    
-    auto base2 = std::make_unique<LiteralNode>(Value(4.0));
-    auto exp2 = std::make_unique<LiteralNode>(Value(2.0));
-    std::vector<std::unique_ptr<ASTNode>> pow2Args;
-    pow2Args.push_back(std::move(base2));
-    pow2Args.push_back(std::move(exp2));
-    auto pow2Func = std::make_unique<IdentifierNode>("pow");
-    auto pow2Call = std::make_unique<FunctionCallNode>(std::move(pow2Func), std::move(pow2Args));
-    
-    auto sumOfSquares = std::make_unique<BinaryOpNode>(std::move(pow1Call), BinaryOperator::Add, std::move(pow2Call));
-    
-    std::vector<std::unique_ptr<ASTNode>> sqrtArgs;
-    sqrtArgs.push_back(std::move(sumOfSquares));
-    auto sqrtFunc = std::make_unique<IdentifierNode>("sqrt");
-    auto sqrtCall = std::make_unique<FunctionCallNode>(std::move(sqrtFunc), std::move(sqrtArgs));
+    auto base1 = program.make<LiteralNode>(Value(3.0));
+    auto exp1 = program.make<LiteralNode>(Value(2.0));
+    std::vector<ASTNode *> pow1Args;
+    pow1Args.push_back(base1);
+    pow1Args.push_back(exp1);
+    auto pow1Func = program.make<IdentifierNode>("pow");
+    auto pow1Call = program.make<FunctionCallNode>(pow1Func, program.makeList(pow1Args));
+    
+    auto base2 = program.make<LiteralNode>(Value(4.0));
+    auto exp2 = program.make<LiteralNode>(Value(2.0));
+    std::vector<ASTNode *> pow2Args;
+    pow2Args.push_back(base2);
+    pow2Args.push_back(exp2);
+    auto pow2Func = program.make<IdentifierNode>("pow");
+    auto pow2Call = program.make<FunctionCallNode>(pow2Func, program.makeList(pow2Args));
+    
+    auto sumOfSquares = program.make<BinaryOpNode>(pow1Call, BinaryOperator::Add, pow2Call);
+    
+    std::vector<ASTNode *> sqrtArgs;
+    sqrtArgs.push_back(sumOfSquares);
+    auto sqrtFunc = program.make<IdentifierNode>("sqrt");
+    auto sqrtCall = program.make<FunctionCallNode>(sqrtFunc, program.makeList(sqrtArgs));
     
     ASTTestRunner::assert_true(sqrtCall->getArguments().size() == 1, "Complex sqrt expression has one argument");
     ASTTestRunner::assert_true(sqrtCall->getFunction() != nullptr, "Complex sqrt expression has function");
@@ -333,26 +350,28 @@ void test_complex_mathematical_expressions() {
 void test_block_and_function_nodes() {
     std::cout << "\n=== Testing Block and Function Nodes ===" << std::endl;
     
+    Program program;
+    
     // Test BlockNode
-    std::vector<std::unique_ptr<ASTNode>> statements;
-    statements.push_back(std::make_unique<LiteralNode>(Value(1.0)));
-    statements.push_back(std::make_unique<LiteralNode>(Value(2.0)));
+    std::vector<ASTNode *> statements;
+    statements.push_back(program.make<LiteralNode>(Value(1.0)));
+    statements.push_back(program.make<LiteralNode>(Value(2.0)));
     
-    auto block = std::make_unique<BlockNode>(std::move(statements));
+    auto block = program.make<BlockNode>(program.makeList(statements));
     ASTTestRunner::assert_true(block->getStatements().size() == 2, "BlockNode stores statements");
     
     // Test FunctionDefNode
     std::vector<std::string> params = {"x", "y"};
-    auto body = std::make_unique<LiteralNode>(Value(0.0));
-    auto funcDef = std::make_unique<FunctionDefNode>("add", params, std::move(body));
+    auto body = program.make<LiteralNode>(Value(0.0));
+    auto funcDef = program.make<FunctionDefNode>("add", params, body);
     
     ASTTestRunner::assert_equal("add", funcDef->getName(), "FunctionDefNode stores name");
     ASTTestRunner::assert_true(funcDef->getParameters().size() == 2, "FunctionDefNode stores parameters");
     ASTTestRunner::assert_true(funcDef->getBody() != nullptr, "FunctionDefNode stores body");
     
     // Test ReturnNode
-    auto returnValue = std::make_unique<LiteralNode>(Value(42.0));
-    auto returnNode = std::make_unique<ReturnNode>(std::move(returnValue));
+    auto returnValue = program.make<LiteralNode>(Value(42.0));
+    auto returnNode = program.make<ReturnNode>(returnValue);
     ASTTestRunner::assert_true(returnNode->getValue() != nullptr, "ReturnNode stores value");
     
     // Test visitor patterns
@@ -0,0 +1,140 @@
+#include "threadpool.h"
+
+namespace
+{
+
+// Pool and index of the worker running on this thread
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local size_t t_index = ThreadPool::NotAWorker;
+
+} // anonymous namespace
+
+ThreadPool::ThreadPool(size_t threads)
+    : m_queued(0), m_pending(0), m_nextQueue(0), m_stopping(false)
+{
+    if (threads == 0) {
+        threads = defaultThreadCount();
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back([this, i] { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    size_t index = workerIndex();
+    if (index == NotAWorker) {
+        index = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    }
+
+    // Counted first, so the counters never drop below the number of tasks in the queues
+    m_pending.fetch_add(1);
+    m_queued.fetch_add(1);
+    {
+        Queue &queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders the increment before a sleeping worker's re-check
+    { std::lock_guard<std::mutex> lock(m_mutex); }
+    m_wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_pending.load() == 0; });
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+size_t ThreadPool::workerIndex() const
+{
+    return t_pool == this ? t_index : NotAWorker;
+}
+
+size_t ThreadPool::defaultThreadCount()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+bool ThreadPool::take(size_t index, Task &task)
+{
+    // Own queue from the back: the most recent task is the most likely to be cache-warm
+    {
+        Queue &own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Other queues from the front, starting with the next worker
+    for (size_t offset = 1; offset < m_queues.size(); ++offset) {
+        Queue &victim = *m_queues[(index + offset) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index)
+{
+    t_pool = this;
+    t_index = index;
+
+    while (true) {
+        Task task;
+        if (take(index, task)) {
+            m_queued.fetch_sub(1);
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error) {
+                    m_error = std::current_exception();
+                }
+            }
+            task = nullptr; // Release captures before reporting completion
+
+            if (m_pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping && m_queued.load() == 0) {
+            return;
+        }
+        m_wake.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of worker threads sharing tasks by work stealing
+ *
+ * Every worker owns a task queue. Tasks submitted from outside the pool are
+ * dealt to the queues in turn; tasks submitted by a worker go to its own
+ * queue. A worker takes its newest task first and, once its queue is empty,
+ * steals the oldest task of another worker, so uneven tasks still keep every
+ * thread busy.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    /// Returned by workerIndex() outside the pool's threads
+    static constexpr size_t NotAWorker = static_cast<size_t>(-1);
+
+    /**
+     * @brief Start the worker threads
+     * @param threads Number of workers; 0 uses defaultThreadCount()
+     */
+    explicit ThreadPool(size_t threads = 0);
+
+    /**
+     * @brief Run the remaining tasks, then stop the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Queue a task
+     */
+    void submit(Task task);
+
+    /**
+     * @brief Block until every submitted task has finished
+     *
+     * Must not be called from a task of this pool.
+     * @throws The first exception a task let escape since the last wait()
+     */
+    void wait();
+
+    /**
+     * @brief Number of worker threads
+     */
+    size_t size() const { return m_threads.size(); }
+
+    /**
+     * @brief Index of the calling worker in [0, size()), or NotAWorker
+     */
+    size_t workerIndex() const;
+
+    /**
+     * @brief One worker per hardware thread (at least one)
+     */
+    static size_t defaultThreadCount();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+    bool take(size_t index, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_queued;    // Tasks waiting in a queue
+    std::atomic<size_t> m_pending;   // Tasks submitted and not yet finished
+    std::atomic<size_t> m_nextQueue; // Round robin for outside submissions
+    std::mutex m_mutex;              // Guards sleeping, stopping and m_error
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    bool m_stopping;
+    std::exception_ptr m_error;
+};
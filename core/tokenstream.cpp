@@ -0,0 +1,112 @@
+#include "tokenstream.h"
+#include <stdexcept>
+
+TokenStream::TokenStream(std::istream &input)
+    : m_input(input)
+    , m_chunkLine(1)
+    , m_nextLine(1)
+    , m_finished(false)
+    , m_current(0)
+{
+    m_lexer.reset(m_chunk);
+    for (size_t offset = 0; offset < Lookahead; ++offset) {
+        lexInto(slot(offset));
+    }
+}
+
+const Token &TokenStream::peek(size_t offset) const
+{
+    return slot(offset).token;
+}
+
+const Token &TokenStream::previous() const
+{
+    return slot(WindowSize - 1).token;
+}
+
+void TokenStream::advance()
+{
+    if (slot(0).token.type == TokenType::EndOfFile) {
+        return;
+    }
+    ++m_current;
+    lexInto(slot(Lookahead - 1));
+    checkCurrent();
+}
+
+void TokenStream::checkCurrent() const
+{
+    if (!slot(0).error.empty()) {
+        throw std::runtime_error(slot(0).error);
+    }
+}
+
+void TokenStream::lexInto(Slot &slot)
+{
+    slot.text.clear();
+    slot.error.clear();
+    while (!m_finished) {
+        Token token;
+        try {
+            token = m_lexer.nextToken();
+        } catch (const std::exception &e) {
+            // The lexer has consumed the rest of the chunk; report it when the parser gets here
+            slot.token = Token(TokenType::Invalid, "", m_chunkLine + m_lexer.getCurrentLine() - 1, 0);
+            slot.error = e.what();
+            return;
+        }
+
+        if (token.type != TokenType::EndOfFile) {
+            slot.text.assign(token.value);
+            slot.token = Token(token.type, slot.text, m_chunkLine + token.line - 1, token.column);
+            return;
+        }
+
+        if (readChunk()) {
+            m_lexer.reset(m_chunk);
+        } else {
+            m_finished = true;
+        }
+    }
+    slot.token = Token(TokenType::EndOfFile, "", m_nextLine, 1);
+}
+
+bool TokenStream::readChunk()
+{
+    m_chunk.clear();
+    m_chunkLine = m_nextLine;
+
+    bool inString = false;
+    std::string line;
+    while (std::getline(m_input, line)) {
+        ++m_nextLine;
+
+        // Blank and comment lines between chunks are dropped before they reach the lexer
+        if (m_chunk.empty()) {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') {
+                m_chunkLine = m_nextLine;
+                continue;
+            }
+        }
+
+        // Same quoting rules as Lexer::readString(), so a chunk never splits a literal
+        for (size_t i = 0; i < line.size(); ++i) {
+            if (!inString) {
+                inString = line[i] == '"' || line[i] == '\'';
+            } else if (line[i] == '\\') {
+                ++i;
+            } else if (line[i] == '"') {
+                inString = false;
+            }
+        }
+
+        m_chunk += line;
+        m_chunk += '\n';
+        if (!inString) {
+            return true;
+        }
+    }
+    // An unterminated literal at the end of the input is left for the lexer to report
+    return !m_chunk.empty();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "lexer.h"
+#include <istream>
+#include <string>
+
+/**
+ * @brief Pull-based token source reading a script from a stream
+ *
+ * Source text is read a chunk at a time (a line, or several lines when a
+ * string literal spans them) and lexed on demand, so only the current chunk
+ * and a small window of tokens are held in memory however long the script
+ * is. Tokens in the window own their text: they stay valid after the chunk
+ * they came from has been replaced. Lines whose first non-blank character
+ * is '#' are comments, as in .glo files.
+ */
+class TokenStream
+{
+public:
+    /// Tokens available through peek(): the current one plus lookahead
+    static constexpr size_t Lookahead = 2;
+
+    /**
+     * @brief Create a stream and lex its first tokens
+     * @param input Script source; read lazily, must outlive the stream
+     */
+    explicit TokenStream(std::istream &input);
+
+    TokenStream(const TokenStream &) = delete;
+    TokenStream &operator=(const TokenStream &) = delete;
+
+    /**
+     * @brief Get the current token (offset 0) or one of the following ones
+     * @param offset Distance from the current token, below Lookahead
+     */
+    const Token &peek(size_t offset = 0) const;
+
+    /**
+     * @brief Get the token before the current one
+     */
+    const Token &previous() const;
+
+    /**
+     * @brief Move to the next token; stays on EndOfFile at the end
+     * @throws std::runtime_error if the new current token could not be lexed
+     */
+    void advance();
+
+    /**
+     * @brief Throw the lexing error of the current token, if it has one
+     */
+    void checkCurrent() const;
+
+private:
+    struct Slot {
+        Token token;
+        std::string text;  // Storage the token's value views
+        std::string error; // Lexing error; the token is then Invalid
+    };
+
+    Slot &slot(size_t offset) { return m_window[(m_current + offset) % WindowSize]; }
+    const Slot &slot(size_t offset) const { return m_window[(m_current + offset) % WindowSize]; }
+    void lexInto(Slot &slot);
+    bool readChunk();
+
+    static constexpr size_t WindowSize = Lookahead + 1; // Also keeps the previous token
+    std::istream &m_input;
+    Lexer m_lexer;
+    std::string m_chunk;  // Source text being lexed
+    int m_chunkLine;      // Script line the chunk starts on
+    int m_nextLine;       // Script line read next
+    bool m_finished;      // Input exhausted and last chunk lexed
+    Slot m_window[WindowSize];
+    size_t m_current;     // Window index of the current token
+};
@@ -0,0 +1,485 @@
+#include "vm.h"
+#include "arrayops.h"
+#include "budget.h"
+#include "compiler.h"
+#include "context.h"
+#include "memocache.h"
+#include "outputsink.h"
+#include "parallelfor.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+
+inline double numberOf(const Value &value)
+{
+    return value.isNumber() ? value.asNumber() : value.toNumber();
+}
+
+// Strings and arrays are checked when built, since a statement without a loop never meters memory
+inline void checkSize(ExecutionBudget *budget, const Value &value)
+{
+    if (!budget) {
+        return;
+    }
+    if (value.getType() == Value::String) {
+        budget->checkString(value.asString().size());
+    } else if (value.isArray()) {
+        budget->checkArray(value.asArray().size());
+    }
+}
+
+BinaryOperator arrayOperator(OpCode op)
+{
+    switch (op) {
+    case OpCode::Add: return BinaryOperator::Add;
+    case OpCode::Subtract: return BinaryOperator::Subtract;
+    case OpCode::Multiply: return BinaryOperator::Multiply;
+    case OpCode::Divide: return BinaryOperator::Divide;
+    case OpCode::Power: return BinaryOperator::Power;
+    case OpCode::Mod: return BinaryOperator::Mod;
+    case OpCode::Div: return BinaryOperator::Div;
+    case OpCode::Equal: return BinaryOperator::Equal;
+    case OpCode::NotEqual: return BinaryOperator::NotEqual;
+    case OpCode::Less: return BinaryOperator::Less;
+    case OpCode::Greater: return BinaryOperator::Greater;
+    case OpCode::LessEqual: return BinaryOperator::LessEqual;
+    case OpCode::GreaterEqual: return BinaryOperator::GreaterEqual;
+    default:
+        throw std::runtime_error("Unsupported binary operator");
+    }
+}
+
+/**
+ * @brief Apply a binary operator, the result replacing the left operand
+ *
+ * An unshared array operand is updated in place. A number divided by zero
+ * leaves both operands as they were.
+ * @return The error message of a division by zero, or nullptr
+ */
+const char *arithmetic(OpCode op, Value &left, Value &right)
+{
+    if (left.isArray() || right.isArray()) {
+        left = elementwise(arrayOperator(op), std::move(left), std::move(right));
+        return nullptr;
+    }
+    switch (op) {
+    case OpCode::Add:
+        if (left.isNumber() && right.isNumber()) {
+            left = Value(left.asNumber() + right.asNumber());
+        } else {
+            left = left + right;
+        }
+        return nullptr;
+    case OpCode::Subtract:
+        left = Value(numberOf(left) - numberOf(right));
+        return nullptr;
+    case OpCode::Multiply:
+        left = Value(numberOf(left) * numberOf(right));
+        return nullptr;
+    case OpCode::Divide: {
+        double divisor = numberOf(right);
+        if (divisor == 0.0) {
+            return "Division by zero";
+        }
+        left = Value(numberOf(left) / divisor);
+        return nullptr;
+    }
+    case OpCode::Power:
+        left = Value(std::pow(numberOf(left), numberOf(right)));
+        return nullptr;
+    case OpCode::Mod: {
+        double divisor = numberOf(right);
+        if (divisor == 0.0) {
+            return "Modulo by zero";
+        }
+        left = Value(std::fmod(numberOf(left), divisor));
+        return nullptr;
+    }
+    case OpCode::Div: {
+        double divisor = numberOf(right);
+        if (divisor == 0.0) {
+            return "Integer division by zero";
+        }
+        left = Value(std::trunc(numberOf(left) / divisor));
+        return nullptr;
+    }
+    case OpCode::Equal: left = Value(numberOf(left) == numberOf(right)); return nullptr;
+    case OpCode::NotEqual: left = Value(numberOf(left) != numberOf(right)); return nullptr;
+    case OpCode::Less: left = Value(numberOf(left) < numberOf(right)); return nullptr;
+    case OpCode::Greater: left = Value(numberOf(left) > numberOf(right)); return nullptr;
+    case OpCode::LessEqual: left = Value(numberOf(left) <= numberOf(right)); return nullptr;
+    case OpCode::GreaterEqual: left = Value(numberOf(left) >= numberOf(right)); return nullptr;
+    default:
+        throw std::runtime_error("Unsupported binary operator");
+    }
+}
+
+OpCode compoundOperation(OpCode op)
+{
+    switch (op) {
+    case OpCode::AddAssign: return OpCode::Add;
+    case OpCode::SubtractAssign: return OpCode::Subtract;
+    case OpCode::MultiplyAssign: return OpCode::Multiply;
+    default: return OpCode::Divide;
+    }
+}
+
+const char *modifyingOperation(OpCode op)
+{
+    switch (op) {
+    case OpCode::Increment: return "pre-increment";
+    case OpCode::Decrement: return "pre-decrement";
+    case OpCode::PostIncrement: return "post-increment";
+    case OpCode::PostDecrement: return "post-decrement";
+    default: return "compound assignment";
+    }
+}
+
+} // anonymous namespace
+
+VirtualMachine::VirtualMachine()
+    : m_output(&OutputSink::standardOutput())
+{
+}
+
+VirtualMachine::~VirtualMachine() = default;
+
+bool VirtualMachine::execute(const Chunk &chunk, Context *context, Value &result)
+{
+    if (!context) {
+        throw std::runtime_error("No context for bytecode execution");
+    }
+
+    m_error.clear();
+    if (m_stack.size() < chunk.maxStackDepth + 1) {
+        m_stack.resize(chunk.maxStackDepth + 1);
+    }
+    return m_profiler ? run<true>(chunk, context, result) : run<false>(chunk, context, result);
+}
+
+template <bool Profiling>
+bool VirtualMachine::run(const Chunk &chunk, Context *context, Value &result)
+{
+    const Chunk *active = &chunk;
+    const Instruction *code = active->code.data();
+    Value *stackBase = m_stack.data();
+    Value *sp = stackBase;
+    size_t pc = 0;
+    m_loopIterations = 0;
+
+    // Calls an error abandons are unwound together with their context frames
+    struct FrameGuard {
+        std::vector<CallFrame> &frames;
+        Context *context;
+        size_t depth;
+        ~FrameGuard()
+        {
+            while (frames.size() > depth) {
+                context->popFrame();
+                frames.pop_back();
+            }
+        }
+    } guard{m_frames, context, m_frames.size()};
+
+    while (true) {
+        const Instruction &inst = code[pc++];
+
+        switch (inst.op) {
+        case OpCode::PushConstant:
+            *sp++ = active->constants[inst.operand];
+            break;
+        case OpCode::PushNull:
+            *sp++ = Value();
+            break;
+        case OpCode::PushTrue:
+            *sp++ = Value(true);
+            break;
+        case OpCode::PushFalse:
+            *sp++ = Value(false);
+            break;
+        case OpCode::Pop:
+            --sp;
+            break;
+
+        case OpCode::LoadVariable: {
+            const VariableSlot &slot = context->slot(SlotRef{inst.count, inst.operand});
+            if (!slot.defined) {
+                m_error.code = ErrorCode::UndefinedVariable;
+                m_error.message = "Undefined variable: " + context->slotName(SlotRef{inst.count, inst.operand});
+                goto failed;
+            }
+            if constexpr (Profiling) {
+                m_profiler->count(Profiler::VariableLoads);
+            }
+            *sp++ = slot.value;
+            break;
+        }
+        case OpCode::StoreVariable: {
+            VariableSlot &slot = context->slot(SlotRef{inst.count, inst.operand});
+            slot.value = sp[-1];
+            slot.defined = true;
+            if constexpr (Profiling) {
+                m_profiler->count(Profiler::VariableStores);
+            }
+            break;
+        }
+        case OpCode::AddAssign:
+        case OpCode::SubtractAssign:
+        case OpCode::MultiplyAssign:
+        case OpCode::DivideAssign: {
+            SlotRef ref{inst.count, inst.operand};
+            VariableSlot &slot = context->slot(ref);
+            if (!slot.defined) {
+                goto missing;
+            }
+            if (const char *message = arithmetic(compoundOperation(inst.op), slot.value, sp[-1])) {
+                m_error.code = ErrorCode::DivisionByZero;
+                m_error.message = message;
+                goto failed;
+            }
+            checkSize(m_budget, slot.value);
+            sp[-1] = slot.value;
+            if constexpr (Profiling) {
+                m_profiler->count(Profiler::VariableStores);
+            }
+            break;
+        }
+        case OpCode::Increment:
+        case OpCode::Decrement:
+        case OpCode::PostIncrement:
+        case OpCode::PostDecrement: {
+            SlotRef ref{inst.count, inst.operand};
+            VariableSlot &slot = context->slot(ref);
+            if (!slot.defined) {
+                goto missing;
+            }
+            double current = numberOf(slot.value);
+            double step = (inst.op == OpCode::Increment || inst.op == OpCode::PostIncrement) ? 1.0 : -1.0;
+            bool isPost = inst.op == OpCode::PostIncrement || inst.op == OpCode::PostDecrement;
+            if (isPost) {
+                *sp++ = slot.value;
+            }
+            slot.value = Value(current + step);
+            if (!isPost) {
+                *sp++ = slot.value;
+            }
+            if constexpr (Profiling) {
+                m_profiler->count(Profiler::VariableStores);
+            }
+            break;
+        }
+
+        case OpCode::Add:
+            arithmetic(inst.op, sp[-2], sp[-1]);
+            checkSize(m_budget, sp[-2]);
+            --sp;
+            break;
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+        case OpCode::Power:
+        case OpCode::Mod:
+        case OpCode::Div:
+        case OpCode::Equal:
+        case OpCode::NotEqual:
+        case OpCode::Less:
+        case OpCode::Greater:
+        case OpCode::LessEqual:
+        case OpCode::GreaterEqual:
+            if (const char *message = arithmetic(inst.op, sp[-2], sp[-1])) {
+                m_error.code = ErrorCode::DivisionByZero;
+                m_error.message = message;
+                goto failed;
+            }
+            checkSize(m_budget, sp[-2]);
+            --sp;
+            break;
+        case OpCode::Negate:
+            sp[-1] = sp[-1].isArray() ? negateElements(std::move(sp[-1])) : Value(-numberOf(sp[-1]));
+            break;
+        case OpCode::Not:
+            sp[-1] = Value(!sp[-1].toBool());
+            break;
+        case OpCode::ToBool:
+            sp[-1] = Value(sp[-1].toBool());
+            break;
+
+        case OpCode::Jump:
+            if (inst.operand < pc) {
+                ++m_loopIterations;
+                if constexpr (Profiling) {
+                    m_profiler->count(Profiler::LoopIterations);
+                }
+                if (m_budget) {
+                    m_budget->step();
+                }
+            }
+            pc = inst.operand;
+            break;
+        case OpCode::JumpIfFalse:
+            if (!(--sp)->toBool()) {
+                pc = inst.operand;
+            }
+            break;
+        case OpCode::JumpIfTrue:
+            if ((--sp)->toBool()) {
+                pc = inst.operand;
+            }
+            break;
+
+        case OpCode::CallBuiltin: {
+            // Arguments are passed in place; the result replaces the first one
+            Value *args = sp - inst.count;
+            const BuiltinFunction *native = active->natives[inst.operand];
+            Profiler::Clock::time_point start;
+            if constexpr (Profiling) {
+                start = Profiler::Clock::now();
+            }
+            *args = native->function(Span<const Value>(args, inst.count));
+            if constexpr (Profiling) {
+                m_profiler->builtinCall(*native, start);
+            }
+            checkSize(m_budget, *args);
+            sp = args + 1;
+            break;
+        }
+        case OpCode::CallFunction: {
+            if (m_budget) {
+                m_budget->step();
+            }
+            const std::string &name = active->names[inst.operand];
+            std::shared_ptr<UserFunction> function = context->findFunction(name);
+            if (!function) {
+                m_error.code = ErrorCode::UnknownFunction;
+                m_error.message = "Unknown function: " + name + " with " + std::to_string(inst.count) + " arguments";
+                goto failed;
+            }
+            if (inst.count != function->parameters.size()) {
+                m_error.code = ErrorCode::ArgumentCount;
+                m_error.message = "Function " + name + " expects " + std::to_string(function->parameters.size()) +
+                                  " arguments, got " + std::to_string(inst.count);
+                goto failed;
+            }
+
+            Value *args = sp - inst.count;
+            std::shared_ptr<MemoCache> memo = context->memoFor(*function) ? function->memo : nullptr;
+            std::vector<Value> key;
+            if (memo) {
+                if (const Value *cached = memo->lookup(Span<const Value>(args, inst.count))) {
+                    if constexpr (Profiling) {
+                        m_profiler->memoHit(name);
+                    }
+                    *args = *cached;
+                    sp = args + 1;
+                    break;
+                }
+                key.assign(args, sp);
+            }
+            if (!function->chunk) {
+                function->chunk = Compiler().compile(function->body);
+            }
+
+            // Arguments move into the callee's frame; its operands start where they were
+            context->pushFrame(*function);
+            for (std::uint16_t i = 0; i < inst.count; ++i) {
+                VariableSlot &slot = context->slot(SlotRef{SlotRef::FrameDepth, i});
+                slot.value = std::move(args[i]);
+                slot.defined = true;
+            }
+
+            size_t base = static_cast<size_t>(args - m_stack.data());
+            m_frames.push_back(CallFrame{active, pc, static_cast<size_t>(stackBase - m_stack.data()),
+                                         std::move(function), std::move(memo), std::move(key)});
+            if constexpr (Profiling) {
+                m_profiler->enterFunction(name);
+            }
+            active = m_frames.back().function->chunk.get();
+            if (m_stack.size() < base + active->maxStackDepth + 1) {
+                m_stack.resize(std::max(base + active->maxStackDepth + 1, m_stack.size() * 2));
+            }
+            code = active->code.data();
+            stackBase = m_stack.data() + base;
+            sp = stackBase;
+            pc = 0;
+            break;
+        }
+        case OpCode::DefineFunction:
+            context->defineFunction(active->functions[inst.operand]);
+            *sp++ = Value();
+            break;
+        case OpCode::ParallelFor: {
+            ParallelLoops &loops = m_parallel ? *m_parallel : ParallelLoops::sequential();
+            if (!loops.run(active->loops[inst.operand], *context, m_budget, m_error)) {
+                // At the position of the failing node in the loop, not of the loop
+                return false;
+            }
+            *sp++ = Value();
+            break;
+        }
+        case OpCode::Print: {
+            Profiler::Clock::time_point start;
+            if constexpr (Profiling) {
+                start = Profiler::Clock::now();
+            }
+            Value *first = sp - inst.operand;
+            m_line.clear();
+            for (Value *it = first; it != sp; ++it) {
+                it->appendTo(m_line);
+            }
+            m_line += '\n';
+            m_output->write(m_line.data(), m_line.size());
+            if constexpr (Profiling) {
+                m_profiler->print(start);
+            }
+            *first = Value();
+            sp = first + 1;
+            break;
+        }
+        case OpCode::Fail:
+            m_error.code = ErrorCode::InvalidTarget;
+            m_error.message = active->constants[inst.operand].toString();
+            goto failed;
+        case OpCode::Return: {
+            Value value = sp > stackBase ? sp[-1] : Value();
+            if (m_frames.size() == guard.depth) {
+                result = std::move(value);
+                return true;
+            }
+
+            // Back to the caller, the result in place of the arguments
+            const CallFrame &frame = m_frames.back();
+            if constexpr (Profiling) {
+                m_profiler->leaveFunction();
+            }
+            if (frame.memo) {
+                frame.memo->insert(Span<const Value>(frame.arguments.data(), frame.arguments.size()), value);
+            }
+            context->popFrame();
+            active = frame.chunk;
+            code = active->code.data();
+            pc = frame.pc;
+            sp = stackBase;
+            stackBase = m_stack.data() + frame.stackBase;
+            *sp++ = std::move(value);
+            m_frames.pop_back();
+            break;
+        }
+        }
+    }
+
+missing:
+    // Compound assignments and increments of a variable never assigned
+    m_error.code = ErrorCode::UndefinedVariable;
+    m_error.message = std::string("Variable not found for ") + modifyingOperation(code[pc - 1].op) + ": " +
+                      context->slotName(SlotRef{code[pc - 1].count, code[pc - 1].operand});
+failed:
+    SourcePosition position = active->positionOf(pc - 1);
+    m_error.line = position.line;
+    m_error.column = position.column;
+    return false;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ast.h"
+#include "bytecode.h"
+#include "evalerror.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class Context;
+class ExecutionBudget;
+class OutputSink;
+class MemoCache;
+class ParallelLoops;
+class Profiler;
+struct UserFunction;
+
+/**
+ * @brief Stack-based virtual machine that executes compiled bytecode
+ *
+ * Produces the same results as Evaluator for the same AST, but runs a flat
+ * instruction stream instead of walking the tree through ASTVisitor.
+ *
+ * Calls to user functions do not recurse in C++: the caller's position is
+ * pushed on a frame stack and the callee's chunk (compiled on its first call)
+ * runs in the same loop, its operands on top of the caller's.
+ */
+class VirtualMachine
+{
+public:
+    VirtualMachine();
+    ~VirtualMachine();
+
+    /**
+     * @brief Execute a compiled chunk
+     *
+     * The errors listed in ErrorCode are returned without throwing; calls
+     * they abandon are unwound. Builtins, array operations and the budget
+     * may still throw.
+     * @param chunk The bytecode to run
+     * @param context The execution context
+     * @param result Receives the value left by the chunk's top-level statement
+     * @return False if it failed, with error() telling why
+     */
+    bool execute(const Chunk &chunk, Context *context, Value &result);
+
+    /**
+     * @brief Why the last execute() failed, at the position of the failing instruction
+     */
+    const EvalError &error() const { return m_error; }
+
+    /**
+     * @brief Number of backward jumps (loop iterations) taken by the last execute()
+     */
+    size_t loopIterations() const { return m_loopIterations; }
+
+    /**
+     * @brief Set where print statements write (OutputSink::standardOutput() by default)
+     * @param output Sink that outlives the VM
+     */
+    void setOutput(OutputSink *output) { m_output = output; }
+
+    /**
+     * @brief Report calls, loops and variable accesses to a profiler
+     *
+     * Profiling runs a separate instantiation of the dispatch loop, so the
+     * default loop carries no checks for it.
+     * @param profiler Profiler that outlives the VM, or nullptr to stop profiling
+     */
+    void setProfiler(Profiler *profiler) { m_profiler = profiler; }
+
+    /**
+     * @brief Meter backward jumps and calls, and strings built by concatenation, against a budget
+     * @param budget Budget that outlives the VM, or nullptr to run unmetered
+     */
+    void setBudget(ExecutionBudget *budget) { m_budget = budget; }
+
+    /**
+     * @brief Run parallel for loops with the given loops (ParallelLoops::sequential() by default)
+     * @param loops Loops that outlive the VM, or nullptr for the default
+     */
+    void setParallelLoops(ParallelLoops *loops) { m_parallel = loops; }
+
+private:
+    struct CallFrame {
+        const Chunk *chunk;                     // Caller's chunk
+        size_t pc;                              // Caller's next instruction
+        size_t stackBase;                       // Caller's stack base, as an offset into m_stack
+        std::shared_ptr<UserFunction> function; // Callee, kept alive if it redefines itself
+        std::shared_ptr<MemoCache> memo;        // Receives the result of a pure callee
+        std::vector<Value> arguments;           // Memo key; parameters may be reassigned
+    };
+
+    template <bool Profiling>
+    bool run(const Chunk &chunk, Context *context, Value &result);
+
+    std::vector<Value> m_stack;
+    std::vector<CallFrame> m_frames;
+    size_t m_loopIterations = 0;
+    OutputSink *m_output;
+    Profiler *m_profiler = nullptr;
+    ExecutionBudget *m_budget = nullptr;
+    ParallelLoops *m_parallel = nullptr;
+    std::string m_line; // Reused to format print statements
+    EvalError m_error;
+};
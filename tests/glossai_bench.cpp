@@ -0,0 +1,851 @@
+/**
+ * @file glossai_bench.cpp
+ * @brief Micro and macro benchmarks for the GlossAI interpreter
+ *
+ * Every benchmark is calibrated until one run takes at least the minimum
+ * time, then repeated; the median is reported. Results are printed as a
+ * table and can be written as JSON in the layout used by Google Benchmark,
+ * so existing comparison tools work on them.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "interpreter.h"
+#include "builtins.h"
+#include "compiledprogram.h"
+#include "context.h"
+#include "lexer.h"
+#include "outputsink.h"
+#include "parser.h"
+
+#ifndef GLOSSAI_BENCH_SCRIPTS
+#define GLOSSAI_BENCH_SCRIPTS "test_scripts"
+#endif
+
+namespace
+{
+
+#if defined(__GNUC__) || defined(__clang__)
+/**
+ * @brief Keep the compiler from discarding a computed value
+ */
+template <typename T>
+void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Make the compiler assume a value may have changed, so work on it is not hoisted out of a loop
+ */
+template <typename T>
+void doNotOptimize(T &value)
+{
+    asm volatile("" : "+m,r"(value) : : "memory");
+}
+#else
+const void *volatile g_sink;
+
+template <typename T>
+void doNotOptimize(const T &value)
+{
+    g_sink = &value;
+}
+#endif
+
+/**
+ * @brief Measured timing of one benchmark
+ */
+struct BenchmarkResult {
+    std::string name;
+    size_t iterations = 0;  // Per repetition
+    size_t repetitions = 0;
+    double realTime = 0.0;  // Median nanoseconds per iteration
+    double minTime = 0.0;   // Fastest repetition, nanoseconds per iteration
+    double cpuTime = 0.0;   // Median process CPU nanoseconds per iteration
+    double itemsPerSecond = 0.0;
+    std::string label;      // Printed after the figures, e.g. the accuracy of an approximation
+    std::string error;      // Set if the benchmark threw
+};
+
+/**
+ * @brief Registry and driver of the benchmarks
+ *
+ * A benchmark body receives the number of iterations and runs its loop
+ * itself, so the harness adds no per-iteration overhead.
+ */
+class BenchmarkRunner
+{
+public:
+    using Body = std::function<void(size_t iterations)>;
+
+    /**
+     * @brief Register a benchmark
+     * @param name Name, '/'-separated from general to specific
+     * @param body Runs the measured operation the given number of times
+     * @param itemsPerIteration Items (lines, rows, calls) processed per iteration, for a throughput figure
+     * @param label Reported with the result
+     */
+    void add(const std::string &name, Body body, double itemsPerIteration = 0.0, const std::string &label = "")
+    {
+        m_benchmarks.push_back(Benchmark{name, std::move(body), itemsPerIteration, label});
+    }
+
+    std::vector<std::string> names() const
+    {
+        std::vector<std::string> names;
+        for (const Benchmark &benchmark : m_benchmarks) {
+            names.push_back(benchmark.name);
+        }
+        return names;
+    }
+
+    /**
+     * @brief Run the benchmarks whose name contains filter, printing a line per benchmark
+     */
+    std::vector<BenchmarkResult> run(const std::string &filter, double minSeconds, size_t repetitions,
+                                     std::ostream &log)
+    {
+        std::vector<BenchmarkResult> results;
+        log << std::left << std::setw(44) << "Benchmark" << std::right << std::setw(16) << "Time"
+            << std::setw(16) << "CPU" << std::setw(14) << "Iterations" << "  Throughput\n";
+        log << std::string(100, '-') << "\n";
+        for (const Benchmark &benchmark : m_benchmarks) {
+            if (benchmark.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            BenchmarkResult result = measure(benchmark, minSeconds, repetitions);
+            print(result, log);
+            results.push_back(std::move(result));
+        }
+        return results;
+    }
+
+private:
+    struct Benchmark {
+        std::string name;
+        Body body;
+        double itemsPerIteration;
+        std::string label;
+    };
+
+    struct Sample {
+        double real; // Seconds
+        double cpu;  // Seconds
+    };
+
+    static Sample time(const Benchmark &benchmark, size_t iterations)
+    {
+        std::clock_t cpuStart = std::clock();
+        auto start = std::chrono::steady_clock::now();
+        benchmark.body(iterations);
+        auto end = std::chrono::steady_clock::now();
+        std::clock_t cpuEnd = std::clock();
+        return Sample{std::chrono::duration<double>(end - start).count(),
+                      static_cast<double>(cpuEnd - cpuStart) / CLOCKS_PER_SEC};
+    }
+
+    static BenchmarkResult measure(const Benchmark &benchmark, double minSeconds, size_t repetitions)
+    {
+        BenchmarkResult result;
+        result.name = benchmark.name;
+        result.label = benchmark.label;
+        try {
+            // Grow the iteration count until one run is long enough to time reliably
+            size_t iterations = 1;
+            while (true) {
+                double seconds = time(benchmark, iterations).real;
+                if (seconds >= minSeconds || iterations >= (size_t(1) << 40)) {
+                    break;
+                }
+                double factor = seconds > 0.0 ? 1.4 * minSeconds / seconds : 10.0;
+                factor = std::min(10.0, std::max(2.0, factor));
+                iterations = static_cast<size_t>(std::ceil(iterations * factor));
+            }
+
+            std::vector<Sample> samples;
+            for (size_t i = 0; i < repetitions; ++i) {
+                samples.push_back(time(benchmark, iterations));
+            }
+            auto median = [&samples](double Sample::*field) {
+                std::vector<double> values;
+                for (const Sample &sample : samples) {
+                    values.push_back(sample.*field);
+                }
+                std::sort(values.begin(), values.end());
+                return values[values.size() / 2];
+            };
+            double fastest = samples.front().real;
+            for (const Sample &sample : samples) {
+                fastest = std::min(fastest, sample.real);
+            }
+
+            result.iterations = iterations;
+            result.repetitions = repetitions;
+            result.realTime = median(&Sample::real) * 1e9 / iterations;
+            result.minTime = fastest * 1e9 / iterations;
+            result.cpuTime = median(&Sample::cpu) * 1e9 / iterations;
+            if (benchmark.itemsPerIteration > 0.0 && result.realTime > 0.0) {
+                result.itemsPerSecond = benchmark.itemsPerIteration * 1e9 / result.realTime;
+            }
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+
+    static std::string formatTime(double nanoseconds)
+    {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(nanoseconds < 10.0 ? 2 : (nanoseconds < 1000.0 ? 1 : 0));
+        if (nanoseconds < 1e4) {
+            text << nanoseconds << " ns";
+        } else if (nanoseconds < 1e6) {
+            text << std::setprecision(1) << nanoseconds / 1e3 << " us";
+        } else {
+            text << std::setprecision(2) << nanoseconds / 1e6 << " ms";
+        }
+        return text.str();
+    }
+
+    static void print(const BenchmarkResult &result, std::ostream &log)
+    {
+        log << std::left << std::setw(44) << result.name << std::right;
+        if (!result.error.empty()) {
+            log << "  ERROR: " << result.error << "\n";
+            return;
+        }
+        log << std::setw(16) << formatTime(result.realTime) << std::setw(16) << formatTime(result.cpuTime)
+            << std::setw(14) << result.iterations;
+        if (result.itemsPerSecond > 0.0) {
+            log << "  " << std::fixed << std::setprecision(2) << result.itemsPerSecond / 1e6 << "M items/s"
+                << std::defaultfloat;
+        }
+        if (!result.label.empty()) {
+            log << "  " << result.label;
+        }
+        log << "\n";
+    }
+
+    std::vector<Benchmark> m_benchmarks;
+};
+
+std::string jsonString(const std::string &text)
+{
+    std::ostringstream out;
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec
+                    << std::setfill(' ');
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+/**
+ * @brief Write results in the JSON layout of Google Benchmark
+ */
+void writeJson(const std::vector<BenchmarkResult> &results, const std::string &executable, std::ostream &out)
+{
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": " << jsonString(date) << ",\n";
+    out << "    \"executable\": " << jsonString(executable) << ",\n";
+    out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\",\n";
+#else
+    out << "    \"library_build_type\": \"debug\",\n";
+#endif
+#ifdef GLOSSAI_ENABLE_JIT
+    out << "    \"glossai_jit\": true,\n";
+#else
+    out << "    \"glossai_jit\": false,\n";
+#endif
+    out << "    \"glossai_version\": \"1.0.0\"\n  },\n";
+    out << "  \"benchmarks\": [";
+    out << std::setprecision(17);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult &result = results[i];
+        out << (i ? ",\n" : "\n") << "    {\n";
+        out << "      \"name\": " << jsonString(result.name) << ",\n";
+        out << "      \"run_name\": " << jsonString(result.name) << ",\n";
+        out << "      \"run_type\": \"iteration\",\n";
+        if (!result.error.empty()) {
+            out << "      \"error_occurred\": true,\n";
+            out << "      \"error_message\": " << jsonString(result.error) << "\n    }";
+            continue;
+        }
+        out << "      \"repetitions\": " << result.repetitions << ",\n";
+        out << "      \"iterations\": " << result.iterations << ",\n";
+        out << "      \"real_time\": " << result.realTime << ",\n";
+        out << "      \"cpu_time\": " << result.cpuTime << ",\n";
+        out << "      \"min_real_time\": " << result.minTime << ",\n";
+        if (result.itemsPerSecond > 0.0) {
+            out << "      \"items_per_second\": " << result.itemsPerSecond << ",\n";
+        }
+        if (!result.label.empty()) {
+            out << "      \"label\": " << jsonString(result.label) << ",\n";
+        }
+        out << "      \"time_unit\": \"ns\"\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Representative inputs
+
+const char *const Expression = "x = 3.5 * (y + 2) ^ 2 - sin(pi / 4) / sqrt(z) + max(y, 10) MOD 7";
+
+/**
+ * @brief A script of assignments, conditionals, loops and function definitions
+ */
+std::string syntheticScript(int lines)
+{
+    std::string script;
+    for (int i = 0; i < lines; ++i) {
+        switch (i % 4) {
+        case 0: script += "v" + std::to_string(i) + " = " + std::to_string(i) + " * 1.5 + sqrt(" + std::to_string(i) + ")\n"; break;
+        case 1: script += "if (v" + std::to_string(i - 1) + " > 10) w = v" + std::to_string(i - 1) + " / 2 else w = 0\n"; break;
+        case 2: script += "{ s = 0; for (k = 0; k < 3; k++) s += k * w }\n"; break;
+        case 3: script += "function f" + std::to_string(i) + "(a, b) { return a * b + " + std::to_string(i) + " }\n"; break;
+        }
+    }
+    return script;
+}
+
+/**
+ * @brief An interpreter whose prints are discarded
+ */
+std::unique_ptr<Interpreter> quietInterpreter()
+{
+    auto interpreter = std::make_unique<Interpreter>();
+    interpreter->setOutput(std::make_unique<CallbackSink>(nullptr));
+    return interpreter;
+}
+
+void addLexerBenchmarks(BenchmarkRunner &runner)
+{
+    runner.add("lexer/tokenize/expression", [](size_t iterations) {
+        Lexer lexer;
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(lexer.tokenize(Expression));
+        }
+    });
+
+    auto script = std::make_shared<std::string>(syntheticScript(1000));
+    runner.add("lexer/tokenize/script_1000_lines", [script](size_t iterations) {
+        Lexer lexer;
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(lexer.tokenize(*script));
+        }
+    }, 1000);
+
+    // One keystroke in the last line of a 1000-line statement still being entered
+    runner.add("lexer/line/keystroke_after_1000_lines", [script](size_t iterations) {
+        Context context;
+        context.addPendingLine("procedure run() {");
+        std::istringstream lines(*script);
+        for (std::string line; std::getline(lines, line);) {
+            context.addPendingLine(line);
+        }
+        Lexer lexer;
+        std::vector<LineToken> tokens;
+        const std::string edited = "total = f3(v0, [1, 2]) + \"(\"";
+        for (size_t i = 0; i < iterations; ++i) {
+            LexState state = context.getPendingState();
+            lexer.lexLine(edited, state, &tokens);
+            doNotOptimize(state.continues() && context.getBraceLevel() > 0);
+        }
+    });
+}
+
+void addParserBenchmarks(BenchmarkRunner &runner)
+{
+    runner.add("parser/parse/expression", [](size_t iterations) {
+        Lexer lexer;
+        Parser parser;
+        std::vector<Token> tokens = lexer.tokenize(Expression);
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(parser.parse(tokens));
+        }
+    });
+
+    auto script = std::make_shared<std::string>(syntheticScript(1000));
+    runner.add("parser/parse/script_1000_lines", [script](size_t iterations) {
+        Lexer lexer;
+        Parser parser;
+        std::vector<Token> tokens = lexer.tokenize(*script);
+        std::vector<Parser::ScriptStatement> statements;
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(parser.parseScript(*script, tokens, statements));
+        }
+    }, 1000);
+}
+
+void addContextBenchmarks(BenchmarkRunner &runner)
+{
+    const size_t Globals = 1000;
+    auto names = std::make_shared<std::vector<std::string>>();
+    for (size_t i = 0; i < Globals; ++i) {
+        names->push_back("variable_" + std::to_string(i));
+    }
+
+    runner.add("context/get_variable/hit", [names](size_t iterations) {
+        Context context;
+        for (size_t i = 0; i < names->size(); ++i) {
+            context.setVariable((*names)[i], Value(static_cast<double>(i)));
+        }
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(context.getVariable((*names)[i % names->size()]));
+        }
+    });
+    runner.add("context/has_variable/miss", [names](size_t iterations) {
+        Context context;
+        for (size_t i = 0; i < names->size(); ++i) {
+            context.setVariable((*names)[i], Value(static_cast<double>(i)));
+        }
+        const std::string missing = "undefined_name";
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(context.hasVariable(missing));
+        }
+    });
+    runner.add("context/set_variable/existing", [names](size_t iterations) {
+        Context context;
+        for (size_t i = 0; i < names->size(); ++i) {
+            context.setVariable((*names)[i], Value(0.0));
+        }
+        for (size_t i = 0; i < iterations; ++i) {
+            context.setVariable((*names)[i % names->size()], Value(static_cast<double>(i)));
+        }
+    });
+}
+
+void addValueBenchmarks(BenchmarkRunner &runner)
+{
+    auto binary = [&runner](const std::string &name, Value left, Value right,
+                            Value (Value::*op)(const Value &) const) {
+        runner.add("value/" + name, [left, right, op](size_t iterations) {
+            Value a = left, b = right;
+            for (size_t i = 0; i < iterations; ++i) {
+                doNotOptimize(a);
+                doNotOptimize((a.*op)(b));
+            }
+        });
+    };
+    binary("add/number", Value(1.25), Value(2.5), &Value::operator+);
+    binary("subtract/number", Value(1.25), Value(2.5), &Value::operator-);
+    binary("multiply/number", Value(1.25), Value(2.5), &Value::operator*);
+    binary("divide/number", Value(1.25), Value(2.5), &Value::operator/);
+    binary("add/string", Value("gloss"), Value("ai"), &Value::operator+);
+
+    runner.add("value/less/number", [](size_t iterations) {
+        Value left(1.25), right(2.5);
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(left);
+            doNotOptimize(left < right);
+        }
+    });
+    runner.add("value/copy/string", [](size_t iterations) {
+        Value text("a string value");
+        for (size_t i = 0; i < iterations; ++i) {
+            Value copy(text);
+            doNotOptimize(copy);
+        }
+    });
+    runner.add("value/to_string/number", [](size_t iterations) {
+        Value number(2.0 / 3.0);
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(number);
+            doNotOptimize(number.toString());
+        }
+    });
+}
+
+void addBuiltinBenchmarks(BenchmarkRunner &runner)
+{
+    const BuiltinRegistry &builtins = BuiltinRegistry::standard();
+    for (const std::string &name : builtins.names()) {
+        const BuiltinFunction *builtin = builtins.find(name);
+        // In range for every standard function, including asin, acos, log and root
+        std::vector<Value> arguments = {Value(0.5), Value(2.0)};
+        arguments.resize(builtin->minArgs);
+        runner.add("builtin/" + name, [builtin, arguments](size_t iterations) {
+            Span<const Value> args(arguments.data(), arguments.size());
+            for (size_t i = 0; i < iterations; ++i) {
+                doNotOptimize(builtin->function(args));
+            }
+        });
+    }
+}
+
+void addInterpreterBenchmarks(BenchmarkRunner &runner)
+{
+    runner.add("interpreter/execute/cached_expression", [](size_t iterations) {
+        auto interpreter = quietInterpreter();
+        interpreter->execute("x = 4");
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(interpreter->execute("2 * x + sqrt(x) - 1"));
+        }
+    });
+    runner.add("interpreter/evaluate/cached_expression", [](size_t iterations) {
+        auto interpreter = quietInterpreter();
+        interpreter->execute("x = 4");
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(interpreter->evaluate("2 * x + sqrt(x) - 1"));
+        }
+    });
+    runner.add("interpreter/execute/new_expression", [](size_t iterations) {
+        auto interpreter = quietInterpreter();
+        interpreter->setCacheCapacity(0);
+        interpreter->execute("x = 4");
+        for (size_t i = 0; i < iterations; ++i) {
+            doNotOptimize(interpreter->execute("2 * x + sqrt(x) - 1"));
+        }
+    });
+    // Failures come back as a Result on both engines, without an exception
+    for (auto mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        const char *engine = mode == Interpreter::ExecutionMode::Bytecode ? "vm" : "tree_walk";
+        runner.add(std::string("interpreter/evaluate/undefined_variable/") + engine, [mode](size_t iterations) {
+            auto interpreter = quietInterpreter();
+            interpreter->setExecutionMode(mode);
+            interpreter->execute("x = 4");
+            for (size_t i = 0; i < iterations; ++i) {
+                doNotOptimize(interpreter->evaluate("2 * x + missing - 1"));
+            }
+        });
+    }
+}
+
+/**
+ * @brief Synthetic programs dominated by loops and calls, on both engines
+ */
+void addLoopBenchmarks(BenchmarkRunner &runner)
+{
+    struct Loop {
+        const char *name;
+        const char *setup;
+        const char *code;
+        double items;
+    };
+    const std::vector<Loop> loops = {
+        {"for_sum_100k", "", "{ s = 0; for (i = 0; i < 100000; i++) s += i * 2 }", 100000},
+        {"while_100k", "", "{ i = 0; t = 0; while (i < 100000) { t = t + i MOD 7; i = i + 1 } }", 100000},
+        {"nested_300x300", "", "{ c = 0; for (i = 0; i < 300; i++) for (j = 0; j < 300; j++) c += i < j }", 90000},
+        {"builtins_50k", "", "{ a = 0; for (i = 1; i <= 50000; i++) a += sin(i) * sqrt(i) }", 50000},
+        {"fib_20", "function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2) }", "fib(20)", 21891},
+        {"print_10k", "", "{ for (i = 0; i < 10000; i++) print \"row \", i, \" = \", i * 0.5 }", 10000},
+        {"array_sum_100k", "x = range(100000)", "sum(x * 2)", 100000},
+        {"array_norm_100k", "x = range(100000)", "norm(sin(x) * sqrt(x))", 100000},
+    };
+    for (auto mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        const char *engine = mode == Interpreter::ExecutionMode::Bytecode ? "vm" : "tree_walk";
+        for (const Loop &loop : loops) {
+            runner.add(std::string("loop/") + loop.name + "/" + engine, [loop, mode](size_t iterations) {
+                auto interpreter = quietInterpreter();
+                interpreter->setExecutionMode(mode);
+                interpreter->setMemoCapacity(0); // Measure the calls themselves
+                if (*loop.setup) {
+                    interpreter->execute(loop.setup);
+                }
+                for (size_t i = 0; i < iterations; ++i) {
+                    interpreter->execute(loop.code);
+                    if (!interpreter->getLastError().empty()) {
+                        throw std::runtime_error(interpreter->getLastError());
+                    }
+                }
+            }, loop.items);
+        }
+    }
+}
+
+/**
+ * @brief One compiled program run on several threads, each with an ExecutionContext
+ *
+ * Items are runs of the program, split evenly over the threads, so items/s
+ * should grow with the thread count up to the number of cores.
+ */
+void addSharedProgramBenchmarks(BenchmarkRunner &runner)
+{
+    CompiledProgram::Options options;
+    options.globals = std::make_shared<SharedGlobals>(
+        std::unordered_map<std::string, Value>{{"rate", Value(0.05)}, {"months", Value(120.0)}});
+    auto program = CompiledProgram::compile("principal * pow(1 + rate / 12, months) - principal", options);
+    for (size_t threads : {1, 2, 4, 8}) {
+        runner.add("shared/formula/threads_" + std::to_string(threads), [program, threads](size_t iterations) {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t) {
+                size_t runs = iterations / threads + (t < iterations % threads ? 1 : 0);
+                workers.emplace_back([program, runs, t] {
+                    ExecutionContext context(program);
+                    for (size_t i = 0; i < runs; ++i) {
+                        context.setVariable("principal", Value(1000.0 + static_cast<double>(t + i)));
+                        doNotOptimize(context.run());
+                    }
+                });
+            }
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+        });
+    }
+}
+
+/**
+ * @brief One parallel for loop on an increasing number of threads
+ *
+ * Items are loop iterations; threads_1 runs the chunks on the calling thread.
+ */
+void addParallelLoopBenchmarks(BenchmarkRunner &runner)
+{
+    for (size_t threads : {1, 2, 4, 8}) {
+        runner.add("parallel/builtins_200k/threads_" + std::to_string(threads), [threads](size_t iterations) {
+            auto interpreter = quietInterpreter();
+            interpreter->setThreadCount(threads);
+            interpreter->execute("a = 0");
+            for (size_t i = 0; i < iterations; ++i) {
+                interpreter->execute("parallel (a) for (i = 1; i <= 200000; i++) { a += sin(i) * sqrt(i) }");
+                if (!interpreter->getLastError().empty()) {
+                    throw std::runtime_error(interpreter->getLastError());
+                }
+            }
+        }, 200000);
+    }
+}
+
+/**
+ * @brief libm against the fast-math version of each function that has one
+ *
+ * math/NAME/scalar_* call the builtin on 4096 arguments spread over a typical
+ * range, math/NAME/batch_* evaluate it over a column of the same arguments.
+ * The fast results are labelled with their largest relative error against
+ * libm on those arguments.
+ */
+void addFastMathBenchmarks(BenchmarkRunner &runner)
+{
+    struct Range {
+        const char *name;
+        double low, high; // First argument
+        double exponentLow, exponentHigh; // Second argument of pow
+    };
+    const Range ranges[] = {
+        {"sin", -10, 10, 0, 0}, {"cos", -10, 10, 0, 0}, {"tan", -1.5, 1.5, 0, 0},
+        {"exp", -50, 50, 0, 0}, {"log", 1e-3, 1e3, 0, 0}, {"log2", 1e-3, 1e3, 0, 0},
+        {"log10", 1e-3, 1e3, 0, 0}, {"pow", 0.1, 10, -5, 5},
+    };
+    constexpr size_t Count = 4096;
+
+    BuiltinRegistry fastMath;
+    fastMath.setFastMath(true);
+    for (const Range &range : ranges) {
+        const BuiltinFunction *exact = BuiltinRegistry::standard().find(range.name);
+        const BuiltinFunction *fast = fastMath.find(range.name); // Entries of a static table
+        const size_t arity = exact->minArgs;
+
+        // A low-discrepancy sequence covers the range evenly without sorting the arguments
+        auto inputs = std::make_shared<std::vector<std::vector<double>>>(arity, std::vector<double>(Count));
+        auto arguments = std::make_shared<std::vector<Value>>();
+        for (size_t i = 0; i < Count; ++i) {
+            double spread = std::fmod(0.5 + 0.6180339887498949 * static_cast<double>(i), 1.0);
+            (*inputs)[0][i] = range.low + (range.high - range.low) * spread;
+            arguments->push_back(Value((*inputs)[0][i]));
+            if (arity == 2) {
+                (*inputs)[1][i] = range.exponentLow + (range.exponentHigh - range.exponentLow) * (1.0 - spread);
+                arguments->push_back(Value((*inputs)[1][i]));
+            }
+        }
+
+        // Batches may use a kernel where single calls keep libm, so both are measured
+        const std::string expression = std::string(range.name) + (arity == 2 ? "(x, y)" : "(x)");
+        std::vector<double> batch(Count);
+        {
+            auto interpreter = quietInterpreter();
+            interpreter->setFastMath(true);
+            std::vector<BatchColumn> columns = {{"x", (*inputs)[0]}};
+            if (arity == 2) {
+                columns.push_back({"y", (*inputs)[1]});
+            }
+            interpreter->evaluateBatch(expression, columns, batch);
+        }
+        double scalarWorst = 0.0;
+        double batchWorst = 0.0;
+        for (size_t i = 0; i < Count; ++i) {
+            Span<const Value> args(arguments->data() + i * arity, arity);
+            double reference = exact->function(args).toNumber();
+            scalarWorst = std::max(scalarWorst, std::abs((fast->function(args).toNumber() - reference) / reference));
+            batchWorst = std::max(batchWorst, std::abs((batch[i] - reference) / reference));
+        }
+        auto accuracy = [](double worst) {
+            std::ostringstream label;
+            label << "max relative error " << std::setprecision(2) << worst;
+            return label.str();
+        };
+        const std::string scalarLabel = fast->function == exact->function ? "libm, faster than the kernel" : accuracy(scalarWorst);
+
+        for (const BuiltinFunction *builtin : {exact, fast}) {
+            const bool approximate = builtin == fast;
+            const std::string variant = approximate ? "fast" : "libm";
+            const std::string label = approximate ? scalarLabel : "";
+            runner.add("math/" + std::string(range.name) + "/scalar_" + variant, [builtin, arguments, arity](size_t iterations) {
+                const size_t calls = arguments->size() / arity;
+                for (size_t i = 0; i < iterations; ++i) {
+                    for (size_t call = 0; call < calls; ++call) {
+                        doNotOptimize(builtin->function(Span<const Value>(arguments->data() + call * arity, arity)));
+                    }
+                }
+            }, Count, label);
+            runner.add("math/" + std::string(range.name) + "/batch_" + variant, [approximate, expression, inputs](size_t iterations) {
+                auto interpreter = quietInterpreter();
+                interpreter->setFastMath(approximate);
+                std::vector<BatchColumn> columns = {{"x", (*inputs)[0]}};
+                if (inputs->size() == 2) {
+                    columns.push_back({"y", (*inputs)[1]});
+                }
+                std::vector<double> out(Count);
+                for (size_t i = 0; i < iterations; ++i) {
+                    if (!interpreter->evaluateBatch(expression, columns, out)) {
+                        throw std::runtime_error(interpreter->getLastError());
+                    }
+                    doNotOptimize(out.data());
+                }
+            }, Count, approximate ? accuracy(batchWorst) : "");
+        }
+    }
+}
+
+/**
+ * @brief Run every .glo file of a directory on a fresh interpreter
+ */
+void addScriptBenchmarks(BenchmarkRunner &runner, const std::string &directory)
+{
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.path().extension() == ".glo") {
+            files.push_back(entry.path());
+        }
+    }
+    if (error) {
+        std::cerr << "Warning: no scripts benchmarked, cannot read '" << directory << "'" << std::endl;
+    }
+    std::sort(files.begin(), files.end());
+
+    for (const auto &file : files) {
+        std::ifstream in(file, std::ios::binary);
+        auto source = std::make_shared<std::string>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        double lines = static_cast<double>(std::count(source->begin(), source->end(), '\n'));
+        runner.add("script/" + file.stem().string(), [source](size_t iterations) {
+            for (size_t i = 0; i < iterations; ++i) {
+                auto interpreter = quietInterpreter();
+                interpreter->executeSource(*source); // Scripts with deliberate errors are measured too
+            }
+        }, lines);
+    }
+}
+
+void printUsage(const char *programName)
+{
+    std::cout << "Usage: " << programName << " [OPTIONS]\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  --filter TEXT       Run only benchmarks whose name contains TEXT\n";
+    std::cout << "  --min-time SECONDS  Minimum duration of one timed run (default 0.1)\n";
+    std::cout << "  --repetitions N     Timed runs per benchmark; the median is reported (default 3)\n";
+    std::cout << "  --json FILE         Also write the results as JSON (- for standard output)\n";
+    std::cout << "  --scripts DIR       Directory of .glo files for the script benchmarks\n";
+    std::cout << "  --list              List the benchmark names and exit\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    std::string filter;
+    double minSeconds = 0.1;
+    size_t repetitions = 3;
+    std::string jsonPath;
+    std::string scripts = GLOSSAI_BENCH_SCRIPTS;
+    bool list = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            minSeconds = std::stod(argv[++i]);
+        } else if (arg == "--repetitions" && hasValue) {
+            repetitions = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++i];
+        } else if (arg == "--scripts" && hasValue) {
+            scripts = argv[++i];
+        } else if (arg == "--list") {
+            list = true;
+        } else {
+            printUsage(argv[0]);
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    BenchmarkRunner runner;
+    addLexerBenchmarks(runner);
+    addParserBenchmarks(runner);
+    addContextBenchmarks(runner);
+    addValueBenchmarks(runner);
+    addBuiltinBenchmarks(runner);
+    addInterpreterBenchmarks(runner);
+    addLoopBenchmarks(runner);
+    addSharedProgramBenchmarks(runner);
+    addParallelLoopBenchmarks(runner);
+    addFastMathBenchmarks(runner);
+    addScriptBenchmarks(runner, scripts);
+
+    if (list) {
+        for (const std::string &name : runner.names()) {
+            std::cout << name << "\n";
+        }
+        return 0;
+    }
+
+    // With JSON on standard output, the table goes to standard error
+    std::ostream &log = jsonPath == "-" ? std::cerr : std::cout;
+    std::vector<BenchmarkResult> results = runner.run(filter, minSeconds, repetitions, log);
+
+    if (jsonPath == "-") {
+        writeJson(results, argv[0], std::cout);
+    } else if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        writeJson(results, argv[0], out);
+        if (!out) {
+            std::cerr << "Error: Could not write '" << jsonPath << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    bool failed = std::any_of(results.begin(), results.end(),
+                              [](const BenchmarkResult &result) { return !result.error.empty(); });
+    return failed ? 1 : 0;
+}
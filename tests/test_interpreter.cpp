@@ -1,9 +1,37 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <cassert>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <vector>
 #include "interpreter.h"
+#include "arrayops.h"
+#include "compiledprogram.h"
 #include "context.h"
+#include "dependencygraph.h"
+#include "fastmath.h"
+#include "lexer.h"
+#include "lineparser.h"
+#include "outputsink.h"
+#include "parser.h"
+#include "profiler.h"
+#include "server.h"
+#ifdef GLOSSAI_ENABLE_JIT
+#include "jit.h"
+#include "resolver.h"
+#endif
+#include "threadpool.h"
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 // Simple test framework
 class TestRunner {
@@ -158,6 +186,1651 @@ void test_complex_expressions() {
     TestRunner::assert_equal("13", result, "Variables in complex expressions");
 }
 
+void test_bytecode_vm() {
+    std::cout << "\n=== Testing Bytecode VM ===" << std::endl;
+    
+    // Every snippet must produce the same result on the VM and the tree walker
+    const std::vector<std::string> program = {
+        "x = 5",
+        "x++",
+        "++x",
+        "x--",
+        "--x",
+        "x += 10",
+        "x -= 3",
+        "x *= 2",
+        "x /= 4",
+        "17 mod 5",
+        "17 div 5",
+        "2 ^ 10",
+        "-x + 1",
+        "x > 3 and x < 10",
+        "x < 3 or x == 6",
+        "not (x == 6)",
+        "y = if (x > 3) x * 2 else x",
+        "s = \"a\" + \"b\"",
+        "i = 0",
+        "total = 0",
+        "while (i < 100) { total += i; i++ }",
+        "total",
+        "max(sqrt(16), abs(-3))"
+    };
+    
+    Interpreter vmInterpreter;
+    Interpreter treeInterpreter;
+    treeInterpreter.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    
+    bool allMatch = true;
+    for (const auto &line : program) {
+        std::string vmResult = vmInterpreter.execute(line);
+        std::string treeResult = treeInterpreter.execute(line);
+        if (vmResult != treeResult || vmInterpreter.getLastError() != treeInterpreter.getLastError()) {
+            std::cout << "  Mismatch for '" << line << "': " << vmResult << " vs " << treeResult << std::endl;
+            allMatch = false;
+        }
+    }
+    TestRunner::assert_true(allMatch, "VM matches tree-walking evaluator");
+    TestRunner::assert_equal("4950", vmInterpreter.execute("total"), "VM while loop accumulates");
+    
+    // Errors are reported the same way
+    vmInterpreter.execute("missing + 1");
+    TestRunner::assert_equal("Undefined variable: missing", vmInterpreter.getLastError(), "VM undefined variable error");
+    vmInterpreter.execute("1 / 0");
+    TestRunner::assert_equal("Division by zero", vmInterpreter.getLastError(), "VM division by zero error");
+}
+
+void test_slot_resolution() {
+    std::cout << "\n=== Testing Slot Resolution ===" << std::endl;
+    
+    Interpreter interpreter;
+    interpreter.execute("a = 1");
+    interpreter.execute("a + b");
+    
+    // Referencing an undefined name reserves a slot but does not define it
+    auto identifiers = interpreter.getAvailableIdentifiers();
+    TestRunner::assert_true(identifiers.size() == 1 && identifiers[0] == "a", "Only assigned variables are listed");
+    TestRunner::assert_equal("Undefined variable: b", interpreter.getLastError(), "Reserved slot is still undefined");
+    
+    // Once assigned, the reserved slot is used
+    interpreter.execute("b = 41");
+    TestRunner::assert_equal("42", interpreter.execute("a + b"), "Reserved slot picks up later assignment");
+    
+    // Direct Context access and slot access agree
+    Context context;
+    context.setVariable("x", Value(3.0));
+    SlotRef ref = context.resolveVariable("x");
+    context.slot(ref).value = Value(7.0);
+    TestRunner::assert_equal("7", context.getVariable("x").toString(), "Slot writes are visible by name");
+    context.removeVariable("x");
+    TestRunner::assert_true(!context.hasVariable("x") && !context.slot(ref).defined, "Removed variable leaves an undefined slot");
+}
+
+void test_compact_values() {
+    std::cout << "\n=== Testing Compact Values ===" << std::endl;
+    
+    TestRunner::assert_true(sizeof(Value) == 16, "Value is 16 bytes");
+    
+    // Equal strings share one interned payload, released with the last reference
+    size_t before = StringTable::size();
+    {
+        Value a(std::string("interned-test"));
+        Value b("interned-test");
+        Value c = a;
+        TestRunner::assert_true(a == b && c == b && StringTable::size() == before + 1, "Equal strings are interned once");
+        c = Value(1.0);
+        TestRunner::assert_equal("interned-test", b.toString(), "String survives other references going away");
+    }
+    TestRunner::assert_true(StringTable::size() == before, "Interned string is freed with its last reference");
+    
+    Interpreter interpreter;
+    interpreter.execute("s = \"ab\" + \"cd\"");
+    TestRunner::assert_equal("abcd", interpreter.execute("s"), "String concatenation through variables");
+}
+
+void test_program_arena() {
+    std::cout << "\n=== Testing Program Arena ===" << std::endl;
+    
+    Lexer lexer;
+    Parser parser;
+    auto program = parser.parse(lexer.tokenize("{ a = 1; b = a + sqrt(4) }"));
+    TestRunner::assert_true(program && dynamic_cast<BlockNode*>(program->root()) != nullptr, "Parse produces a program with a root");
+    // a, 1, =, b, a, sqrt, 4, call, +, =, block
+    TestRunner::assert_true(program->nodeCount() == 11, "Every node is allocated from the program");
+    TestRunner::assert_equal("{ (a = 1); (b = (a + sqrt(4))) }", program->root()->toString(), "Arena tree keeps its structure");
+    
+    // A failed parse releases whatever was built before the error
+    TestRunner::assert_true(parser.parse(lexer.tokenize("{ a = (1 + }")) == nullptr, "Failed parse returns no program");
+    
+    Arena arena(64);
+    int *first = arena.make<int>(1);
+    int *second = arena.make<int>(2);
+    TestRunner::assert_true(second == first + 1, "Arena lays objects out contiguously");
+    arena.allocate(1000);
+    TestRunner::assert_true(arena.bytesReserved() >= 1064, "Oversized allocations get their own block");
+}
+
+void test_lexer_tokens() {
+    std::cout << "\n=== Testing Lexer Tokens ===" << std::endl;
+    
+    Lexer lexer;
+    std::string source = "WHILE Count pi \"a\\\"b\\n\"";
+    auto tokens = lexer.tokenize(source);
+    TestRunner::assert_true(tokens.size() == 5 && tokens[0].type == TokenType::While, "Keywords are case-insensitive");
+    TestRunner::assert_true(tokens[1].type == TokenType::Identifier && tokens[1].value == "Count", "Identifiers keep their spelling");
+    TestRunner::assert_true(tokens[1].value.data() == source.data() + 6, "Token values view the source");
+    TestRunner::assert_true(tokens[2].type == TokenType::Number, "Named constants become numbers");
+    TestRunner::assert_equal("a\\\"b\\n", std::string(tokens[3].value), "String tokens hold the raw literal");
+    TestRunner::assert_equal("a\"b\n", Lexer::unescape(tokens[3].value), "Escapes are decoded on demand");
+    
+    Interpreter interpreter;
+    interpreter.execute(std::string("Value = 2"));
+    interpreter.execute(std::string("VALUE = 3"));
+    TestRunner::assert_equal("5", interpreter.execute("Value + VALUE"), "Parsed names outlive their source");
+}
+
+void test_streaming_script() {
+    std::cout << "\n=== Testing Streaming Script ===" << std::endl;
+    
+    Interpreter interpreter;
+    std::istringstream script("# setup\nx = 2\ny = x *\n  3; y + 1\n\nz = (1 + ) + 5\nw = 4\nw * 2\n");
+    std::vector<Interpreter::StatementResult> results;
+    bool ok = interpreter.executeScript(script, [&](const Interpreter::StatementResult &result) {
+        results.push_back(result);
+    });
+    TestRunner::assert_true(!ok && results.size() == 6, "Every statement is reported");
+    TestRunner::assert_equal("6", results[1].value, "Statements may span lines");
+    TestRunner::assert_true(results[2].line == 4 && results[2].value == "7", "Statements may share a line");
+    TestRunner::assert_true(results[3].line == 6 && !results[3].error.empty(), "Syntax errors report their line");
+    TestRunner::assert_equal("8", results[5].value, "Parsing resumes after the failed line");
+    TestRunner::assert_true(interpreter.getLastError().rfind("Line 6: ", 0) == 0, "First error is kept");
+    TestRunner::assert_true(interpreter.getCacheStatistics().size == 0, "Streamed statements bypass the cache");
+}
+
+void test_whole_script() {
+    std::cout << "\n=== Testing Whole-Script Execution ===" << std::endl;
+    
+    const std::string source =
+        "# setup\nn = 0\n  # indented comment\nwhile (n < 3) {\n    n++\n}\n"
+        "y = n++\n++n\nz = (1 + ) + 5\nfunction sq(x) {\n    return x * x\n}\nsq(n); e\n";
+    Interpreter interpreter;
+    std::vector<Interpreter::StatementResult> results;
+    std::vector<std::string> sources;
+    bool ok = interpreter.executeSource(source, [&](const Interpreter::StatementResult &result) {
+        results.push_back(result);
+        sources.emplace_back(result.source);
+    });
+    TestRunner::assert_true(!ok && results.size() == 8, "Every statement is reported");
+    TestRunner::assert_true(results[1].line == 4 && sources[1] == "while (n < 3) {\n    n++\n}",
+                            "Blocks span lines and keep their source text");
+    TestRunner::assert_true(results[2].value == "3" && results[3].value == "5", "Postfix operators end at the line");
+    TestRunner::assert_true(results[4].line == 9 && !results[4].error.empty(), "Syntax errors report their line");
+    TestRunner::assert_true(results[6].value == "25" && sources[6] == "sq(n)", "Statements may share a line");
+    TestRunner::assert_true(sources[7] == "e" && results[7].value == "2.718282", "Source text is as written");
+    TestRunner::assert_true(interpreter.getLastError().rfind("Line 9: ", 0) == 0, "First error is kept");
+    TestRunner::assert_true(interpreter.getCacheStatistics().size == 0, "Script statements bypass the cache");
+    
+    std::string path = (std::filesystem::temp_directory_path() / "glossai_whole_script.glo").string();
+    {
+        std::ofstream file(path);
+        file << "total = 0\nfor (i = 1; i <= 100; i++) {\n    total += i\n}\ntotal\n";
+    }
+    Interpreter fromFile;
+    std::string last;
+    ok = fromFile.executeProgram(path, [&](const Interpreter::StatementResult &result) { last = result.value; });
+    std::filesystem::remove(path);
+    TestRunner::assert_true(ok && last == "5050", "Mapped file runs as one program");
+    
+    ok = fromFile.executeProgram(path);
+    TestRunner::assert_true(!ok && !fromFile.getLastError().empty(), "Missing file is an error");
+}
+
+void test_structured_results() {
+    std::cout << "\n=== Testing Structured Results ===" << std::endl;
+    
+    Interpreter interpreter;
+    Interpreter::Result result = interpreter.evaluate("rate = 0.05");
+    TestRunner::assert_true(result.ok() && result.number() == 0.05, "Assignment yields its value");
+    result = interpreter.evaluate("1000 * (1 + rate) ^ 2");
+    TestRunner::assert_true(result.ok() && result.value.isNumber() && std::abs(result.number() - 1102.5) < 1e-9,
+                            "Numbers come back unformatted");
+    result = interpreter.evaluate("{ k = 1 }");
+    TestRunner::assert_true(result.ok() && result.value.getType() == Value::Null, "Statements have no result");
+    
+    result = interpreter.evaluate("x = (1 + ");
+    TestRunner::assert_true(result.status == Interpreter::Status::SyntaxError && result.line == 1 &&
+                            result.column == 10 && result.error == interpreter.getLastError(),
+                            "Syntax errors carry their location");
+    result = interpreter.evaluate("{ a = 1;\n  b = a + * 2 }");
+    TestRunner::assert_true(result.line == 2 && result.column == 11, "Location spans lines");
+    result = interpreter.evaluate("1 / 0");
+    TestRunner::assert_true(result.status == Interpreter::Status::RuntimeError && result.line == 1 &&
+                            result.column == 3 && result.code == ErrorCode::DivisionByZero && !result.error.empty(),
+                            "Runtime errors are reported at the failing operator");
+    TestRunner::assert_true(interpreter.evaluate("2 + 2").ok() && interpreter.getLastError().empty(),
+                            "Success clears the last error");
+    
+    std::vector<Interpreter::Result> results;
+    std::vector<std::string> lines = {"  rate * 100 ", "", "rate ** ", "\t", "sqrt(16)"};
+    size_t failures = interpreter.evaluateMultiple(lines, results);
+    TestRunner::assert_true(failures == 1 && results.size() == 3 && results[0].number() == 5 &&
+                            !results[1].ok() && results[2].number() == 4, "Lines are trimmed and empty ones skipped");
+    const Interpreter::Result *buffer = results.data();
+    interpreter.evaluateMultiple(lines, results);
+    TestRunner::assert_true(results.data() == buffer && results.size() == 3, "The buffer is reused");
+    TestRunner::assert_true(interpreter.executeMultiple(lines) == std::vector<std::string>({"5", "", "4"}),
+                            "executeMultiple() agrees");
+}
+
+void test_optimizer() {
+    std::cout << "\n=== Testing Optimizer ===" << std::endl;
+    
+    Interpreter interpreter;
+    interpreter.setOptimizationLevel(1);
+    TestRunner::assert_equal("(6.283185 * r)", interpreter.dumpTree("2*pi*r"), "Constants are folded");
+    TestRunner::assert_equal("0.707107", interpreter.dumpTree("sqrt(2)/2"), "Pure builtins are folded");
+    TestRunner::assert_equal("a", interpreter.dumpTree("if (1) a else b"), "Constant branch is selected");
+    TestRunner::assert_equal("(1 / 0)", interpreter.dumpTree("1/0"), "Failing expression is not folded");
+    
+    interpreter.setOptimizationLevel(2);
+    TestRunner::assert_equal("((x * x) + (y * 0.250000))", interpreter.dumpTree("x^2 + y/4"), "Strength reduction");
+    interpreter.execute("tiny = 2^-1000");
+    TestRunner::assert_true(interpreter.evaluate("tiny / 2^-1074").number() == std::ldexp(1.0, 74),
+                            "Divisors without a finite reciprocal are kept");
+    std::string loop = "{ r = 2; i = 0; s = 0; while (i < 3) { s = s + sin(r) * r; i++ } }";
+    TestRunner::assert_equal("{ (r = 2); (i = 0); (s = 0); { ($inv0 = (sin(r) * r)); while ((i < 3)) { (s = (s + $inv0)); (++i) } } }",
+                             interpreter.dumpTree(loop), "Loop invariant is hoisted");
+    
+    // Optimized programs give the same results and errors as unoptimized ones
+    const std::vector<std::string> program = {
+        loop, "s", "2 ^ 2 + 3 * 4", "1 / 0", "if (2 > 1) 10 else 20", "sqrt(-4)",
+        "{ k = 5; j = 0; t = 0; while (j < 4) { t += k * 2 / 8; j++ } }", "t", "while (0) 1"
+    };
+    Interpreter reference;
+    bool allMatch = true;
+    for (const auto &line : program) {
+        std::string optimized = interpreter.execute(line);
+        std::string plain = reference.execute(line);
+        if (optimized != plain || interpreter.getLastError() != reference.getLastError()) {
+            std::cout << "  Mismatch for '" << line << "': " << optimized << " vs " << plain << std::endl;
+            allMatch = false;
+        }
+    }
+    TestRunner::assert_true(allMatch, "Optimized results match unoptimized ones");
+    
+    auto identifiers = interpreter.getAvailableIdentifiers();
+    TestRunner::assert_true(std::find(identifiers.begin(), identifiers.end(), "$inv0") == identifiers.end(), "Temporaries are not listed");
+}
+
+void test_parse_cache() {
+    std::cout << "\n=== Testing Parse Cache ===" << std::endl;
+    
+    Interpreter interpreter;
+    interpreter.execute("x = 1");
+    interpreter.execute("x = x + 1");
+    interpreter.execute("x = x + 1");
+    TestRunner::assert_equal("3", interpreter.execute("x"), "Cached program sees updated variables");
+    auto stats = interpreter.getCacheStatistics();
+    TestRunner::assert_true(stats.hits == 1 && stats.misses == 3 && stats.size == 3, "Repeated source is a cache hit");
+    
+    // Syntax checks share the cache, failures included
+    TestRunner::assert_true(interpreter.isValidSyntax("x"), "Cached program is valid syntax");
+    TestRunner::assert_true(!interpreter.isValidSyntax("2 +"), "Invalid syntax is rejected");
+    interpreter.execute("2 +");
+    TestRunner::assert_true(!interpreter.getLastError().empty(), "Cached parse error is reported");
+    TestRunner::assert_true(interpreter.getCacheStatistics().hits == 3, "Syntax checks hit the cache");
+    
+    interpreter.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    TestRunner::assert_equal("3", interpreter.execute("x"), "Cached program runs on the evaluator");
+    
+    // Entries are bound to the context they ran in
+    interpreter.clearContext();
+    TestRunner::assert_true(interpreter.getCacheStatistics().size == 0, "Clearing the context empties the cache");
+    interpreter.execute("x");
+    TestRunner::assert_true(!interpreter.getLastError().empty(), "Cleared variable is undefined");
+    
+    interpreter.setCacheCapacity(2);
+    interpreter.execute("1 + 1");
+    interpreter.execute("2 + 2");
+    interpreter.execute("3 + 3");
+    TestRunner::assert_true(interpreter.getCacheStatistics().size == 2, "Cache is bounded");
+    
+    interpreter.setCacheCapacity(0);
+    TestRunner::assert_equal("8", interpreter.execute("4 + 4"), "Disabled cache still executes");
+    TestRunner::assert_true(interpreter.getCacheStatistics().size == 0, "Disabled cache keeps nothing");
+}
+
+Value hypot_function(Span<const Value> args) {
+    return Value(std::hypot(args[0].toNumber(), args[1].toNumber()));
+}
+
+void test_builtin_functions() {
+    std::cout << "\n=== Testing Builtin Function Table ===" << std::endl;
+    
+    Interpreter interpreter;
+    TestRunner::assert_equal("3", interpreter.execute("floor(3.7)"), "Floor function");
+    TestRunner::assert_equal("4", interpreter.execute("ceil(3.2)"), "Ceil function");
+    TestRunner::assert_equal("-3", interpreter.execute("round(-2.5)"), "Round function");
+    TestRunner::assert_equal("3", interpreter.execute("log2(8)"), "Log2 function");
+    TestRunner::assert_equal("0", interpreter.execute("asin(0)"), "Asin function");
+    
+    interpreter.execute("asin(2)");
+    TestRunner::assert_equal("Arcsine of value outside [-1, 1]", interpreter.getLastError(), "Asin domain error");
+    
+    interpreter.execute("sqrt(1, 2)");
+    TestRunner::assert_equal("Unknown function: sqrt with 2 arguments", interpreter.getLastError(), "Arity mismatch error");
+    
+    // Embedder functions are bound like the standard ones, in both engines
+    interpreter.registerFunction("hypot", 2, 2, hypot_function);
+    TestRunner::assert_equal("5", interpreter.execute("hypot(3, 4)"), "Registered function on the VM");
+    interpreter.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    TestRunner::assert_equal("13", interpreter.execute("hypot(5, 12)"), "Registered function on the evaluator");
+    
+    auto names = interpreter.getBuiltinFunctions();
+    TestRunner::assert_true(!names.empty() && names.front() == "sin" && names.back() == "hypot", "Registered function is listed");
+}
+
+void test_batch_evaluation() {
+    std::cout << "\n=== Testing Batch Evaluation ===" << std::endl;
+    
+    Interpreter interpreter;
+    interpreter.execute("c = 10");
+    std::vector<double> a(1000), b(1000), out(1000);
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = static_cast<double>(i);
+        b[i] = 0.001 * static_cast<double>(i);
+    }
+    bool ok = interpreter.evaluateBatch("a*sin(b)+c", {{"a", a}, {"b", b}}, out);
+    bool allMatch = ok;
+    for (size_t i = 0; i < out.size(); ++i) {
+        allMatch = allMatch && out[i] == a[i] * std::sin(b[i]) + 10;
+    }
+    TestRunner::assert_true(allMatch, "Batch matches scalar evaluation across chunks");
+    
+    // Failures are per row: the other rows still get their values
+    std::vector<double> divisors = {1, 0, 4};
+    std::vector<double> quotients(3);
+    ok = interpreter.evaluateBatch("12 / d", {{"d", divisors}}, quotients);
+    TestRunner::assert_true(!ok && quotients[0] == 12 && std::isnan(quotients[1]) && quotients[2] == 3, "Failed row is NaN");
+    TestRunner::assert_equal("Row 1: Division by zero (1 of 3 rows failed)", interpreter.getLastError(), "Failed row is reported");
+    
+    ok = interpreter.evaluateBatch("sqrt(d - 2)", {{"d", divisors}}, quotients);
+    TestRunner::assert_equal("Row 0: Square root of negative number (2 of 3 rows failed)", interpreter.getLastError(), "Domain errors are per row");
+    
+    interpreter.registerFunction("hypot", 2, 2, hypot_function);
+    ok = interpreter.evaluateBatch("hypot(d, 3) > 3", {{"d", divisors}}, quotients);
+    TestRunner::assert_true(ok && quotients[0] == 1 && quotients[1] == 0, "Registered functions run per row");
+    
+    ok = interpreter.evaluateBatch("x = d", {{"d", divisors}}, quotients);
+    TestRunner::assert_true(!ok && !interpreter.getLastError().empty(), "Assignments are rejected");
+    ok = interpreter.evaluateBatch("d + undefinedName", {{"d", divisors}}, quotients);
+    TestRunner::assert_equal("Undefined variable: undefinedName", interpreter.getLastError(), "Unknown inputs are rejected");
+}
+
+#ifdef GLOSSAI_ENABLE_JIT
+void test_jit() {
+    std::cout << "\n=== Testing JIT Tier ===" << std::endl;
+    
+    const std::string loop = "{ i = 0; s = 0; while (i < 2000 and not (s < 0)) { s += sqrt(i) * 2 - i % 7; i++ } }";
+#if defined(__x86_64__) || defined(_M_X64)
+    {
+        Context context;
+        Lexer lexer;
+        Parser parser;
+        auto program = parser.parse(lexer.tokenize(loop));
+        Resolver().resolve(program->root(), &context);
+        auto native = JitCompiler().compile(program->root(), true);
+        Value result;
+        TestRunner::assert_true(native && native->run(&context, result), "Numeric loop compiles and runs");
+        TestRunner::assert_true(context.getVariable("i").toNumber() == 2000, "Native code writes variables back");
+        
+        auto printing = parser.parse(lexer.tokenize("print(i)"));
+        Resolver().resolve(printing->root(), &context);
+        TestRunner::assert_true(!JitCompiler().compile(printing->root(), true), "Side effects are not compiled");
+        
+        // A stop request makes native loops bail out without touching the context
+        std::atomic<bool> stop(true);
+        context.setVariable("i", Value(0.0));
+        auto stoppable = JitCompiler().compile(program->root(), true, &stop);
+        TestRunner::assert_true(stoppable && !stoppable->run(&context, result) &&
+                                context.getVariable("i").toNumber() == 0,
+                                "Stopped native loop bails out");
+    }
+#endif
+    
+    // Repeated runs get promoted; results and errors match the reference evaluator
+    const std::vector<std::string> program = {
+        loop, "s", "x = 3", "y = x * 2 + pow(x, 2)", "x / (y - 15)", "x = \"text\"", "x + 1", "x = 4",
+        "if (x > 3) sqrt(x) else -x", "z += 1", "log(x - 4)", "{ n = 10; f = 1; while (n > 1) { f *= n--; } }", "f"
+    };
+    Interpreter jit;
+    Interpreter reference;
+    reference.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    bool allMatch = true;
+    for (int round = 0; round < 2 * static_cast<int>(JitFunction::RunThreshold); ++round) {
+        for (const auto &line : program) {
+            std::string native = jit.execute(line);
+            std::string expected = reference.execute(line);
+            if (native != expected || jit.getLastError() != reference.getLastError()) {
+                std::cout << "  Mismatch for '" << line << "': " << native << " vs " << expected << std::endl;
+                allMatch = false;
+            }
+        }
+    }
+    TestRunner::assert_true(allMatch, "JIT results match the evaluator");
+    
+    // Promoted loops still honour stop requests
+    const std::string counting = "{ k = 0; while (k < limit) k++ }";
+    jit.execute("limit = 2000");
+    for (size_t run = 0; run < JitFunction::RunThreshold; ++run) {
+        jit.execute(counting);
+    }
+    jit.execute("limit = 1000000000 * 1000000");
+    std::thread stopper([&jit] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        jit.requestStop();
+    });
+    jit.execute(counting);
+    stopper.join();
+    TestRunner::assert_equal("Execution stopped", jit.getLastError(), "Native loop stops on request");
+}
+#endif
+
+void test_user_functions() {
+    std::cout << "\n=== Testing User Functions ===" << std::endl;
+    
+    // The VM and the tree-walking evaluator agree on results and errors
+    const std::vector<std::string> program = {
+        "function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2) }", "fib(10)",
+        "{ s = 0; for (i = 1; i <= 10; i++) { s += i } }", "s",
+        "function fact(n) { r = 1; for (; n > 1; n--) r *= n; return r }", "fact(5)", "r",
+        "function first(limit) { for (k = 0; ; k++) { if (k * k > limit) return k } }", "first(50)",
+        "fib(1, 2)", "nothing(1)", "function down(n) { return down(n + 1) }", "down(0)"
+    };
+    Interpreter vm;
+    Interpreter reference;
+    reference.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    bool allMatch = true;
+    for (const auto &line : program) {
+        std::string compiled = vm.execute(line);
+        std::string expected = reference.execute(line);
+        if (compiled != expected || vm.getLastError() != reference.getLastError()) {
+            std::cout << "  Mismatch for '" << line << "': " << compiled << " vs " << expected << std::endl;
+            allMatch = false;
+        }
+    }
+    TestRunner::assert_true(allMatch, "VM results match the evaluator");
+    
+    TestRunner::assert_equal("55", vm.execute("fib(10)"), "Recursive function");
+    TestRunner::assert_equal("55", vm.execute("s"), "For loop");
+    TestRunner::assert_equal("120", vm.execute("fact(5)"), "Function with a local loop");
+    vm.execute("r");
+    TestRunner::assert_true(!vm.getLastError().empty(), "Locals do not leak into globals");
+    vm.execute("fib(1, 2)");
+    TestRunner::assert_equal("Function fib expects 1 arguments, got 2", vm.getLastError(), "Arity is checked");
+    
+    vm.setMaxCallDepth(50);
+    vm.execute("down(0)");
+    TestRunner::assert_equal("Maximum call depth exceeded (50)", vm.getLastError(), "Runaway recursion is stopped");
+    TestRunner::assert_equal("8", vm.execute("fib(6)"), "Calls work again after a depth error");
+    
+    vm.execute("total = 0");
+    vm.execute("function add(x) { total += x }");
+    vm.execute("{ add(2); add(3) }");
+    TestRunner::assert_equal("5", vm.execute("total"), "Functions update globals they do not assign");
+}
+
+void test_memoization() {
+    std::cout << "\n=== Testing Memoization ===" << std::endl;
+    
+    Interpreter interpreter;
+    interpreter.execute("function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2) }");
+    TestRunner::assert_equal("12586269025", interpreter.execute("fib(50)"), "Memoized recursion finishes");
+    auto statistics = interpreter.getMemoStatistics();
+    TestRunner::assert_true(statistics.size() == 1 && statistics[0].function == "fib" &&
+                            statistics[0].misses == 51 && statistics[0].hits == 48, "Each argument is computed once");
+    
+    interpreter.execute("scale = 2");
+    interpreter.execute("function scaled(x) { return x * scale }");
+    interpreter.execute("function shout(x) { print x; return x }");
+    interpreter.execute("scaled(1)");
+    interpreter.execute("shout(1)");
+    TestRunner::assert_true(interpreter.getMemoStatistics().empty(), "Reading globals or printing is impure");
+    interpreter.execute("scale = 3");
+    TestRunner::assert_equal("3", interpreter.execute("scaled(1)"), "Impure functions see global changes");
+    
+    interpreter.execute("function sq(x) { return x * x }");
+    interpreter.execute("function tw(x) { return 2 * sq(x) }");
+    interpreter.execute("tw(3)");
+    interpreter.execute("function sq(x) { return x * x * x }");
+    TestRunner::assert_equal("54", interpreter.execute("tw(3)"), "Redefining a callee drops cached results");
+    
+    interpreter.setMemoCapacity(4);
+    interpreter.execute("{ for (i = 0; i < 10; i++) sq(i) }");
+    statistics = interpreter.getMemoStatistics();
+    auto sq = std::find_if(statistics.begin(), statistics.end(),
+                           [](const Interpreter::MemoStatistics &memo) { return memo.function == "sq"; });
+    TestRunner::assert_true(sq != statistics.end() && sq->size == 4 && sq->evictions == 6, "Cache is bounded");
+    
+    interpreter.setMemoCapacity(0);
+    interpreter.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    TestRunner::assert_equal("6765", interpreter.execute("fib(20)"), "Memoization can be turned off");
+    TestRunner::assert_true(interpreter.getMemoStatistics().empty(), "No caches when turned off");
+}
+
+void test_parallel_interpreters() {
+    std::cout << "\n=== Testing Parallel Interpreters ===" << std::endl;
+    
+    // Independent interpreters on pool threads, each printing to its own buffer
+    const size_t scripts = 64;
+    std::vector<std::ostringstream> outputs(scripts);
+    std::vector<std::string> results(scripts);
+    ThreadPool pool(4);
+    for (size_t i = 0; i < scripts; ++i) {
+        pool.submit([&, i] {
+            Interpreter interpreter;
+            interpreter.setOutput(outputs[i]);
+            interpreter.execute("n = " + std::to_string(i));
+            interpreter.execute("function tri(k) { t = 0; for (j = 1; j <= k; j++) t += j; return t }");
+            interpreter.execute("print \"n=\", n");
+            results[i] = interpreter.execute("tri(n)");
+        });
+    }
+    pool.wait();
+    
+    bool allMatch = true;
+    for (size_t i = 0; i < scripts; ++i) {
+        allMatch = allMatch && outputs[i].str() == "n=" + std::to_string(i) + "\n" &&
+                   results[i] == std::to_string(i * (i + 1) / 2);
+    }
+    TestRunner::assert_true(allMatch, "Each interpreter keeps its own output and state");
+    
+    pool.submit([] { throw std::runtime_error("task failed"); });
+    std::string error;
+    try {
+        pool.wait();
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    TestRunner::assert_equal("task failed", error, "Task exceptions reach wait()");
+}
+
+void test_output_sink() {
+    std::cout << "\n=== Testing Output Sinks ===" << std::endl;
+    
+    Interpreter interpreter;
+    std::vector<std::string> blocks;
+    interpreter.setOutput(std::make_unique<CallbackSink>([&](const std::string &text) { blocks.push_back(text); }));
+    interpreter.execute("print \"a\", 1, \" \", 2.5, \" \", -0.125, \" \", 1 < 2");
+    TestRunner::assert_true(blocks.size() == 1 && blocks[0] == "a1 2.500000 -0.125000 true\n",
+                            "Printed line is delivered when execute() returns");
+    
+    blocks.clear();
+    interpreter.execute("{ for (i = 0; i < 1000; i++) print i }");
+    TestRunner::assert_true(blocks.size() == 1, "A printing loop is delivered as one block");
+    
+    // Nested prints keep the order of the old string-building implementation
+    interpreter.execute("function loud(x) { print \"in\"; return x }");
+    for (auto mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        interpreter.setExecutionMode(mode);
+        blocks.clear();
+        interpreter.execute("print \"out\", loud(7)");
+        TestRunner::assert_true(blocks.size() == 1 && blocks[0] == "in\nout7\n", "Inner print comes first");
+    }
+    
+    // Small blocks are delivered early, never splitting a line
+    std::vector<std::string> small;
+    {
+        CallbackSink sink([&](const std::string &text) { small.push_back(text); }, 8);
+        for (const char *line : {"abc\n", "def\n", "a much longer line\n", "x\n"}) {
+            sink.write(line, std::char_traits<char>::length(line));
+        }
+    }
+    TestRunner::assert_true(small == std::vector<std::string>{"abc\ndef\n", "a much longer line\n", "x\n"},
+                            "Blocks end on line boundaries");
+    
+    bool sameText = true;
+    for (double number : {0.0, -0.0, 1.0, -17.0, 0.1, 2.0 / 3.0, -1e-7, 123456.789, 1e15 + 0.5, 1e22, -3e300}) {
+        std::string expected = number == static_cast<double>(static_cast<long long>(number))
+            ? std::to_string(static_cast<long long>(number)) : std::to_string(number);
+        sameText = sameText && Value(number).toString() == expected;
+    }
+    TestRunner::assert_true(sameText, "Numbers format as before");
+}
+
+void test_snapshot() {
+    std::cout << "\n=== Testing Snapshots ===" << std::endl;
+    
+    Interpreter library;
+    for (const char *line : {"rate = 0.05", "name = \"glossai\"", "flag = 1 < 2", "limit = 10",
+                             "function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2) }",
+                             "function grow(x, years) { for (i = 0; i < years; i++) x *= 1 + rate; return x }",
+                             "function count() { k = 0; while (k < limit) k++; return -k }",
+                             "function greet() { print name, \"!\" }"}) {
+        library.execute(line);
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "glossai_snapshot.gloc").string();
+    TestRunner::assert_true(library.saveSnapshot(path), "Snapshot is written");
+    
+    Interpreter restored;
+    TestRunner::assert_true(restored.loadSnapshot(path), "Snapshot is loaded");
+    bool allMatch = true;
+    for (const char *line : {"rate", "name", "flag", "fib(15)", "grow(100, 3)", "count()", "sqrt(limit)"}) {
+        allMatch = allMatch && restored.execute(line) == library.execute(line);
+    }
+    TestRunner::assert_true(allMatch, "Restored variables and functions behave like the originals");
+    std::string printed;
+    restored.setOutput(std::make_unique<CallbackSink>([&](const std::string &text) { printed += text; }));
+    restored.execute("greet()");
+    TestRunner::assert_equal("glossai!\n", printed, "Restored function prints");
+    restored.execute("limit = 3");
+    TestRunner::assert_equal("-3", restored.execute("count()"), "Restored function reads the new global");
+    
+    // Saving the same state gives the same bytes
+    std::string second = (std::filesystem::temp_directory_path() / "glossai_snapshot_2.gloc").string();
+    Interpreter copy;
+    copy.loadSnapshot(path);
+    copy.saveSnapshot(second);
+    auto read = [](const std::string &file) {
+        std::ifstream in(file, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    std::string bytes = read(path);
+    TestRunner::assert_true(bytes == read(second), "Snapshots are deterministic");
+    
+    // Damaged snapshots are rejected as a whole
+    bool allRejected = true;
+    for (size_t size : {size_t(0), size_t(3), size_t(8), bytes.size() / 2, bytes.size() - 1}) {
+        {
+            std::ofstream out(second, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(size));
+        }
+        Interpreter target;
+        target.execute("rate = 1");
+        allRejected = allRejected && !target.loadSnapshot(second) && !target.getLastError().empty() &&
+                      target.execute("rate") == "1" && target.getAvailableIdentifiers().size() == 1;
+    }
+    TestRunner::assert_true(allRejected, "Truncated snapshots leave the context unchanged");
+    std::string wrongVersion = bytes;
+    wrongVersion[4] = 99;
+    {
+        std::ofstream out(second, std::ios::binary | std::ios::trunc);
+        out << wrongVersion;
+    }
+    TestRunner::assert_true(!restored.loadSnapshot(second) &&
+                            restored.getLastError().find("version") != std::string::npos,
+                            "Other format versions are rejected");
+    TestRunner::assert_true(!restored.loadSnapshot(path + ".missing"), "Missing snapshot is reported");
+    
+    std::filesystem::remove(path);
+    std::filesystem::remove(second);
+}
+
+void test_profiler() {
+    std::cout << "\n=== Testing Profiler ===" << std::endl;
+    
+    const char *script = "function fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2) }\n"
+                         "function norm(x, y) { return sqrt(x * x + y * y) }\n"
+                         "total = 0\n"
+                         "for (i = 0; i < 50; i++) { total += norm(i, 2) }\n"
+                         "print fib(10)\n";
+    auto find = [](const std::vector<Profiler::NodeStats> &nodes, const std::string &kind) {
+        for (const Profiler::NodeStats &node : nodes) {
+            if (node.kind == kind) {
+                return node.count;
+            }
+        }
+        return std::uint64_t(0);
+    };
+    
+    for (auto mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (tree walk)";
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        interpreter.setOutput(std::make_unique<CallbackSink>([](const std::string &) {}));
+        interpreter.setProfiling(true);
+        TestRunner::assert_true(interpreter.executeSource(script), "Profiled script runs" + engine);
+        const Profiler &profiler = *interpreter.getProfiler();
+        
+        std::vector<Profiler::LineStats> lines = profiler.lines();
+        TestRunner::assert_equal("5", std::to_string(lines.size()), "Every statement line is recorded" + engine);
+        TestRunner::assert_equal("4", std::to_string(lines.empty() ? 0 : lines[0].line),
+                                 "The loop is the hottest line" + engine);
+        
+        std::vector<Profiler::NodeStats> nodes = profiler.nodes();
+        TestRunner::assert_equal("50", std::to_string(find(nodes, "FunctionCallNode norm")),
+                                 "User function calls are counted" + engine);
+        TestRunner::assert_equal("50", std::to_string(find(nodes, "FunctionCallNode sqrt (builtin)")),
+                                 "Builtin calls are counted" + engine);
+        TestRunner::assert_equal("11", std::to_string(find(nodes, "FunctionCallNode fib")),
+                                 "Memoized calls run once per argument" + engine);
+        TestRunner::assert_equal("8", std::to_string(find(nodes, "FunctionCallNode fib (memo hits)")),
+                                 "Memo hits are counted" + engine);
+        TestRunner::assert_equal("1", std::to_string(find(nodes, "PrintNode")), "Prints are counted" + engine);
+        TestRunner::assert_equal("50", std::to_string(find(nodes, "WhileNode/ForNode iterations")),
+                                 "Loop iterations are counted" + engine);
+        TestRunner::assert_true(find(nodes, "IdentifierNode loads") > 0 && find(nodes, "Assignments") > 0,
+                                "Variable accesses are counted" + engine);
+        
+        std::ostringstream folded;
+        profiler.writeFoldedStacks(folded);
+        TestRunner::assert_true(folded.str().find("line 4;norm;sqrt ") != std::string::npos &&
+                                folded.str().find("line 5;fib;fib;fib") != std::string::npos,
+                                "Folded stacks follow the calls" + engine);
+        std::ostringstream report;
+        profiler.writeReport(report);
+        TestRunner::assert_true(report.str().find("Hot lines") != std::string::npos &&
+                                report.str().find("FunctionCallNode norm") != std::string::npos,
+                                "Report lists hot lines and nodes" + engine);
+    }
+    
+    // Errors close the calls they abandon
+    Interpreter interpreter;
+    interpreter.setProfiling(true);
+    interpreter.execute("function bad(x) { return x + missing }");
+    interpreter.execute("bad(1)");
+    interpreter.execute("bad(2)");
+    std::ostringstream folded;
+    interpreter.getProfiler()->writeFoldedStacks(folded);
+    TestRunner::assert_true(folded.str().find("bad;bad") == std::string::npos, "Failed calls are unwound");
+    
+    interpreter.resetProfile();
+    TestRunner::assert_true(interpreter.getProfiler()->lines().empty(), "Reset forgets the profile");
+    interpreter.setProfiling(false);
+    interpreter.execute("1 + 2");
+    TestRunner::assert_true(interpreter.getProfiler()->lines().empty() && !interpreter.isProfiling(),
+                            "Nothing is recorded while profiling is off");
+}
+
+void test_stop_request() {
+    std::cout << "\n=== Testing Stop Requests ===" << std::endl;
+    
+    // Each runaway program is stopped from another thread
+    auto stopSoon = [](Interpreter &interpreter) {
+        return std::thread([&interpreter] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            interpreter.requestStop();
+        });
+    };
+    
+    for (auto mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (tree walk)";
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        interpreter.execute("x = 0");
+        
+        std::thread stopper = stopSoon(interpreter);
+        interpreter.execute("while (1 < 2) x++");
+        stopper.join();
+        TestRunner::assert_equal("Execution stopped", interpreter.getLastError(), "Runaway loop stops" + engine);
+        TestRunner::assert_true(interpreter.execute("x") != "0", "Loop variables keep their values" + engine);
+        
+        // Exponential recursion without loops; the global write keeps it from being memoized
+        interpreter.execute("function burn(n) { x++; if (n < 2) return n; return burn(n - 1) + burn(n - 2) }");
+        stopper = stopSoon(interpreter);
+        interpreter.execute("burn(60)");
+        stopper.join();
+        TestRunner::assert_equal("Execution stopped", interpreter.getLastError(), "Runaway recursion stops" + engine);
+        
+        TestRunner::assert_equal("3", interpreter.execute("1 + 2"), "Next execution runs normally" + engine);
+    }
+    
+    // A stopped script skips the statements after the interrupted one
+    Interpreter interpreter;
+    std::vector<std::string> errors;
+    std::thread stopper = stopSoon(interpreter);
+    bool success = interpreter.executeSource("a = 1\nwhile (1 < 2) a++\nb = 2\n",
+                                             [&](const Interpreter::StatementResult &result) {
+                                                 errors.push_back(result.error);
+                                             });
+    stopper.join();
+    TestRunner::assert_true(!success && errors.size() == 2 && errors[1] == "Execution stopped",
+                            "Script stops at the interrupted statement");
+    TestRunner::assert_equal("Line 2: Execution stopped", interpreter.getLastError(), "Script reports the stop");
+    TestRunner::assert_equal("", interpreter.execute("b"), "Later statements do not run");
+}
+
+void test_execution_limits() {
+    std::cout << "\n=== Testing Execution Limits ===" << std::endl;
+    
+    for (auto mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (tree walk)";
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        
+        // Ten iterations are ten steps: a limit of ten is enough, nine is not
+        ExecutionLimits limits;
+        limits.maxSteps = 10;
+        interpreter.setLimits(limits);
+        interpreter.execute("i = 0");
+        TestRunner::assert_true(interpreter.evaluate("while (i < 10) i++").ok(), "Loop within the step limit" + engine);
+        limits.maxSteps = 9;
+        interpreter.setLimits(limits);
+        interpreter.execute("i = 0");
+        Interpreter::Result result = interpreter.evaluate("while (i < 10) i++");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Step limit exceeded" + engine);
+        TestRunner::assert_equal("Step limit exceeded (9 steps)", result.error, "Step limit message" + engine);
+        TestRunner::assert_equal("10", interpreter.execute("i"), "Variables keep their values" + engine);
+        
+        // Each execution gets a fresh budget
+        TestRunner::assert_true(interpreter.evaluate("while (i < 15) i++").ok(), "Budget is per execution" + engine);
+        
+        // Calls are steps too, and the limit unwinds them
+        limits.maxSteps = 1000;
+        interpreter.setLimits(limits);
+        interpreter.execute("function spin(n) { if (n < 1) return 0; return spin(n - 1) + 1 }");
+        TestRunner::assert_equal("100", interpreter.execute("spin(100)"), "Calls within the step limit" + engine);
+        result = interpreter.evaluate("spin(5000)");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Recursion exceeds the step limit" + engine);
+        TestRunner::assert_equal("3", interpreter.execute("1 + 2"), "Context usable after unwinding" + engine);
+        
+        limits = ExecutionLimits();
+        limits.maxTime = std::chrono::milliseconds(30);
+        interpreter.setLimits(limits);
+        result = interpreter.evaluate("while (1 < 2) i++");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Time limit exceeded" + engine);
+        TestRunner::assert_equal("Time limit exceeded (30 ms)", result.error, "Time limit message" + engine);
+        
+        // A single string over the limit fails as soon as it is built
+        limits = ExecutionLimits();
+        limits.maxMemory = 1000;
+        interpreter.setLimits(limits);
+        interpreter.execute("s = \"ab\"");
+        result = interpreter.evaluate("while (1 < 2) s = s + s");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "String over the memory limit" + engine);
+        TestRunner::assert_equal("Memory limit exceeded (1000 bytes)", result.error, "Memory limit message" + engine);
+        
+        // Strings below the limit that add up to more are caught by the estimate
+        for (const char *name : {"a", "b", "c", "d"}) {
+            interpreter.execute(std::string(name) + " = \"\"");
+        }
+        result = interpreter.evaluate("while (1 < 2) { a = a + \"x\"; b = b + \"x\"; c = c + \"x\"; d = d + \"x\"; "
+                                      "k = 0; while (k < 50) k++ }");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Variables over the memory limit" + engine);
+        
+        // So are arrays, checked when built even by statements without a loop
+        result = interpreter.evaluate("big = range(1000)");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Range over the memory limit" + engine);
+        TestRunner::assert_true(interpreter.evaluate("small = range(100)").ok(), "Array within the memory limit" + engine);
+        result = interpreter.evaluate("[small, small]");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Literal over the memory limit" + engine);
+        interpreter.setVariable("big", Value(std::vector<double>(1000, 1.0)));
+        result = interpreter.evaluate("big + 1");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded,
+                                "Element-wise result over the memory limit" + engine);
+        
+        limits = ExecutionLimits();
+        limits.maxCallDepth = 10;
+        interpreter.setLimits(limits);
+        TestRunner::assert_equal("5", interpreter.execute("spin(5)"), "Calls within the depth limit" + engine);
+        // spin() is memoized up to 100 by now
+        result = interpreter.evaluate("spin(200)");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Call depth limit exceeded" + engine);
+        
+        interpreter.setLimits(ExecutionLimits());
+        TestRunner::assert_equal("200", interpreter.execute("spin(200)"), "Limits can be lifted" + engine);
+        
+        // Cancelling while idle stops the next execution only
+        interpreter.getCancelToken().cancel();
+        result = interpreter.evaluate("while (1 < 2) i++");
+        TestRunner::assert_true(result.status == Interpreter::Status::Stopped, "Cancelled token stops the next run" + engine);
+        TestRunner::assert_true(!interpreter.getCancelToken().isCancelled(), "Token resets after the run" + engine);
+        interpreter.execute("i = 0");
+        TestRunner::assert_true(interpreter.evaluate("while (i < 5000) i++").ok(), "Run after the stop" + engine);
+    }
+    
+    // A script ends at the statement that ran out of budget
+    Interpreter interpreter;
+    ExecutionLimits limits;
+    limits.maxSteps = 100;
+    interpreter.setLimits(limits);
+    std::vector<std::string> errors;
+    bool success = interpreter.executeSource("a = 1\nwhile (1 < 2) a++\nb = 2\n",
+                                             [&](const Interpreter::StatementResult &result) {
+                                                 errors.push_back(result.error);
+                                             });
+    TestRunner::assert_true(!success && errors.size() == 2, "Script ends at the exhausted statement");
+    TestRunner::assert_equal("Line 2: Step limit exceeded (100 steps)", interpreter.getLastError(), "Script reports the limit");
+    TestRunner::assert_equal("", interpreter.execute("b"), "Statements after the limit do not run");
+}
+
+void test_compiled_programs() {
+    std::cout << "\n=== Testing Shared Compiled Programs ===" << std::endl;
+    
+    auto constants = std::make_shared<SharedGlobals>(std::unordered_map<std::string, Value>{{"rate", Value(0.25)}});
+    CompiledProgram::Options options;
+    options.globals = constants;
+    auto price = CompiledProgram::compile("price * (1 + rate)", options);
+    TestRunner::assert_true(price->ok(), "Program compiles");
+    
+    // Each context has its own variables; the constant is shared
+    ExecutionContext first(price), second(price);
+    first.setVariable("price", Value(100.0));
+    second.setVariable("price", Value(8.0));
+    TestRunner::assert_equal("125", first.run().value.toString(), "First context");
+    TestRunner::assert_equal("10", second.run().value.toString(), "Second context");
+    TestRunner::assert_true(first.getVariable("rate").toNumber() == 0.25, "Constant visible in the context");
+    
+    bool rejected = false;
+    try {
+        first.setVariable("rate", Value(1.0));
+    } catch (const std::runtime_error &) {
+        rejected = true;
+    }
+    TestRunner::assert_true(rejected, "Constants cannot be set");
+    
+    auto write = CompiledProgram::compile("rate += 1", options);
+    TestRunner::assert_true(!write->ok() && write->error() == "Cannot assign to constant: rate", "Constant write rejected");
+    TestRunner::assert_true(CompiledProgram::compile("function f(x) { rate = x; return rate * 2 }", options)->ok(),
+                            "Function locals may shadow constants");
+    
+    auto broken = CompiledProgram::compile("1 +");
+    Interpreter::Result result = ExecutionContext(broken).run();
+    TestRunner::assert_true(!broken->ok() && result.status == Interpreter::Status::SyntaxError, "Syntax error reported on run");
+    
+    // Variables persist between runs until reset()
+    auto counter = CompiledProgram::compile("n++");
+    ExecutionContext context(counter);
+    context.setVariable("n", Value(1.0));
+    context.run();
+    context.run();
+    TestRunner::assert_equal("3", context.getVariable("n").toString(), "Variables persist between runs");
+    context.reset();
+    TestRunner::assert_true(context.getVariable("n").getType() == Value::Null, "Reset forgets variables");
+    TestRunner::assert_true(context.run().status == Interpreter::Status::RuntimeError, "Run after reset fails cleanly");
+    
+    // Native functions and the optimization level come from the interpreter; the program outlives it
+    std::shared_ptr<const CompiledProgram> native;
+    {
+        Interpreter interpreter;
+        interpreter.registerFunction("hypot", 2, 2, hypot_function);
+        interpreter.execute("scale = 2");
+        native = interpreter.compile("hypot(a, 4) * scale", interpreter.shareGlobals());
+    }
+    ExecutionContext nativeContext(native);
+    nativeContext.setVariable("a", Value(3.0));
+    TestRunner::assert_equal("10", nativeContext.run().value.toString(), "Interpreter-compiled program");
+    
+    auto loop = CompiledProgram::compile("while (i < n) { total += i * rate; i++ }", options);
+    ExecutionContext limited(loop);
+    ExecutionLimits limits;
+    limits.maxSteps = 5;
+    limited.setLimits(limits);
+    limited.setVariable("i", Value(0.0));
+    limited.setVariable("n", Value(100.0));
+    limited.setVariable("total", Value(0.0));
+    TestRunner::assert_true(limited.run().status == Interpreter::Status::LimitExceeded, "Limits apply to contexts");
+    
+    // One program, one context per thread
+    const size_t threads = 4;
+    std::vector<double> totals(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            ExecutionContext local(loop);
+            for (int repeat = 0; repeat < 50; ++repeat) {
+                local.setVariable("i", Value(0.0));
+                local.setVariable("n", Value(100.0 * (t + 1)));
+                local.setVariable("total", Value(0.0));
+                local.run();
+            }
+            totals[t] = local.getVariable("total").toNumber();
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    bool correct = true;
+    for (size_t t = 0; t < threads; ++t) {
+        double n = 100.0 * (t + 1);
+        correct = correct && totals[t] == n * (n - 1) / 2 * 0.25;
+    }
+    TestRunner::assert_true(correct, "Contexts run one program on several threads");
+}
+
+void test_arrays() {
+    std::cout << "\n=== Testing Arrays ===" << std::endl;
+    
+    for (Interpreter::ExecutionMode mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        const std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (evaluator)";
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        interpreter.execute("a = [1, 2, 3]");
+        TestRunner::assert_equal("[1, 2, 3]", interpreter.execute("a"), "Array literal" + engine);
+        TestRunner::assert_equal("3", interpreter.execute("a[2]"), "Indexing" + engine);
+        TestRunner::assert_equal("[3, 5, 7]", interpreter.execute("a * 2 + 1"), "Broadcast number operand" + engine);
+        TestRunner::assert_equal("[0, 0, 2]", interpreter.execute("[4, 6, 8] % a"), "Element-wise operator" + engine);
+        TestRunner::assert_equal("[0, 1, 1]", interpreter.execute("a >= 2"), "Element-wise comparison" + engine);
+        TestRunner::assert_equal("[-1, -2, -3]", interpreter.execute("-a"), "Negation" + engine);
+        TestRunner::assert_equal("[1, 2, 3, 4]", interpreter.execute("[a, 4]"), "Arrays are spliced into literals" + engine);
+        TestRunner::assert_equal("[1, 4, 9]", interpreter.execute("pow(a, 2)"), "Builtins broadcast" + engine);
+        TestRunner::assert_equal("[1, 2, 2]", interpreter.execute("min(a, 2)"), "Two-argument min is element-wise" + engine);
+        TestRunner::assert_equal("3", interpreter.execute("max(a)"), "One-argument max reduces" + engine);
+        
+        // Copies share elements until one of them changes
+        interpreter.execute("b = a");
+        interpreter.execute("b += 10");
+        TestRunner::assert_equal("[1, 2, 3]", interpreter.execute("a"), "Copy is unaffected by an update" + engine);
+        TestRunner::assert_equal("[11, 12, 13]", interpreter.execute("b"), "Compound assignment updates" + engine);
+        interpreter.execute("function scale(v, k) { return v * k }");
+        TestRunner::assert_equal("[2, 4, 6]", interpreter.execute("scale(a, 2)"), "Arrays as arguments" + engine);
+        TestRunner::assert_equal("[1, 2, 3]", interpreter.execute("a"), "Argument is unaffected" + engine);
+        
+        interpreter.evaluate("a[3]");
+        TestRunner::assert_equal("Array index out of range: 3 (length 3)", interpreter.getLastError(),
+                                 "Index out of range" + engine);
+        interpreter.evaluate("a + [1, 2]");
+        TestRunner::assert_equal("Arrays of different lengths: 3 and 2", interpreter.getLastError(),
+                                 "Length mismatch" + engine);
+        interpreter.evaluate("a / [1, 0, 1]");
+        TestRunner::assert_equal("Division by zero", interpreter.getLastError(), "Zero divisor element" + engine);
+        interpreter.evaluate("b -= [1, 2]");
+        TestRunner::assert_equal("[11, 12, 13]", interpreter.execute("b"), "Failed update keeps the array" + engine);
+    }
+    
+    // Unshared elements are reused, shared ones copied
+    Value unshared(std::vector<double>{1, 2, 3});
+    const double *storage = unshared.asArray().data();
+    Value sum = elementwise(BinaryOperator::Add, std::move(unshared), Value(1.0));
+    TestRunner::assert_true(sum.asArray().data() == storage, "Unshared array is updated in place");
+    Value shared = sum;
+    Value product = elementwise(BinaryOperator::Multiply, std::move(shared), Value(2.0));
+    TestRunner::assert_equal("[2, 3, 4]", sum.toString(), "Shared array is copied");
+    TestRunner::assert_equal("[4, 6, 8]", product.toString(), "Copy holds the result");
+    
+    // Reductions
+    Interpreter interpreter;
+    TestRunner::assert_equal("6", interpreter.execute("sum([1, 2, 3])"), "sum");
+    TestRunner::assert_equal("2.500000", interpreter.execute("mean([1, 2, 3, 4])"), "mean");
+    TestRunner::assert_equal("32", interpreter.execute("dot([1, 2, 3], [4, 5, 6])"), "dot");
+    TestRunner::assert_equal("5", interpreter.execute("norm([3, 4])"), "norm");
+    TestRunner::assert_equal("-7", interpreter.execute("min([5, 1, -7, 3, 9, 2, 8, 0, 4])"), "min past the vector width");
+    TestRunner::assert_equal("[2, 5, 8]", interpreter.execute("range(2, 10, 3)"), "range with a step");
+    TestRunner::assert_equal("0", interpreter.execute("len(range(5, 1))"), "Empty range");
+    interpreter.evaluate("mean([])");
+    TestRunner::assert_equal("Mean of an empty array", interpreter.getLastError(), "Mean of nothing fails");
+    
+    // A million elements in single builtin calls, matching a scalar loop
+    interpreter.execute("x = range(1000000)");
+    TestRunner::assert_equal("499999500000", interpreter.execute("sum(x)"), "sum of a million elements");
+    TestRunner::assert_equal("999999", interpreter.execute("max(x)"), "max of a million elements");
+    TestRunner::assert_equal("499999500000", interpreter.execute("dot(x, x * 0 + 1)"), "dot of a million elements");
+    interpreter.execute("s = 0");
+    interpreter.execute("for (i = 0; i < 1000; i++) s += i * i");
+    TestRunner::assert_equal(interpreter.execute("s"), interpreter.execute("sum(range(1000) ^ 2)"),
+                             "Element-wise power and sum match a loop");
+    
+    // Folded and run at every optimization level alike
+    bool same = true;
+    for (const char *code : {"[1, 2, 3] * [4, 5, 6]", "sum(sqrt([4, 9, 16]))", "[1, 2][1] + 1"}) {
+        Interpreter optimized;
+        optimized.setOptimizationLevel(2);
+        same = same && optimized.execute(code) == interpreter.execute(code);
+    }
+    TestRunner::assert_true(same, "Optimizer keeps array results");
+    
+    // Snapshots keep array variables
+    std::string path = (std::filesystem::temp_directory_path() / "glossai_arrays.gloc").string();
+    interpreter.execute("v = [0.5, -2, 8]");
+    TestRunner::assert_true(interpreter.saveSnapshot(path), "Snapshot with an array is written");
+    Interpreter restored;
+    TestRunner::assert_true(restored.loadSnapshot(path), "Snapshot with an array is loaded");
+    TestRunner::assert_equal("[0.500000, -2, 8]", restored.execute("v"), "Restored array");
+    std::filesystem::remove(path);
+}
+
+void test_error_codes() {
+    std::cout << "\n=== Testing Error Codes ===" << std::endl;
+    
+    for (Interpreter::ExecutionMode mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        const std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (evaluator)";
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        interpreter.execute("x = 4");
+        
+        Interpreter::Result result = interpreter.evaluate("2 * x + missing");
+        TestRunner::assert_true(result.code == ErrorCode::UndefinedVariable && result.line == 1 && result.column == 9,
+                                "Undefined variable at its token" + engine);
+        TestRunner::assert_equal("Undefined variable: missing", result.error, "Undefined variable message" + engine);
+        result = interpreter.evaluate("{ a = 1;\n  b = a MOD 0 }");
+        TestRunner::assert_true(result.code == ErrorCode::DivisionByZero && result.line == 2 && result.column == 9,
+                                "Division by zero at its operator" + engine);
+        TestRunner::assert_equal("Modulo by zero", result.error, "Modulo message" + engine);
+        result = interpreter.evaluate("x /= 0");
+        TestRunner::assert_true(result.code == ErrorCode::DivisionByZero && interpreter.execute("x") == "4",
+                                "Failed compound division keeps the variable" + engine);
+        result = interpreter.evaluate("y += 1");
+        TestRunner::assert_true(result.code == ErrorCode::UndefinedVariable && result.column == 1,
+                                "Compound assignment of an unset variable" + engine);
+        result = interpreter.evaluate("1 + nosuch(2)");
+        TestRunner::assert_true(result.code == ErrorCode::UnknownFunction && result.column == 5,
+                                "Unknown function at its name" + engine);
+        result = interpreter.evaluate("3++");
+        TestRunner::assert_true(result.code == ErrorCode::InvalidTarget, "Increment of a literal" + engine);
+        result = interpreter.evaluate("[1] + [1, 2]");
+        TestRunner::assert_true(result.code == ErrorCode::Other, "Thrown errors are coded Other" + engine);
+        
+        // Errors inside calls unwind them; the position is in the body
+        interpreter.execute("function inverse(n) { return 1 / n }");
+        result = interpreter.evaluate("inverse(2) + inverse(0)");
+        TestRunner::assert_true(result.code == ErrorCode::DivisionByZero && result.column == 32,
+                                "Error inside a call" + engine);
+        result = interpreter.evaluate("inverse(1, 2)");
+        TestRunner::assert_true(result.code == ErrorCode::ArgumentCount && result.column == 1,
+                                "Wrong argument count" + engine);
+        TestRunner::assert_equal("2", interpreter.execute("inverse(0.5)"), "Calls work after an error" + engine);
+        
+        result = interpreter.evaluate("for (i = 0; i < 3; i++) { x = x + undefinedInLoop }");
+        TestRunner::assert_true(result.code == ErrorCode::UndefinedVariable && interpreter.execute("i") == "0",
+                                "Loops stop at the first error" + engine);
+        TestRunner::assert_true(interpreter.evaluate("2 * x").ok(), "Next evaluation succeeds" + engine);
+    }
+    
+    // Script statements report errors from their own line
+    Interpreter script;
+    std::vector<std::string> errors;
+    script.executeSource("a = 1\nb = a / 0\nc = a + 1\n", [&](const Interpreter::StatementResult &statement) {
+        errors.push_back(statement.error);
+    });
+    TestRunner::assert_true(errors.size() == 3 && errors[1] == "Division by zero" && errors[2].empty(),
+                            "Script continues after a runtime error");
+    TestRunner::assert_equal("Line 2: Division by zero", script.getLastError(), "Script error names its line");
+    
+    // Shared programs report codes and positions too
+    auto program = CompiledProgram::compile("total / count", CompiledProgram::Options());
+    ExecutionContext context(program);
+    context.setVariable("total", Value(6.0));
+    Interpreter::Result result = context.run();
+    TestRunner::assert_true(result.code == ErrorCode::UndefinedVariable && result.column == 9,
+                            "Execution contexts report the unset variable");
+    context.setVariable("count", Value(0.0));
+    result = context.run();
+    TestRunner::assert_true(result.code == ErrorCode::DivisionByZero && result.column == 7,
+                            "Execution contexts report division by zero");
+    
+    // Nodes carry their kind and the position of their token
+    Lexer lexer;
+    Parser parser;
+    auto parsed = parser.parse(lexer.tokenize("a + b * 2"));
+    auto *sum = nodeCast<BinaryOpNode>(parsed->root());
+    TestRunner::assert_true(sum && sum->getKind() == NodeKind::BinaryOp && sum->getColumn() == 3,
+                            "Binary node at its operator");
+    TestRunner::assert_true(!nodeCast<IdentifierNode>(parsed->root()) && nodeCast<IdentifierNode>(sum->getLeft()),
+                            "nodeCast checks the kind");
+    TestRunner::assert_true(nodeCast<BinaryOpNode>(sum->getRight())->getColumn() == 7, "Nested node position");
+}
+
+void test_incremental_lexing() {
+    std::cout << "\n=== Testing Incremental Lexing ===" << std::endl;
+    
+    // Lexing line by line from each line's starting state gives the tokens of the whole text
+    std::vector<std::string> lines = {"  # comment {", "f = \"a { (\" + [1, g(2", "), 3]", "s = \"two",
+                                      "lines\\\" #\" x", "x # y"};
+    std::string text;
+    for (const std::string &line : lines) {
+        text += line + "\n";
+    }
+    Lexer lexer;
+    std::vector<TokenType> whole;
+    for (const Token &token : lexer.tokenize(text)) {
+        if (token.type != TokenType::EndOfFile) {
+            whole.push_back(token.type);
+        }
+    }
+    std::vector<TokenType> byLine;
+    std::vector<LexState> checkpoints;
+    std::vector<LineToken> tokens;
+    LexState state;
+    for (const std::string &line : lines) {
+        lexer.lexLine(line, state, &tokens);
+        checkpoints.push_back(state);
+        for (const LineToken &token : tokens) {
+            // A string spanning lines is one token of the whole text
+            if (token.type == TokenType::Comment ||
+                (token.type == TokenType::String && token.start == 0 && !byLine.empty() &&
+                 byLine.back() == TokenType::String)) {
+                continue;
+            }
+            byLine.push_back(token.type);
+        }
+    }
+    TestRunner::assert_true(byLine == whole, "Line-by-line lexing matches the whole text");
+    TestRunner::assert_true(checkpoints[0] == LexState(), "Brackets in comments are not counted");
+    TestRunner::assert_true(checkpoints[1].brackets == 1 && checkpoints[1].parens == 1 && !checkpoints[1].inString,
+                            "Brackets in strings are not counted");
+    TestRunner::assert_true(!checkpoints[2].continues() && checkpoints[3].inString && !checkpoints[4].inString,
+                            "Strings continue onto the next line");
+    
+    // An edited line is re-lexed from its checkpoint alone
+    LexState resumed = checkpoints[3];
+    lexer.lexLine("lines\" + (1", resumed, &tokens);
+    TestRunner::assert_true(resumed.parens == 1 && tokens.size() == 4 && tokens[0].type == TokenType::String &&
+                                tokens[0].length == 6,
+                            "Lexing resumes inside a string");
+    state = LexState();
+    lexer.lexLine("x = a[1])", state);
+    TestRunner::assert_true(state.unbalanced && !state.continues(), "Stray closing bracket is recorded");
+    
+    // REPL continuation
+    LineParser lineParser;
+    TestRunner::assert_true(lineParser.processLine("label = \"}\""), "Brace in a string is complete");
+    lineParser.clear();
+    TestRunner::assert_true(!lineParser.processLine("message = \"first"), "Open string needs continuation");
+    TestRunner::assert_true(!lineParser.processLine("second ( \" + f(1,"), "Open call needs continuation");
+    TestRunner::assert_true(lineParser.processLine("2)"), "Statement ends when everything is closed");
+    lineParser.clear();
+    TestRunner::assert_true(!lineParser.processLine("if (x > 1) {"), "Open block needs continuation");
+    TestRunner::assert_equal("...     ", lineParser.getContinuationPrompt(), "Prompt is indented by open braces");
+    
+    Context context;
+    context.addPendingLine("function f(a) {");
+    context.addPendingLine("  return g(\")\") + a");
+    TestRunner::assert_true(context.getBraceLevel() == 1 && context.getParenLevel() == 0,
+                            "Pending lines count brackets like the lexer");
+    context.clearPendingLines();
+    TestRunner::assert_true(context.getBraceLevel() == 0 && !context.getPendingState().continues(),
+                            "Clearing pending lines resets the state");
+    
+    Interpreter interpreter;
+    TestRunner::assert_true(!interpreter.isValidSyntax("sqrt(2"), "Open bracket is invalid");
+    TestRunner::assert_true(!interpreter.isValidSyntax("2)"), "Stray bracket is invalid");
+    TestRunner::assert_true(!interpreter.isValidSyntax("\"abc"), "Unterminated string is invalid");
+    TestRunner::assert_true(interpreter.isValidSyntax("s = \"(\""), "Bracket in a string is valid");
+}
+
+void test_fast_math() {
+    std::cout << "\n=== Testing Fast Math ===" << std::endl;
+    
+    // The kernels stay within their documented error over wide ranges of arguments
+    auto relative = [](double fast, double exact) { return exact == 0 ? std::abs(fast) : std::abs((fast - exact) / exact); };
+    double worstTrig = 0, worstExp = 0, worstLog = 0, worstPow = 0;
+    for (int i = -20000; i <= 20000; ++i) {
+        double x = i * 0.00731;
+        worstTrig = std::max({worstTrig, relative(FastMath::sin(x), std::sin(x)), relative(FastMath::cos(x), std::cos(x)),
+                              relative(FastMath::tan(x), std::tan(x))});
+        worstExp = std::max(worstExp, relative(FastMath::exp(x * 4.8), std::exp(x * 4.8)));
+        double positive = std::exp(x * 4.8);
+        worstLog = std::max({worstLog, relative(FastMath::log(positive), std::log(positive)),
+                             relative(FastMath::log2(positive), std::log2(positive)),
+                             relative(FastMath::log10(positive), std::log10(positive))});
+        worstPow = std::max(worstPow, relative(FastMath::pow(1.0 + std::abs(x), x / 4), std::pow(1.0 + std::abs(x), x / 4)));
+    }
+    TestRunner::assert_true(worstTrig < 1e-11, "sin, cos and tan are accurate");
+    TestRunner::assert_true(worstExp < 2e-12, "exp is accurate");
+    TestRunner::assert_true(worstLog < 1e-13, "Logarithms are accurate");
+    TestRunner::assert_true(worstPow < 2e-11, "pow is accurate");
+    TestRunner::assert_true(FastMath::sin(0.0) == 0 && FastMath::cos(0.0) == 1 && FastMath::exp(0.0) == 1 &&
+                            FastMath::log(1.0) == 0 && FastMath::pow(7.0, 0.0) == 1, "Exact at the usual points");
+    TestRunner::assert_true(FastMath::sin(3e7) == std::sin(3e7) && FastMath::pow(-2.0, 3.0) == -8 &&
+                            std::isinf(FastMath::exp(800)) && FastMath::exp(-800) == 0 && std::isinf(FastMath::log(INFINITY)),
+                            "Arguments outside the kernels' ranges");
+    
+    for (Interpreter::ExecutionMode mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        const std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (evaluator)";
+        
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        interpreter.execute("function f(x) { return sin(x) + log(x) }");
+        TestRunner::assert_true(interpreter.evaluate("f(0.7)").number() == std::sin(0.7) + std::log(0.7), "libm by default" + engine);
+        
+        interpreter.setFastMath(true);
+        TestRunner::assert_true(interpreter.isFastMath(), "Fast math is on" + engine);
+        TestRunner::assert_true(interpreter.evaluate("tan(0.3) * log10(2.5)").number() ==
+                                    FastMath::tan(0.3) * FastMath::log10(2.5), "Builtins use the kernels" + engine);
+        TestRunner::assert_true(interpreter.evaluate("exp(0.3) * pow(2.5, 1.7)").number() ==
+                                    std::exp(0.3) * std::pow(2.5, 1.7), "Single calls keep the faster libm" + engine);
+        TestRunner::assert_true(interpreter.evaluate("f(0.7)").number() == FastMath::sin(0.7) + std::log(0.7),
+                                "Functions defined before the switch are rebound" + engine);
+        Interpreter::Result array = interpreter.evaluate("sum(cos([0.25, 0.5]))");
+        TestRunner::assert_true(array.number() == FastMath::cos(0.25) + FastMath::cos(0.5), "Array arguments" + engine);
+        
+        Interpreter::Result failed = interpreter.evaluate("1 + ln(-1)");
+        TestRunner::assert_equal("Logarithm of non-positive number", failed.error, "Domain errors are kept" + engine);
+        TestRunner::assert_equal("1", interpreter.execute("sqrt(1)"), "Other functions are unchanged" + engine);
+        
+        // Constant folding calls the same functions
+        interpreter.setOptimizationLevel(1);
+        TestRunner::assert_true(interpreter.evaluate("tan(1.2) + 0").number() == FastMath::tan(1.2), "Folded calls" + engine);
+        
+        interpreter.setFastMath(false);
+        TestRunner::assert_true(interpreter.evaluate("f(0.7)").number() == std::sin(0.7) + std::log(0.7), "Switching back" + engine);
+    }
+    
+    // Batches run the kernels of all nine over whole columns, redoing the lanes they do not cover with libm
+    Interpreter interpreter;
+    interpreter.setFastMath(true);
+    std::vector<double> x = {0.5, 2e6, -3.25, 0.0};
+    std::vector<double> out(x.size());
+    bool ok = interpreter.evaluateBatch("sin(x) + pow(x, 2) + exp(x)", {{"x", x}}, out);
+    bool allMatch = ok;
+    for (size_t i = 0; i < x.size(); ++i) {
+        allMatch = allMatch && out[i] == FastMath::sin(x[i]) + FastMath::pow(x[i], 2) + FastMath::exp(x[i]);
+    }
+    TestRunner::assert_true(allMatch, "Batches use the kernels");
+    ok = interpreter.evaluateBatch("log10(x)", {{"x", x}}, out);
+    TestRunner::assert_true(!ok && out[0] == FastMath::log10(0.5) && std::isnan(out[2]) && std::isnan(out[3]),
+                            "Batch domain errors are per row");
+    
+    // Compiled programs keep the mode of the interpreter that compiled them
+    ExecutionContext compiled(interpreter.compile("cos(1.1)"));
+    interpreter.setFastMath(false);
+    TestRunner::assert_true(compiled.run().number() == FastMath::cos(1.1), "Compiled programs copy the mode");
+    
+#ifdef GLOSSAI_ENABLE_JIT
+    Interpreter jit;
+    jit.setFastMath(true);
+    Interpreter reference;
+    reference.setExecutionMode(Interpreter::ExecutionMode::TreeWalk);
+    reference.setFastMath(true);
+    const std::string loop = "{ i = 1; s = 0; while (i < 500) { s += sin(i) * exp(-i / 100) + log10(i); i++ } }";
+    bool jitMatches = true;
+    for (size_t run = 0; run < 2 * JitFunction::RunThreshold; ++run) {
+        jit.execute(loop);
+        reference.execute(loop);
+        jitMatches = jitMatches && jit.execute("s") == reference.execute("s");
+    }
+    TestRunner::assert_true(jitMatches, "Native code calls the same kernels");
+#endif
+}
+
+void test_parallel_for() {
+    std::cout << "\n=== Testing Parallel For ===" << std::endl;
+    
+    for (Interpreter::ExecutionMode mode : {Interpreter::ExecutionMode::Bytecode, Interpreter::ExecutionMode::TreeWalk}) {
+        const std::string engine = mode == Interpreter::ExecutionMode::Bytecode ? " (VM)" : " (evaluator)";
+        
+        // The same chunks are added in the same order on any number of threads
+        const std::string sum = "parallel (s) for (i = 0; i < 20000; i++) { s += 1 / (i + 1) }";
+        std::vector<std::string> sums;
+        for (size_t threads : {1, 4, 8}) {
+            Interpreter interpreter;
+            interpreter.setExecutionMode(mode);
+            interpreter.setThreadCount(threads);
+            interpreter.execute("s = 0");
+            TestRunner::assert_true(interpreter.evaluate(sum).ok(), "Harmonic sum runs" + engine);
+            sums.push_back(interpreter.execute("s - 9"));
+        }
+        TestRunner::assert_true(sums[0] == sums[1] && sums[1] == sums[2], "Sums do not depend on the thread count" + engine);
+        
+        Interpreter interpreter;
+        interpreter.setExecutionMode(mode);
+        interpreter.setThreadCount(4);
+        interpreter.execute("s = 0");
+        interpreter.execute("n = 1000");
+        interpreter.execute("parallel (s) for (i = 1; i <= n; i++) { s += i * i }");
+        TestRunner::assert_equal("333833500", interpreter.execute("s"), "Sum of squares" + engine);
+        interpreter.execute("t = 0");
+        interpreter.execute("for (i = 1; i <= n; i++) t += i * i");
+        TestRunner::assert_equal(interpreter.execute("t"), interpreter.execute("s"), "Same as a plain loop" + engine);
+        
+        // Reductions add to the values before the loop; locals and user functions work per iteration
+        interpreter.execute("function sq(x) { y = x * x; return y }");
+        interpreter.execute("evens = 10");
+        interpreter.execute("odds = 0");
+        interpreter.execute("total = [0, 0]");
+        TestRunner::assert_true(interpreter.evaluate("parallel (evens, odds, total) for (k = 99; k >= 0; k -= 1) {\n"
+                                                     "  v = sq(k); if (k MOD 2 == 0) evens++ else odds += 1\n"
+                                                     "  total += [v, 1] }").ok(),
+                                "Several reductions" + engine);
+        TestRunner::assert_equal("60", interpreter.execute("evens"), "Counted reduction" + engine);
+        TestRunner::assert_equal("50", interpreter.execute("odds"), "Compound reduction" + engine);
+        TestRunner::assert_equal("[328350, 100]", interpreter.execute("total"), "Array reduction" + engine);
+        TestRunner::assert_true(interpreter.getVariable("v").getType() == Value::Null, "Body locals stay private" + engine);
+        interpreter.execute("s = 5");
+        TestRunner::assert_true(interpreter.evaluate("parallel (s) for (i = 0; i < 0; i++) { s += 1 }").ok() &&
+                                    interpreter.execute("s") == "5",
+                                "Empty range leaves reductions" + engine);
+        
+        // Bodies that would race, or depend on the order of iterations, are rejected before running
+        interpreter.execute("g = 1");
+        interpreter.execute("function bump(x) { g += x }");
+        interpreter.execute("function via(x) { return bump(x) }");
+        interpreter.execute("text = \"x\"");
+        const std::vector<std::pair<std::string, std::string>> rejected = {
+            {"parallel (s) for (i = 0; i < 9; i++) { g += i }", "global write"},
+            {"parallel (s) for (i = 0; i < 9; i++) { g = i }", "plain assignment of a global"},
+            {"parallel (s) for (i = 0; i < 9; i++) { print(i) }", "print"},
+            {"parallel (s) for (i = 0; i < 9; i++) { s += via(i) }", "function writing a global"},
+            {"parallel (s) for (i = 0; i < 9; i++) { s += s }", "reduction read"},
+            {"parallel (s) for (i = 0; i < 9; i++) { s *= 2 }", "reduction multiplied"},
+            {"parallel (s) for (i = 0; i < 9; i++) { i += 1 }", "loop variable assigned"},
+            {"parallel (s) for (i = 0; i * i < 9; i++) { s += 1 }", "unsupported condition"},
+            {"parallel (s) for (i = 0; i < 9; i += 0) { s += 1 }", "endless step"},
+            {"parallel (s, s) for (i = 0; i < 9; i++) { s += 1 }", "duplicate reduction"},
+            {"parallel (text) for (i = 0; i < 600; i++) { text += 1 }", "string reduction"},
+        };
+        for (const auto &entry : rejected) {
+            Interpreter::Result result = interpreter.evaluate(entry.first);
+            TestRunner::assert_true(result.status == Interpreter::Status::RuntimeError &&
+                                        result.code == ErrorCode::Other,
+                                    "Rejects " + entry.second + engine);
+        }
+        TestRunner::assert_equal("5", interpreter.execute("s"), "Rejected loops change nothing" + engine);
+        TestRunner::assert_equal("1", interpreter.execute("g"), "Rejected loops run nothing" + engine);
+        TestRunner::assert_equal("x", interpreter.execute("text"), "String reductions left alone" + engine);
+        
+        // The first failing iteration is reported, at its position in the body
+        Interpreter::Result result =
+            interpreter.evaluate("parallel (s) for (i = 0; i < 5000; i++) {\n  s += 1 / (i - 4000) + 1 / (i - 3000) }");
+        TestRunner::assert_true(result.code == ErrorCode::DivisionByZero && result.line == 2 && result.column == 27,
+                                "First failing iteration reported" + engine);
+        TestRunner::assert_equal("5", interpreter.execute("s"), "Failed loops leave reductions" + engine);
+        result = interpreter.evaluate("parallel (unset) for (i = 0; i < 3; i++) { unset += 1 }");
+        TestRunner::assert_true(result.code == ErrorCode::UndefinedVariable, "Reductions must be defined" + engine);
+        
+        // Limits apply to the iterations on every thread
+        ExecutionLimits limits;
+        limits.maxSteps = 5000;
+        interpreter.setLimits(limits);
+        result = interpreter.evaluate("parallel (s) for (i = 0; i < 100000; i++) { s += 1 }");
+        TestRunner::assert_true(result.status == Interpreter::Status::LimitExceeded, "Step limit stops the loop" + engine);
+        TestRunner::assert_true(interpreter.evaluate("parallel (s) for (i = 0; i < 4000; i++) { s += 1 }").ok(),
+                                "Loop within the step limit" + engine);
+        interpreter.setLimits(ExecutionLimits());
+    }
+    
+    // Parallel loops are statements of the top level only
+    Interpreter interpreter;
+    Interpreter::Result result = interpreter.evaluate("function f(n) { parallel for (i = 0; i < n; i++) { } }");
+    TestRunner::assert_true(result.status == Interpreter::Status::SyntaxError, "Not allowed in a function");
+    result = interpreter.evaluate("parallel for (i = 0; i < 3; i++) { parallel for (j = 0; j < 3; j++) { } }");
+    TestRunner::assert_true(result.status == Interpreter::Status::SyntaxError, "Not allowed in a parallel loop");
+    result = interpreter.evaluate("parallel while (1 < 2) { }");
+    TestRunner::assert_true(result.status == Interpreter::Status::SyntaxError, "Only for loops are parallel");
+    TestRunner::assert_true(interpreter.getThreadCount() >= 1, "Default thread count");
+}
+
+void test_reactive_definitions() {
+    std::cout << "\n=== Testing Reactive Definitions ===" << std::endl;
+    
+    Interpreter interpreter;
+    interpreter.setReactive(true);
+    interpreter.execute("x = 2");
+    interpreter.execute("y = 2 * x + 1");
+    interpreter.execute("z = y * 10");
+    const DependencyGraph &graph = interpreter.getDependencies();
+    TestRunner::assert_equal("2", std::to_string(graph.size()), "Formulas are recorded, plain values are not");
+    
+    // Changes only mark dependents stale; reads recompute what they need, in order
+    interpreter.setVariable("x", Value(3.0));
+    TestRunner::assert_equal("2", std::to_string(graph.staleCount()), "Dependents marked stale");
+    TestRunner::assert_equal("0", std::to_string(graph.recomputations()), "Nothing recomputed before a read");
+    TestRunner::assert_equal("7", interpreter.getVariable("y").toString(), "Read recomputes its formula");
+    TestRunner::assert_true(graph.isStale("z"), "Formulas that were not read stay stale");
+    TestRunner::assert_equal("71", interpreter.execute("z + 1"), "Statements recompute what they read");
+    TestRunner::assert_equal("2", std::to_string(graph.recomputations()), "Each formula recomputed once");
+    
+    // Assignments in code change inputs too
+    interpreter.execute("x = 10");
+    TestRunner::assert_equal("210", interpreter.execute("z"), "Assignment marks dependents stale");
+    interpreter.execute("x++");
+    TestRunner::assert_equal("230", interpreter.execute("z"), "Increment marks dependents stale");
+    
+    // Cycles are rejected before anything runs
+    interpreter.evaluate("x = z + 1");
+    TestRunner::assert_equal("Circular definition: x -> z -> y -> x", interpreter.getLastError(), "Cycle detected");
+    TestRunner::assert_equal("11", interpreter.execute("x"), "Rejected definition did not run");
+    
+    // A plain value replaces a formula
+    interpreter.execute("y = 100");
+    interpreter.setVariable("x", Value(1.0));
+    TestRunner::assert_equal("1000", interpreter.execute("z"), "Overridden formula is forgotten");
+    
+    // Redefining a function makes the formulas calling it stale
+    interpreter.execute("function twice(a) { return a * 2 }");
+    interpreter.execute("w = twice(x)");
+    interpreter.execute("function twice(a) { return a * 3 }");
+    TestRunner::assert_equal("3", interpreter.execute("w"), "Function redefinition recomputes callers");
+    
+    // Failures name the formula and are retried on the next read
+    interpreter.execute("d = 1");
+    interpreter.execute("q = 1 / d");
+    interpreter.setVariable("d", Value(0.0));
+    TestRunner::assert_true(interpreter.getVariable("q").getType() == Value::Null, "Failed recomputation reads null");
+    TestRunner::assert_equal("Recomputing q: Division by zero", interpreter.getLastError(), "Failure names the formula");
+    interpreter.setVariable("d", Value(4.0));
+    TestRunner::assert_equal("0.250000", interpreter.getVariable("q").toString(), "Recomputation retried");
+    
+    // Of many formulas, an edit recomputes only those depending on it
+    Interpreter sheet;
+    sheet.setReactive(true);
+    for (int i = 0; i < 200; ++i) {
+        std::string n = std::to_string(i);
+        sheet.execute("in" + n + " = " + n);
+        sheet.execute("out" + n + " = in" + n + " * 2 + 1");
+    }
+    sheet.execute("total = out7 + out8");
+    sheet.setVariable("in7", Value(100.0));
+    bool refreshed = sheet.refresh();
+    TestRunner::assert_true(refreshed, "Refresh succeeds");
+    TestRunner::assert_equal("2", std::to_string(sheet.getDependencies().recomputations()), "Only dependents recomputed");
+    TestRunner::assert_equal("218", sheet.execute("total"), "Edit reaches indirect dependents");
+    
+    // Turning reactive mode off brings values up to date and forgets the formulas
+    sheet.setVariable("in8", Value(0.0));
+    sheet.setReactive(false);
+    TestRunner::assert_equal("0", std::to_string(sheet.getDependencies().size()), "Formulas forgotten");
+    TestRunner::assert_equal("202", sheet.execute("total"), "Values brought up to date");
+    sheet.execute("in8 = 50");
+    TestRunner::assert_equal("202", sheet.execute("total"), "No recomputation when off");
+    
+    // Formulas reading the two before them share every dependency; each definition is checked in linear time
+    Interpreter chain;
+    chain.setReactive(true);
+    chain.execute("a0 = 1");
+    chain.execute("a1 = a0 * 1");
+    for (int i = 2; i < 300; ++i) {
+        chain.execute("a" + std::to_string(i) + " = (a" + std::to_string(i - 1) + " + a" + std::to_string(i - 2) + ") / 2");
+    }
+    TestRunner::assert_equal("1", chain.execute("a299"), "Shared dependencies computed");
+    chain.evaluate("a0 = a299 + 1");
+    const std::string &cycle = chain.getLastError();
+    TestRunner::assert_true(cycle.rfind("Circular definition: a0 -> a299 -> a298 -> ", 0) == 0 &&
+                                cycle.size() > 5 && cycle.compare(cycle.size() - 5, 5, "-> a0") == 0,
+                            "Cycle through shared dependencies detected");
+}
+
+#ifdef __linux__
+// Send requests to a Unix socket and read answers until the server closes the connection
+std::string askServer(const std::string &path, const std::string &requests) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    std::string answers;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+        send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size())) {
+        char buffer[4096];
+        ssize_t count;
+        while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            answers.append(buffer, static_cast<size_t>(count));
+        }
+    }
+    close(fd);
+    return answers;
+}
+
+void test_server() {
+    std::cout << "\n=== Testing Server Mode ===" << std::endl;
+    
+    std::string path = (std::filesystem::temp_directory_path() / "glossai_test_server.sock").string();
+    Server::Options options;
+    options.workers = 2;
+    Server server(options);
+    server.listen(path);
+    std::thread loop([&server] { server.run(); });
+    
+    // Pipelined requests are answered in order, with printed lines before their result
+    std::string answers = askServer(path, "x = 2\nx * 21\n\nprint(\"a\\nb\")\n1/0\n:quit\nx\n");
+    TestRunner::assert_equal("ok 2\nok 42\nout a\nout b\nok\nerror Division by zero\nok\n", answers,
+                             "Pipelined requests");
+    
+    // Every connection has its own session
+    TestRunner::assert_equal("error Undefined variable: x\nok\n", askServer(path, "x\n:quit\n"), "Sessions per connection");
+    TestRunner::assert_equal("ok 1\nok\nerror Undefined variable: y\nok\n", askServer(path, "y = 1\n:reset\ny\n:quit\n"),
+                             "Reset gives a fresh session");
+    
+    std::string stats = askServer(path, ":stats\n:quit\n");
+    TestRunner::assert_true(stats.find("\"total_connections\": 4") != std::string::npos, "Connections counted");
+    TestRunner::assert_true(stats.find("\"errors\": 3") != std::string::npos, "Errors counted");
+    
+    server.stop();
+    loop.join();
+    Server::Statistics statistics = server.statistics();
+    TestRunner::assert_equal("0", std::to_string(statistics.connections), "Connections closed");
+    TestRunner::assert_equal("0", std::to_string(statistics.queueDepth), "Queue drained");
+    TestRunner::assert_equal("13", std::to_string(statistics.requests), "Requests counted");
+}
+
+// CPU time the calling thread has used
+double threadCpuSeconds() {
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9;
+}
+
+void test_server_half_close() {
+    std::cout << "\n=== Testing Server Half-Close ===" << std::endl;
+    
+    std::string path = (std::filesystem::temp_directory_path() / "glossai_test_half_close.sock").string();
+    Server::Options options;
+    options.workers = 1;
+    Server server(options);
+    server.listen(path);
+    double loopCpu = 0.0;
+    std::thread loop([&server, &loopCpu] {
+        server.run();
+        loopCpu = threadCpuSeconds();
+    });
+    
+    // The client stops sending while its batch runs; the EOF must not keep waking the event loop
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    std::string requests = "function spin(n) { s = 0; i = 0; while (i < n) { s += i; i++ }; return s }\n"
+                           "spin(3000000)\n";
+    std::string answers;
+    auto started = std::chrono::steady_clock::now();
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+        send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size())) {
+        shutdown(fd, SHUT_WR);
+        char buffer[4096];
+        ssize_t count;
+        while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            answers.append(buffer, static_cast<size_t>(count));
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    close(fd);
+    TestRunner::assert_equal("ok\nok 4499998500000\n", answers, "Answered after the client half-closed");
+    
+    server.stop();
+    loop.join();
+    TestRunner::assert_true(loopCpu < 0.05 * elapsed + 0.01, "Event loop idle while the batch runs");
+    TestRunner::assert_equal("0", std::to_string(server.statistics().connections), "Half-closed connection closed");
+}
+#endif
+
 int main() {
     std::cout << "Running GlossAI Interpreter Tests..." << std::endl;
     
@@ -167,6 +1840,40 @@ int main() {
         test_variables();
         test_error_handling();
         test_complex_expressions();
+        test_bytecode_vm();
+        test_slot_resolution();
+        test_builtin_functions();
+        test_compact_values();
+        test_program_arena();
+        test_lexer_tokens();
+        test_streaming_script();
+        test_whole_script();
+        test_structured_results();
+        test_optimizer();
+        test_parse_cache();
+        test_batch_evaluation();
+        test_user_functions();
+        test_memoization();
+        test_parallel_interpreters();
+        test_output_sink();
+        test_snapshot();
+        test_profiler();
+        test_stop_request();
+        test_execution_limits();
+        test_compiled_programs();
+        test_reactive_definitions();
+        test_arrays();
+        test_error_codes();
+        test_incremental_lexing();
+        test_parallel_for();
+        test_fast_math();
+#ifdef __linux__
+        test_server();
+        test_server_half_close();
+#endif
+#ifdef GLOSSAI_ENABLE_JIT
+        test_jit();
+#endif
     } catch (const std::exception& e) {
         std::cout << "Exception caught: " << e.what() << std::endl;
         return 1;
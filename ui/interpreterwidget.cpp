@@ -1,5 +1,7 @@
 #include "interpreterwidget.h"
 #include "../core/interpreter.h"
+#include "../core/mappedfile.h"
+#include "../core/outputsink.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -19,14 +21,52 @@
 #include <QApplication>
 #include <QFont>
 #include <QScrollBar>
+#include <QProgressBar>
+#include <QThread>
+#include <QTimer>
+#include <QMutexLocker>
+#include <QTextCursor>
+#include <QColor>
+#include <QTextCharFormat>
+#include <QInputMethodEvent>
+#include <algorithm>
+
+namespace
+{
+
+bool isKeyword(TokenType type)
+{
+    return (type >= TokenType::If && type <= TokenType::False) || type == TokenType::And ||
+           type == TokenType::Or || type == TokenType::Not || type == TokenType::Mod || type == TokenType::Div;
+}
+
+} // anonymous namespace
 
 InterpreterWidget::InterpreterWidget(QWidget *parent)
     : QWidget(parent)
     , m_interpreter(std::make_unique<Interpreter>()) // Pure C++ interpreter
+    , m_workerThread(new QThread(this))
+    , m_worker(new QObject)
+    , m_busy(false)
+    , m_progressTimer(new QTimer(this))
+    , m_progressLine(0)
+    , m_progressTotal(0)
+    , m_outputTimer(new QTimer(this))
+    , m_inputUnbalanced(false)
     , m_historyIndex(-1)
 {
+    // Jobs are queued to the worker object as functors and run on its thread
+    m_worker->moveToThread(m_workerThread);
+    connect(m_workerThread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_workerThread->start();
+    
+    m_outputTimer->setSingleShot(true);
+    m_outputTimer->setInterval(OUTPUT_BATCH_MS);
+    m_progressTimer->setInterval(100);
+    
     setupUI();
     setupConnections();
+    setupOutput();
     loadHistory();
     showWelcomeMessage();
     
@@ -35,6 +75,10 @@ InterpreterWidget::InterpreterWidget(QWidget *parent)
 
 InterpreterWidget::~InterpreterWidget()
 {
+    // A running job must end before the interpreter goes away
+    m_interpreter->requestStop();
+    m_workerThread->quit();
+    m_workerThread->wait();
     saveHistory();
 }
 
@@ -108,6 +152,10 @@ void InterpreterWidget::setupUI()
     m_loadButton = new QPushButton("Load File");
     m_saveButton = new QPushButton("Save Session");
     m_helpButton = new QPushButton("Help");
+    m_stopButton = new QPushButton("Stop");
+    m_stopButton->setShortcut(Qt::Key_Escape);
+    m_stopButton->setToolTip("Stop the running command (Esc)");
+    m_stopButton->setEnabled(false);
     
     QString buttonStyle = 
         "QPushButton {"
@@ -129,21 +177,46 @@ void InterpreterWidget::setupUI()
     m_loadButton->setStyleSheet(buttonStyle);
     m_saveButton->setStyleSheet(buttonStyle);
     m_helpButton->setStyleSheet(buttonStyle);
+    m_stopButton->setStyleSheet(
+        "QPushButton {"
+        "    background-color: #f44336;"
+        "    color: white;"
+        "    border: none;"
+        "    padding: 6px 12px;"
+        "    border-radius: 3px;"
+        "    font-weight: bold;"
+        "}"
+        "QPushButton:hover {"
+        "    background-color: #da190b;"
+        "}"
+        "QPushButton:disabled {"
+        "    background-color: #555;"
+        "    color: #999;"
+        "}"
+    );
     
     buttonLayout->addWidget(m_clearButton);
     buttonLayout->addWidget(m_loadButton);
     buttonLayout->addWidget(m_saveButton);
     buttonLayout->addWidget(m_helpButton);
     buttonLayout->addStretch();
+    buttonLayout->addWidget(m_stopButton);
     
-    // Status label
+    // Status label and progress of the running command
+    auto *statusLayout = new QHBoxLayout;
     m_statusLabel = new QLabel("Ready");
     m_statusLabel->setStyleSheet("color: #4CAF50; font-weight: bold; padding: 4px;");
+    m_progressBar = new QProgressBar;
+    m_progressBar->setMaximumHeight(14);
+    m_progressBar->setTextVisible(false);
+    m_progressBar->setVisible(false);
+    statusLayout->addWidget(m_statusLabel);
+    statusLayout->addWidget(m_progressBar, 1);
     
     consoleLayout->addWidget(m_outputDisplay);
     consoleLayout->addLayout(inputLayout);
     consoleLayout->addLayout(buttonLayout);
-    consoleLayout->addWidget(m_statusLabel);
+    consoleLayout->addLayout(statusLayout);
     
     // Right panel - History and Variables
     m_sidePanel = new QWidget;
@@ -245,22 +318,39 @@ void InterpreterWidget::setupUI()
     );
 }
 
+void InterpreterWidget::setupOutput()
+{
+    // Print statements run on the worker; their lines join the next output batch
+    m_interpreter->setOutput(std::make_unique<CallbackSink>([this](const std::string &text) {
+        QStringList lines = stdToQt(text).split('\n');
+        lines.removeLast(); // Blocks end with a newline
+        for (const QString &line : lines) {
+            appendOutput(line, "color: #FFFFFF;");
+        }
+    }));
+}
+
 void InterpreterWidget::setupConnections()
 {
     connect(m_executeButton, &QPushButton::clicked, this, &InterpreterWidget::executeCommand);
     connect(m_inputLine, &QLineEdit::returnPressed, this, &InterpreterWidget::onInputReturnPressed);
+    connect(m_inputLine, &QLineEdit::textChanged, this, &InterpreterWidget::highlightInput);
     connect(m_clearButton, &QPushButton::clicked, this, &InterpreterWidget::clearOutput);
     connect(m_loadButton, &QPushButton::clicked, this, &InterpreterWidget::loadFile);
     connect(m_saveButton, &QPushButton::clicked, this, &InterpreterWidget::saveSession);
     connect(m_helpButton, &QPushButton::clicked, this, &InterpreterWidget::showHelp);
     connect(m_clearContextButton, &QPushButton::clicked, this, &InterpreterWidget::clearContext);
     connect(m_historyList, &QListWidget::itemDoubleClicked, this, &InterpreterWidget::onHistoryItemDoubleClicked);
+    connect(m_stopButton, &QPushButton::clicked, this, &InterpreterWidget::stopExecution);
+    connect(m_outputTimer, &QTimer::timeout, this, &InterpreterWidget::flushOutput);
+    connect(m_progressTimer, &QTimer::timeout, this, &InterpreterWidget::updateProgress);
 }
 
 void InterpreterWidget::executeCommand()
 {
     QString command = m_inputLine->text().trimmed();
-    if (command.isEmpty()) {
+    bool continuing = m_lineParser.needsContinuation();
+    if ((command.isEmpty() && !continuing) || m_busy) {
         return;
     }
     
@@ -268,52 +358,138 @@ void InterpreterWidget::executeCommand()
     addToHistory(command);
     
     // Display command
-    appendOutput(QString("> %1").arg(command), "color: #81C784; font-weight: bold;");
-    
-    // Execute command using pure C++ interpreter
-    m_statusLabel->setText("Executing...");
-    m_statusLabel->setStyleSheet("color: #FF9800; font-weight: bold; padding: 4px;");
-    QApplication::processEvents();
-    
-    std::string result = m_interpreter->execute(qtToStd(command));
-    
-    if (!m_interpreter->getLastError().empty()) {
-        showError(stdToQt(m_interpreter->getLastError()));
-        m_statusLabel->setText("Error");
-        m_statusLabel->setStyleSheet("color: #f44336; font-weight: bold; padding: 4px;");
-    } else {
-        if (!result.empty()) {
-            appendOutput(stdToQt(result), "color: #E0E0E0;");
-        }
-        m_statusLabel->setText("Ready");
-        m_statusLabel->setStyleSheet("color: #4CAF50; font-weight: bold; padding: 4px;");
-    }
-    
-    // Update variable list
-    updateVariableList();
+    appendOutput(QString("%1%2").arg(continuing ? "... " : "> ", command), "color: #81C784; font-weight: bold;");
     
     // Clear input
     m_inputLine->clear();
     m_historyIndex = -1;
+    
+    // A line leaving a bracket or a string open waits for the rest of the statement
+    if (!m_lineParser.processLine(qtToStd(command))) {
+        setStatus("Continue the statement", "#FF9800");
+        return;
+    }
+    std::string code = m_lineParser.getCode();
+    m_lineParser.clear();
+    
+    // Execute on the worker; printed lines reach the console while it runs
+    struct Outcome {
+        std::string value;
+        std::string error;
+    };
+    auto outcome = std::make_shared<Outcome>();
+    m_progressTotal = 0;
+    runInBackground([this, code = std::move(code), outcome] {
+        outcome->value = m_interpreter->execute(code);
+        outcome->error = m_interpreter->getLastError();
+    }, [this, outcome] {
+        if (!outcome->error.empty()) {
+            showError(stdToQt(outcome->error));
+            setStatus(outcome->error == "Execution stopped" ? "Stopped" : "Error", "#f44336");
+        } else {
+            if (!outcome->value.empty()) {
+                appendOutput(stdToQt(outcome->value), "color: #E0E0E0;");
+            }
+            setStatus("Ready", "#4CAF50");
+        }
+        
+        // Update variable list
+        updateVariableList();
+    });
+}
+
+void InterpreterWidget::stopExecution()
+{
+    if (m_busy) {
+        // Safe from this thread; the worker fails at its next loop iteration or call
+        m_interpreter->requestStop();
+        setStatus("Stopping...", "#FF9800");
+    }
+}
+
+void InterpreterWidget::runInBackground(std::function<void()> job, std::function<void()> done)
+{
+    setBusy(true);
+    QMetaObject::invokeMethod(m_worker, [this, job, done] {
+        job();
+        // Back on the GUI thread, where the interpreter may be used again
+        QMetaObject::invokeMethod(this, [this, done] {
+            done();
+            // A Stop pressed after the job returned must not stop the next one
+            m_interpreter->getCancelToken().reset();
+            setBusy(false);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void InterpreterWidget::setBusy(bool busy)
+{
+    m_busy = busy;
+    m_executeButton->setEnabled(!busy);
+    m_loadButton->setEnabled(!busy);
+    m_clearContextButton->setEnabled(!busy);
+    m_stopButton->setEnabled(busy);
+    m_progressBar->setVisible(busy);
+    if (busy) {
+        m_progressLine = 0;
+        m_runClock.start();
+        m_progressTimer->start();
+        updateProgress();
+    } else {
+        m_progressTimer->stop();
+        flushOutput();
+    }
+}
+
+void InterpreterWidget::updateProgress()
+{
+    QString elapsed = QString::number(m_runClock.elapsed() / 1000.0, 'f', 1);
+    int total = m_progressTotal;
+    if (total > 0) {
+        int line = std::min(static_cast<int>(m_progressLine), total);
+        m_progressBar->setRange(0, total);
+        m_progressBar->setValue(line);
+        setStatus(QString("Running line %1 of %2 (%3 s)...").arg(line).arg(total).arg(elapsed), "#FF9800");
+    } else {
+        m_progressBar->setRange(0, 0); // Busy indicator
+        setStatus(QString("Executing... (%1 s)").arg(elapsed), "#FF9800");
+    }
+}
+
+void InterpreterWidget::setStatus(const QString &text, const QString &color)
+{
+    m_statusLabel->setText(text);
+    m_statusLabel->setStyleSheet(QString("color: %1; font-weight: bold; padding: 4px;").arg(color));
 }
 
 void InterpreterWidget::clearOutput()
 {
+    {
+        QMutexLocker lock(&m_outputMutex);
+        m_pendingOutput.clear();
+    }
     m_outputDisplay->clear();
     showWelcomeMessage();
 }
 
 void InterpreterWidget::clearContext()
 {
+    if (m_busy) {
+        return;
+    }
     m_interpreter->clearContext();
+    m_lineParser.clear();
     updateVariableList();
     appendOutput("Context cleared. All variables and functions removed.", "color: #FF9800; font-style: italic;");
-    m_statusLabel->setText("Context Cleared");
-    m_statusLabel->setStyleSheet("color: #FF9800; font-weight: bold; padding: 4px;");
+    setStatus("Context Cleared", "#FF9800");
 }
 
 void InterpreterWidget::loadFile()
 {
+    if (m_busy) {
+        return;
+    }
+    
     QString fileName = QFileDialog::getOpenFileName(this, 
         "Load GlossAI Script", 
         QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation),
@@ -323,36 +499,68 @@ void InterpreterWidget::loadFile()
         return;
     }
     
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QMessageBox::warning(this, "Error", QString("Could not open file: %1").arg(fileName));
-        return;
-    }
-    
-    QTextStream in(&file);
-    QStringList lines;
-    while (!in.atEnd()) {
-        lines.append(in.readLine());
-    }
-    
     appendOutput(QString("Loading file: %1").arg(QFileInfo(fileName).fileName()), "color: #2196F3; font-weight: bold;");
     
-    for (const QString &line : lines) {
-        QString trimmed = line.trimmed();
-        if (!trimmed.isEmpty() && !trimmed.startsWith("#") && !trimmed.startsWith("//")) {
-            appendOutput(QString("> %1").arg(trimmed), "color: #81C784; font-weight: bold;");
+    struct Outcome {
+        std::string error; // Set if the file could not be opened or lexed
+        bool stopped = false;
+    };
+    auto outcome = std::make_shared<Outcome>();
+    m_progressTotal = 0;
+    runInBackground([this, path = qtToStd(fileName), outcome] {
+        // The whole file is parsed once; printed lines are held back to follow their statement's echo
+        std::string printed;
+        m_interpreter->setOutput(std::make_unique<CallbackSink>([&printed](const std::string &text) { printed += text; }));
+        bool failedStatement = false;
+        bool success = false;
+        try {
+            MappedFile file(path);
+            std::string_view source = file.view();
+            m_progressTotal = static_cast<int>(std::count(source.begin(), source.end(), '\n')) + 1;
+            success = m_interpreter->executeSource(source, [&](const Interpreter::StatementResult &result) {
+                appendOutput(QString("> %1").arg(stdToQt(std::string(result.source))), "color: #81C784; font-weight: bold;");
+                QStringList lines = stdToQt(printed).split('\n');
+                lines.removeLast();
+                for (const QString &line : lines) {
+                    appendOutput(line, "color: #FFFFFF;");
+                }
+                printed.clear();
+                
+                if (!result.error.empty()) {
+                    showError(QString("Line %1: %2").arg(result.line).arg(stdToQt(result.error)));
+                    failedStatement = true;
+                } else if (!result.value.empty()) {
+                    appendOutput(stdToQt(result.value), "color: #E0E0E0;");
+                }
+                m_progressLine = result.line;
+            });
             
-            std::string result = m_interpreter->execute(qtToStd(trimmed));
-            if (!m_interpreter->getLastError().empty()) {
-                showError(stdToQt(m_interpreter->getLastError()));
-            } else if (!result.empty()) {
-                appendOutput(stdToQt(result), "color: #E0E0E0;");
+            // A stop ends the error of the statement it interrupted, or stands alone between statements
+            const std::string &error = m_interpreter->getLastError();
+            const std::string stopped = "Execution stopped";
+            outcome->stopped = !success && error.size() >= stopped.size() &&
+                               error.compare(error.size() - stopped.size(), stopped.size(), stopped) == 0;
+            if (!success && !failedStatement && !outcome->stopped) {
+                outcome->error = error;
             }
+        } catch (const std::exception &e) {
+            outcome->error = e.what();
         }
-    }
-    
-    updateVariableList();
-    appendOutput("File execution completed.", "color: #2196F3; font-style: italic;");
+        setupOutput();
+    }, [this, outcome] {
+        updateVariableList();
+        if (outcome->stopped) {
+            appendOutput("File execution stopped.", "color: #FF9800; font-style: italic;");
+            setStatus("Stopped", "#f44336");
+        } else if (!outcome->error.empty()) {
+            // The file could not be opened or lexed
+            QMessageBox::warning(this, "Error", stdToQt(outcome->error));
+            setStatus("Error", "#f44336");
+        } else {
+            appendOutput("File execution completed.", "color: #2196F3; font-style: italic;");
+            setStatus("Ready", "#4CAF50");
+        }
+    });
 }
 
 void InterpreterWidget::saveSession()
@@ -372,11 +580,13 @@ void InterpreterWidget::saveSession()
         return;
     }
     
+    flushOutput();
     QTextStream out(&file);
     out << m_outputDisplay->toPlainText();
     
-    m_statusLabel->setText("Session Saved");
-    m_statusLabel->setStyleSheet("color: #4CAF50; font-weight: bold; padding: 4px;");
+    if (!m_busy) {
+        setStatus("Session Saved", "#4CAF50");
+    }
 }
 
 void InterpreterWidget::showHelp()
@@ -419,6 +629,12 @@ void InterpreterWidget::showHelp()
                              "• max(x,y) : Maximum of two values\n"
                              "• ceil(x), floor(x), round(x) : Rounding\n\n"
 
+                             "Arrays:\n"
+                             "• [x, y, ...] : Array literal; a[i] is element i (from 0)\n"
+                             "• len(a), range(n), range(a,b,step) : Length and number ranges\n"
+                             "• sum(a), mean(a), min(a), max(a) : Reductions\n"
+                             "• dot(a,b), norm(a) : Dot product and Euclidean length\n\n"
+
                              "Mathematical Constants:\n"
                              "• pi : π (3.14159...)\n"
                              "• e : Euler's number (2.71828...)\n"
@@ -447,6 +663,55 @@ void InterpreterWidget::onInputReturnPressed()
     executeCommand();
 }
 
+void InterpreterWidget::highlightInput()
+{
+    // Only the line being edited is lexed, from the state the pending lines ended in,
+    // so a keystroke costs the same however long the statement has grown
+    std::string line = qtToStd(m_inputLine->text());
+    LexState state = m_lineParser.getState();
+    m_inputLexer.lexLine(line, state, &m_inputTokens);
+    
+    QTextCharFormat keyword, number, string, comment, invalid;
+    keyword.setForeground(QColor("#569CD6"));
+    number.setForeground(QColor("#B5CEA8"));
+    string.setForeground(QColor("#CE9178"));
+    comment.setForeground(QColor("#6A9955"));
+    invalid.setForeground(QColor("#f44336"));
+    
+    // Token offsets are in UTF-8 bytes; the line edit counts UTF-16 units
+    bool ascii = m_inputLine->text().size() == static_cast<qsizetype>(line.size());
+    auto position = [&](int offset) {
+        return ascii ? offset : static_cast<int>(QString::fromUtf8(line.data(), offset).size());
+    };
+    
+    // Formats are given relative to the cursor, as for an input method's preedit text
+    const int cursor = m_inputLine->cursorPosition();
+    QList<QInputMethodEvent::Attribute> attributes;
+    for (const LineToken &token : m_inputTokens) {
+        const QTextCharFormat *format = nullptr;
+        switch (token.type) {
+        case TokenType::Number: format = &number; break;
+        case TokenType::String: format = &string; break;
+        case TokenType::Comment: format = &comment; break;
+        case TokenType::Invalid: format = &invalid; break;
+        default: format = isKeyword(token.type) ? &keyword : nullptr; break;
+        }
+        if (format) {
+            int start = position(token.start);
+            attributes.append(QInputMethodEvent::Attribute(QInputMethodEvent::TextFormat, start - cursor,
+                                                           position(token.start + token.length) - start, *format));
+        }
+    }
+    QInputMethodEvent event(QString(), attributes);
+    QCoreApplication::sendEvent(m_inputLine, &event);
+    
+    // A closing bracket nothing opened is reported while typing, before the line is run
+    if (state.unbalanced != m_inputUnbalanced && !m_busy) {
+        m_inputUnbalanced = state.unbalanced;
+        setStatus(m_inputUnbalanced ? "Unmatched closing bracket" : "Ready", m_inputUnbalanced ? "#f44336" : "#4CAF50");
+    }
+}
+
 void InterpreterWidget::onHistoryItemDoubleClicked(QListWidgetItem *item)
 {
     if (item) {
@@ -484,17 +749,39 @@ void InterpreterWidget::addToHistory(const QString &command)
 
 void InterpreterWidget::appendOutput(const QString &text, const QString &style)
 {
-    QString styledText = text;
-    if (!style.isEmpty()) {
-        styledText = QString("<span style=\"%1\">%2</span>").arg(style, text.toHtmlEscaped());
-        m_outputDisplay->insertHtml(styledText + "<br>");
-    } else {
-        m_outputDisplay->insertPlainText(text + "\n");
+    // Called from the worker as well; lines are collected and inserted in batches
+    QString line = style.isEmpty() ? text.toHtmlEscaped()
+                                   : QString("<span style=\"%1\">%2</span>").arg(style, text.toHtmlEscaped());
+    bool scheduled;
+    {
+        QMutexLocker lock(&m_outputMutex);
+        scheduled = !m_pendingOutput.isEmpty();
+        m_pendingOutput += line;
+        m_pendingOutput += "<br>";
+    }
+    if (!scheduled) {
+        // The first line of a batch starts its timer on the GUI thread
+        QMetaObject::invokeMethod(m_outputTimer, [this] { m_outputTimer->start(); }, Qt::QueuedConnection);
+    }
+}
+
+void InterpreterWidget::flushOutput()
+{
+    QString html;
+    {
+        QMutexLocker lock(&m_outputMutex);
+        html.swap(m_pendingOutput);
+    }
+    if (html.isEmpty()) {
+        return;
     }
     
-    // Scroll to bottom
-    QTextCursor cursor = m_outputDisplay->textCursor();
+    // One insertion per batch, so a long run re-lays out the document a few times a second
+    QTextCursor cursor(m_outputDisplay->document());
     cursor.movePosition(QTextCursor::End);
+    cursor.insertHtml(html);
+    
+    // Scroll to bottom
     m_outputDisplay->setTextCursor(cursor);
     m_outputDisplay->ensureCursorVisible();
 }
@@ -9,6 +9,11 @@
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QLabel>
+#include <QElapsedTimer>
+#include <QMutex>
+#include "../core/lineparser.h"
+#include <atomic>
+#include <functional>
 #include <memory>
 
 // Forward declaration of the pure C++ interpreter
@@ -21,6 +26,9 @@ class QListWidget;
 class QSplitter;
 class QPushButton;
 class QLabel;
+class QProgressBar;
+class QThread;
+class QTimer;
 QT_END_NAMESPACE
 
 /**
@@ -28,6 +36,10 @@ QT_END_NAMESPACE
  * 
  * Qt-based UI that interfaces with the pure C++ interpreter core.
  * Provides a console-like interface for mathematical expression evaluation.
+ *
+ * Commands and files run on a worker thread, so the window stays responsive
+ * and a runaway loop can be stopped. Output from either thread is queued and
+ * inserted into the console in timed batches.
  */
 class InterpreterWidget : public QWidget
 {
@@ -58,6 +70,11 @@ public slots:
      */
     void loadFile();
     
+    /**
+     * @brief Stop the running command or file
+     */
+    void stopExecution();
+    
     /**
      * @brief Save current session to a file
      */
@@ -72,12 +89,19 @@ private slots:
     void onInputReturnPressed();
     void onHistoryItemDoubleClicked(QListWidgetItem *item);
     void updateVariableList();
+    void flushOutput();
+    void updateProgress();
+    void highlightInput();
 
 private:
     void setupUI();
     void setupConnections();
+    void setupOutput();
     void addToHistory(const QString &command);
     void appendOutput(const QString &text, const QString &style = QString());
+    void runInBackground(std::function<void()> job, std::function<void()> done);
+    void setBusy(bool busy);
+    void setStatus(const QString &text, const QString &color);
     void showError(const QString &error);
     void loadHistory();
     void saveHistory();
@@ -96,7 +120,9 @@ private:
     QPushButton *m_loadButton;
     QPushButton *m_saveButton;
     QPushButton *m_helpButton;
+    QPushButton *m_stopButton;
     QLabel *m_statusLabel;
+    QProgressBar *m_progressBar;
     
     // Right panel - History and variables
     QWidget *m_sidePanel;
@@ -107,6 +133,27 @@ private:
     // Pure C++ interpreter engine (no Qt dependencies)
     std::unique_ptr<Interpreter> m_interpreter;
     
+    // Background execution; only the worker thread touches m_interpreter while busy
+    QThread *m_workerThread;
+    QObject *m_worker;
+    bool m_busy;
+    QElapsedTimer m_runClock;
+    QTimer *m_progressTimer;
+    std::atomic<int> m_progressLine;  // Line of the statement that ran last
+    std::atomic<int> m_progressTotal; // Lines of the running file, 0 for commands
+    
+    // Output waiting for the next batch, appended to from either thread
+    QMutex m_outputMutex;
+    QString m_pendingOutput;
+    QTimer *m_outputTimer;
+    static const int OUTPUT_BATCH_MS = 50;
+    
+    // Lines of a statement still being entered, and the lexer for the line being edited
+    LineParser m_lineParser;
+    Lexer m_inputLexer;
+    std::vector<LineToken> m_inputTokens;
+    bool m_inputUnbalanced; // Status shows an unmatched closing bracket in the input
+    
     // State
     QStringList m_commandHistory;
     int m_historyIndex;